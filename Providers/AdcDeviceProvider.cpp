@@ -9,6 +9,8 @@ using namespace Microsoft::IoT::Lightning::Providers;
 #pragma region LightningAdcProvider
 
 IAdcProvider^ LightningAdcProvider::providerSingleton = nullptr;
+std::vector<ULONG> LightningAdcProvider::chipSelectPins;
+bool LightningAdcProvider::mcp3208Chips = false;
 
 IAdcProvider ^ LightningAdcProvider::GetAdcProvider()
 {
@@ -20,6 +22,35 @@ IAdcProvider ^ LightningAdcProvider::GetAdcProvider()
     return providerSingleton;
 }
 
+void LightningAdcProvider::SetChipSelectPins(const Platform::Array<int>^ chipSelectPins, bool mcp3208)
+{
+    BoardPinsClass::BOARD_TYPE boardType;
+    std::vector<ULONG> mappedPins;
+
+    HRESULT hr = g_pins.getBoardType(boardType);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"An error occurred determining board type.");
+    }
+
+    if (chipSelectPins != nullptr)
+    {
+        if (chipSelectPins->Length > MCP3008_MAX_CHIPS)
+        {
+            LightningProvider::ThrowError(DMAP_E_ADC_TOO_MANY_CHIPS, L"Too many chip select pins.");
+        }
+
+        // The pins are given as GPIO numbers, the same as for the GPIO controller.
+        for (unsigned int i = 0; i < chipSelectPins->Length; i++)
+        {
+            mappedPins.push_back((ULONG)LightningProvider::MapGpioPin(boardType, chipSelectPins[i]));
+        }
+    }
+
+    LightningAdcProvider::chipSelectPins = mappedPins;
+    mcp3208Chips = mcp3208;
+}
+
 #pragma endregion
 
 #pragma region LightningMCP3008AdcControllerProvider
@@ -56,6 +87,57 @@ int LightningMCP3008AdcControllerProvider::ReadValue(int channelNumber)
     ULONG bits = 0;
     _addOnAdc->readValue(channelNumber, value, bits);
 
+    return ScaleValue(value, bits);
+}
+
+void LightningMCP3008AdcControllerProvider::ReadValues(const Platform::Array<int>^ channelNumbers, Platform::WriteOnlyArray<int>^ values)
+{
+    if (channelNumbers == nullptr || values == nullptr)
+    {
+        throw ref new Platform::InvalidArgumentException(L"channel or value array cannot be null.");
+    }
+
+    if (channelNumbers->Length != values->Length)
+    {
+        throw ref new Platform::InvalidArgumentException(L"channel and value arrays must be the same length.");
+    }
+
+    // Build the list of channels to convert.
+    std::vector<ULONG> channels(channelNumbers->Length);
+    for (unsigned int i = 0; i < channelNumbers->Length; i++)
+    {
+        int channelNumber = channelNumbers[i];
+
+        if (channelNumber < 0 || channelNumber >= _channelCount)
+        {
+            throw ref new Platform::InvalidArgumentException(L"Invalid channel number.");
+        }
+
+        if (!_channelsAcquired[channelNumber])
+        {
+            throw ref new Platform::AccessDeniedException(L"Channel not acquired");
+        }
+
+        channels[i] = (ULONG)channelNumber;
+    }
+
+    std::vector<ULONG> readings(channels.size(), 0);
+    ULONG bits = 0;
+    HRESULT hr = _addOnAdc->readChannels(channels.data(), (ULONG)channels.size(), readings.data(), bits);
+
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"An error occurred reading the ADC.");
+    }
+
+    for (unsigned int i = 0; i < channelNumbers->Length; i++)
+    {
+        values[i] = ScaleValue(readings[i], bits);
+    }
+}
+
+int LightningMCP3008AdcControllerProvider::ScaleValue(ULONG value, ULONG bits)
+{
     // Scale the digitized analog value to the currently set analog read resolution.
     if (_resolutionInBits > (int)bits)
     {
@@ -70,7 +152,9 @@ int LightningMCP3008AdcControllerProvider::ReadValue(int channelNumber)
 }
 
 LightningMCP3008AdcControllerProvider::LightningMCP3008AdcControllerProvider() :
-    _resolutionInBits(MCP3008_ADC_BIT_RESOLUTION)
+    _channelCount(0),
+    _maxValue(0),
+    _resolutionInBits(0)
 {
     Initialize();
 }
@@ -98,13 +182,27 @@ void LightningMCP3008AdcControllerProvider::Initialize()
 
     _addOnAdc.reset(new MCP3008Device());
 
-    hr = _addOnAdc->begin();
+    if (LightningAdcProvider::chipSelectPins.empty())
+    {
+        hr = _addOnAdc->begin();
+    }
+    else
+    {
+        hr = _addOnAdc->begin(LightningAdcProvider::chipSelectPins.data(),
+                              (ULONG)LightningAdcProvider::chipSelectPins.size(),
+                              LightningAdcProvider::mcp3208Chips ? MCP3008Device::MCP3208 : MCP3008Device::MCP3008);
+    }
     if (FAILED(hr))
     {
         LightningProvider::ThrowError(hr, L"An error occurred Initializing ADC.");
     }
 
-    _channelsAcquired.resize(MCP3008_ADC_CHANNEL_COUNT, false);
+    // The channels of all the chips are presented as one set of channels.
+    _channelCount = (int)_addOnAdc->getChannelCount();
+    _resolutionInBits = (int)_addOnAdc->getBits();
+    _maxValue = (1 << _resolutionInBits) - 1;
+
+    _channelsAcquired.resize(_channelCount, false);
 }
 
 IVectorView<IAdcControllerProvider^>^ LightningAdcProvider::GetControllers(
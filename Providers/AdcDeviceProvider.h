@@ -3,10 +3,7 @@
 
 #include <MCP3008support.h>
 
-#define MCP3008_ADC_CHANNEL_COUNT 8
 #define MCP3008_ADC_MIN 0
-#define MCP3008_ADC_MAX 1023
-#define MCP3008_ADC_BIT_RESOLUTION 10
 
 using namespace Windows::Devices::Adc::Provider;
 
@@ -21,6 +18,16 @@ namespace Microsoft {
                     virtual IVectorView<IAdcControllerProvider^>^ GetControllers();
                     static IAdcProvider^ GetAdcProvider();
 
+                    // Use several MCP3008 or MCP3208 chips, each on its own chip select pin, for the
+                    // controllers created after this call.  The channels of the chips are numbered
+                    // as one set, 8 channels per chip in the order of the pins.  An empty array
+                    // goes back to one MCP3008 on the standard chip select pin of the board.
+                    static void SetChipSelectPins(const Platform::Array<int>^ chipSelectPins, bool mcp3208);
+
+                internal:
+                    static std::vector<ULONG> chipSelectPins;
+                    static bool mcp3208Chips;
+
                 private:
                     LightningAdcProvider() { }
                     static IAdcProvider^ providerSingleton;
@@ -32,12 +39,12 @@ namespace Microsoft {
                     // Inherited via IAdcControllerProvider
                     virtual property int ChannelCount
                     {
-                        int get() { return MCP3008_ADC_CHANNEL_COUNT; }
+                        int get() { return _channelCount; }
                     }
 
                     virtual property int MaxValue
                     {
-                        int get() { return MCP3008_ADC_MAX; }
+                        int get() { return _maxValue; }
                     }
                     virtual property int MinValue
                     {
@@ -73,6 +80,10 @@ namespace Microsoft {
 
                     virtual int ReadValue(int channelNumber);
 
+                    // Read several channels, converted back to back with one use of the SPI bus,
+                    // going round the chips in turn.
+                    void ReadValues(const Platform::Array<int>^ channelNumbers, Platform::WriteOnlyArray<int>^ values);
+
                     virtual ~LightningMCP3008AdcControllerProvider();
 
                 internal:
@@ -81,10 +92,13 @@ namespace Microsoft {
                 private:
                     std::shared_ptr<MCP3008Device> _addOnAdc;
                     std::vector<bool> _channelsAcquired;
+                    int _channelCount;
+                    int _maxValue;
                     int _resolutionInBits;
                     ProviderAdcChannelMode _channelMode;
 
                     void Initialize();
+                    int ScaleValue(ULONG value, ULONG bits);
 
                 };
             }
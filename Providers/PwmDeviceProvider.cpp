@@ -6,7 +6,6 @@
 #include "boardpins.h"
 
 using namespace Microsoft::IoT::Lightning::Providers;
-using namespace Windows::System::Threading;
 
 #pragma region LightningPwmProvider
 
@@ -29,6 +28,15 @@ IVectorView<IPwmControllerProvider^>^ LightningPwmProvider::GetControllers(
     auto controllerCollection = ref new Vector<IPwmControllerProvider^>();
     controllerCollection->Append(ref new LightningPCA9685PwmControllerProvider());
     controllerCollection->Append(ref new LightningSoftwarePwmControllerProvider());
+
+    // The PWM controller in the SOC is only available on the Raspberry Pi 2.
+    BoardPinsClass::BOARD_TYPE boardType;
+    HRESULT hr = g_pins.getBoardType(boardType);
+    if (SUCCEEDED(hr) && (boardType == BoardPinsClass::BOARD_TYPE::PI2_BARE))
+    {
+        controllerCollection->Append(ref new LightningBcmPwmControllerProvider());
+    }
+
     return controllerCollection->GetView();
 }
 
@@ -37,12 +45,16 @@ IVectorView<IPwmControllerProvider^>^ LightningPwmProvider::GetControllers(
 #pragma region LightningSoftwarePwmControllerProvider
 
 LightningSoftwarePwmControllerProvider::LightningSoftwarePwmControllerProvider() :
-    _started(false),
-    _actualFrequency(MinFrequency)
+    _started(false)
 {
     Initialize();
 }
 
+LightningSoftwarePwmControllerProvider::~LightningSoftwarePwmControllerProvider()
+{
+    _softwarePwm->end();
+}
+
 void LightningSoftwarePwmControllerProvider::Initialize()
 {
     HRESULT hr = g_pins.getBoardType(_boardType);
@@ -70,25 +82,48 @@ void LightningSoftwarePwmControllerProvider::Initialize()
     _gpioController = ref new LightningGpioControllerProvider();
 
     _pins = ref new Vector<LightningSoftwarePwmPin^>(_gpioController->PinCount);
+
+    _softwarePwm.reset(new SoftwarePwmClass());
+
+    hr = _softwarePwm->setFrequency(DEFAULT_FREQUENCY);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Pwm Controller Provider Init Failed.");
+    }
 }
 
 double LightningSoftwarePwmControllerProvider::SetDesiredFrequency(double frequency)
 {
-    _actualFrequency = frequency;
-    return _actualFrequency;
+    HRESULT hr = _softwarePwm->setFrequency((ULONG)(frequency + 0.5));
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Could not set desired frequency.");
+    }
+
+    return _softwarePwm->getActualFrequency();
+}
+
+void LightningSoftwarePwmControllerProvider::ThreadPriority::set(int value)
+{
+    HRESULT hr = _softwarePwm->setThreadPriority(value);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Could not set the PWM thread priority.");
+    }
 }
 
 void LightningSoftwarePwmControllerProvider::AcquirePin(int pin)
 {
+    HRESULT hr;
+
     if (!_started)
     {
-        _started = true;
-
-        WorkItemHandler^ loop = ref new WorkItemHandler([&](IAsyncAction^ asyncAction)
+        hr = _softwarePwm->begin(_softwarePwm->getThreadPriority());
+        if (FAILED(hr))
         {
-            Loop();
-        });
-        ThreadPool::RunAsync(loop, WorkItemPriority::High);
+            LightningProvider::ThrowError(hr, L"Could not start the PWM thread.");
+        }
+        _started = true;
     }
 
     if (_pins->GetAt(pin) != nullptr)
@@ -101,15 +136,25 @@ void LightningSoftwarePwmControllerProvider::AcquirePin(int pin)
 
     auto gpioPin = _gpioController->OpenPinProviderNoMapping(pin, mappedPin, ProviderGpioSharingMode::Exclusive);
     gpioPin->SetDriveMode(ProviderGpioPinDriveMode::Output);
-    _pins->SetAt(pin, ref new LightningSoftwarePwmPin(gpioPin));
+
+    hr = _softwarePwm->addPin(mappedPin);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Could not use the pin for PWM.");
+    }
+
+    _pins->SetAt(pin, ref new LightningSoftwarePwmPin(gpioPin, mappedPin));
 }
 
 void LightningSoftwarePwmControllerProvider::ReleasePin(int pin)
 {
-    if (_pins->GetAt(pin) == nullptr)
+    auto pwmPin = _pins->GetAt(pin);
+    if (pwmPin == nullptr)
     {
         throw ref new Platform::AccessDeniedException();
     }
+
+    _softwarePwm->removePin(pwmPin->MappedPin);
     _pins->SetAt(pin, nullptr);
 }
 
@@ -121,7 +166,11 @@ void LightningSoftwarePwmControllerProvider::EnablePin(int pin)
         throw ref new Platform::AccessDeniedException(L"Pin was not acquired");
     }
 
-    pwmPin->Enabled = true;
+    HRESULT hr = _softwarePwm->enablePin(pwmPin->MappedPin);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Could not enable the PWM pin.");
+    }
 }
 
 void LightningSoftwarePwmControllerProvider::DisablePin(int pin)
@@ -132,7 +181,11 @@ void LightningSoftwarePwmControllerProvider::DisablePin(int pin)
         throw ref new Platform::AccessDeniedException(L"Pin was not acquired");
     }
 
-    pwmPin->Enabled = false;
+    HRESULT hr = _softwarePwm->disablePin(pwmPin->MappedPin);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Could not disable the PWM pin.");
+    }
 }
 
 void LightningSoftwarePwmControllerProvider::SetPulseParameters(int pin, double dutyCycle, bool invertPolarity)
@@ -143,70 +196,10 @@ void LightningSoftwarePwmControllerProvider::SetPulseParameters(int pin, double
         throw ref new Platform::AccessDeniedException(L"Pin was not acquired");
     }
 
-    pwmPin->DutyCycle = dutyCycle;
-    pwmPin->InvertPolarity = invertPolarity;
-}
-
-void LightningSoftwarePwmControllerProvider::Loop()
-{
-    LARGE_INTEGER ticks;
-    QueryPerformanceFrequency(&ticks);
-    auto TicksASecond = ticks.QuadPart;
-    Vector<LightningSoftwarePwmPin^>^ enabledPins = ref new Vector<LightningSoftwarePwmPin^>(0);
-    while (true)
+    HRESULT hr = _softwarePwm->setDutyCycle(pwmPin->MappedPin, (ULONG)(dutyCycle * 0xFFFFFFFF), invertPolarity);
+    if (FAILED(hr))
     {
-        enabledPins->Clear();
-        for (UINT i = 0; i < _pins->Size; i++)
-        {
-            auto pin = _pins->GetAt(i);
-            if (pin != nullptr && pin->Enabled && pin->DutyCycle != 0)
-            {
-                bool inserted = false;
-                for (UINT j = 0; j < enabledPins->Size; j++)
-                {
-                    auto pinCompare = enabledPins->GetAt(j);
-                    if (pinCompare->DutyCycle > pin->DutyCycle)
-                    {
-                        enabledPins->InsertAt(j, pin);
-                        inserted = true;
-                        break;
-                    }
-                }
-
-                if (!inserted)
-                {
-                    enabledPins->Append(pin);
-                }
-            }
-        }
-
-        for (UINT i = 0; i < enabledPins->Size; i++)
-        {
-            LightningSoftwarePwmPin^ pin = enabledPins->GetAt(i);
-            auto pinValue = (pin->InvertPolarity) ? ProviderGpioPinValue::Low : ProviderGpioPinValue::High;
-            pin->GpioPin->Write(pinValue);
-        }
-        LARGE_INTEGER startTicks;
-        QueryPerformanceCounter(&startTicks);
-        for (UINT i = 0; i < enabledPins->Size; i++)
-        {
-            auto pin = enabledPins->GetAt(i);
-            double targetTicks = startTicks.QuadPart + pin->DutyCycle*Period*TicksASecond / 1000.0;
-            LARGE_INTEGER currentTicks;
-            QueryPerformanceCounter(&currentTicks);
-            while (currentTicks.QuadPart < targetTicks) {
-                QueryPerformanceCounter(&currentTicks);
-            }
-            auto pinValue = (pin->InvertPolarity) ? ProviderGpioPinValue::High : ProviderGpioPinValue::Low;
-            pin->GpioPin->Write(pinValue);
-        }
-        double endCycleTicks = startTicks.QuadPart + Period*TicksASecond / 1000.0;
-        LARGE_INTEGER currentTicks;
-        QueryPerformanceCounter(&currentTicks);
-        while (currentTicks.QuadPart < endCycleTicks) {
-            QueryPerformanceCounter(&currentTicks);
-        }
-
+        LightningProvider::ThrowError(hr, L"Could not set PWM pulse parameters.");
     }
 }
 
@@ -216,18 +209,18 @@ void LightningSoftwarePwmControllerProvider::Loop()
 
 double LightningPCA9685PwmControllerProvider::ActualFrequency::get()
 {
-    return (double)g_pins.getActualPwmFrequency(0);
+    return (double)g_pins.getActualPwmFrequency(GetIoPin(0));
 }
 
 double LightningPCA9685PwmControllerProvider::SetDesiredFrequency(double frequency)
 {
     _desiredFrequency = frequency;
-    HRESULT hr = g_pins.setPwmFrequency(0, (ULONG)frequency);
+    HRESULT hr = g_pins.setAllPwmFrequency((ULONG)frequency);
     if (FAILED(hr)) {
         LightningProvider::ThrowError(hr, L"Could not set desired frequency.");
     }
 
-    return (double)g_pins.getActualPwmFrequency(0);
+    return (double)g_pins.getActualPwmFrequency(GetIoPin(0));
 }
 
 void LightningPCA9685PwmControllerProvider::AcquirePin(int pin)
@@ -259,12 +252,7 @@ void LightningPCA9685PwmControllerProvider::EnablePin(int pin)
 
     // Set the PWM duty cycle.
     ULONGLONG scaledDutyCycle = scaleDutyCycle(pwmPin->DutyCycle, pwmPin->InvertPolarity);
-    HRESULT hr = g_pins.setPwmDutyCycle(GetIoPin(pin), (ULONG)scaledDutyCycle);
-
-    if (FAILED(hr))
-    {
-        LightningProvider::ThrowError(hr, L"Could not enable PWM pin.");
-    }
+    WriteDutyCycle(pin, (ULONG)scaledDutyCycle, L"Could not enable PWM pin.");
 }
 
 void LightningPCA9685PwmControllerProvider::DisablePin(int pin)
@@ -273,31 +261,76 @@ void LightningPCA9685PwmControllerProvider::DisablePin(int pin)
     {
         throw ref new Platform::AccessDeniedException(L"Pin was not acquired");
     }
-    HRESULT hr = g_pins.setPwmDutyCycle(GetIoPin(pin), 0);
-    if (FAILED(hr))
-    {
-        LightningProvider::ThrowError(hr, L"Could not disable PWM pin.");
-    }
+    WriteDutyCycle(pin, 0, L"Could not disable PWM pin.");
 }
 
 void LightningPCA9685PwmControllerProvider::SetPulseParameters(int pin, double dutyCycle, bool invertPolarity)
 {
     // Set the PWM duty cycle.
     ULONGLONG scaledDutyCycle = scaleDutyCycle(dutyCycle, invertPolarity);
-    HRESULT hr = g_pins.setPwmDutyCycle(GetIoPin(pin), (ULONG)scaledDutyCycle);
-
-    if (FAILED(hr))
-    {
-        LightningProvider::ThrowError(hr, L"Could not set PWM pulse parameters.");
-    }
+    WriteDutyCycle(pin, (ULONG)scaledDutyCycle, L"Could not set PWM pulse parameters.");
 
     auto pwmPin = _pins->GetAt(pin);
     pwmPin->DutyCycle = dutyCycle;
     pwmPin->InvertPolarity = invertPolarity;
 }
 
+void LightningPCA9685PwmControllerProvider::DeferUpdates::set(bool value)
+{
+    // Send any changes being held when deferring is turned off.
+    if (_deferUpdates && !value)
+    {
+        CommitUpdates();
+    }
+    _deferUpdates = value;
+}
+
+void LightningPCA9685PwmControllerProvider::CommitUpdates()
+{
+    std::vector<ULONG> pins;
+    std::vector<ULONG> dutyCycles;
+
+    for (UINT i = 0; i < _pinCount; i++)
+    {
+        if (_pendingPins[i])
+        {
+            pins.push_back(GetIoPin(i));
+            dutyCycles.push_back(_pendingDutyCycles[i]);
+            _pendingPins[i] = false;
+        }
+    }
+
+    if (pins.size() > 0)
+    {
+        HRESULT hr = g_pins.setPwmDutyCycles(pins.data(), dutyCycles.data(), (ULONG)pins.size());
+        if (FAILED(hr))
+        {
+            LightningProvider::ThrowError(hr, L"Could not commit PWM pulse parameters.");
+        }
+    }
+}
+
+void LightningPCA9685PwmControllerProvider::WriteDutyCycle(int pin, ULONG dutyCycle, LPCWSTR errorMessage)
+{
+    if (_deferUpdates)
+    {
+        _pendingDutyCycles[pin] = dutyCycle;
+        _pendingPins[pin] = true;
+    }
+    else
+    {
+        HRESULT hr = g_pins.setPwmDutyCycle(GetIoPin(pin), dutyCycle);
+        if (FAILED(hr))
+        {
+            LightningProvider::ThrowError(hr, errorMessage);
+        }
+    }
+}
+
 LightningPCA9685PwmControllerProvider::LightningPCA9685PwmControllerProvider() :
-    _desiredFrequency(MinFrequency)
+    _desiredFrequency(MinFrequency),
+    _pinCount(0),
+    _deferUpdates(false)
 {
     Initialize();
 }
@@ -318,9 +351,189 @@ void LightningPCA9685PwmControllerProvider::Initialize()
         throw ref new Platform::NotImplementedException(L"This board type has not been implemented.");
     }
 
-    _pins = ref new Vector<LightningPCA9685PwmPin^>(PCA9685_PIN_COUNT);
+    // The channels of all the external PWM chips are presented as one set of pins.
+    ULONG channelCount = 0;
+    hr = g_pins.getPwmChannelCount(channelCount);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Pwm Controller Provider Init Failed.");
+    }
+
+    _pinCount = channelCount;
+    _pins = ref new Vector<LightningPCA9685PwmPin^>(_pinCount);
+    _pendingPins.assign(_pinCount, false);
+    _pendingDutyCycles.assign(_pinCount, 0);
+
+    g_pins.setAllPwmFrequency((ULONG)_desiredFrequency);
+}
+
+#pragma endregion
+
+#pragma region LightningBcmPwmControllerProvider
+
+LightningBcmPwmControllerProvider::LightningBcmPwmControllerProvider()
+{
+    Initialize();
+}
+
+LightningBcmPwmControllerProvider::~LightningBcmPwmControllerProvider()
+{
+    // Stop the channels driven through this controller, and unlock the pins they drive.
+    for (ULONG i = 0; i < BCM_PWM_CHANNELS; i++)
+    {
+        if (_channelPins[i] != -1)
+        {
+            g_bcmPwm.disableChannel(i);
+
+            auto pwmPin = _pins->GetAt(_channelPins[i]);
+            if (pwmPin != nullptr)
+            {
+                g_pins.verifyPinFunction(pwmPin->MappedPin, FUNC_DIO, BoardPinsClass::UNLOCK_FUNCTION);
+            }
+            _channelPins[i] = -1;
+        }
+    }
+}
+
+void LightningBcmPwmControllerProvider::Initialize()
+{
+    HRESULT hr = g_pins.getBoardType(_boardType);
+
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"An error occurred determining board type.");
+    }
+
+    if (_boardType != BoardPinsClass::BOARD_TYPE::PI2_BARE)
+    {
+        throw ref new Platform::NotImplementedException(L"This board type has not been implemented.");
+    }
+
+    ULONG pinCount = 0;
+    hr = g_pins.getGpioPinCount(pinCount);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Pwm Controller Provider Init Failed.");
+    }
+
+    _pinCount = (USHORT)pinCount;
+
+    _pins = ref new Vector<LightningBcmPwmPin^>(_pinCount);
+
+    for (ULONG i = 0; i < BCM_PWM_CHANNELS; i++)
+    {
+        _channelPins[i] = -1;
+    }
+}
 
-    g_pins.setPwmFrequency(0, (ULONG)_desiredFrequency);
+double LightningBcmPwmControllerProvider::SetDesiredFrequency(double frequency)
+{
+    HRESULT hr = g_bcmPwm.setFrequency((ULONG)(frequency + 0.5));
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Could not set desired frequency.");
+    }
+
+    return (double)g_bcmPwm.getActualFrequency();
+}
+
+void LightningBcmPwmControllerProvider::AcquirePin(int pin)
+{
+    if (_pins->GetAt(pin) != nullptr)
+    {
+        throw ref new Platform::AccessDeniedException(L"Pin already acquired");
+    }
+
+    int mappedPin = LightningProvider::MapGpioPin(_boardType, pin);
+
+    ULONG channel = 0;
+    HRESULT hr = g_pins.getSocPwmChannel(mappedPin, channel);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Invalid function for pin.");
+    }
+
+    // Each channel can only drive one pin at a time.
+    if (_channelPins[channel] != -1)
+    {
+        throw ref new Platform::AccessDeniedException(L"The PWM channel for this pin is in use on another pin");
+    }
+
+    // Connect the PWM channel to the pin.
+    hr = g_pins.verifyPinFunction(mappedPin, FUNC_PWM, BoardPinsClass::LOCK_FUNCTION);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Invalid function for pin.");
+    }
+
+    _channelPins[channel] = pin;
+    _pins->SetAt(pin, ref new LightningBcmPwmPin(mappedPin, channel));
+}
+
+void LightningBcmPwmControllerProvider::ReleasePin(int pin)
+{
+    auto pwmPin = _pins->GetAt(pin);
+    if (pwmPin == nullptr)
+    {
+        throw ref new Platform::AccessDeniedException(L"Pin was not acquired");
+    }
+
+    g_bcmPwm.disableChannel(pwmPin->Channel);
+    g_pins.verifyPinFunction(pwmPin->MappedPin, FUNC_DIO, BoardPinsClass::UNLOCK_FUNCTION);
+
+    _channelPins[pwmPin->Channel] = -1;
+    _pins->SetAt(pin, nullptr);
+}
+
+void LightningBcmPwmControllerProvider::EnablePin(int pin)
+{
+    auto pwmPin = _pins->GetAt(pin);
+    if (pwmPin == nullptr)
+    {
+        throw ref new Platform::AccessDeniedException(L"Pin was not acquired");
+    }
+
+    WriteDutyCycle(pwmPin, L"Could not enable PWM pin.");
+}
+
+void LightningBcmPwmControllerProvider::DisablePin(int pin)
+{
+    auto pwmPin = _pins->GetAt(pin);
+    if (pwmPin == nullptr)
+    {
+        throw ref new Platform::AccessDeniedException(L"Pin was not acquired");
+    }
+
+    HRESULT hr = g_bcmPwm.disableChannel(pwmPin->Channel);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"Could not disable PWM pin.");
+    }
+}
+
+void LightningBcmPwmControllerProvider::SetPulseParameters(int pin, double dutyCycle, bool invertPolarity)
+{
+    auto pwmPin = _pins->GetAt(pin);
+    if (pwmPin == nullptr)
+    {
+        throw ref new Platform::AccessDeniedException(L"Pin was not acquired");
+    }
+
+    pwmPin->DutyCycle = dutyCycle;
+    pwmPin->InvertPolarity = invertPolarity;
+
+    WriteDutyCycle(pwmPin, L"Could not set PWM pulse parameters.");
+}
+
+void LightningBcmPwmControllerProvider::WriteDutyCycle(LightningBcmPwmPin^ pwmPin, LPCWSTR errorMessage)
+{
+    double dutyCycle = pwmPin->InvertPolarity ? 1 - pwmPin->DutyCycle : pwmPin->DutyCycle;
+
+    HRESULT hr = g_pins.setPwmDutyCycle(pwmPin->MappedPin, (ULONG)(dutyCycle * 0xFFFFFFFF));
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, errorMessage);
+    }
 }
 
 #pragma endregion
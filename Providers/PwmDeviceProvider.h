@@ -28,48 +28,32 @@ namespace Microsoft {
                         IGpioPinProvider^ get() { return _gpioPin; }
                     }
 
-                    property bool Enabled
+                    property ULONG MappedPin
                     {
-                        bool get() { return _enabled; }
-                        void set(bool value) { _enabled = value; }
+                        ULONG get() { return _mappedPin; }
                     }
 
-                    property bool InvertPolarity
-                    {
-                        bool get() { return _invertPolarity; }
-                        void set(bool value) { _invertPolarity = value; }
-                    }
-
-                    property double DutyCycle
-                    {
-                        double get() { return _dutyCycle; }
-                        void set(double value) { _dutyCycle = value; }
-                    }
-
-                    LightningSoftwarePwmPin(IGpioPinProvider^ pin) :
+                    LightningSoftwarePwmPin(IGpioPinProvider^ pin, ULONG mappedPin) :
                         _gpioPin(pin),
-                        _dutyCycle(0),
-                        _enabled(false),
-                        _invertPolarity(false)
+                        _mappedPin(mappedPin)
                     {
                     }
 
                 private:
 
                     IGpioPinProvider^ _gpioPin;
-                    bool _enabled;
-                    bool _invertPolarity;
-                    double _dutyCycle;
+                    ULONG _mappedPin;
                 };
 
                 public ref class LightningSoftwarePwmControllerProvider sealed : public IPwmControllerProvider
                 {
                 private:
-                    static const int MAX_FREQUENCY = 1000;
-                    static const int MIN_FREQUENCY = 40;
+                    static const int MAX_FREQUENCY = SOFT_PWM_MAX_FREQUENCY_HZ;
+                    static const int MIN_FREQUENCY = SOFT_PWM_MIN_FREQUENCY_HZ;
+                    static const int DEFAULT_FREQUENCY = 40;
                 public:
                     // Inherited via IPwmControllerProvider
-                    virtual property double ActualFrequency { double get() { { return _actualFrequency; } }}
+                    virtual property double ActualFrequency { double get() { { return _softwarePwm->getActualFrequency(); } }}
                     virtual property double MaxFrequency { double get() { { return MAX_FREQUENCY; } }}
                     virtual property double MinFrequency { double get() { { return MIN_FREQUENCY; } }}
                     virtual property int PinCount { int get() { return _pinCount; } }
@@ -81,24 +65,28 @@ namespace Microsoft {
                     virtual void DisablePin(int pin);
                     virtual void SetPulseParameters(int pin, double dutyCycle, bool invertPolarity);
 
+                    // The Win32 priority of the thread that generates the PWM signals,
+                    // THREAD_PRIORITY_TIME_CRITICAL by default.
+                    property int ThreadPriority
+                    {
+                        int get() { return _softwarePwm->getThreadPriority(); }
+                        void set(int value);
+                    }
+
+                    virtual ~LightningSoftwarePwmControllerProvider();
+
                 internal:
                     LightningSoftwarePwmControllerProvider();
 
                 private:
                     unsigned short _pinCount;
-                    double _actualFrequency;
                     bool _started;
                     LightningGpioControllerProvider^ _gpioController;
                     Platform::Collections::Vector<LightningSoftwarePwmPin^>^ _pins;
                     BoardPinsClass::BOARD_TYPE _boardType;
-
-                    property double Period
-                    {
-                        double get() { return 1000.0 / ActualFrequency; }
-                    }
+                    std::shared_ptr<SoftwarePwmClass> _softwarePwm;
 
                     void Initialize();
-                    void Loop();
 
                 };
 
@@ -133,14 +121,13 @@ namespace Microsoft {
                 private:
                     static const int MAX_FREQUENCY = 1000;
                     static const int MIN_FREQUENCY = 24;
-                    static const unsigned int PCA9685_PIN_COUNT = 16;
 
                 public:
                     // Inherited via IPwmControllerProvider
                     virtual property double ActualFrequency { double get(); }
                     virtual property double MaxFrequency { double get() { return MAX_FREQUENCY; }}
                     virtual property double MinFrequency { double get() { return MIN_FREQUENCY; }}
-                    virtual property int PinCount { int get() { return PCA9685_PIN_COUNT; } }
+                    virtual property int PinCount { int get() { return _pinCount; } }
 
                     virtual double SetDesiredFrequency(double frequency);
                     virtual void AcquirePin(int pin);
@@ -149,12 +136,26 @@ namespace Microsoft {
                     virtual void DisablePin(int pin);
                     virtual void SetPulseParameters(int pin, double dutyCycle, bool invertPolarity);
 
+                    // While true, pulse changes are held until CommitUpdates() is called, so
+                    // changes to many pins are sent with one I2C transaction per PWM chip.
+                    property bool DeferUpdates
+                    {
+                        bool get() { return _deferUpdates; }
+                        void set(bool value);
+                    }
+
+                    void CommitUpdates();
+
                 internal:
                     LightningPCA9685PwmControllerProvider();
 
                 private:
                     double _desiredFrequency;
+                    unsigned int _pinCount;
                     Platform::Collections::Vector<LightningPCA9685PwmPin^>^ _pins;
+                    bool _deferUpdates;
+                    std::vector<bool> _pendingPins;
+                    std::vector<ULONG> _pendingDutyCycles;
 
                     property double Period
                     {
@@ -162,6 +163,7 @@ namespace Microsoft {
                     }
 
                     void Initialize();
+                    void WriteDutyCycle(int pin, ULONG dutyCycle, LPCWSTR errorMessage);
                     inline UINT GetIoPin(int pin)
                     {
                         return PWM0 + pin;
@@ -173,6 +175,84 @@ namespace Microsoft {
                     }
 
                 };
+
+                ref class LightningBcmPwmPin
+                {
+                internal:
+                    property ULONG MappedPin
+                    {
+                        ULONG get() { return _mappedPin; }
+                    }
+
+                    property ULONG Channel
+                    {
+                        ULONG get() { return _channel; }
+                    }
+
+                    property bool InvertPolarity
+                    {
+                        bool get() { return _invertPolarity; }
+                        void set(bool value) { _invertPolarity = value; }
+                    }
+
+                    property double DutyCycle
+                    {
+                        double get() { return _dutyCycle; }
+                        void set(double value) { _dutyCycle = value; }
+                    }
+
+                    LightningBcmPwmPin(ULONG mappedPin, ULONG channel) :
+                        _mappedPin(mappedPin),
+                        _channel(channel),
+                        _dutyCycle(0),
+                        _invertPolarity(false)
+                    {
+                    }
+
+                private:
+                    ULONG _mappedPin;
+                    ULONG _channel;
+                    bool _invertPolarity;
+                    double _dutyCycle;
+                };
+
+                // PWM controller for the two PWM channels of the BCM2836 SOC on the Raspberry Pi 2.
+                // The channels can be brought out on GPIO12 or GPIO18 (channel 0) and on GPIO13 or
+                // GPIO19 (channel 1), and once set up they run with no CPU or I2C use.
+                public ref class LightningBcmPwmControllerProvider sealed : public IPwmControllerProvider
+                {
+                private:
+                    static const int MAX_FREQUENCY = BCM_PWM_MAX_FREQUENCY_HZ;
+                    static const int MIN_FREQUENCY = BCM_PWM_MIN_FREQUENCY_HZ;
+
+                public:
+                    // Inherited via IPwmControllerProvider
+                    virtual property double ActualFrequency { double get() { return (double)g_bcmPwm.getActualFrequency(); } }
+                    virtual property double MaxFrequency { double get() { return MAX_FREQUENCY; }}
+                    virtual property double MinFrequency { double get() { return MIN_FREQUENCY; }}
+                    virtual property int PinCount { int get() { return _pinCount; } }
+
+                    virtual double SetDesiredFrequency(double frequency);
+                    virtual void AcquirePin(int pin);
+                    virtual void ReleasePin(int pin);
+                    virtual void EnablePin(int pin);
+                    virtual void DisablePin(int pin);
+                    virtual void SetPulseParameters(int pin, double dutyCycle, bool invertPolarity);
+
+                    virtual ~LightningBcmPwmControllerProvider();
+
+                internal:
+                    LightningBcmPwmControllerProvider();
+
+                private:
+                    unsigned short _pinCount;
+                    BoardPinsClass::BOARD_TYPE _boardType;
+                    Platform::Collections::Vector<LightningBcmPwmPin^>^ _pins;
+                    int _channelPins[BCM_PWM_CHANNELS];
+
+                    void Initialize();
+                    void WriteDutyCycle(LightningBcmPwmPin^ pwmPin, LPCWSTR errorMessage);
+                };
             }
         }
     }
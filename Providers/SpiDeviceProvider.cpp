@@ -2,10 +2,7 @@
 #include "pch.h"  
 #include "Provider.h"
 #include "SpiDeviceProvider.h"
-#include "GpioDeviceProvider.h"
 #include "boardpins.h"
-#include <BcmSpiController.h>
-#include <BtSpiController.h>
 
 using namespace Microsoft::IoT::Lightning::Providers;
 
@@ -62,37 +59,7 @@ LightningSpiDeviceProvider::LightningSpiDeviceProvider(ProviderSpiConnectionSett
         LightningProvider::ThrowError(hr, L"An error occurred determining board type.");
     }
 
-    if (board == BoardPinsClass::BOARD_TYPE::MBM_BARE)
-    {
-        _SpiController.reset(new BtSpiControllerClass());
-        hr = _SpiController->configurePins(MBM_PIN_MISO, MBM_PIN_MOSI, MBM_PIN_SCK);
-    }
-    else if (board == BoardPinsClass::BOARD_TYPE::PI2_BARE)
-    {
-        _SpiController.reset(new BcmSpiControllerClass());
-        hr = _SpiController->configurePins(PI2_PIN_SPI0_MISO, PI2_PIN_SPI0_MOSI, PI2_PIN_SPI0_SCK);
-    }
-    else
-    {
-        throw ref new Platform::NotImplementedException(L"This board type has not been implemented.");
-    }
-
-    if (FAILED(hr))
-    {
-        LightningProvider::ThrowError(hr, L"An error occurred while configuring pins for SPI");
-    }
-
-    // Set the SPI bit shifting order to MSB
-    _SpiController->setMsbFirstBitOrder();
-
-    hr = _SpiController->begin(EXTERNAL_SPI_BUS, (ULONG)settings->Mode, (ULONG)(settings->ClockFrequency / 1000.0), (ULONG)settings->DataBitLength);
-
-    if (FAILED(hr))
-    {
-        LightningProvider::ThrowError(hr, L"An error occurred while initializing the SPI controller");
-    }
-
-    // Try to find and open the SPI CS pin
+    // Find the SPI CS pin
     int spiChipSelectPinMapped = 0;
     if (board == BoardPinsClass::BOARD_TYPE::MBM_BARE)
     {
@@ -120,11 +87,19 @@ LightningSpiDeviceProvider::LightningSpiDeviceProvider(ProviderSpiConnectionSett
             throw ref new Platform::InvalidArgumentException("Invalid chip select line.");
         }
     }
+    else
+    {
+        throw ref new Platform::NotImplementedException(L"This board type has not been implemented.");
+    }
+
+    // Add the device to the shared SPI bus.  The bus uses the controller chip select line
+    // on the CS pin, or drives the pin as a GPIO if the controller can't drive it.
+    hr = g_spi.addDevice(spiChipSelectPinMapped, (ULONG)settings->Mode, (ULONG)(settings->ClockFrequency / 1000.0), (ULONG)settings->DataBitLength, FALSE, _SpiDevice);
 
-    // Open the chip select pin
-    auto gpioControllerProvider = ref new LightningGpioControllerProvider();
-    _chipSelectPin = gpioControllerProvider->OpenPinProviderNoMapping(settings->ChipSelectLine, spiChipSelectPinMapped, ProviderGpioSharingMode::Exclusive);
-    _chipSelectPin->SetDriveMode(ProviderGpioPinDriveMode::Output);
+    if (FAILED(hr))
+    {
+        LightningProvider::ThrowError(hr, L"An error occurred while initializing the SPI controller");
+    }
 }
 
 
@@ -170,18 +145,18 @@ void LightningSpiDeviceProvider::TransferSequential(const Platform::Array<unsign
         throw ref new Platform::InvalidArgumentException(L"read or write buffer cannot be null.");
     }
 
-    HRESULT hr = TransferFullDuplexInternal(writeBuffer, nullptr);
-
-    if (FAILED(hr))
-    {
-        LightningProvider::ThrowError(hr, L"Could not write data to SPI device.");
-    }
+    // Write then read, with the device selected for both.
+    SPI_SEGMENT segments[2] = { 0 };
+    segments[0].dataOut = writeBuffer->Data;
+    segments[0].byteCount = writeBuffer->Length;
+    segments[1].dataIn = readBuffer->Data;
+    segments[1].byteCount = readBuffer->Length;
 
-    hr = TransferFullDuplexInternal(nullptr, readBuffer);
+    HRESULT hr = TransferSegmentsInternal(segments, ARRAYSIZE(segments));
 
     if (FAILED(hr))
     {
-        LightningProvider::ThrowError(hr, L"Could not read data from SPI device.");
+        LightningProvider::ThrowError(hr, L"Could not transfer data from SPI device.");
     }
 }
 
@@ -206,26 +181,37 @@ HRESULT LightningSpiDeviceProvider::TransferFullDuplexInternal(const Platform::A
     //  1) At least one of writeBuffer or ReadBuffer is valid
     //  2) If both read and write buffers are provided, they must have equal sizes
 
-    // Take the chip select low to select the device
-    _chipSelectPin->Write(ProviderGpioPinValue::Low);
+    SPI_SEGMENT segment = { 0 };
+    segment.dataOut = writeBuffer ? writeBuffer->Data : nullptr;
+    segment.dataIn = readBuffer ? readBuffer->Data : nullptr;
+    segment.byteCount = writeBuffer ? writeBuffer->Length : readBuffer->Length;
 
-    UINT bufferLength = writeBuffer ? writeBuffer->Length : readBuffer->Length;
-    HRESULT hr = _SpiController->transferBuffer(writeBuffer? writeBuffer->Data : nullptr, readBuffer ? readBuffer->Data : nullptr, bufferLength);
+    return TransferSegmentsInternal(&segment, 1);
+}
 
-     //Regardless of the return result, take the chip select high to de-select the device
-    _chipSelectPin->Write(ProviderGpioPinValue::High);
+HRESULT LightningSpiDeviceProvider::TransferSegmentsInternal(const SPI_SEGMENT* segments, ULONG segmentCount)
+{
+    // Get the SPI bus, set up for this device
+    SpiControllerClass* spiController = nullptr;
+    HRESULT hr = g_spi.acquire(_SpiDevice, spiController);
+
+    if (SUCCEEDED(hr))
+    {
+        // Take the chip select low for all the segments, and high again at the end
+        hr = spiController->transferSegments(segments, segmentCount);
+
+        g_spi.release();
+    }
 
     return hr;
 }
 
 LightningSpiDeviceProvider::~LightningSpiDeviceProvider()
 {
-    if (_SpiController != nullptr)
-    {
-        // Set all SPI pins as digital I/O.
-        // This frees up the external SPI bus so its pins can be used for other functions
-        _SpiController->revertPinsToGpio();
-    }
+    // Remove the device from the SPI bus.  When no other devices are on the bus this
+    // sets all SPI pins as digital I/O, which frees up the external SPI bus so its pins
+    // can be used for other functions.
+    g_spi.removeDevice(_SpiDevice);
 }
 
 Platform::String ^ LightningSpiDeviceProvider::DeviceId::get()
@@ -1,8 +1,7 @@
 // Copyright (c) Microsoft. All rights reserved.
 #pragma once
 
-#include <SpiController.h>
-#include <GpioDeviceProvider.h>
+#include <SpiBus.h>
 
 using namespace Windows::Devices::Spi::Provider;
 
@@ -61,10 +60,10 @@ namespace Microsoft {
                 private:
                     LightningSpiDeviceProvider() { }
                     ProviderSpiConnectionSettings ^_ConnectionSettings;
-                    std::unique_ptr<SpiControllerClass> _SpiController;
-                    IGpioPinProvider^ _chipSelectPin;
+                    ULONG _SpiDevice = SPI_BUS_NO_DEVICE;
 
                     HRESULT TransferFullDuplexInternal(const Platform::Array<unsigned char> ^writeBuffer, Platform::WriteOnlyArray<unsigned char> ^readBuffer);
+                    HRESULT TransferSegmentsInternal(const SPI_SEGMENT* segments, ULONG segmentCount);
 
                     inline USHORT flipShort(USHORT dataOut)
                     {
@@ -5,6 +5,8 @@
 
 #include <memory>
 #include <BoardPins.h>
+#include <SoftwarePwm.h>
+#include <BcmPwmController.h>
 
 using namespace Concurrency;
 
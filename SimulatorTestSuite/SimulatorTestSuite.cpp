@@ -0,0 +1,759 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+// Simulator Test Suite
+//
+// This console program runs on an x86 or x64 development PC.  It enables the peripheral
+// simulator, which makes the board a simulated PI2, attaches device models to the
+// simulated buses, and drives the models through the unmodified Lightning drivers:
+//
+//   PCA9685 PWM chip on the I2C bus at address 0x40
+//   PCA9685 PWM chip on the I2C bus at address 0x41, used through a register map
+//   ADS1015 ADC on the I2C bus at address 0x48
+//   24C32 EEPROM on the I2C bus at address 0x50
+//   MCP3008 ADC on SPI chip select CE0
+//
+// All tests are expected to Succeed.  The exit code is the number of tests that failed.
+
+#include <stdio.h>
+
+#include "BoardPins.h"
+#include "PCA9685Support.h"
+#include "ADS1015Support.h"
+#include "MCP3008support.h"
+#include "AdcFilter.h"
+#include "eeprom.h"
+#include "I2cRegisterMap.h"
+#include "I2cStatistics.h"
+#include "I2cTransaction.h"
+#include "Wire.h"
+#include "PeripheralSimulator.h"
+#include "SimulatedDevices.h"
+
+#define PCA9685_ADR 0x40
+#define REG_MAP_ADR 0x41
+#define EEPROM_ADR 0x50
+#define EEPROM_SIZE 4096
+#define EEPROM_PAGE 32
+#define ABSENT_ADR 0x30
+
+unsigned int test_count = 0;
+unsigned int success_count = 0;
+
+SimPCA9685Device pwmModel;
+SimPCA9685Device regMapModel;
+SimADS1015Device ads1015Model;
+Sim24CxxEepromDevice eepromModel(EEPROM_SIZE, EEPROM_PAGE);
+SimMCP3008Device mcp3008Model;
+
+void PostTestResult(bool succeeded, const wchar_t* function)
+{
+    wprintf(L"**** %s **** - %s\n", (succeeded ? L"SUCCEEDED" : L"FAILED"), function);
+    ::test_count++;
+    ::success_count += (succeeded ? 1 : 0);
+}
+
+void Test_BoardType(void)
+{
+    BoardPinsClass::BOARD_TYPE board = BoardPinsClass::BOARD_TYPE::NOT_SET;
+    HRESULT hr = g_pins.getBoardType(board);
+
+    PostTestResult(SUCCEEDED(hr) && (board == BoardPinsClass::BOARD_TYPE::PI2_BARE), __FUNCTIONW__);
+}
+
+void Test_PCA9685(void)
+{
+    HRESULT hr = S_OK;
+    ULONG onCount = 0;
+    ULONG offCount = 0;
+    ULONG frequency = 0;
+
+    hr = PCA9685Device::SetPwmFrequency(PCA9685_ADR, 200);
+
+    if (SUCCEEDED(hr))
+    {
+        // A 25% duty cycle is 1024 of the 4096 counts in each PWM period.
+        hr = PCA9685Device::SetPwmDutyCycle(PCA9685_ADR, 3, 0x40000000);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pwmModel.getChannel(3, onCount, offCount);
+    }
+
+    frequency = pwmModel.getOutputFrequency();
+
+    PostTestResult(SUCCEEDED(hr) && (onCount == 0) && (offCount == 1024) &&
+        (frequency >= 190) && (frequency <= 210) && !pwmModel.isSleeping(), __FUNCTIONW__);
+}
+
+void Test_ADS1015(void)
+{
+    HRESULT hr = S_OK;
+    ADS1015Device adc;
+    ULONG value = 0;
+    ULONG bits = 0;
+
+    hr = adc.begin();
+
+    if (SUCCEEDED(hr))
+    {
+        hr = ads1015Model.setInputVoltage(2, 1.0);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = adc.readValue(2, value, bits);
+    }
+
+    adc.end();
+
+    // Readings are scaled so 5 volts is full scale: 1 volt reads as 2047 / 5.
+    PostTestResult(SUCCEEDED(hr) && (bits == 11) && (value >= 407) && (value <= 411), __FUNCTIONW__);
+}
+
+void Test_MCP3008(void)
+{
+    HRESULT hr = S_OK;
+    MCP3008Device adc;
+    ULONG value = 0;
+    ULONG bits = 0;
+
+    hr = adc.begin();
+
+    if (SUCCEEDED(hr))
+    {
+        hr = mcp3008Model.setChannelValue(5, 0x2A5);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = adc.readValue(5, value, bits);
+    }
+
+    adc.end();
+
+    PostTestResult(SUCCEEDED(hr) && (bits == 10) && (value == 0x2A5), __FUNCTIONW__);
+}
+
+void Test_24CxxEeprom(void)
+{
+    HRESULT hr = S_OK;
+    uint8_t written[100];
+    uint8_t readBack[100];
+    ULONG writeCycles = 0;
+    bool match = true;
+
+    for (ULONG i = 0; i < sizeof(written); i++)
+    {
+        written[i] = (uint8_t)(i * 7 + 3);
+    }
+    ZeroMemory(readBack, sizeof(readBack));
+
+    hr = EEPROM.setDevice(EEPROM_ADR, EEPROM_SIZE, EEPROM_PAGE);
+
+    // The block starts part way through a page, so it takes four page writes.
+    if (SUCCEEDED(hr))
+    {
+        hr = EEPROM.writeBlock(1000, written, sizeof(written));
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = EEPROM.readBlock(1000, readBack, sizeof(readBack));
+    }
+
+    writeCycles = eepromModel.getWriteCycles();
+
+    for (ULONG i = 0; i < sizeof(written); i++)
+    {
+        if ((readBack[i] != written[i]) || (eepromModel.getMemory()[1000 + i] != written[i]))
+        {
+            match = false;
+        }
+    }
+
+    PostTestResult(SUCCEEDED(hr) && match && (writeCycles == 4), __FUNCTIONW__);
+}
+
+void Test_I2cRegisterMap(void)
+{
+    HRESULT hr = S_OK;
+    I2cRegisterMapClass registers;
+    I2cStatisticsClass::SLAVE_STATS before;
+    I2cStatisticsClass::SLAVE_STATS afterFlush;
+    I2cStatisticsClass::SLAVE_STATS afterCached;
+    ULONG value = 0;
+    ULONG on0 = 0;
+    ULONG off0 = 0;
+    ULONG on1 = 0;
+    ULONG off1 = 0;
+
+    ZeroMemory(&before, sizeof(before));
+    ZeroMemory(&afterFlush, sizeof(afterFlush));
+    ZeroMemory(&afterCached, sizeof(afterCached));
+
+    // MODE1, then the 2-byte ON and OFF registers of channels 0 and 1, sent LSB first.
+    hr = registers.setAddress(REG_MAP_ADR);
+    registers.setAutoIncrement(TRUE);
+    registers.setMsbFirst(FALSE);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = registers.declareRegister(0x00, 1, REG_CACHEABLE);
+    }
+
+    for (ULONG regAdr = 0x06; SUCCEEDED(hr) && (regAdr < 0x0E); regAdr += 2)
+    {
+        hr = registers.declareRegister(regAdr, 2, REG_CACHEABLE);
+    }
+
+    // Turn on auto-increment and the oscillator, and get channel 1 ON into the cache.
+    if (SUCCEEDED(hr))
+    {
+        hr = registers.writeRegister(0x00, 0x20);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = registers.readRegister(0x0A, value);
+    }
+
+    // Channel 0 ON and OFF are adjacent, and channel 1 OFF is only the cached channel 1
+    // ON register away, so the three writes go in one 9-byte transfer.
+    if (SUCCEEDED(hr))
+    {
+        hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, REG_MAP_ADR, before);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = registers.stageRegister(0x06, 0x0000);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = registers.stageRegister(0x08, 0x0400);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = registers.stageRegister(0x0C, 0x0800);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = registers.flush();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, REG_MAP_ADR, afterFlush);
+    }
+
+    // Writing a value a cached register already has, and reading it back, use no bus traffic.
+    if (SUCCEEDED(hr))
+    {
+        hr = registers.writeRegister(0x08, 0x0400);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = registers.readRegister(0x08, value);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, REG_MAP_ADR, afterCached);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = regMapModel.getChannel(0, on0, off0);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = regMapModel.getChannel(1, on1, off1);
+    }
+
+    PostTestResult(SUCCEEDED(hr) &&
+        ((afterFlush.transactions - before.transactions) == 1) &&
+        ((afterFlush.bytes - before.bytes) == 9) &&
+        (afterCached.transactions == afterFlush.transactions) && (value == 0x0400) &&
+        (on0 == 0) && (off0 == 0x0400) && (on1 == 0) && (off1 == 0x0800), __FUNCTIONW__);
+}
+
+void Test_WireRingBuffer(void)
+{
+    HRESULT hr = S_OK;
+    I2cStatisticsClass::SLAVE_STATS before;
+    I2cStatisticsClass::SLAVE_STATS after;
+    uint8_t tooLong[9];
+    ULONG firstCount = 0;
+    ULONG secondCount = 0;
+    ULONG overrun = TwoWire::SUCCESS;
+    ULONG writeCycles = 0;
+    bool match = true;
+
+    ZeroMemory(&before, sizeof(before));
+    ZeroMemory(&after, sizeof(after));
+    ZeroMemory(tooLong, sizeof(tooLong));
+
+    for (ULONG i = 0; i < 16; i++)
+    {
+        eepromModel.getMemory()[200 + i] = (UCHAR)(0xA0 + i);
+    }
+
+    try
+    {
+        Wire.begin();
+        Wire.setBufferLength(8);
+
+        // Read 5 bytes from EEPROM address 200, which fill the start of the receive ring.
+        Wire.beginTransmission(EEPROM_ADR);
+        Wire.write((uint8_t)0);
+        Wire.write((uint8_t)200);
+        Wire.endTransmission(FALSE);
+        firstCount = Wire.requestFrom(EEPROM_ADR, 5);
+
+        for (ULONG i = 0; i < 5; i++)
+        {
+            if (Wire.read() != (ULONG)(0xA0 + i))
+            {
+                match = false;
+            }
+        }
+
+        // The next 6 bytes wrap around the end of the ring, but are still read in one transfer.
+        hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, EEPROM_ADR, before);
+
+        Wire.beginTransmission(EEPROM_ADR);
+        Wire.write((uint8_t)0);
+        Wire.write((uint8_t)205);
+        Wire.endTransmission(FALSE);
+        secondCount = Wire.requestFrom(EEPROM_ADR, 6);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, EEPROM_ADR, after);
+        }
+
+        for (ULONG i = 0; i < 6; i++)
+        {
+            if (Wire.read() != (ULONG)(0xA5 + i))
+            {
+                match = false;
+            }
+        }
+
+        // A write longer than the transmit buffer is not sent at all.
+        writeCycles = eepromModel.getWriteCycles();
+        Wire.beginTransmission(EEPROM_ADR);
+        Wire.write(tooLong, sizeof(tooLong));
+        overrun = Wire.endTransmission();
+
+        Wire.setBufferLength(WIRE_BUFFER_LENGTH);
+        Wire.end();
+    }
+    catch (const _arduino_fatal_error &)
+    {
+        hr = E_FAIL;
+    }
+
+    PostTestResult(SUCCEEDED(hr) && match && (firstCount == 5) && (secondCount == 6) &&
+        ((after.transactions - before.transactions) == 1) && (Wire.available() == 0) &&
+        (overrun == TwoWire::TWI_BUFFER_OVERRUN) && (eepromModel.getWriteCycles() == writeCycles), __FUNCTIONW__);
+}
+
+void Test_I2cStatistics(void)
+{
+    HRESULT hr = S_OK;
+    HRESULT nackHr = S_OK;
+    I2cTransactionClass transaction;
+    I2cStatisticsClass::SLAVE_STATS before;
+    I2cStatisticsClass::SLAVE_STATS after;
+    I2cStatisticsClass::SLAVE_STATS absent;
+    std::string text;
+    UCHAR regAdr = 0x00;
+    UCHAR mode1 = 0;
+
+    ZeroMemory(&before, sizeof(before));
+    ZeroMemory(&after, sizeof(after));
+    ZeroMemory(&absent, sizeof(absent));
+
+    hr = g_i2c.begin();
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, PCA9685_ADR, before);
+    }
+
+    // Read the MODE1 register: one transaction of 2 bytes, counted in the 2-3 byte bucket.
+    if (SUCCEEDED(hr))
+    {
+        hr = transaction.setAddress(PCA9685_ADR);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = transaction.queueWrite(&regAdr, 1);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = transaction.queueRead(&mode1, 1);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = transaction.execute(g_i2c.getController());
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, PCA9685_ADR, after);
+    }
+
+    // No device answers at the absent address, so the transaction fails with an address NACK.
+    if (SUCCEEDED(hr))
+    {
+        transaction.reset();
+        hr = transaction.setAddress(ABSENT_ADR);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = transaction.queueWrite(&regAdr, 1);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        nackHr = transaction.execute(g_i2c.getController());
+        hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, ABSENT_ADR, absent);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_i2cStats.formatStatistics(text);
+    }
+
+    PostTestResult(SUCCEEDED(hr) &&
+        ((after.transactions - before.transactions) == 1) && ((after.bytes - before.bytes) == 2) &&
+        ((after.bytesHistogram[2] - before.bytesHistogram[2]) == 1) && (after.failures == before.failures) &&
+        FAILED(nackHr) && (absent.transactions == 1) && (absent.failures == 1) && (absent.adrNacks == 1) &&
+        (text.find("slave 0x30:") != std::string::npos), __FUNCTIONW__);
+}
+
+void Test_SpiSegments(void)
+{
+    HRESULT hr = S_OK;
+    HRESULT badHr = S_OK;
+    ULONG device = 0;
+    SpiControllerClass* spi = nullptr;
+    BYTE start[1] = { 0x01 };
+    BYTE command[2] = { (BYTE)((0x08 | 6) << 4), 0x00 };
+    BYTE result[2] = { 0 };
+    SPI_SEGMENT segments[2] = { 0 };
+    SPI_SEGMENT badSegment = { 0 };
+    ULONG conversions = 0;
+    ULONG value = 0;
+
+    hr = mcp3008Model.setChannelValue(6, 0x1C3);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_spi.addDevice(PI2_SPI_CS_PIN, SPI_MODE0, 1000, 8, FALSE, device);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_spi.acquire(device, spi);
+
+        if (SUCCEEDED(hr))
+        {
+            // The start bit goes in an 8-bit segment, and the channel select and the result
+            // in a 16-bit segment after a short delay.  The conversion only works if the chip
+            // select stays asserted between the two.
+            segments[0].dataOut = start;
+            segments[0].byteCount = sizeof(start);
+            segments[1].dataOut = command;
+            segments[1].dataIn = result;
+            segments[1].byteCount = sizeof(command);
+            segments[1].dataBits = 16;
+            segments[1].delayUs = 10;
+
+            conversions = mcp3008Model.getConversionCount();
+            hr = spi->transferSegments(segments, ARRAYSIZE(segments));
+            conversions = mcp3008Model.getConversionCount() - conversions;
+
+            // A 16-bit segment of 3 bytes is rejected before anything is sent.
+            badSegment.dataOut = command;
+            badSegment.byteCount = 3;
+            badSegment.dataBits = 16;
+            badHr = spi->transferSegments(&badSegment, 1);
+
+            g_spi.release();
+        }
+
+        g_spi.removeDevice(device);
+    }
+
+    value = ((result[0] << 8) | result[1]) & 0x3FF;
+
+    PostTestResult(SUCCEEDED(hr) && (conversions == 1) && (value == 0x1C3) &&
+        (badHr == DMAP_E_SPI_SEGMENT_LENGTH_INVALID), __FUNCTIONW__);
+}
+
+void Test_AdcFilter(void)
+{
+    HRESULT hr = S_OK;
+    AdcFilterClass filter;
+    ADC_SAMPLE input[12];
+    ADC_SAMPLE fir[6];
+    ADC_SAMPLE cic[3];
+    ADC_SAMPLE median[12];
+    ADC_SAMPLE iir[12];
+    ADC_SAMPLE average[12];
+    const float taps[3] = { 0.5f, 0.3f, 0.2f };
+    ULONG used = 0;
+    ULONG firCount = 0;
+    ULONG cicCount = 0;
+    ULONG medianCount = 0;
+    ULONG iirCount = 0;
+    ULONG averageCount = 0;
+    ULONG limitedUsed = 0;
+    ULONG limitedCount = 0;
+
+    // Channel 0 is a ramp, and channel 5 is steady with one spike.
+    ZeroMemory(input, sizeof(input));
+    for (ULONG i = 0; i < ARRAYSIZE(input); i++)
+    {
+        input[i].ticks = 1000 + i;
+        input[i].sequence = i;
+        input[i].values[0] = 10 * i;
+        input[i].values[5] = (i == 4) ? 1000 : 100;
+    }
+
+    // With room for only two outputs, the input that would complete a third is not used.
+    hr = filter.setFir(taps, ARRAYSIZE(taps), 2);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = filter.process(input, ARRAYSIZE(input), fir, 2, limitedUsed, limitedCount);
+    }
+
+    // FIR, newest sample weighted most, decimated by 2.  The last output is taken at input
+    // 11: 0.5 * 110 + 0.3 * 100 + 0.2 * 90 = 103.
+    if (SUCCEEDED(hr))
+    {
+        filter.reset();
+        hr = filter.process(input, ARRAYSIZE(input), fir, ARRAYSIZE(fir), used, firCount);
+    }
+
+    // A second order CIC decimating by 4 has the triangular response (1 2 3 4 3 2 1) / 16,
+    // so the last output is the ramp delayed by 3 samples.
+    if (SUCCEEDED(hr))
+    {
+        hr = filter.setCic(2, 4);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = filter.process(input, ARRAYSIZE(input), cic, ARRAYSIZE(cic), used, cicCount);
+    }
+
+    // A 3 sample median removes the spike.
+    if (SUCCEEDED(hr))
+    {
+        hr = filter.setMedian(3, 1);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = filter.process(input, ARRAYSIZE(input), median, ARRAYSIZE(median), used, medianCount);
+    }
+
+    // Exponential smoothing moves half way to each new input.
+    if (SUCCEEDED(hr))
+    {
+        hr = filter.setIir(0.5f, 1);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = filter.process(input, ARRAYSIZE(input), iir, ARRAYSIZE(iir), used, iirCount);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = filter.setMovingAverage(4, 1);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = filter.process(input, ARRAYSIZE(input), average, ARRAYSIZE(average), used, averageCount);
+    }
+
+    PostTestResult(SUCCEEDED(hr) &&
+        (limitedUsed == 5) && (limitedCount == 2) &&
+        (firCount == 6) && (fir[5].values[0] == 103) && (fir[5].values[5] == 100) &&
+        (fir[5].ticks == 1011) && (fir[5].sequence == 5) &&
+        (cicCount == 3) && (cic[2].values[0] == 80) && (cic[2].values[5] == 100) &&
+        (medianCount == 12) && (median[4].values[5] == 100) && (median[5].values[5] == 100) &&
+        (median[5].values[0] == 40) &&
+        (iirCount == 12) && (iir[4].values[5] == 550) && (iir[5].values[5] == 325) &&
+        (averageCount == 12) && (average[11].values[0] == 95), __FUNCTIONW__);
+}
+
+void Test_PCA9685Batching(void)
+{
+    HRESULT hr = S_OK;
+    I2cStatisticsClass::SLAVE_STATS before;
+    I2cStatisticsClass::SLAVE_STATS afterStage;
+    I2cStatisticsClass::SLAVE_STATS afterFlush;
+    I2cStatisticsClass::SLAVE_STATS afterIdleFlush;
+    I2cStatisticsClass::SLAVE_STATS afterBatch;
+    ULONG dutyCycles[PCA9685_CHANNEL_COUNT];
+    ULONG on[PCA9685_CHANNEL_COUNT];
+    ULONG off[PCA9685_CHANNEL_COUNT];
+
+    ZeroMemory(&before, sizeof(before));
+    ZeroMemory(&afterStage, sizeof(afterStage));
+    ZeroMemory(&afterFlush, sizeof(afterFlush));
+    ZeroMemory(&afterIdleFlush, sizeof(afterIdleFlush));
+    ZeroMemory(&afterBatch, sizeof(afterBatch));
+    ZeroMemory(dutyCycles, sizeof(dutyCycles));
+    ZeroMemory(on, sizeof(on));
+    ZeroMemory(off, sizeof(off));
+
+    hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, PCA9685_ADR, before);
+
+    // Staged duty cycles stay in the driver until they are flushed, and are then sent in
+    // one transaction even though the channels are not adjacent.
+    if (SUCCEEDED(hr))
+    {
+        hr = PCA9685Device::StagePwmDutyCycle(PCA9685_ADR, 4, 0x20000000);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = PCA9685Device::StagePwmDutyCycle(PCA9685_ADR, 5, 0x80000000);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = PCA9685Device::StagePwmDutyCycle(PCA9685_ADR, 9, 0xC0000000);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, PCA9685_ADR, afterStage);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = PCA9685Device::FlushPwmDutyCycles();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, PCA9685_ADR, afterFlush);
+    }
+
+    // With nothing staged, a flush sends nothing.
+    if (SUCCEEDED(hr))
+    {
+        hr = PCA9685Device::FlushPwmDutyCycles();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, PCA9685_ADR, afterIdleFlush);
+    }
+
+    // A batched update of two channels is also one transaction.
+    if (SUCCEEDED(hr))
+    {
+        dutyCycles[10] = 0x10000000;
+        dutyCycles[11] = 0x30000000;
+        hr = PCA9685Device::SetPwmDutyCycles(PCA9685_ADR, (1 << 10) | (1 << 11), dutyCycles);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_i2cStats.getSlaveStatistics(EXTERNAL_I2C_BUS, PCA9685_ADR, afterBatch);
+    }
+
+    for (ULONG ch = 0; SUCCEEDED(hr) && (ch < PCA9685_CHANNEL_COUNT); ch++)
+    {
+        hr = pwmModel.getChannel(ch, on[ch], off[ch]);
+    }
+
+    PostTestResult(SUCCEEDED(hr) &&
+        (afterStage.transactions == before.transactions) &&
+        ((afterFlush.transactions - afterStage.transactions) == 1) &&
+        (afterIdleFlush.transactions == afterFlush.transactions) &&
+        ((afterBatch.transactions - afterIdleFlush.transactions) == 1) &&
+        (on[4] == 0) && (off[4] == 512) && (on[5] == 0) && (off[5] == 2048) &&
+        (on[9] == 0) && (off[9] == 3072) && (off[10] == 256) && (off[11] == 768) &&
+        (off[3] == 1024), __FUNCTIONW__);
+}
+
+int main()
+{
+    HRESULT hr = S_OK;
+
+    hr = g_simulator.enable();
+
+    if (SUCCEEDED(hr))
+    {
+        g_simulator.setTimingEnabled(FALSE);
+        hr = g_simulator.attachI2cDevice(EXTERNAL_I2C_BUS, PCA9685_ADR, &pwmModel);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_simulator.attachI2cDevice(EXTERNAL_I2C_BUS, REG_MAP_ADR, &regMapModel);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_simulator.attachI2cDevice(EXTERNAL_I2C_BUS, 0x48, &ads1015Model);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_simulator.attachI2cDevice(EXTERNAL_I2C_BUS, EEPROM_ADR, &eepromModel);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = g_simulator.attachSpiDevice(EXTERNAL_SPI_BUS, 0, &mcp3008Model);
+    }
+
+    if (FAILED(hr))
+    {
+        wprintf(L"The simulator could not be started, error 0x%08X\n", hr);
+        return 1;
+    }
+
+    Test_BoardType();
+    Test_PCA9685();
+    Test_ADS1015();
+    Test_MCP3008();
+    Test_24CxxEeprom();
+    Test_I2cRegisterMap();
+    Test_WireRingBuffer();
+    Test_I2cStatistics();
+    Test_SpiSegments();
+    Test_AdcFilter();
+    Test_PCA9685Batching();
+
+    wprintf(L"%u of %u tests succeeded\n", ::success_count, ::test_count);
+
+    g_simulator.disable();
+
+    return (int)(::test_count - ::success_count);
+}
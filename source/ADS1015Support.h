@@ -6,17 +6,56 @@
 #define _ADS1015_SUPPORT_H_
 
 #include <Windows.h>
+#include <functional>
 
 #include "I2c.h"
 #include "I2cTransaction.h"
 #include "I2cController.h"
+#include "BoardPins.h"
+
+#define ADS1015_CHANNELS 4
+
+// Data rate settings (conversions per second).
+#define ADS1015_DR_128SPS 0
+#define ADS1015_DR_250SPS 1
+#define ADS1015_DR_490SPS 2
+#define ADS1015_DR_920SPS 3
+#define ADS1015_DR_1600SPS 4
+#define ADS1015_DR_2400SPS 5
+#define ADS1015_DR_3300SPS 6
+
+// Programmable gain amplifier settings (full scale input range).
+#define ADS1015_PGA_6144MV 0
+#define ADS1015_PGA_4096MV 1
+#define ADS1015_PGA_2048MV 2
+#define ADS1015_PGA_1024MV 3
+#define ADS1015_PGA_512MV 4
+#define ADS1015_PGA_256MV 5
+
+// Pin value used when no pin is connected to the ALERT/RDY output of the ADC.
+#define ADS1015_NO_READY_PIN 0xFFFFFFFF
+
+// Comparator modes.
+#define ADS1015_COMP_TRADITIONAL 0
+#define ADS1015_COMP_WINDOW 1
+
+// Number of successive results beyond a threshold needed to assert ALERT/RDY.
+#define ADS1015_COMP_QUEUE_1 0
+#define ADS1015_COMP_QUEUE_2 1
+#define ADS1015_COMP_QUEUE_4 2
 
 class ADS1015Device
 {
 public:
     /// Constructor.
-    ADS1015Device()
+    ADS1015Device() :
+        m_dataRate(CONFIG_REG_INIT_DR),
+        m_gain(CONFIG_REG_INIT_PGA),
+        m_continuous(FALSE),
+        m_readyPin(ADS1015_NO_READY_PIN),
+        m_readyHandledTicks(0)
     {
+        InitializeSRWLock(&m_readyLock);
     }
 
     /// Destructor.
@@ -42,10 +81,212 @@ public:
     /// Release the ADC.
     inline void end()
     {
+        // Return the ADC to single-shot mode if it is converting continuously.
+        stopContinuous();
+
         // Release the I2C controller.
         g_i2c.end();
     }
 
+    /// Set the data rate used for conversions.
+    /**
+    \param[in] dataRate One of the ADS1015_DR_xxx values.
+    \return HRESULT success or error code.
+    \note The new data rate is used starting with the next conversion started.
+    */
+    inline HRESULT setDataRate(ULONG dataRate)
+    {
+        HRESULT hr = S_OK;
+
+        if (dataRate > ADS1015_DR_3300SPS)
+        {
+            hr = DMAP_E_ADC_SETTING_INVALID;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            m_dataRate = dataRate;
+        }
+
+        return hr;
+    }
+
+    /// Set the full scale input range used for conversions.
+    /**
+    \param[in] gain One of the ADS1015_PGA_xxx values.
+    \return HRESULT success or error code.
+    \note The new range is used starting with the next conversion started.
+    */
+    inline HRESULT setGain(ULONG gain)
+    {
+        HRESULT hr = S_OK;
+
+        if (gain > ADS1015_PGA_256MV)
+        {
+            hr = DMAP_E_ADC_SETTING_INVALID;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            m_gain = gain;
+        }
+
+        return hr;
+    }
+
+    /// Start continuous conversions on one channel.
+    /**
+    The ADC converts the channel over and over at the data rate set with setDataRate().
+    If a ready pin is given, the ALERT/RDY output of the ADC is set up to pulse low at the
+    end of each conversion, and each pulse causes a GPIO interrupt which reads the result
+    (with one 2-byte I2C read) and passes it to the callback function.
+    \param[in] channel Number of channel on ADC to convert.
+    \param[in] readyPin The GPIO pin the ALERT/RDY output is connected to, or
+    ADS1015_NO_READY_PIN to read results with readContinuous() instead.
+    \param[in] callback The function called with each result and the high resolution timer
+    reading taken when the ready pulse was seen.  Required if a ready pin is given, not used
+    if readyPin is ADS1015_NO_READY_PIN.
+    \return HRESULT success or error code.
+    */
+    inline HRESULT startContinuous(ULONG channel, ULONG readyPin, std::function<void(ULONG value, ULONGLONG eventTime)> callback)
+    {
+        HRESULT hr;
+
+        if ((readyPin != ADS1015_NO_READY_PIN) && !callback)
+        {
+            hr = E_INVALIDARG;
+        }
+        else if (readyPin == ADS1015_NO_READY_PIN)
+        {
+            hr = _startContinuous(channel, ADS1015_NO_READY_PIN, 0, 0, 0, FALSE, COMP_QUE_DISABLE, nullptr);
+        }
+        else
+        {
+            // Setting the MSB of the high threshold register and clearing the MSB of the
+            // low threshold register makes ALERT/RDY a conversion ready output.
+            hr = _startContinuous(channel, readyPin, 0x8000, 0x0000, ADS1015_COMP_TRADITIONAL, FALSE, ADS1015_COMP_QUEUE_1, callback);
+        }
+
+        return hr;
+    }
+
+    /// Start watching one channel with the comparator.
+    /**
+    The ADC converts the channel continuously and compares each result to the thresholds
+    itself, so no I2C traffic is needed while the input stays in range.  When the
+    comparator asserts the ALERT/RDY output a GPIO interrupt reads the result (with one
+    2-byte I2C read, which also clears a latched alert) and passes it to the callback
+    function.
+    \param[in] channel Number of channel on ADC to watch.
+    \param[in] alertPin The GPIO pin the ALERT/RDY output is connected to.
+    \param[in] mode ADS1015_COMP_TRADITIONAL to alert when a result is above the high
+    threshold (until a result is below the low threshold), or ADS1015_COMP_WINDOW to
+    alert when a result is outside the range from the low to the high threshold.
+    \param[in] lowThreshold The low threshold, in the units of the values readValue() returns.
+    \param[in] highThreshold The high threshold, in the units of the values readValue() returns.
+    \param[in] queue The number of successive results beyond a threshold needed to alert
+    (one of the ADS1015_COMP_QUEUE_xxx values).
+    \param[in] latching TRUE to keep ALERT/RDY asserted until a result is read, FALSE to
+    let it deassert when the results are back in range.
+    \param[in] callback The function called with each result read when ALERT/RDY asserts
+    and the high resolution timer reading taken when it asserted.
+    \return HRESULT success or error code.
+    \note The thresholds use the gain set with setGain() when this method is called.  Use
+    stopContinuous() to stop watching the channel.
+    */
+    inline HRESULT startComparator(ULONG channel, ULONG alertPin, ULONG mode, ULONG lowThreshold, ULONG highThreshold,
+        ULONG queue, BOOL latching, std::function<void(ULONG value, ULONGLONG eventTime)> callback)
+    {
+        HRESULT hr = S_OK;
+
+        if ((alertPin == ADS1015_NO_READY_PIN) || !callback)
+        {
+            hr = E_INVALIDARG;
+        }
+
+        if (SUCCEEDED(hr) && ((mode > ADS1015_COMP_WINDOW) || (queue > ADS1015_COMP_QUEUE_4) || (lowThreshold > highThreshold)))
+        {
+            hr = DMAP_E_ADC_SETTING_INVALID;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = _startContinuous(channel, alertPin, _thresholdRegister(highThreshold), _thresholdRegister(lowThreshold),
+                mode, latching, queue, callback);
+        }
+
+        return hr;
+    }
+
+    /// Read the latest result of continuous conversions.
+    /**
+    \param[out] value The value read from the ADC.
+    \param[out] bits The size of the reading in "value" in bits.
+    \return HRESULT success or error code.
+    \note This is a single 2-byte I2C read.  If it is not synchronized with the end of
+    each conversion (see startContinuous()) the same result can be read more than once.
+    */
+    inline HRESULT readContinuous(ULONG & value, ULONG & bits)
+    {
+        HRESULT hr = S_OK;
+        I2cTransactionClass transaction;
+        BYTE conversionData[2] = { 0 };
+
+        if (!m_continuous)
+        {
+            hr = DMAP_E_ADC_NOT_IN_CONTINUOUS_MODE;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = transaction.setAddress(ADC_I2C_ADR);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = transaction.queueRead(conversionData, 2);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = transaction.execute(g_i2c.getController());
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            value = _scaleReading(conversionData);
+            bits = ADC_BITS;
+        }
+
+        return hr;
+    }
+
+    /// Stop continuous conversions.
+    /**
+    The ADC is returned to single-shot mode (where it powers down between conversions)
+    and the ALERT/RDY interrupt, if any, is detached.
+    */
+    inline void stopContinuous()
+    {
+        CONFIG_REG_H configH;
+        CONFIG_REG_L configL;
+
+        if (m_readyPin != ADS1015_NO_READY_PIN)
+        {
+            g_pins.detachInterrupt((uint8_t)m_readyPin);
+            m_readyPin = ADS1015_NO_READY_PIN;
+        }
+
+        if (m_continuous)
+        {
+            _buildConfig(0, configH, configL);
+            _writeRegister(CONFIG_REG_ADR, (configH.ALL_BITS << 8) | configL.ALL_BITS);
+            m_continuous = FALSE;
+        }
+
+        m_readyCallback = nullptr;
+    }
+
     /// Take a reading with the ADC used on the Ika Lure board.
     /**
     \param[in] channel Number of channel on ADC to read.
@@ -69,28 +310,19 @@ public:
         BYTE conversionRegAdr[1] = { 0 };
         BYTE conversionData[2] = { 0 };
 
+        // Single-shot conversions would stop continuous conversions.
+        if (m_continuous)
+        {
+            hr = DMAP_E_ADC_IN_CONTINUOUS_MODE;
+        }
+
         //
         // Build the Configuration Register contents.
         //
 
-        configH.ALL_BITS = CONFIG_REG_INIT_H;
-        configL.ALL_BITS = CONFIG_REG_INIT_L;
-        switch (channel)
+        if (SUCCEEDED(hr))
         {
-        case 0:
-            configH.MUX = ANI0;
-            break;
-        case 1:
-            configH.MUX = ANI1;
-            break;
-        case 2:
-            configH.MUX = ANI2;
-            break;
-        case 3:
-            configH.MUX = ANI3;
-            break;
-        default:
-            hr = DMAP_E_ADC_DOES_NOT_HAVE_REQUESTED_CHANNEL;
+            hr = _buildConfig(channel, configH, configL);
         }
 
         if (SUCCEEDED(hr))
@@ -185,18 +417,7 @@ public:
         
         if (SUCCEEDED(hr))
         {
-            value = conversionData[0] << 8;
-            value = value | conversionData[1];
-            // Extract the reading from the data sent back from the ADC.
-            value = value >> DATA_SHIFT;
-            // This is a signed ADC, so make sure the result is not negative.
-            if ((value & (1 << ADC_BITS)) != 0)
-            {
-                value = 0;
-            }
-            // Scale the ADC for its full-scale value not being 5.000 volts.
-            value = ((value * FULL_SCALE) + 2500) / 5000;
-
+            value = _scaleReading(conversionData);
             bits = ADC_BITS;
         }
 
@@ -238,18 +459,31 @@ private:
     /// The shift amount to right justify the data read from the ADC.
     const ULONG DATA_SHIFT = 4;
 
-    /// The full-scale ADC value, compared to 5000.
-    const ULONG FULL_SCALE = 6144;
-
     /// The I2C address of the Ika Lure ADC.
     const BYTE ADC_I2C_ADR = 0x48;
 
+    /// The register addresses.
+    const BYTE CONVERSION_REG_ADR = 0;
+    const BYTE CONFIG_REG_ADR = 1;
+    const BYTE LO_THRESH_REG_ADR = 2;
+    const BYTE HI_THRESH_REG_ADR = 3;
+
     /// The Configuration Register MSByte initialization values.
     const BYTE CONFIG_REG_INIT_H = 0x01;    // Single-shot mode, 6.144V full scale
 
     /// The Configuration Register LSByte initialization values.
     const BYTE CONFIG_REG_INIT_L = 0xE3;    // 3.3k Samples/sec, Disable comparator
 
+    /// The comparator queue setting that disables the comparator.
+    static const ULONG COMP_QUE_DISABLE = 3;
+
+    /// The data rate and PGA settings in the initialization values.
+    static const ULONG CONFIG_REG_INIT_DR = 7;
+    static const ULONG CONFIG_REG_INIT_PGA = 0;
+
+    /// The full scale range for each PGA setting, in millivolts.
+    static const ULONG FULL_SCALE_MV[8];
+
     /// The mux value for single-ended input on AIN0.
     const BYTE ANI0 = 4;
 
@@ -262,6 +496,297 @@ private:
     /// The mux value for single-ended input on AIN3.
     const BYTE ANI3 = 7;
 
+    /// The data rate setting.
+    ULONG m_dataRate;
+
+    /// The PGA (full scale range) setting.
+    ULONG m_gain;
+
+    /// TRUE if the ADC is converting continuously.
+    BOOL m_continuous;
+
+    /// The pin the ALERT/RDY output is connected to in continuous mode.
+    ULONG m_readyPin;
+
+    /// The function called with each result in continuous mode.
+    std::function<void(ULONG, ULONGLONG)> m_readyCallback;
+
+    /// Lock held while a result is read and passed to the callback, so the ALERT/RDY
+    /// interrupt handler and the check made after attaching it deliver one at a time.
+    SRWLOCK m_readyLock;
+
+    /// The high resolution timer reading of the last ALERT/RDY assertion handled.  Edges
+    /// from before this reading have already been delivered.  0 if none has been handled.
+    ULONGLONG m_readyHandledTicks;
+
+    /// Method to build the Configuration Register contents for a single-shot conversion.
+    /**
+    \param[in] channel Number of channel on ADC to convert.
+    \param[out] configH The Configuration Register MSByte.
+    \param[out] configL The Configuration Register LSByte.
+    \return HRESULT success or error code.
+    */
+    inline HRESULT _buildConfig(ULONG channel, CONFIG_REG_H & configH, CONFIG_REG_L & configL)
+    {
+        HRESULT hr = S_OK;
+
+        configH.ALL_BITS = CONFIG_REG_INIT_H;
+        configL.ALL_BITS = CONFIG_REG_INIT_L;
+        configH.PGA = m_gain;
+        configL.DR = m_dataRate;
+        switch (channel)
+        {
+        case 0:
+            configH.MUX = ANI0;
+            break;
+        case 1:
+            configH.MUX = ANI1;
+            break;
+        case 2:
+            configH.MUX = ANI2;
+            break;
+        case 3:
+            configH.MUX = ANI3;
+            break;
+        default:
+            hr = DMAP_E_ADC_DOES_NOT_HAVE_REQUESTED_CHANNEL;
+        }
+
+        return hr;
+    }
+
+    /// Method to start continuous conversions with the comparator set up as specified.
+    /**
+    \param[in] channel Number of channel on ADC to convert.
+    \param[in] alertPin The GPIO pin the ALERT/RDY output is connected to, or
+    ADS1015_NO_READY_PIN if it is not used.
+    \param[in] hiThresh The value for the high threshold register.
+    \param[in] loThresh The value for the low threshold register.
+    \param[in] compMode The comparator mode.
+    \param[in] compLat TRUE for a latching comparator.
+    \param[in] compQue The comparator queue setting, COMP_QUE_DISABLE to turn it off.
+    \param[in] callback The function called from the ALERT/RDY interrupt.
+    \return HRESULT success or error code.
+    */
+    inline HRESULT _startContinuous(ULONG channel, ULONG alertPin, ULONG hiThresh, ULONG loThresh,
+        ULONG compMode, BOOL compLat, ULONG compQue, std::function<void(ULONG, ULONGLONG)> callback)
+    {
+        HRESULT hr = S_OK;
+        CONFIG_REG_H configH;
+        CONFIG_REG_L configL;
+        BOOL settingUp = FALSE;
+        ULONG pinState = HIGH;
+        ULONG value = 0;
+        ULONG bits = 0;
+        LARGE_INTEGER eventTime;
+
+        if (m_continuous)
+        {
+            hr = DMAP_E_ADC_IN_CONTINUOUS_MODE;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            settingUp = TRUE;
+            hr = _buildConfig(channel, configH, configL);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            configL.COMP_MODE = compMode;
+            configL.COMP_POL = 0;           // ALERT/RDY active low
+            configL.COMP_LAT = compLat ? 1 : 0;
+            configL.COMP_QUE = compQue;
+        }
+
+        if (SUCCEEDED(hr) && (alertPin != ADS1015_NO_READY_PIN))
+        {
+            hr = _writeRegister(HI_THRESH_REG_ADR, hiThresh);
+
+            if (SUCCEEDED(hr))
+            {
+                hr = _writeRegister(LO_THRESH_REG_ADR, loThresh);
+            }
+
+            // The ALERT/RDY output is open drain.
+            if (SUCCEEDED(hr))
+            {
+                hr = g_pins.setPinMode(alertPin, DIRECTION_IN, TRUE);
+            }
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            // Start the conversions, then leave the register pointer on the conversion
+            // register so each result can be read without writing the pointer first.
+            configH.MODE = 0;               // Continuous conversion mode
+            hr = _writeRegister(CONFIG_REG_ADR, (configH.ALL_BITS << 8) | configL.ALL_BITS);
+
+            if (SUCCEEDED(hr))
+            {
+                m_continuous = TRUE;
+                hr = _setPointer(CONVERSION_REG_ADR);
+            }
+        }
+
+        // Attach the ALERT/RDY interrupt only once the pointer is on the conversion register,
+        // so the first read done by the handler gets a result, not the config register.
+        if (SUCCEEDED(hr) && (alertPin != ADS1015_NO_READY_PIN))
+        {
+            m_readyCallback = callback;
+            m_readyHandledTicks = 0;
+            hr = g_pins.attachInterruptEx((uint8_t)alertPin,
+                [this](PDMAP_WAIT_INTERRUPT_NOTIFY_BUFFER info)
+                {
+                    ULONG value = 0;
+                    ULONG bits = 0;
+
+                    AcquireSRWLockExclusive(&m_readyLock);
+
+                    // Skip an edge that was already handled after the interrupt was attached.
+                    if ((info->EventTime >= m_readyHandledTicks) && SUCCEEDED(readContinuous(value, bits)) && m_readyCallback)
+                    {
+                        m_readyHandledTicks = info->EventTime;
+                        m_readyCallback(value, info->EventTime);
+                    }
+
+                    ReleaseSRWLockExclusive(&m_readyLock);
+                },
+                FALLING);
+
+            if (SUCCEEDED(hr))
+            {
+                m_readyPin = alertPin;
+            }
+
+            // ALERT/RDY may have asserted before the interrupt was attached, in which case
+            // there will be no falling edge until a result has been read.  The check is made
+            // under the handler's lock, and only if the handler has not delivered a result yet.
+            if (SUCCEEDED(hr))
+            {
+                AcquireSRWLockExclusive(&m_readyLock);
+
+                if (m_readyHandledTicks == 0)
+                {
+                    QueryPerformanceCounter(&eventTime);
+                    hr = g_pins.getPinState(alertPin, pinState);
+
+                    if (SUCCEEDED(hr) && (pinState == LOW) && SUCCEEDED(readContinuous(value, bits)))
+                    {
+                        m_readyHandledTicks = eventTime.QuadPart;
+                        m_readyCallback(value, eventTime.QuadPart);
+                    }
+                }
+
+                ReleaseSRWLockExclusive(&m_readyLock);
+            }
+        }
+
+        // If continuous conversions could not be fully set up, undo what was done.
+        if (FAILED(hr) && settingUp)
+        {
+            stopContinuous();
+        }
+
+        return hr;
+    }
+
+    /// Method to convert a reading to a threshold register value.
+    /**
+    \param[in] threshold A value in the units of the values readValue() returns.
+    \return The threshold register value that matches the reading at the current gain.
+    */
+    inline ULONG _thresholdRegister(ULONG threshold)
+    {
+        ULONG value;
+
+        // Undo the scaling done by _scaleReading().
+        value = ((threshold * 5000) + (FULL_SCALE_MV[m_gain & 0x7] / 2)) / FULL_SCALE_MV[m_gain & 0x7];
+        if (value >= (1UL << ADC_BITS))
+        {
+            value = (1UL << ADC_BITS) - 1;
+        }
+
+        return value << DATA_SHIFT;
+    }
+
+    /// Method to write a 16-bit register of the ADC.
+    /**
+    \param[in] regAdr The address of the register.
+    \param[in] value The value to write to the register.
+    \return HRESULT success or error code.
+    */
+    inline HRESULT _writeRegister(BYTE regAdr, ULONG value)
+    {
+        HRESULT hr;
+        I2cTransactionClass transaction;
+        BYTE writeData[3] = { regAdr, (BYTE)(value >> 8), (BYTE)value };
+
+        hr = transaction.setAddress(ADC_I2C_ADR);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = transaction.queueWrite(writeData, 3);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = transaction.execute(g_i2c.getController());
+        }
+
+        return hr;
+    }
+
+    /// Method to set the register address pointer of the ADC for following reads.
+    /**
+    \param[in] regAdr The address of the register.
+    \return HRESULT success or error code.
+    */
+    inline HRESULT _setPointer(BYTE regAdr)
+    {
+        HRESULT hr;
+        I2cTransactionClass transaction;
+
+        hr = transaction.setAddress(ADC_I2C_ADR);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = transaction.queueWrite(&regAdr, 1);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = transaction.execute(g_i2c.getController());
+        }
+
+        return hr;
+    }
+
+    /// Method to convert the contents of the conversion register to a reading.
+    /**
+    \param[in] conversionData The two bytes read from the conversion register.
+    \return The reading, scaled as though the ADC had a 5.000 volt full scale range.
+    */
+    inline ULONG _scaleReading(BYTE conversionData[2])
+    {
+        ULONG value;
+
+        value = conversionData[0] << 8;
+        value = value | conversionData[1];
+        // Extract the reading from the data sent back from the ADC.
+        value = value >> DATA_SHIFT;
+        // This is a signed ADC, so make sure the result is not negative.
+        if ((value & (1 << ADC_BITS)) != 0)
+        {
+            value = 0;
+        }
+        // Scale the ADC for its full-scale value not being 5.000 volts.
+        value = ((value * FULL_SCALE_MV[m_gain & 0x7]) + 2500) / 5000;
+
+        return value;
+    }
 };
 
+__declspec(selectany) const ULONG ADS1015Device::FULL_SCALE_MV[8] = { 6144, 4096, 2048, 1024, 512, 256, 256, 256 };
+
 #endif  // _ADS1015_SUPPORT_H_
\ No newline at end of file
@@ -0,0 +1,634 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#include "pch.h"
+
+#include <algorithm>
+
+#include "AdcFilter.h"
+#include "ErrorCodes.h"
+
+//
+// Four channel vector operations, mapped onto SSE2 or NEON.
+//
+// The filters keep the channels of each sample side by side, so one vector operation
+// filters four channels.  Loads and stores do not need to be aligned.
+//
+
+#if defined(_M_IX86) || defined(_M_X64)
+
+#include <emmintrin.h>
+
+typedef __m128 FLOAT4;
+typedef __m128i INT4;
+
+static inline FLOAT4 loadFloat4(const float* p) { return _mm_loadu_ps(p); }
+static inline void storeFloat4(float* p, FLOAT4 v) { _mm_storeu_ps(p, v); }
+static inline FLOAT4 splatFloat4(float f) { return _mm_set1_ps(f); }
+static inline FLOAT4 addFloat4(FLOAT4 a, FLOAT4 b) { return _mm_add_ps(a, b); }
+static inline FLOAT4 subFloat4(FLOAT4 a, FLOAT4 b) { return _mm_sub_ps(a, b); }
+static inline FLOAT4 mulFloat4(FLOAT4 a, FLOAT4 b) { return _mm_mul_ps(a, b); }
+static inline FLOAT4 mulAddFloat4(FLOAT4 acc, FLOAT4 a, FLOAT4 b) { return _mm_add_ps(acc, _mm_mul_ps(a, b)); }
+static inline FLOAT4 minFloat4(FLOAT4 a, FLOAT4 b) { return _mm_min_ps(a, b); }
+static inline FLOAT4 maxFloat4(FLOAT4 a, FLOAT4 b) { return _mm_max_ps(a, b); }
+static inline INT4 loadInt4(const ULONG* p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void storeInt4(ULONG* p, INT4 v) { _mm_storeu_si128((__m128i*)p, v); }
+static inline INT4 addInt4(INT4 a, INT4 b) { return _mm_add_epi32(a, b); }
+static inline INT4 subInt4(INT4 a, INT4 b) { return _mm_sub_epi32(a, b); }
+static inline FLOAT4 intToFloat4(INT4 v) { return _mm_cvtepi32_ps(v); }
+static inline INT4 floatToInt4(FLOAT4 v) { return _mm_cvttps_epi32(v); }
+
+#elif defined(_M_ARM)
+
+#include <arm_neon.h>
+
+typedef float32x4_t FLOAT4;
+typedef uint32x4_t INT4;
+
+static inline FLOAT4 loadFloat4(const float* p) { return vld1q_f32(p); }
+static inline void storeFloat4(float* p, FLOAT4 v) { vst1q_f32(p, v); }
+static inline FLOAT4 splatFloat4(float f) { return vdupq_n_f32(f); }
+static inline FLOAT4 addFloat4(FLOAT4 a, FLOAT4 b) { return vaddq_f32(a, b); }
+static inline FLOAT4 subFloat4(FLOAT4 a, FLOAT4 b) { return vsubq_f32(a, b); }
+static inline FLOAT4 mulFloat4(FLOAT4 a, FLOAT4 b) { return vmulq_f32(a, b); }
+static inline FLOAT4 mulAddFloat4(FLOAT4 acc, FLOAT4 a, FLOAT4 b) { return vmlaq_f32(acc, a, b); }
+static inline FLOAT4 minFloat4(FLOAT4 a, FLOAT4 b) { return vminq_f32(a, b); }
+static inline FLOAT4 maxFloat4(FLOAT4 a, FLOAT4 b) { return vmaxq_f32(a, b); }
+static inline INT4 loadInt4(const ULONG* p) { return vld1q_u32((const uint32_t*)p); }
+static inline void storeInt4(ULONG* p, INT4 v) { vst1q_u32((uint32_t*)p, v); }
+static inline INT4 addInt4(INT4 a, INT4 b) { return vaddq_u32(a, b); }
+static inline INT4 subInt4(INT4 a, INT4 b) { return vsubq_u32(a, b); }
+static inline FLOAT4 intToFloat4(INT4 v) { return vcvtq_f32_s32(vreinterpretq_s32_u32(v)); }
+static inline INT4 floatToInt4(FLOAT4 v) { return vreinterpretq_u32_s32(vcvtq_s32_f32(v)); }
+
+#endif // defined(_M_ARM)
+
+// Convert four channels of a filter output to ADC readings, rounded to the nearest
+// whole value and limited to values that are not negative.
+static inline void storeReadings(ULONG* p, FLOAT4 v)
+{
+    v = maxFloat4(v, splatFloat4(0.0f));
+    storeInt4(p, floatToInt4(addFloat4(v, splatFloat4(0.5f))));
+}
+
+// Get four channels of an ADC sample as floating point values.
+static inline FLOAT4 loadReadings(const ULONG* p)
+{
+    return intToFloat4(loadInt4(p));
+}
+
+// Constructor.
+AdcFilterClass::AdcFilterClass() :
+    m_type(NO_FILTER),
+    m_length(0),
+    m_decimation(1),
+    m_phase(0),
+    m_position(0),
+    m_sequence(0),
+    m_scale(1.0f),
+    m_alpha(1.0f),
+    m_primed(FALSE)
+{
+}
+
+/**
+Each output is the average of the last "length" input samples.  The sums are kept with
+integer arithmetic, so they do not drift however long the stream is.
+\param[in] length The number of input samples averaged.
+\param[in] decimation The number of input samples for each output sample.
+\return HRESULT success or error code.
+*/
+HRESULT AdcFilterClass::setMovingAverage(ULONG length, ULONG decimation)
+{
+    HRESULT hr = S_OK;
+
+    hr = _setFilter(MOVING_AVERAGE_FILTER, length, ADC_FILTER_MAX_LENGTH, decimation);
+
+    if (SUCCEEDED(hr))
+    {
+        m_scale = 1.0f / (float)length;
+        m_intHistory.assign(length * ADC_SAMPLER_MAX_CHANNELS, 0);
+        m_intState.assign(ADC_SAMPLER_MAX_CHANNELS, 0);
+    }
+
+    return hr;
+}
+
+/**
+A Cascaded Integrator-Comb filter decimates with only additions and subtractions: the
+integrators run at the input rate and the combs at the output rate.  The output is
+scaled by the filter gain (decimation raised to the power of the order) so it is in the
+units of the input.
+\param[in] order The number of integrator and comb stages (1 to ADC_FILTER_MAX_CIC_ORDER).
+\param[in] decimation The number of input samples for each output sample.
+\return HRESULT success or error code.
+*/
+HRESULT AdcFilterClass::setCic(ULONG order, ULONG decimation)
+{
+    HRESULT hr = S_OK;
+    ULONGLONG gain = 1;
+
+    hr = _setFilter(CIC_FILTER, order, ADC_FILTER_MAX_CIC_ORDER, decimation);
+
+    if (SUCCEEDED(hr))
+    {
+        for (ULONG i = 0; i < order; i++)
+        {
+            gain = gain * decimation;
+        }
+
+        if (gain > ADC_FILTER_MAX_CIC_GAIN)
+        {
+            m_type = NO_FILTER;
+            hr = DMAP_E_ADC_FILTER_SETTING_INVALID;
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_scale = 1.0f / (float)gain;
+
+        // The integrators come first, then the comb delays.
+        m_intState.assign(2 * order * ADC_SAMPLER_MAX_CHANNELS, 0);
+    }
+
+    return hr;
+}
+
+/**
+Each output is the sum of the last "tapCount" input samples multiplied by the taps, the
+newest sample by taps[0].  The output is only calculated for the input samples that
+produce an output sample, so decimation reduces the work done.
+\param[in] taps The filter coefficients.
+\param[in] tapCount The number of coefficients (1 to ADC_FILTER_MAX_LENGTH).
+\param[in] decimation The number of input samples for each output sample.
+\return HRESULT success or error code.
+*/
+HRESULT AdcFilterClass::setFir(const float* taps, ULONG tapCount, ULONG decimation)
+{
+    HRESULT hr = S_OK;
+
+    if (taps == nullptr)
+    {
+        hr = E_POINTER;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = _setFilter(FIR_FILTER, tapCount, ADC_FILTER_MAX_LENGTH, decimation);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // Store the taps oldest sample first, to match the order of the history.
+        m_taps.resize(tapCount * 4);
+        for (ULONG i = 0; i < tapCount; i++)
+        {
+            for (ULONG j = 0; j < 4; j++)
+            {
+                m_taps[(i * 4) + j] = taps[tapCount - 1 - i];
+            }
+        }
+
+        // Each sample is stored twice, "tapCount" entries apart, so the last "tapCount"
+        // samples are always in consecutive entries.
+        m_history.assign(2 * tapCount * ADC_SAMPLER_MAX_CHANNELS, 0.0f);
+    }
+
+    return hr;
+}
+
+/**
+Each output moves from the last output toward the input sample by "alpha" times the
+difference between them.  The filter starts from the first input sample.
+\param[in] alpha The filter coefficient, greater than 0.0 and no more than 1.0.
+\param[in] decimation The number of input samples for each output sample.
+\return HRESULT success or error code.
+*/
+HRESULT AdcFilterClass::setIir(float alpha, ULONG decimation)
+{
+    HRESULT hr = S_OK;
+
+    if (!((alpha > 0.0f) && (alpha <= 1.0f)))
+    {
+        hr = DMAP_E_ADC_FILTER_SETTING_INVALID;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = _setFilter(IIR_FILTER, 1, 1, decimation);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_alpha = alpha;
+        m_state.assign(ADC_SAMPLER_MAX_CHANNELS, 0.0f);
+    }
+
+    return hr;
+}
+
+/**
+Each output is the median of the last "length" input samples, which removes spikes
+shorter than half the window.
+\param[in] length The number of input samples in the window, an odd number no more
+than ADC_FILTER_MAX_MEDIAN_LENGTH.
+\param[in] decimation The number of input samples for each output sample.
+\return HRESULT success or error code.
+*/
+HRESULT AdcFilterClass::setMedian(ULONG length, ULONG decimation)
+{
+    HRESULT hr = S_OK;
+
+    if ((length & 1) == 0)
+    {
+        hr = DMAP_E_ADC_FILTER_SETTING_INVALID;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = _setFilter(MEDIAN_FILTER, length, ADC_FILTER_MAX_MEDIAN_LENGTH, decimation);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_history.assign(length * ADC_SAMPLER_MAX_CHANNELS, 0.0f);
+    }
+
+    return hr;
+}
+
+/**
+Clears the past samples, so the filter output starts again as it would with a new
+stream.  The filter settings are not changed.
+*/
+void AdcFilterClass::reset()
+{
+    m_phase = 0;
+    m_position = 0;
+    m_sequence = 0;
+    m_primed = FALSE;
+
+    std::fill(m_history.begin(), m_history.end(), 0.0f);
+    std::fill(m_intHistory.begin(), m_intHistory.end(), 0);
+    std::fill(m_intState.begin(), m_intState.end(), 0);
+    std::fill(m_state.begin(), m_state.end(), 0.0f);
+}
+
+/**
+All the channels of each sample are filtered, whether they were read or not.  Each output
+sample has the timer reading of the input sample that completed it, and a sequence number
+that counts the output samples.  Input samples are used until the output array is full,
+so the samples not used can be passed in again with the next call.
+\param[in] input The samples to filter, oldest first.
+\param[in] inputCount The number of samples to filter.
+\param[out] output The array the filtered samples are stored in.
+\param[in] maxOutput The number of entries in the output array.
+\param[out] inputUsed The number of input samples used.
+\param[out] outputCount The number of samples stored in the output array.
+\return HRESULT success or error code.
+*/
+HRESULT AdcFilterClass::process(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output, ULONG maxOutput, ULONG & inputUsed, ULONG & outputCount)
+{
+    HRESULT hr = S_OK;
+    ULONGLONG usable;
+
+    inputUsed = 0;
+    outputCount = 0;
+
+    if (m_type == NO_FILTER)
+    {
+        hr = DMAP_E_ADC_FILTER_NOT_SET;
+    }
+
+    if (SUCCEEDED(hr) && (((input == nullptr) && (inputCount > 0)) || ((output == nullptr) && (maxOutput > 0))))
+    {
+        hr = E_POINTER;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // Use the input samples up to (but not including) the one that would complete an
+        // output sample there is no room for.
+        usable = ((ULONGLONG)maxOutput * m_decimation) + (m_decimation - 1 - m_phase);
+        inputUsed = (ULONG)min((ULONGLONG)inputCount, usable);
+
+        switch (m_type)
+        {
+        case MOVING_AVERAGE_FILTER:
+            outputCount = _runMovingAverage(input, inputUsed, output);
+            break;
+        case CIC_FILTER:
+            outputCount = _runCic(input, inputUsed, output);
+            break;
+        case FIR_FILTER:
+            outputCount = _runFir(input, inputUsed, output);
+            break;
+        case IIR_FILTER:
+            outputCount = _runIir(input, inputUsed, output);
+            break;
+        case MEDIAN_FILTER:
+            outputCount = _runMedian(input, inputUsed, output);
+            break;
+        default:
+            hr = DMAP_E_DMAP_INTERNAL_ERROR;
+        }
+    }
+
+    return hr;
+}
+
+/**
+\param[in] type The type of filter.
+\param[in] length The window length, number of FIR taps, or CIC order.
+\param[in] maxLength The largest length supported for this type of filter.
+\param[in] decimation The number of input samples for each output sample.
+\return HRESULT success or error code.
+*/
+HRESULT AdcFilterClass::_setFilter(FILTER_TYPE type, ULONG length, ULONG maxLength, ULONG decimation)
+{
+    HRESULT hr = S_OK;
+
+    m_type = NO_FILTER;
+
+    if ((length == 0) || (length > maxLength) || (decimation == 0) || (decimation > ADC_FILTER_MAX_DECIMATION))
+    {
+        hr = DMAP_E_ADC_FILTER_SETTING_INVALID;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_history.clear();
+        m_intHistory.clear();
+        m_intState.clear();
+        m_state.clear();
+        m_taps.clear();
+
+        m_type = type;
+        m_length = length;
+        m_decimation = decimation;
+        m_scale = 1.0f;
+        reset();
+    }
+
+    return hr;
+}
+
+/**
+\param[in] input The samples to filter.
+\param[in] inputCount The number of samples to filter.
+\param[out] output The array the filtered samples are stored in.
+\return The number of samples stored in the output array.
+*/
+ULONG AdcFilterClass::_runMovingAverage(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output)
+{
+    ULONG outputCount = 0;
+    ULONG* oldest;
+    FLOAT4 scale = splatFloat4(m_scale);
+    INT4 value;
+
+    for (ULONG i = 0; i < inputCount; i++)
+    {
+        // Replace the oldest sample in the sums with the new one.
+        oldest = &m_intHistory[m_position * ADC_SAMPLER_MAX_CHANNELS];
+        for (ULONG ch = 0; ch < ADC_SAMPLER_MAX_CHANNELS; ch += 4)
+        {
+            value = loadInt4(&input[i].values[ch]);
+            storeInt4(&m_intState[ch], addInt4(subInt4(loadInt4(&m_intState[ch]), loadInt4(&oldest[ch])), value));
+            storeInt4(&oldest[ch], value);
+        }
+
+        m_position++;
+        if (m_position == m_length)
+        {
+            m_position = 0;
+        }
+
+        if (_outputDue(input[i], &output[outputCount]))
+        {
+            for (ULONG ch = 0; ch < ADC_SAMPLER_MAX_CHANNELS; ch += 4)
+            {
+                storeReadings(&output[outputCount].values[ch], mulFloat4(intToFloat4(loadInt4(&m_intState[ch])), scale));
+            }
+            outputCount++;
+        }
+    }
+
+    return outputCount;
+}
+
+/**
+The integrators are allowed to wrap around; the comb outputs are still correct since the
+filter gain has been limited to keep them within 31 bits.
+\param[in] input The samples to filter.
+\param[in] inputCount The number of samples to filter.
+\param[out] output The array the filtered samples are stored in.
+\return The number of samples stored in the output array.
+*/
+ULONG AdcFilterClass::_runCic(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output)
+{
+    ULONG outputCount = 0;
+    ULONG* integrators = &m_intState[0];
+    ULONG* delays = &m_intState[m_length * ADC_SAMPLER_MAX_CHANNELS];
+    FLOAT4 scale = splatFloat4(m_scale);
+    INT4 value;
+    INT4 last;
+
+    for (ULONG i = 0; i < inputCount; i++)
+    {
+        for (ULONG ch = 0; ch < ADC_SAMPLER_MAX_CHANNELS; ch += 4)
+        {
+            value = loadInt4(&input[i].values[ch]);
+            for (ULONG stage = 0; stage < m_length; stage++)
+            {
+                value = addInt4(loadInt4(&integrators[(stage * ADC_SAMPLER_MAX_CHANNELS) + ch]), value);
+                storeInt4(&integrators[(stage * ADC_SAMPLER_MAX_CHANNELS) + ch], value);
+            }
+        }
+
+        if (_outputDue(input[i], &output[outputCount]))
+        {
+            for (ULONG ch = 0; ch < ADC_SAMPLER_MAX_CHANNELS; ch += 4)
+            {
+                value = loadInt4(&integrators[((m_length - 1) * ADC_SAMPLER_MAX_CHANNELS) + ch]);
+                for (ULONG stage = 0; stage < m_length; stage++)
+                {
+                    last = loadInt4(&delays[(stage * ADC_SAMPLER_MAX_CHANNELS) + ch]);
+                    storeInt4(&delays[(stage * ADC_SAMPLER_MAX_CHANNELS) + ch], value);
+                    value = subInt4(value, last);
+                }
+                storeReadings(&output[outputCount].values[ch], mulFloat4(intToFloat4(value), scale));
+            }
+            outputCount++;
+        }
+    }
+
+    return outputCount;
+}
+
+/**
+\param[in] input The samples to filter.
+\param[in] inputCount The number of samples to filter.
+\param[out] output The array the filtered samples are stored in.
+\return The number of samples stored in the output array.
+*/
+ULONG AdcFilterClass::_runFir(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output)
+{
+    ULONG outputCount = 0;
+    float* newest;
+    const float* window;
+    FLOAT4 value;
+    FLOAT4 sum;
+
+    for (ULONG i = 0; i < inputCount; i++)
+    {
+        newest = &m_history[m_position * ADC_SAMPLER_MAX_CHANNELS];
+        for (ULONG ch = 0; ch < ADC_SAMPLER_MAX_CHANNELS; ch += 4)
+        {
+            value = loadReadings(&input[i].values[ch]);
+            storeFloat4(&newest[ch], value);
+            storeFloat4(&newest[(m_length * ADC_SAMPLER_MAX_CHANNELS) + ch], value);
+        }
+
+        if (_outputDue(input[i], &output[outputCount]))
+        {
+            // The window starts with the oldest sample, one entry after the newest.
+            window = &m_history[(m_position + 1) * ADC_SAMPLER_MAX_CHANNELS];
+            for (ULONG ch = 0; ch < ADC_SAMPLER_MAX_CHANNELS; ch += 4)
+            {
+                sum = splatFloat4(0.0f);
+                for (ULONG tap = 0; tap < m_length; tap++)
+                {
+                    sum = mulAddFloat4(sum, loadFloat4(&window[(tap * ADC_SAMPLER_MAX_CHANNELS) + ch]), loadFloat4(&m_taps[tap * 4]));
+                }
+                storeReadings(&output[outputCount].values[ch], sum);
+            }
+            outputCount++;
+        }
+
+        m_position++;
+        if (m_position == m_length)
+        {
+            m_position = 0;
+        }
+    }
+
+    return outputCount;
+}
+
+/**
+\param[in] input The samples to filter.
+\param[in] inputCount The number of samples to filter.
+\param[out] output The array the filtered samples are stored in.
+\return The number of samples stored in the output array.
+*/
+ULONG AdcFilterClass::_runIir(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output)
+{
+    ULONG outputCount = 0;
+    FLOAT4 alpha = splatFloat4(m_alpha);
+    FLOAT4 value;
+    FLOAT4 state;
+
+    for (ULONG i = 0; i < inputCount; i++)
+    {
+        for (ULONG ch = 0; ch < ADC_SAMPLER_MAX_CHANNELS; ch += 4)
+        {
+            value = loadReadings(&input[i].values[ch]);
+            state = m_primed ? loadFloat4(&m_state[ch]) : value;
+            storeFloat4(&m_state[ch], mulAddFloat4(state, alpha, subFloat4(value, state)));
+        }
+        m_primed = TRUE;
+
+        if (_outputDue(input[i], &output[outputCount]))
+        {
+            for (ULONG ch = 0; ch < ADC_SAMPLER_MAX_CHANNELS; ch += 4)
+            {
+                storeReadings(&output[outputCount].values[ch], loadFloat4(&m_state[ch]));
+            }
+            outputCount++;
+        }
+    }
+
+    return outputCount;
+}
+
+/**
+The median is found by sorting the window with a network of minimum and maximum
+operations, which sorts four channels at once without any branches.
+\param[in] input The samples to filter.
+\param[in] inputCount The number of samples to filter.
+\param[out] output The array the filtered samples are stored in.
+\return The number of samples stored in the output array.
+*/
+ULONG AdcFilterClass::_runMedian(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output)
+{
+    ULONG outputCount = 0;
+    float* newest;
+    FLOAT4 window[ADC_FILTER_MAX_MEDIAN_LENGTH];
+    FLOAT4 low;
+
+    for (ULONG i = 0; i < inputCount; i++)
+    {
+        newest = &m_history[m_position * ADC_SAMPLER_MAX_CHANNELS];
+        for (ULONG ch = 0; ch < ADC_SAMPLER_MAX_CHANNELS; ch += 4)
+        {
+            storeFloat4(&newest[ch], loadReadings(&input[i].values[ch]));
+        }
+
+        m_position++;
+        if (m_position == m_length)
+        {
+            m_position = 0;
+        }
+
+        if (_outputDue(input[i], &output[outputCount]))
+        {
+            for (ULONG ch = 0; ch < ADC_SAMPLER_MAX_CHANNELS; ch += 4)
+            {
+                for (ULONG j = 0; j < m_length; j++)
+                {
+                    window[j] = loadFloat4(&m_history[(j * ADC_SAMPLER_MAX_CHANNELS) + ch]);
+                }
+
+                // Odd-even transposition sort: "length" passes sort "length" values.
+                for (ULONG pass = 0; pass < m_length; pass++)
+                {
+                    for (ULONG j = (pass & 1); (j + 1) < m_length; j += 2)
+                    {
+                        low = minFloat4(window[j], window[j + 1]);
+                        window[j + 1] = maxFloat4(window[j], window[j + 1]);
+                        window[j] = low;
+                    }
+                }
+
+                storeReadings(&output[outputCount].values[ch], window[m_length / 2]);
+            }
+            outputCount++;
+        }
+    }
+
+    return outputCount;
+}
+
+/**
+\param[in] input The input sample just filtered.
+\param[out] output The output sample to fill in if one is due.
+\return TRUE if an output sample is due, FALSE otherwise.
+*/
+BOOL AdcFilterClass::_outputDue(const ADC_SAMPLE & input, PADC_SAMPLE output)
+{
+    BOOL due = FALSE;
+
+    m_phase++;
+    if (m_phase == m_decimation)
+    {
+        m_phase = 0;
+        output->ticks = input.ticks;
+        output->sequence = m_sequence;
+        m_sequence++;
+        due = TRUE;
+    }
+
+    return due;
+}
@@ -0,0 +1,137 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#ifndef _ADC_FILTER_H_
+#define _ADC_FILTER_H_
+
+#include <Windows.h>
+#include <vector>
+
+#include "AdcSampler.h"
+
+// The longest moving average window or FIR filter supported.
+#define ADC_FILTER_MAX_LENGTH 256
+
+// The longest median filter window supported.
+#define ADC_FILTER_MAX_MEDIAN_LENGTH 15
+
+// The highest CIC filter order supported.
+#define ADC_FILTER_MAX_CIC_ORDER 5
+
+// The highest CIC filter gain (decimation raised to the power of the order) supported.
+// This keeps the integrators of a filter fed with 12-bit readings within 31 bits.
+#define ADC_FILTER_MAX_CIC_GAIN (1UL << 19)
+
+// The highest decimation supported.
+#define ADC_FILTER_MAX_DECIMATION 65536
+
+//
+// Class used to filter and decimate a stream of ADC samples.
+//
+// The filter works on blocks of the samples AdcSamplerClass::read() returns and filters
+// all the channels of each sample at once, four channels to a SIMD register (SSE2 on x86
+// and x64, NEON on ARM).  Filters can be cascaded by passing the output of one filter
+// to another, for example a CIC filter to decimate an oversampled stream followed by a
+// FIR filter to flatten the pass band.  Each filter keeps its state between calls to
+// process(), so a stream can be filtered one block at a time.
+//
+class AdcFilterClass
+{
+public:
+    LIGHTNING_DLL_API AdcFilterClass();
+
+    virtual ~AdcFilterClass()
+    {
+    }
+
+    /// Set the filter up as a moving average.
+    LIGHTNING_DLL_API HRESULT setMovingAverage(ULONG length, ULONG decimation);
+
+    /// Set the filter up as a decimating CIC filter.
+    LIGHTNING_DLL_API HRESULT setCic(ULONG order, ULONG decimation);
+
+    /// Set the filter up as a FIR filter.
+    LIGHTNING_DLL_API HRESULT setFir(const float* taps, ULONG tapCount, ULONG decimation);
+
+    /// Set the filter up as a single pole IIR (exponential smoothing) filter.
+    LIGHTNING_DLL_API HRESULT setIir(float alpha, ULONG decimation);
+
+    /// Set the filter up as a median filter.
+    LIGHTNING_DLL_API HRESULT setMedian(ULONG length, ULONG decimation);
+
+    /// Clear the filter state, so the next sample starts a new stream.
+    LIGHTNING_DLL_API void reset();
+
+    /// Filter a block of samples.
+    LIGHTNING_DLL_API HRESULT process(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output, ULONG maxOutput, ULONG & inputUsed, ULONG & outputCount);
+
+private:
+
+    /// The types of filter.
+    typedef enum {
+        NO_FILTER,
+        MOVING_AVERAGE_FILTER,
+        CIC_FILTER,
+        FIR_FILTER,
+        IIR_FILTER,
+        MEDIAN_FILTER
+    } FILTER_TYPE;
+
+    /// The type of filter this object has been set up as.
+    FILTER_TYPE m_type;
+
+    /// The window length, number of FIR taps, or CIC order.
+    ULONG m_length;
+
+    /// The number of input samples for each output sample.
+    ULONG m_decimation;
+
+    /// The number of input samples taken since the last output sample.
+    ULONG m_phase;
+
+    /// The history entry the next input sample is stored in.
+    ULONG m_position;
+
+    /// The sequence number for the next output sample.
+    ULONG m_sequence;
+
+    /// The factor that scales the filter output to the units of the input.
+    float m_scale;
+
+    /// The IIR filter coefficient.
+    float m_alpha;
+
+    /// TRUE once the IIR filter has been started with a sample.
+    BOOL m_primed;
+
+    /// The FIR taps in reverse order, each repeated once for each channel in a SIMD register.
+    std::vector<float> m_taps;
+
+    /// Past input samples (FIR and median filters), ADC_SAMPLER_MAX_CHANNELS values per sample.
+    std::vector<float> m_history;
+
+    /// Past input samples (moving average filter), ADC_SAMPLER_MAX_CHANNELS values per sample.
+    std::vector<ULONG> m_intHistory;
+
+    /// Running sums, integrators and comb delays, ADC_SAMPLER_MAX_CHANNELS values per stage.
+    std::vector<ULONG> m_intState;
+
+    /// The IIR filter outputs, one for each channel.
+    std::vector<float> m_state;
+
+    // Method to check and store the settings common to all filters.
+    HRESULT _setFilter(FILTER_TYPE type, ULONG length, ULONG maxLength, ULONG decimation);
+
+    // Methods to run each type of filter over a block of samples.
+    ULONG _runMovingAverage(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output);
+    ULONG _runCic(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output);
+    ULONG _runFir(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output);
+    ULONG _runIir(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output);
+    ULONG _runMedian(const ADC_SAMPLE* input, ULONG inputCount, PADC_SAMPLE output);
+
+    // Method to count an input sample, and start an output sample if one is due.
+    BOOL _outputDue(const ADC_SAMPLE & input, PADC_SAMPLE output);
+};
+
+#endif  // _ADC_FILTER_H_
@@ -0,0 +1,410 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#include "pch.h"
+
+#include <new>
+#include <system_error>
+
+#include "AdcSampler.h"
+#include "ErrorCodes.h"
+#include "HiResTimer.h"
+
+// Constructor.
+AdcSamplerClass::AdcSamplerClass() :
+    m_adcType(NO_ADC),
+    m_mcp3008(nullptr),
+    m_ads1015(nullptr),
+    m_channelCount(0),
+    m_rateHz(0),
+    m_startTicks(0),
+    m_writeCount(0),
+    m_readCount(0),
+    m_samples(0),
+    m_overruns(0),
+    m_missedPeriods(0),
+    m_errors(0),
+    m_lastError(S_OK),
+    m_totalJitterTicks(0),
+    m_maxJitterTicks(0),
+    m_stopRequested(FALSE)
+{
+    ZeroMemory(m_channels, sizeof(m_channels));
+    QueryPerformanceFrequency(&m_frequency);
+}
+
+/**
+The MCP3008 must already have been prepared with begin().  All the channels in the
+channel mask are converted with one use of the SPI bus for each sample.
+\param[in] adc The ADC to sample.
+\param[in] channelMask Bit n is set to read channel n in each sample.  For an array of
+chips, channel n is channel (n % 8) of chip (n / 8).
+\param[in] rateHz The number of samples to take per second.
+\param[in] bufferSamples The number of samples the buffer holds, 0 for the default.
+\return HRESULT success or error code.
+*/
+HRESULT AdcSamplerClass::begin(MCP3008Device* adc, ULONGLONG channelMask, ULONG rateHz, ULONG bufferSamples)
+{
+    HRESULT hr = S_OK;
+
+    if (adc == nullptr)
+    {
+        hr = E_POINTER;
+    }
+
+    // Don't change the ADC of a sampler that is already running.
+    if (SUCCEEDED(hr) && m_thread.joinable())
+    {
+        hr = DMAP_E_ADC_SAMPLER_RUNNING;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_adcType = MCP3008_ADC;
+        m_mcp3008 = adc;
+        m_ads1015 = nullptr;
+
+        hr = _start(adc->getChannelCount(), channelMask, rateHz, bufferSamples);
+    }
+
+    return hr;
+}
+
+/**
+The ADS1015 must already have been prepared with begin().  Each channel in the channel
+mask is converted in turn for each sample.  ADS1015Device::readValue() is not thread
+safe, so the ADC must not be used by other threads while it is being sampled.
+\param[in] adc The ADC to sample.
+\param[in] channelMask Bit n is set to read channel n in each sample.
+\param[in] rateHz The number of samples to take per second.
+\param[in] bufferSamples The number of samples the buffer holds, 0 for the default.
+\return HRESULT success or error code.
+*/
+HRESULT AdcSamplerClass::begin(ADS1015Device* adc, ULONGLONG channelMask, ULONG rateHz, ULONG bufferSamples)
+{
+    HRESULT hr = S_OK;
+
+    if (adc == nullptr)
+    {
+        hr = E_POINTER;
+    }
+
+    // Don't change the ADC of a sampler that is already running.
+    if (SUCCEEDED(hr) && m_thread.joinable())
+    {
+        hr = DMAP_E_ADC_SAMPLER_RUNNING;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_adcType = ADS1015_ADC;
+        m_mcp3008 = nullptr;
+        m_ads1015 = adc;
+
+        hr = _start(ADS1015_CHANNELS, channelMask, rateHz, bufferSamples);
+    }
+
+    return hr;
+}
+
+/**
+Waits for the sampling thread to finish.  Samples still in the buffer can be read after
+sampling has stopped, until sampling is started again.
+*/
+void AdcSamplerClass::end()
+{
+    if (m_thread.joinable())
+    {
+        m_stopRequested = TRUE;
+        m_thread.join();
+    }
+}
+
+/**
+\return The number of samples that can be taken out of the buffer with read().
+*/
+ULONG AdcSamplerClass::available()
+{
+    return m_writeCount - m_readCount;
+}
+
+/**
+This method must only be called from one thread at a time.  It does not wait for samples
+to be taken.
+\param[out] samples The array the samples are copied to, oldest first.
+\param[in] maxSamples The number of entries in the array.
+\return The number of samples copied to the array.
+*/
+ULONG AdcSamplerClass::read(PADC_SAMPLE samples, ULONG maxSamples)
+{
+    ULONG count = 0;
+    ULONG readCount = m_readCount;
+    ULONG indexMask = (ULONG)m_buffer.size() - 1;
+
+    if (samples != nullptr)
+    {
+        count = min(m_writeCount - readCount, maxSamples);
+
+        // Make sure the samples are not read before the count that covers them.
+        MemoryBarrier();
+
+        for (ULONG i = 0; i < count; i++)
+        {
+            samples[i] = m_buffer[(readCount + i) & indexMask];
+        }
+
+        // Make sure the samples have been copied before their buffer entries are given back.
+        MemoryBarrier();
+
+        m_readCount = readCount + count;
+    }
+
+    return count;
+}
+
+/**
+\param[out] stats The sampler performance figures.
+*/
+void AdcSamplerClass::getStatistics(ADC_SAMPLER_STATS & stats)
+{
+    LARGE_INTEGER nowTicks;
+    LONGLONG totalJitterTicks;
+    LONGLONG maxJitterTicks;
+
+    ZeroMemory(&stats, sizeof(stats));
+
+    stats.samples = m_samples;
+    stats.overruns = m_overruns;
+    stats.missedPeriods = m_missedPeriods;
+    stats.errors = m_errors;
+    stats.lastError = m_lastError;
+
+    // Read the 64-bit values in one access, so they can't be torn by the sampling thread.
+    totalJitterTicks = InterlockedCompareExchange64(&m_totalJitterTicks, 0, 0);
+    maxJitterTicks = InterlockedCompareExchange64(&m_maxJitterTicks, 0, 0);
+
+    if (stats.samples > 0)
+    {
+        QueryPerformanceCounter(&nowTicks);
+        if (nowTicks.QuadPart > m_startTicks)
+        {
+            stats.achievedRateHz = ((double)stats.samples * (double)m_frequency.QuadPart) / (double)(nowTicks.QuadPart - m_startTicks);
+        }
+        stats.meanJitterUs = _ticksToUs(totalJitterTicks / stats.samples);
+        stats.maxJitterUs = _ticksToUs(maxJitterTicks);
+    }
+}
+
+/**
+The caller must have checked that the sampler is not already running.
+\param[in] channelCount The number of channels on the ADC.
+\param[in] channelMask Bit n is set to read channel n in each sample.
+\param[in] rateHz The number of samples to take per second.
+\param[in] bufferSamples The number of samples the buffer holds, 0 for the default.
+\return HRESULT success or error code.
+*/
+HRESULT AdcSamplerClass::_start(ULONG channelCount, ULONGLONG channelMask, ULONG rateHz, ULONG bufferSamples)
+{
+    HRESULT hr = S_OK;
+    ULONG bufferSize = 1;
+    LARGE_INTEGER startTicks;
+
+    if ((channelMask == 0) || (channelCount > ADC_SAMPLER_MAX_CHANNELS) ||
+        ((channelCount < 64) && ((channelMask & ~((1ULL << channelCount) - 1)) != 0)))
+    {
+        hr = DMAP_E_ADC_DOES_NOT_HAVE_REQUESTED_CHANNEL;
+    }
+
+    if (SUCCEEDED(hr) && ((rateHz == 0) || (rateHz > ADC_SAMPLER_MAX_RATE_HZ)))
+    {
+        hr = DMAP_E_ADC_SAMPLE_RATE_INVALID;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (bufferSamples == 0)
+        {
+            bufferSamples = ADC_SAMPLER_DEFAULT_BUFFER_SAMPLES;
+        }
+
+        // Round the buffer size up to a power of two, so the sample counts can wrap.
+        while ((bufferSize < bufferSamples) && (bufferSize < 0x80000000))
+        {
+            bufferSize = bufferSize << 1;
+        }
+
+        m_buffer.assign(bufferSize, ADC_SAMPLE());
+
+        m_channelCount = 0;
+        for (ULONG channel = 0; channel < channelCount; channel++)
+        {
+            if ((channelMask & (1ULL << channel)) != 0)
+            {
+                m_channels[m_channelCount] = channel;
+                m_channelCount++;
+            }
+        }
+        m_rateHz = rateHz;
+        m_writeCount = 0;
+        m_readCount = 0;
+        m_samples = 0;
+        m_overruns = 0;
+        m_missedPeriods = 0;
+        m_errors = 0;
+        m_lastError = S_OK;
+        m_totalJitterTicks = 0;
+        m_maxJitterTicks = 0;
+        m_stopRequested = FALSE;
+
+        QueryPerformanceCounter(&startTicks);
+        m_startTicks = startTicks.QuadPart;
+
+        // Thread creation reports failure with an exception, which must not escape from
+        // this DLL interface.
+        try
+        {
+            m_thread = std::thread(&AdcSamplerClass::_sampleLoop, this);
+        }
+        catch (const std::system_error &)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_MAX_THRDS_REACHED);
+        }
+        catch (const std::bad_alloc &)
+        {
+            hr = E_OUTOFMEMORY;
+        }
+    }
+
+    return hr;
+}
+
+/**
+Sample n is due at the start time plus n sample periods.  If the thread falls more than
+a sample period behind, the sample periods it missed are skipped (and counted) rather
+than being sampled late.
+*/
+void AdcSamplerClass::_sampleLoop()
+{
+    LARGE_INTEGER nowTicks;
+    LONGLONG dueTicks;
+    LONGLONG jitterTicks;
+    ULONGLONG period = 0;
+    ULONGLONG currentPeriod;
+    ADC_SAMPLE sample;
+    HRESULT hr;
+
+    // Keep Sleep() at 1 ms resolution while the thread runs.
+    TimerResolutionClass timerResolution;
+
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+    while (!m_stopRequested)
+    {
+        // Compute each due time from the start time, so rounding errors don't accumulate.
+        dueTicks = m_startTicks + (LONGLONG)((period * (ULONGLONG)m_frequency.QuadPart) / m_rateHz);
+
+        HiResTimerClass::WaitUntil(dueTicks, m_stopRequested);
+
+        ZeroMemory(&sample, sizeof(sample));
+        QueryPerformanceCounter(&nowTicks);
+        sample.ticks = nowTicks.QuadPart;
+        sample.sequence = (ULONG)period;
+
+        hr = _readSample(sample);
+
+        if (SUCCEEDED(hr))
+        {
+            jitterTicks = sample.ticks - dueTicks;
+            InterlockedExchangeAdd64(&m_totalJitterTicks, jitterTicks);
+            if (jitterTicks > m_maxJitterTicks)
+            {
+                InterlockedExchange64(&m_maxJitterTicks, jitterTicks);
+            }
+
+            // Store the sample if there is room for it in the buffer.
+            if ((m_writeCount - m_readCount) < (ULONG)m_buffer.size())
+            {
+                m_buffer[m_writeCount & ((ULONG)m_buffer.size() - 1)] = sample;
+
+                // Make sure the sample is in the buffer before the count that covers it.
+                MemoryBarrier();
+
+                m_writeCount = m_writeCount + 1;
+            }
+            else
+            {
+                m_overruns = m_overruns + 1;
+            }
+
+            m_samples = m_samples + 1;
+        }
+        else
+        {
+            m_lastError = hr;
+            m_errors = m_errors + 1;
+        }
+
+        // Move on to the next sample period, skipping any that have already passed.
+        period++;
+        QueryPerformanceCounter(&nowTicks);
+        currentPeriod = ((ULONGLONG)(nowTicks.QuadPart - m_startTicks) * m_rateHz) / (ULONGLONG)m_frequency.QuadPart;
+        if (currentPeriod > period)
+        {
+            m_missedPeriods = m_missedPeriods + (ULONG)(currentPeriod - period);
+            period = currentPeriod;
+        }
+    }
+}
+
+/**
+\param[in,out] sample The sample to put the channel readings in.
+\return HRESULT success or error code.
+*/
+HRESULT AdcSamplerClass::_readSample(ADC_SAMPLE & sample)
+{
+    HRESULT hr = S_OK;
+    ULONG bits = 0;
+    ULONG readings[ADC_SAMPLER_MAX_CHANNELS];
+
+    if (m_adcType == MCP3008_ADC)
+    {
+        hr = m_mcp3008->readChannels(m_channels, m_channelCount, readings, bits);
+
+        for (ULONG i = 0; SUCCEEDED(hr) && (i < m_channelCount); i++)
+        {
+            sample.values[m_channels[i]] = readings[i];
+        }
+    }
+    else if (m_adcType == ADS1015_ADC)
+    {
+        for (ULONG i = 0; SUCCEEDED(hr) && (i < m_channelCount); i++)
+        {
+            hr = m_ads1015->readValue(m_channels[i], sample.values[m_channels[i]], bits);
+        }
+    }
+    else
+    {
+        hr = DMAP_E_DMAP_INTERNAL_ERROR;
+    }
+
+    return hr;
+}
+
+/**
+\param[in] ticks A high resolution timer interval.
+\return The interval in microseconds, limited to the range of a ULONG.
+*/
+ULONG AdcSamplerClass::_ticksToUs(LONGLONG ticks)
+{
+    ULONG us = 0;
+    LONGLONG longUs;
+
+    if ((ticks > 0) && (m_frequency.QuadPart != 0))
+    {
+        longUs = (ticks * 1000000LL) / m_frequency.QuadPart;
+        us = (longUs > 0xFFFFFFFFLL) ? 0xFFFFFFFF : (ULONG)longUs;
+    }
+
+    return us;
+}
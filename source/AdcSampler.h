@@ -0,0 +1,155 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#ifndef _ADC_SAMPLER_H_
+#define _ADC_SAMPLER_H_
+
+#include <Windows.h>
+#include <thread>
+#include <vector>
+
+#include "ADS1015Support.h"
+#include "MCP3008support.h"
+
+// The most channels in one sample: every channel of the largest MCP3008 array, which is
+// more than an ADS1015 has.  This must be a multiple of 4 for the filters.
+#define ADC_SAMPLER_MAX_CHANNELS (MCP3008_MAX_CHIPS * MCP3008_CHANNELS)
+
+// The highest sample rate that can be requested.
+#define ADC_SAMPLER_MAX_RATE_HZ 100000
+
+// Sample buffer size used if none is specified (rounded up to a power of two).
+#define ADC_SAMPLER_DEFAULT_BUFFER_SAMPLES 4096
+
+/// One sample taken by the ADC sampler.
+typedef struct _ADC_SAMPLE {
+    LONGLONG ticks;                             ///< QPC reading when the sample was taken
+    ULONG sequence;                             ///< Number of the sample period the sample was taken in
+    ULONG values[ADC_SAMPLER_MAX_CHANNELS];     ///< Value read from each channel, indexed by channel number
+} ADC_SAMPLE, *PADC_SAMPLE;
+
+/// The performance of the ADC sampler.
+typedef struct _ADC_SAMPLER_STATS {
+    ULONG samples;              ///< Number of samples taken
+    ULONG overruns;             ///< Number of samples dropped because the buffer was full
+    ULONG missedPeriods;        ///< Number of sample periods skipped because the thread fell behind
+    ULONG errors;               ///< Number of samples that could not be read from the ADC
+    HRESULT lastError;          ///< The most recent error reading the ADC
+    double achievedRateHz;      ///< Samples taken per second since sampling started
+    ULONG meanJitterUs;         ///< Average time from when a sample was due until it was taken
+    ULONG maxJitterUs;          ///< Longest time from when a sample was due until it was taken
+} ADC_SAMPLER_STATS, *PADC_SAMPLER_STATS;
+
+//
+// Class used to sample an ADC at a fixed rate.
+//
+// A dedicated thread reads a set of ADC channels once per sample period.  Sample times are
+// scheduled from the high resolution timer reading when sampling started (not from the
+// time the last sample was taken) so timing errors do not accumulate.  Samples are stored
+// in a ring buffer with one writer (the sampling thread) and one reader (the thread that
+// calls read()), so neither thread needs a lock.
+//
+class AdcSamplerClass
+{
+public:
+    LIGHTNING_DLL_API AdcSamplerClass();
+
+    virtual ~AdcSamplerClass()
+    {
+        end();
+    }
+
+    /// Start sampling channels of an MCP3008 ADC.
+    LIGHTNING_DLL_API HRESULT begin(MCP3008Device* adc, ULONGLONG channelMask, ULONG rateHz, ULONG bufferSamples);
+
+    /// Start sampling channels of an ADS1015 ADC.
+    LIGHTNING_DLL_API HRESULT begin(ADS1015Device* adc, ULONGLONG channelMask, ULONG rateHz, ULONG bufferSamples);
+
+    /// Stop sampling.
+    LIGHTNING_DLL_API void end();
+
+    /// Get the number of samples waiting to be read.
+    LIGHTNING_DLL_API ULONG available();
+
+    /// Take samples out of the buffer.
+    LIGHTNING_DLL_API ULONG read(PADC_SAMPLE samples, ULONG maxSamples);
+
+    /// Get the performance of the sampler since sampling started.
+    LIGHTNING_DLL_API void getStatistics(ADC_SAMPLER_STATS & stats);
+
+    /// Method to get the number of high resolution timer ticks per second.
+    LONGLONG ticksPerSecond()
+    {
+        return m_frequency.QuadPart;
+    }
+
+private:
+
+    /// The types of ADC that can be sampled.
+    typedef enum {
+        NO_ADC,
+        MCP3008_ADC,
+        ADS1015_ADC
+    } ADC_TYPE;
+
+    /// The type of ADC being sampled.
+    ADC_TYPE m_adcType;
+
+    /// The ADC being sampled (the one that matches m_adcType).
+    MCP3008Device* m_mcp3008;
+    ADS1015Device* m_ads1015;
+
+    /// The numbers of the channels read in each sample, lowest first.
+    ULONG m_channels[ADC_SAMPLER_MAX_CHANNELS];
+
+    /// The number of entries in m_channels.
+    ULONG m_channelCount;
+
+    /// The high resolution timer frequency on this system.
+    LARGE_INTEGER m_frequency;
+
+    /// The requested sample rate.
+    ULONG m_rateHz;
+
+    /// QPC reading when sampling started.
+    LONGLONG m_startTicks;
+
+    /// The sample buffer, the number of entries in it is a power of two.
+    std::vector<ADC_SAMPLE> m_buffer;
+
+    /// Number of samples written to the buffer, only changed by the sampling thread.
+    volatile ULONG m_writeCount;
+
+    /// Number of samples read from the buffer, only changed by read().
+    volatile ULONG m_readCount;
+
+    /// The sampler performance counters, only changed by the sampling thread.
+    volatile ULONG m_samples;
+    volatile ULONG m_overruns;
+    volatile ULONG m_missedPeriods;
+    volatile ULONG m_errors;
+    volatile HRESULT m_lastError;
+    volatile LONGLONG m_totalJitterTicks;
+    volatile LONGLONG m_maxJitterTicks;
+
+    /// Set to TRUE to tell the sampling thread to stop.
+    volatile BOOL m_stopRequested;
+
+    /// The sampling thread.
+    std::thread m_thread;
+
+    // Method to prepare the sampler and start the sampling thread.
+    HRESULT _start(ULONG channelCount, ULONGLONG channelMask, ULONG rateHz, ULONG bufferSamples);
+
+    // Method run by the sampling thread.
+    void _sampleLoop();
+
+    // Method to read the channels of one sample from the ADC.
+    HRESULT _readSample(ADC_SAMPLE & sample);
+
+    // Method to convert a high resolution timer interval to microseconds.
+    ULONG _ticksToUs(LONGLONG ticks);
+};
+
+#endif  // _ADC_SAMPLER_H_
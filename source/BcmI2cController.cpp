@@ -51,65 +51,105 @@ HRESULT BcmI2cControllerClass::configurePins(ULONG sdaPin, ULONG sclPin)
 }
 
 // Method to initialize the I2C Controller at the start of a transaction.
-HRESULT BcmI2cControllerClass::_initializeForTransaction(ULONG slaveAddress, BOOL useHighSpeed)
+HRESULT BcmI2cControllerClass::_initializeForTransaction(ULONG slaveAddress, const I2cTransactionClass::BUS_TIMING & timing)
 {
+    HRESULT hr = S_OK;
     _C controlReg;
     _S statusReg;
     _DIV divReg;
     _A addressReg;
+    _DEL delReg;
     _CLKT clktReg;
+    ULONG cdiv = 0;
+    ULONG maxDelay = 0;
 
 
-    // Disable the controller and controller interrupts.
-    controlReg.ALL_BITS = 0;
-    m_registers->C.ALL_BITS = controlReg.ALL_BITS;
-
-    // Clear status bits that may be set from a previous transaction.
-    statusReg.ALL_BITS = 0;
-    statusReg.CLKT = 1;
-    statusReg.ERR = 1;
-    statusReg.DONE = 1;
-    m_registers->S.ALL_BITS = statusReg.ALL_BITS;
-
-    // Clear the RX and TX FIFOS.
-    controlReg.CLEAR = 3;
-    m_registers->C.ALL_BITS = controlReg.ALL_BITS;
-
-    // Wait for the controller to go idle.
-    while (m_registers->S.TA == 1);
-
-    // Set the desired I2C Clock speed.
-    if (useHighSpeed)
+    if ((timing.clockHz == 0) || (timing.clockHz > I2C_FAST_MODE_PLUS_HZ))
     {
-        divReg.ALL_BITS = m_registers->DIV.ALL_BITS;
-        divReg.ALL_BITS &= _DIV_USED_MASK;
-        divReg.CDIV = CDIV_400KHZ;
-        m_registers->DIV.ALL_BITS = divReg.ALL_BITS;
+        hr = DMAP_E_I2C_INVALID_CLOCK_RATE;
     }
-    else
+
+    if (SUCCEEDED(hr))
     {
-        divReg.ALL_BITS = m_registers->DIV.ALL_BITS;
-        divReg.ALL_BITS &= _DIV_USED_MASK;
-        divReg.CDIV = CDIV_100KHZ;
-        m_registers->DIV.ALL_BITS = divReg.ALL_BITS;
+        // Calculate the clock divider for the requested clock rate.  Round the divider up
+        // so the bus is never faster than requested, and up to an even value because the 
+        // controller ignores the low bit of the divider.
+        cdiv = (CORE_CLOCK_HZ + timing.clockHz - 1) / timing.clockHz;
+        cdiv = (cdiv + 1) & ~1UL;
+
+        if (cdiv > CDIV_MAX)
+        {
+            hr = DMAP_E_I2C_INVALID_CLOCK_RATE;
+        }
     }
 
-    // Set the address of the slave this tranaction affects.
-    addressReg.ALL_BITS = m_registers->A.ALL_BITS;
-    addressReg.ALL_BITS &= _A_USED_MASK;
-    addressReg.ADDR = slaveAddress & 0x7F;
-    m_registers->A.ALL_BITS = addressReg.ALL_BITS;
+    if (SUCCEEDED(hr))
+    {
+        // Build the register values this transaction needs.  Data delays must be less
+        // than half the clock divider.
+        divReg.ALL_BITS = 0;
+        divReg.CDIV = cdiv;
+
+        addressReg.ALL_BITS = 0;
+        addressReg.ADDR = slaveAddress & 0x7F;
+
+        maxDelay = (cdiv / 2) - 1;
+        delReg.ALL_BITS = 0;
+        delReg.REDL = min(timing.risingEdgeDelay, maxDelay);
+        delReg.FEDL = min(timing.fallingEdgeDelay, maxDelay);
 
-    // Disable bus slave timeouts.
-    clktReg.ALL_BITS = 0;
-    m_registers->CLKT.ALL_BITS = clktReg.ALL_BITS;
+        clktReg.ALL_BITS = 0;
+        clktReg.TOUT = min(timing.stretchTimeout, _CLKT_USED_MASK);
 
-    // Enable the controller.
-    controlReg.ALL_BITS = 0;
-    controlReg.I2CEN = 1;
-    m_registers->C.ALL_BITS = controlReg.ALL_BITS;
+        // Clear status bits that may be set from a previous transaction.
+        statusReg.ALL_BITS = 0;
+        statusReg.CLKT = 1;
+        statusReg.ERR = 1;
+        statusReg.DONE = 1;
+        m_registers->S.ALL_BITS = statusReg.ALL_BITS;
 
-    return S_OK;
+        if (m_controllerEnabled)
+        {
+            // The last transaction left the controller enabled, so just clear the
+            // RX and TX FIFOs.
+            controlReg.ALL_BITS = 0;
+            controlReg.I2CEN = 1;
+            controlReg.CLEAR = 3;
+            m_registers->C.ALL_BITS = controlReg.ALL_BITS;
+        }
+        else
+        {
+            // Disable the controller and controller interrupts.
+            controlReg.ALL_BITS = 0;
+            m_registers->C.ALL_BITS = controlReg.ALL_BITS;
+
+            // Clear the RX and TX FIFOS.
+            controlReg.CLEAR = 3;
+            m_registers->C.ALL_BITS = controlReg.ALL_BITS;
+        }
+
+        // Wait for the controller to go idle.
+        while (m_registers->S.TA == 1);
+
+        // Program the clock speed, slave address, data delays and clock stretch timeout
+        // (0 disables the timeout) for every transaction.  Other controller objects, in
+        // this process or another, can have used the controller since this one did.
+        m_registers->DIV.ALL_BITS = divReg.ALL_BITS;
+        m_registers->A.ALL_BITS = addressReg.ALL_BITS;
+        m_registers->DEL.ALL_BITS = delReg.ALL_BITS;
+        m_registers->CLKT.ALL_BITS = clktReg.ALL_BITS;
+
+        // Enable the controller.
+        if (!m_controllerEnabled)
+        {
+            controlReg.ALL_BITS = 0;
+            controlReg.I2CEN = 1;
+            m_registers->C.ALL_BITS = controlReg.ALL_BITS;
+            m_controllerEnabled = TRUE;
+        }
+    }
+
+    return hr;
 }
 
 // Method to map the I2C controller into this process' virtual address space.
@@ -144,6 +184,7 @@ HRESULT BcmI2cControllerClass::_mapController()
         if (SUCCEEDED(hr))
         {
             m_registers = (PI2C_CONTROLLER)baseAddress;
+            m_controllerEnabled = FALSE;
         }
     }
 
@@ -218,6 +259,8 @@ HRESULT BcmI2cControllerClass::_performWrites(I2cTransferClass* & pXfr)
     I2cTransferClass* cmdXfr = nullptr;
     I2cTransferClass* tmpXfr = nullptr;
     LONG cmdsOutstanding = 0;
+    LONG fifoSpace = 0;
+    BOOL busError = FALSE;
     UCHAR outByte;
     _S sReg;
     _C cReg;
@@ -272,44 +315,51 @@ HRESULT BcmI2cControllerClass::_performWrites(I2cTransferClass* & pXfr)
     }
 
     // While we have more bytes to write:
-    while (SUCCEEDED(hr) && (cmdXfr != nullptr) && (cmdsOutstanding > 0))
+    while (SUCCEEDED(hr) && !busError && (cmdXfr != nullptr) && (cmdsOutstanding > 0))
     {
-        while (SUCCEEDED(hr) && (cmdXfr->getNextCmd(outByte)))
+        // Read the status once, then write as many bytes as it shows the TX FIFO has room for.
+        sReg.ALL_BITS = m_registers->S.ALL_BITS;
+        if ((sReg.ERR == 1) || (sReg.CLKT == 1))
         {
-            // Wait for at least one empty space in the TX FIFO.
-            while (SUCCEEDED(hr) && txFifoFull())
-            {
-                sReg.ALL_BITS = m_registers->S.ALL_BITS;
-                if (sReg.ERR == 1)
-                {
-                    hr = E_FAIL;
-                }
-            }
+            busError = TRUE;
+        }
+        else
+        {
+            fifoSpace = _txFifoSpace(sReg);
+        }
 
-            if (SUCCEEDED(hr))
+        while (!busError && (fifoSpace > 0) && (cmdXfr != nullptr) && (cmdsOutstanding > 0))
+        {
+            if (cmdXfr->getNextCmd(outByte))
             {
                 // Write the byte.
                 m_registers->FIFO.ALL_BITS = outByte;
 
                 // Count the byte we sent.
                 cmdsOutstanding--;
+                fifoSpace--;
+            }
+            else
+            {
+                // Get the next transfer in the transaction.
+                cmdXfr = cmdXfr->getNextTransfer();
             }
         }
+    }
 
-        if (SUCCEEDED(hr))
-        {
-            // Get the next transfer in the transaction if there is one.
-            cmdXfr = cmdXfr->getNextTransfer();
-        }
+    if (SUCCEEDED(hr) && !busError && (cmdXfr != nullptr))
+    {
+        // Move past the last transfer written.
+        cmdXfr = cmdXfr->getNextTransfer();
     }
 
-    if (SUCCEEDED(hr))
+    if (SUCCEEDED(hr) && !busError)
     {
         // Wait for the writes to complete.
         do
         {
             sReg.ALL_BITS = m_registers->S.ALL_BITS;
-        } while (sReg.DONE == 0);
+        } while ((sReg.DONE == 0) && (sReg.CLKT == 0));
     }
 
     // Determine if an error occurred.
@@ -345,6 +395,8 @@ HRESULT BcmI2cControllerClass::_performReads(I2cTransferClass* & pXfr)
     I2cTransferClass* readXfr = nullptr;
     PUCHAR readPtr = nullptr;
     LONG cmdsOutstanding = 0;
+    LONG fifoCount = 0;
+    BOOL busError = FALSE;
     UCHAR inByte;
     _S sReg;
     _C cReg;
@@ -400,23 +452,22 @@ HRESULT BcmI2cControllerClass::_performReads(I2cTransferClass* & pXfr)
     }
 
     // While we have more bytes to read:
-    while (SUCCEEDED(hr) && (readXfr != nullptr) && (cmdsOutstanding > 0))
+    while (SUCCEEDED(hr) && !busError && (readXfr != nullptr) && (cmdsOutstanding > 0))
     {
-        // Wait for at least one byte to be available in the RX FIFO.
-        while (SUCCEEDED(hr) && rxFifoEmpty())
+        // Read the status once, then read as many bytes as it shows the RX FIFO holds.
+        sReg.ALL_BITS = m_registers->S.ALL_BITS;
+        fifoCount = _rxFifoCount(sReg);
+        if ((fifoCount == 0) && ((sReg.ERR == 1) || (sReg.CLKT == 1)))
         {
-            sReg.ALL_BITS = m_registers->S.ALL_BITS;
-            if (sReg.ERR == 1)
-            {
-                hr = E_FAIL;
-            }
+            busError = TRUE;
         }
 
-        if (SUCCEEDED(hr))
+        while ((fifoCount > 0) && (cmdsOutstanding > 0))
         {
             // Read a byte from the I2C Controller.
             inByte = readByte();
             cmdsOutstanding--;
+            fifoCount--;
 
             // Store the byte if we have a place for it.
             if (readPtr != nullptr)
@@ -435,14 +486,14 @@ HRESULT BcmI2cControllerClass::_performReads(I2cTransferClass* & pXfr)
         }
     }
 
-    if (SUCCEEDED(hr))
+    if (SUCCEEDED(hr) && !busError)
     {
         // Wait for the reads to complete.
         do
         {
             sReg.ALL_BITS = m_registers->S.ALL_BITS;
         }
-        while (sReg.DONE == 0);
+        while ((sReg.DONE == 0) && (sReg.CLKT == 0));
     }
 
     // Determine if an error occurred.
@@ -479,6 +530,8 @@ HRESULT BcmI2cControllerClass::_performWriteRead(I2cTransferClass* & pXfr)
     PUCHAR readPtr = nullptr;
     LONG writesOutstanding = 0;
     LONG readsOutstanding = 0;
+    LONG fifoSpace = 0;
+    LONG fifoCount = 0;
     UCHAR outByte;
     UCHAR inByte;
     _S sReg;
@@ -543,8 +596,17 @@ HRESULT BcmI2cControllerClass::_performWriteRead(I2cTransferClass* & pXfr)
         cReg.ST = 1;
         m_registers->C.ALL_BITS = cReg.ALL_BITS;
 
-        // Wait for the transfer to be active.
-        while (m_registers->S.TA == 0);
+        // Wait for the transfer to be active, or for a bus error or clock stretch timeout.
+        do
+        {
+            sReg.ALL_BITS = m_registers->S.ALL_BITS;
+        }
+        while ((sReg.TA == 0) && (sReg.ERR == 0) && (sReg.CLKT == 0));
+
+        if ((sReg.ERR == 1) || (sReg.CLKT == 1))
+        {
+            hr = _handleErrors();
+        }
 
         // While we have more bytes to write:
         while (SUCCEEDED(hr) && (cmdXfr != nullptr) && (writesOutstanding > 0))
@@ -554,13 +616,18 @@ HRESULT BcmI2cControllerClass::_performWriteRead(I2cTransferClass* & pXfr)
                 // If this is not the last byte to write:
                 if (writesOutstanding > 1)
                 {
-                    // Wait for at least one empty space in the TX FIFO.
-                    while (SUCCEEDED(hr) && txFifoFull())
+                    // When the TX FIFO space found by the last status read is used up,
+                    // read the status again to find out how much room there is.
+                    while (SUCCEEDED(hr) && (fifoSpace == 0))
                     {
                         sReg.ALL_BITS = m_registers->S.ALL_BITS;
-                        if (sReg.ERR == 1)
+                        if ((sReg.ERR == 1) || (sReg.CLKT == 1))
+                        {
+                            hr = _handleErrors();
+                        }
+                        else
                         {
-                            hr = E_FAIL;
+                            fifoSpace = _txFifoSpace(sReg);
                         }
                     }
 
@@ -568,6 +635,7 @@ HRESULT BcmI2cControllerClass::_performWriteRead(I2cTransferClass* & pXfr)
                     {
                         // Write the byte.
                         m_registers->FIFO.ALL_BITS = outByte;
+                        fifoSpace--;
                     }
                 }
 
@@ -608,9 +676,9 @@ HRESULT BcmI2cControllerClass::_performWriteRead(I2cTransferClass* & pXfr)
         while (SUCCEEDED(hr) && txFifoFull())
         {
             sReg.ALL_BITS = m_registers->S.ALL_BITS;
-            if (sReg.ERR == 1)
+            if ((sReg.ERR == 1) || (sReg.CLKT == 1))
             {
-                hr = E_FAIL;
+                hr = _handleErrors();
             }
         }
 
@@ -629,7 +697,7 @@ HRESULT BcmI2cControllerClass::_performWriteRead(I2cTransferClass* & pXfr)
             {
                 sReg.ALL_BITS = m_registers->S.ALL_BITS;
             }
-            while (sReg.TA == 1);
+            while ((sReg.TA == 1) && (sReg.CLKT == 0));
 
             // Clear the DONE status for cleanliness.
             sReg.ALL_BITS = 0;
@@ -639,13 +707,15 @@ HRESULT BcmI2cControllerClass::_performWriteRead(I2cTransferClass* & pXfr)
 
         while (SUCCEEDED(hr) && (readsOutstanding > 0))
         {
-            // Wait for at least one byte to be available in the RX FIFO.
-            while (SUCCEEDED(hr) && rxFifoEmpty())
+            // When the RX FIFO bytes found by the last status read have been read,
+            // read the status again to find out how many more there are.
+            while (SUCCEEDED(hr) && (fifoCount == 0))
             {
                 sReg.ALL_BITS = m_registers->S.ALL_BITS;
-                if (sReg.ERR == 1)
+                fifoCount = _rxFifoCount(sReg);
+                if ((fifoCount == 0) && ((sReg.ERR == 1) || (sReg.CLKT == 1)))
                 {
-                    hr = E_FAIL;
+                    hr = _handleErrors();
                 }
             }
 
@@ -654,6 +724,7 @@ HRESULT BcmI2cControllerClass::_performWriteRead(I2cTransferClass* & pXfr)
                 // Read a byte from the I2C Controller.
                 inByte = readByte();
                 readsOutstanding--;
+                fifoCount--;
 
                 // Store the byte if we have a place for it.
                 if (readPtr != nullptr)
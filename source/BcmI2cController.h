@@ -8,9 +8,13 @@
 #include <Windows.h>
 #include <functional>
 
+#include "ErrorCodes.h"
 #include "I2cTransfer.h"
 #include "I2cController.h"
 
+// Depth of the BSC TX and RX FIFOs in bytes.
+#define BCM_I2C_FIFO_BYTES 16
+
 //
 // Class that is used to interact with the BCM2836 I2C Controller hardware.
 //
@@ -18,7 +22,8 @@ class BcmI2cControllerClass : public I2cControllerClass
 {
 public:
     BcmI2cControllerClass() :
-        m_registers(nullptr)
+        m_registers(nullptr),
+        m_controllerEnabled(FALSE)
     {
     }
 
@@ -46,7 +51,7 @@ public:
     LIGHTNING_DLL_API HRESULT configurePins(ULONG sdaPin, ULONG sclPin) override;
 
     // Method to initialize the I2C Controller at the start of a transaction.
-    LIGHTNING_DLL_API HRESULT _initializeForTransaction(ULONG slaveAddress, BOOL useHighSpeed) override;
+    LIGHTNING_DLL_API HRESULT _initializeForTransaction(ULONG slaveAddress, const I2cTransactionClass::BUS_TIMING & timing) override;
 
     //
     // I2C Controller accessor methods.  These methods assume the I2C Controller
@@ -87,15 +92,15 @@ public:
 
     /// Determine whether a TX Error has occurred or not.
     /**
-    All I2C bus errors we are interested in are TX errors: failure to ACK an
-    an address or write data.
+    The I2C bus errors we are interested in are failure to ACK an address or
+    write data, and a slave stretching the clock past the clock stretch timeout.
     \return TRUE, an error occured.  FALSE, no error has occured.
     */
     BOOL errorOccurred() override
     {
         _S sReg;
         sReg.ALL_BITS = m_registers->S.ALL_BITS;
-        return (sReg.ERR == 1);
+        return ((sReg.ERR == 1) || (sReg.CLKT == 1));
     }
 
     /// Determine if an I2C address was sent but not acknowledged by any slave.
@@ -122,6 +127,15 @@ public:
         return FALSE;
     }
 
+    /// Determine if a slave stretched the I2C clock past the clock stretch timeout.
+    /**
+    \return TRUE, a clock stretch timeout occurred.  FALSE, no timeout has occurred.
+    */
+    BOOL clockStretchTimedOut()
+    {
+        return (m_registers->S.CLKT == 1);
+    }
+
     /// Handle any errors that have occurred during an I2C transaction.
     /**
     Determine whether an error occurred, and if so (and it is the first error on this
@@ -140,7 +154,11 @@ public:
             if (m_error == I2cTransactionClass::SUCCESS)
             {
                 // Record the type of error that occured.
-                if (addressWasNacked())
+                if (clockStretchTimedOut())
+                {
+                    m_error = I2cTransactionClass::CLOCK_TIMEOUT;
+                }
+                else if (addressWasNacked())
                 {
                     m_error = I2cTransactionClass::ADR_NACK;
                 }
@@ -153,10 +171,19 @@ public:
                     m_error = I2cTransactionClass::OTHER;
                 }
             }
+            // A clock stretch timeout gets its own error code, so a stalled slave
+            // can be told apart from a NACK.
+            if (clockStretchTimedOut())
+            {
+                hr = DMAP_E_I2C_CLOCK_STRETCH_TIMEOUT;
+            }
+            else
+            {
+                hr = E_FAIL;
+            }
+
             // Clear the error.
             clearErrors();
-
-            hr = E_FAIL;
         }
         return hr;
     }
@@ -172,6 +199,9 @@ public:
         statusReg.CLKT = 1;
         statusReg.ERR = 1;
         m_registers->S.ALL_BITS = statusReg.ALL_BITS;
+
+        // Do a full controller reset at the start of the next transaction.
+        m_controllerEnabled = FALSE;
     }
 
 private:
@@ -257,15 +287,15 @@ private:
     typedef union {
         ULONG ALL_BITS;
         struct {
-            ULONG CDIV : 16;            // Clock divider: SCL = 150mhz / CDIV
+            ULONG CDIV : 16;            // Clock divider: SCL = core clock / CDIV (rounded down to even)
             ULONG _rsv : 16;            // Reserved
         };
     } _DIV;
     const ULONG _DIV_USED_MASK = 0x0000FFFF;  // Mask of non-reserved bits in the Clock Divider Register
 
-    // Standard (100khz) and high (400khz) divider values.
-    const ULONG CDIV_100KHZ = 2500;
-    const ULONG CDIV_400KHZ = 626;
+    // The core clock that feeds the clock divider, and the largest usable divider value.
+    const ULONG CORE_CLOCK_HZ = 250000000;
+    const ULONG CDIV_MAX = 0xFFFE;
 
     // I2C Data Delay Register.
     typedef union {
@@ -309,6 +339,9 @@ private:
     // they are mapped into this process' address space.
     PI2C_CONTROLLER m_registers;
 
+    // TRUE if the controller was left enabled and error free by the last transaction.
+    BOOL m_controllerEnabled;
+
     // Method to map the I2C controller into this process' virtual address space.
     LIGHTNING_DLL_API HRESULT _mapController() override;
 
@@ -321,6 +354,42 @@ private:
     // Perform a Write-Restart-Read sequence of transfers.
     HRESULT _performWriteRead(I2cTransferClass* &pXfr);
 
+    // Method to get the number of bytes that can be written to the TX FIFO, from the status.
+    // S.TXW only shows the FIFO is not full, so below the empty level the FIFO is filled one
+    // byte at a time using S.TXD.
+    static LONG _txFifoSpace(const _S & sReg)
+    {
+        LONG space = 0;
+
+        if (sReg.TXE == 1)
+        {
+            space = BCM_I2C_FIFO_BYTES;
+        }
+        else if (sReg.TXD == 1)
+        {
+            space = 1;
+        }
+        return space;
+    }
+
+    // Method to get the number of bytes that can be read from the RX FIFO, from the status.
+    // S.RXR only shows the FIFO holds data, so below the full level the FIFO is emptied one
+    // byte at a time using S.RXD.
+    static LONG _rxFifoCount(const _S & sReg)
+    {
+        LONG count = 0;
+
+        if (sReg.RXF == 1)
+        {
+            count = BCM_I2C_FIFO_BYTES;
+        }
+        else if (sReg.RXD == 1)
+        {
+            count = 1;
+        }
+        return count;
+    }
+
     // The maximum length of a transfer.
     const LONG m_maxTransferBytes = 0xFFFF;
 };
@@ -0,0 +1,387 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#include "pch.h"
+
+#include "BcmPwmController.h"
+#include "ErrorCodes.h"
+
+// 
+// Global extern exports
+//
+BcmPwmControllerClass g_bcmPwm;
+
+/**
+Initialize member variables.  The controller is mapped the first time it is used.
+*/
+BcmPwmControllerClass::BcmPwmControllerClass() :
+    m_hController(INVALID_HANDLE_VALUE),
+    m_registers(nullptr),
+    m_range(0)
+{
+    ZeroMemory(m_dutyCycles, sizeof(m_dutyCycles));
+    InitializeSRWLock(&m_lock);
+}
+
+/**
+Both channels are stopped before the controller is unmapped.
+*/
+void BcmPwmControllerClass::end()
+{
+    _CTL ctl;
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    if (m_registers != nullptr)
+    {
+        ctl.ALL_BITS = m_registers->CTL.ALL_BITS;
+        ctl.PWEN1 = 0;
+        ctl.PWEN2 = 0;
+        m_registers->CTL.ALL_BITS = ctl.ALL_BITS;
+
+        m_registers = nullptr;
+    }
+
+    if (m_hController != INVALID_HANDLE_VALUE)
+    {
+        // Unmap the PWM controller.
+        DmapCloseController(m_hController);
+        m_hController = INVALID_HANDLE_VALUE;
+    }
+
+    // Forget the channel settings, so a later use of the controller starts afresh.
+    m_range = 0;
+    ZeroMemory(m_dutyCycles, sizeof(m_dutyCycles));
+
+    ReleaseSRWLockExclusive(&m_lock);
+}
+
+/**
+The period is a whole number of PWM clocks, so the frequency produced can differ slightly
+from the one requested.  The duty cycles of both channels are kept, and the new period
+starts when the current one ends.
+\param[in] frequencyHz The desired PWM pulse repetition frequency in Hz.
+\return HRESULT success or error code.
+*/
+HRESULT BcmPwmControllerClass::setFrequency(ULONG frequencyHz)
+{
+    HRESULT hr = S_OK;
+
+    if ((frequencyHz < BCM_PWM_MIN_FREQUENCY_HZ) || (frequencyHz > BCM_PWM_MAX_FREQUENCY_HZ))
+    {
+        hr = DMAP_E_PWM_FREQUENCY_INVALID;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        AcquireSRWLockExclusive(&m_lock);
+
+        hr = _mapIfNeeded();
+
+        if (SUCCEEDED(hr))
+        {
+            m_range = (BCM_PWM_CLOCK_HZ + (frequencyHz / 2)) / frequencyHz;
+            m_registers->RNG1 = m_range;
+            m_registers->RNG2 = m_range;
+            _writeData(0);
+            _writeData(1);
+        }
+
+        ReleaseSRWLockExclusive(&m_lock);
+    }
+
+    return hr;
+}
+
+/**
+\return The approximate PWM pulse repetition frequency in Hz, 0 if the controller can't be used.
+*/
+ULONG BcmPwmControllerClass::getActualFrequency()
+{
+    ULONG frequency = 0;
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    if (SUCCEEDED(_mapIfNeeded()) && (m_range != 0))
+    {
+        frequency = (BCM_PWM_CLOCK_HZ + (m_range / 2)) / m_range;
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return frequency;
+}
+
+/**
+\param[in] channel The PWM channel (0 or 1).
+\param[in] dutyCycle The fraction of each period the output is high (0-0xFFFFFFFF for 0-100%).
+\return HRESULT success or error code.
+*/
+HRESULT BcmPwmControllerClass::setDutyCycle(ULONG channel, ULONG dutyCycle)
+{
+    HRESULT hr = S_OK;
+    _CTL ctl;
+
+    if (channel >= BCM_PWM_CHANNELS)
+    {
+        hr = DMAP_E_INVALID_PORT_BIT_FOR_DEVICE;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        AcquireSRWLockExclusive(&m_lock);
+
+        hr = _mapIfNeeded();
+
+        if (SUCCEEDED(hr))
+        {
+            m_dutyCycles[channel] = dutyCycle;
+            _writeData(channel);
+
+            // Start the channel in mark-space mode, taking the high time from the data register.
+            ctl.ALL_BITS = m_registers->CTL.ALL_BITS;
+            if (channel == 0)
+            {
+                ctl.MODE1 = 0;
+                ctl.USEF1 = 0;
+                ctl.POLA1 = 0;
+                ctl.MSEN1 = 1;
+                ctl.PWEN1 = 1;
+            }
+            else
+            {
+                ctl.MODE2 = 0;
+                ctl.USEF2 = 0;
+                ctl.POLA2 = 0;
+                ctl.MSEN2 = 1;
+                ctl.PWEN2 = 1;
+            }
+            m_registers->CTL.ALL_BITS = ctl.ALL_BITS;
+        }
+
+        ReleaseSRWLockExclusive(&m_lock);
+    }
+
+    return hr;
+}
+
+/**
+A stopped channel drives its output LOW.
+\param[in] channel The PWM channel (0 or 1).
+\return HRESULT success or error code.
+*/
+HRESULT BcmPwmControllerClass::disableChannel(ULONG channel)
+{
+    HRESULT hr = S_OK;
+    _CTL ctl;
+
+    if (channel >= BCM_PWM_CHANNELS)
+    {
+        hr = DMAP_E_INVALID_PORT_BIT_FOR_DEVICE;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        AcquireSRWLockExclusive(&m_lock);
+
+        hr = _mapIfNeeded();
+
+        if (SUCCEEDED(hr))
+        {
+            ctl.ALL_BITS = m_registers->CTL.ALL_BITS;
+            if (channel == 0)
+            {
+                ctl.SBIT1 = 0;
+                ctl.PWEN1 = 0;
+            }
+            else
+            {
+                ctl.SBIT2 = 0;
+                ctl.PWEN2 = 0;
+            }
+            m_registers->CTL.ALL_BITS = ctl.ALL_BITS;
+        }
+
+        ReleaseSRWLockExclusive(&m_lock);
+    }
+
+    return hr;
+}
+
+/**
+This method must be called with the lock held.  When the controller is first mapped both
+channels are stopped, the PWM clock is checked and the default frequency is set.  If the
+clock check fails the controller is unmapped again.
+\return HRESULT success or error code.
+*/
+HRESULT BcmPwmControllerClass::_mapIfNeeded()
+{
+    HRESULT hr = S_OK;
+    PVOID baseAddress = nullptr;
+    _CTL ctl;
+
+    if (m_hController == INVALID_HANDLE_VALUE)
+    {
+        // Open the Dmap device for the PWM controller for exclusive access.
+        hr = GetControllerBaseAddress(pi2PwmDeviceName, m_hController, baseAddress);
+
+        if (SUCCEEDED(hr))
+        {
+            m_registers = (PPWM_CONTROLLER)baseAddress;
+
+            ctl.ALL_BITS = 0;
+            m_registers->CTL.ALL_BITS = ctl.ALL_BITS;
+
+            hr = _checkClock();
+
+            if (FAILED(hr))
+            {
+                m_registers = nullptr;
+                DmapCloseController(m_hController);
+                m_hController = INVALID_HANDLE_VALUE;
+            }
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            m_range = (BCM_PWM_CLOCK_HZ + (BCM_PWM_DEFAULT_FREQUENCY_HZ / 2)) / BCM_PWM_DEFAULT_FREQUENCY_HZ;
+            m_registers->RNG1 = m_range;
+            m_registers->RNG2 = m_range;
+            _writeData(0);
+            _writeData(1);
+        }
+    }
+
+    return hr;
+}
+
+/**
+This method must be called with the lock held, the controller mapped and both channels
+stopped.  The PWM clock rate is the number of clocks in the extra words sent by the long
+timing run divided by the extra time it took.
+\return HRESULT success or error code.
+*/
+HRESULT BcmPwmControllerClass::_checkClock()
+{
+    HRESULT hr = S_OK;
+    LARGE_INTEGER frequency;
+    LONGLONG shortTicks = MAXLONGLONG;
+    LONGLONG longTicks = MAXLONGLONG;
+    LONGLONG ticks;
+    LONGLONG clockHz = 0;
+
+    for (ULONG i = 0; SUCCEEDED(hr) && (i < BCM_PWM_CLOCK_CHECK_TRIES); i++)
+    {
+        hr = _timeFifoDrain(BCM_PWM_CLOCK_CHECK_SHORT_WORDS, ticks);
+        if (SUCCEEDED(hr))
+        {
+            shortTicks = min(shortTicks, ticks);
+            hr = _timeFifoDrain(BCM_PWM_CLOCK_CHECK_LONG_WORDS, ticks);
+        }
+        if (SUCCEEDED(hr))
+        {
+            longTicks = min(longTicks, ticks);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        QueryPerformanceFrequency(&frequency);
+        if (longTicks > shortTicks)
+        {
+            clockHz = ((LONGLONG)(BCM_PWM_CLOCK_CHECK_LONG_WORDS - BCM_PWM_CLOCK_CHECK_SHORT_WORDS) *
+                BCM_PWM_CLOCK_CHECK_RANGE * frequency.QuadPart) / (longTicks - shortTicks);
+        }
+
+        if ((clockHz < ((LONGLONG)BCM_PWM_CLOCK_HZ * (100 - BCM_PWM_CLOCK_TOLERANCE_PERCENT)) / 100) ||
+            (clockHz > ((LONGLONG)BCM_PWM_CLOCK_HZ * (100 + BCM_PWM_CLOCK_TOLERANCE_PERCENT)) / 100))
+        {
+            hr = DMAP_E_PWM_CLOCK_RATE_WRONG;
+        }
+    }
+
+    return hr;
+}
+
+/**
+This method must be called with the lock held, the controller mapped and both channels
+stopped.  Channel 1 is run in mark-space mode from the FIFO with words of zero, so its
+output stays LOW.  The channel is stopped and the FIFO cleared again before returning.
+\param[in] words The number of words to put in the FIFO.
+\param[out] ticks The high resolution timer ticks from starting the channel to the FIFO
+becoming empty.
+\return HRESULT success or error code.
+*/
+HRESULT BcmPwmControllerClass::_timeFifoDrain(ULONG words, LONGLONG & ticks)
+{
+    HRESULT hr = S_OK;
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER startTicks;
+    LARGE_INTEGER nowTicks;
+    LONGLONG timeoutTicks;
+    _CTL ctl;
+
+    QueryPerformanceFrequency(&frequency);
+    timeoutTicks = ((LONGLONG)BCM_PWM_CLOCK_CHECK_TIMEOUT_US * frequency.QuadPart) / 1000000LL;
+
+    // Empty the FIFO, clear any old errors and fill the FIFO.
+    ctl.ALL_BITS = 0;
+    ctl.CLRF1 = 1;
+    m_registers->CTL.ALL_BITS = ctl.ALL_BITS;
+    m_registers->STA = BCM_PWM_STA_ERRORS;
+    m_registers->RNG1 = BCM_PWM_CLOCK_CHECK_RANGE;
+    for (ULONG i = 0; i < words; i++)
+    {
+        m_registers->FIF1 = 0;
+    }
+
+    // Start the channel and wait for it to take the last word from the FIFO.
+    ctl.ALL_BITS = 0;
+    ctl.USEF1 = 1;
+    ctl.MSEN1 = 1;
+    ctl.PWEN1 = 1;
+    QueryPerformanceCounter(&startTicks);
+    m_registers->CTL.ALL_BITS = ctl.ALL_BITS;
+    do
+    {
+        QueryPerformanceCounter(&nowTicks);
+    } while (((m_registers->STA & BCM_PWM_STA_EMPT1) == 0) &&
+        ((nowTicks.QuadPart - startTicks.QuadPart) < timeoutTicks));
+
+    if ((m_registers->STA & BCM_PWM_STA_EMPT1) == 0)
+    {
+        hr = DMAP_E_PWM_CLOCK_NOT_RUNNING;
+    }
+    ticks = nowTicks.QuadPart - startTicks.QuadPart;
+
+    // Stop the channel, and leave the FIFO empty with no errors flagged.
+    ctl.ALL_BITS = 0;
+    m_registers->CTL.ALL_BITS = ctl.ALL_BITS;
+    ctl.CLRF1 = 1;
+    m_registers->CTL.ALL_BITS = ctl.ALL_BITS;
+    m_registers->STA = BCM_PWM_STA_ERRORS;
+
+    return hr;
+}
+
+/**
+This method must be called with the lock held and the controller mapped.  A duty cycle of
+100% sets the data register to the range, which keeps the output HIGH for the whole period.
+\param[in] channel The PWM channel (0 or 1).
+*/
+void BcmPwmControllerClass::_writeData(ULONG channel)
+{
+    ULONG data;
+
+    data = (ULONG)((((ULONGLONG)m_dutyCycles[channel] * m_range) + 0x80000000ULL) >> 32);
+
+    if (channel == 0)
+    {
+        m_registers->DAT1 = data;
+    }
+    else
+    {
+        m_registers->DAT2 = data;
+    }
+}
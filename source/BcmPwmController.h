@@ -0,0 +1,167 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#ifndef _BCM_PWM_CONTROLLER_H_
+#define _BCM_PWM_CONTROLLER_H_
+
+#include <Windows.h>
+#include "DmapSupport.h"
+
+// Number of PWM channels on the BCM2836 PWM controller.
+#define BCM_PWM_CHANNELS 2
+
+// Rate of the clock that drives the PWM counters (the 19.2 MHz crystal oscillator).  The
+// PWM clock is set up by the platform firmware: only the PWM controller registers are
+// mapped by DMap, the clock manager registers are not.
+#define BCM_PWM_CLOCK_HZ 19200000
+
+// The PWM clock is checked by timing how long the FIFO takes to drain with the range set
+// to this many clocks.  Each FIFO word takes one range of clocks (250 us at 19.2 MHz).
+#define BCM_PWM_CLOCK_CHECK_RANGE 4800
+
+// Number of FIFO words drained by the short and long timing runs.  The difference between
+// the two runs does not include the time taken to start the channel.
+#define BCM_PWM_CLOCK_CHECK_SHORT_WORDS 2
+#define BCM_PWM_CLOCK_CHECK_LONG_WORDS 6
+
+// Number of times each timing run is made.  The shortest time is used, since the thread
+// may have been interrupted during the others.
+#define BCM_PWM_CLOCK_CHECK_TRIES 3
+
+// Longest a timing run may take before the PWM clock is taken to be stopped.
+#define BCM_PWM_CLOCK_CHECK_TIMEOUT_US 20000
+
+// How far, in percent, the measured PWM clock rate may be from BCM_PWM_CLOCK_HZ.
+#define BCM_PWM_CLOCK_TOLERANCE_PERCENT 10
+
+// PWM Status Register bits.
+#define BCM_PWM_STA_EMPT1 0x00000002    // FIFO empty
+#define BCM_PWM_STA_ERRORS 0x000001FC   // FIFO write and read errors, gaps, bus error
+
+// The PWM frequency used until another frequency is set.
+#define BCM_PWM_DEFAULT_FREQUENCY_HZ 1000
+
+// The lowest and highest PWM frequencies supported.  At the highest frequency a period is
+// 192 PWM clocks long, so duty cycles can still be set in steps of about 0.5%.
+#define BCM_PWM_MIN_FREQUENCY_HZ 1
+#define BCM_PWM_MAX_FREQUENCY_HZ 100000
+
+/// BCM2836 PWM Controller Class for use with Raspberry Pi 2.
+/**
+The PWM controller has two channels, each of which can be brought out on two GPIO pins
+(channel 0 on GPIO12 or GPIO18, channel 1 on GPIO13 or GPIO19).  The channels are run in
+mark-space mode, so each period is one high pulse followed by a low gap, and once set up
+they produce their signals with no further work by the CPU.  Both channels are driven
+by the same clock and are set to the same frequency.
+
+The platform firmware must start the PWM clock from the 19.2 MHz oscillator with a
+divisor of 1 (CM_PWMCTL SRC = 1 and ENAB = 1, CM_PWMDIV DIVI = 1).  The clock manager is
+not mapped by DMap, so this class can't set up the clock itself.  Instead it measures the
+clock rate when it first maps the controller, and fails if the clock is stopped or is
+not close to BCM_PWM_CLOCK_HZ.
+*/
+class BcmPwmControllerClass
+{
+public:
+    /// Constructor.
+    LIGHTNING_DLL_API BcmPwmControllerClass();
+
+    /// Destructor.
+    virtual ~BcmPwmControllerClass()
+    {
+        end();
+    }
+
+    /// Stop both PWM channels and unmap the PWM controller.
+    LIGHTNING_DLL_API void end();
+
+    /// Set the PWM frequency of both channels.
+    LIGHTNING_DLL_API HRESULT setFrequency(ULONG frequencyHz);
+
+    /// Get the PWM frequency actually produced.
+    LIGHTNING_DLL_API ULONG getActualFrequency();
+
+    /// Set the duty cycle of a channel, and start the channel if it is stopped.
+    LIGHTNING_DLL_API HRESULT setDutyCycle(ULONG channel, ULONG dutyCycle);
+
+    /// Stop the PWM signal on a channel.
+    LIGHTNING_DLL_API HRESULT disableChannel(ULONG channel);
+
+private:
+
+#pragma warning(push)
+#pragma warning(disable : 4201) // Ignore nameless struct/union warnings
+
+    /// PWM Control Register
+    typedef union {
+        struct {
+            ULONG PWEN1 : 1;        ///< Channel 1 Enable (0:disabled, 1:enabled)
+            ULONG MODE1 : 1;        ///< Channel 1 Mode (0:PWM mode, 1:serializer mode)
+            ULONG RPTL1 : 1;        ///< Channel 1 Repeat Last Data (0:stop when FIFO empty, 1:repeat)
+            ULONG SBIT1 : 1;        ///< Channel 1 Silence Bit (output state when no transmission)
+            ULONG POLA1 : 1;        ///< Channel 1 Polarity (0:normal, 1:inverted)
+            ULONG USEF1 : 1;        ///< Channel 1 Use FIFO (0:use data register, 1:use FIFO)
+            ULONG CLRF1 : 1;        ///< Clear FIFO (write 1 to clear)
+            ULONG MSEN1 : 1;        ///< Channel 1 M/S Enable (0:PWM algorithm, 1:M/S transmission)
+            ULONG PWEN2 : 1;        ///< Channel 2 Enable (0:disabled, 1:enabled)
+            ULONG MODE2 : 1;        ///< Channel 2 Mode (0:PWM mode, 1:serializer mode)
+            ULONG RPTL2 : 1;        ///< Channel 2 Repeat Last Data (0:stop when FIFO empty, 1:repeat)
+            ULONG SBIT2 : 1;        ///< Channel 2 Silence Bit (output state when no transmission)
+            ULONG POLA2 : 1;        ///< Channel 2 Polarity (0:normal, 1:inverted)
+            ULONG USEF2 : 1;        ///< Channel 2 Use FIFO (0:use data register, 1:use FIFO)
+            ULONG _rsvd1 : 1;       // Reserved
+            ULONG MSEN2 : 1;        ///< Channel 2 M/S Enable (0:PWM algorithm, 1:M/S transmission)
+            ULONG _rsvd2 : 16;      // Reserved
+        };
+        ULONG ALL_BITS;
+    } _CTL;
+
+#pragma warning( pop )
+
+    /// Layout of the BCM2836 PWM Controller registers in memory.
+    typedef struct _PWM_CONTROLLER {
+        volatile _CTL       CTL;    ///< 0x00 - PWM Control Register
+        volatile ULONG      STA;    ///< 0x04 - PWM Status Register
+        volatile ULONG      DMAC;   ///< 0x08 - PWM DMA Configuration Register
+        ULONG               _rsvd1; // 0x0C - Reserved
+        volatile ULONG      RNG1;   ///< 0x10 - PWM Channel 1 Range Register
+        volatile ULONG      DAT1;   ///< 0x14 - PWM Channel 1 Data Register
+        volatile ULONG      FIF1;   ///< 0x18 - PWM FIFO Input Register
+        ULONG               _rsvd2; // 0x1C - Reserved
+        volatile ULONG      RNG2;   ///< 0x20 - PWM Channel 2 Range Register
+        volatile ULONG      DAT2;   ///< 0x24 - PWM Channel 2 Data Register
+    } PWM_CONTROLLER, *PPWM_CONTROLLER;
+
+    /// Device handle used to map PWM controller registers into user-mode address space.
+    HANDLE m_hController;
+
+    /// Pointer to PWM controller registers mapped into this process' address space.
+    PPWM_CONTROLLER m_registers;
+
+    /// The number of PWM clocks in one PWM period.
+    ULONG m_range;
+
+    /// The duty cycle last set for each channel (0-0xFFFFFFFF for 0-100%).
+    ULONG m_dutyCycles[BCM_PWM_CHANNELS];
+
+    /// Lock protecting the control register and the channel settings.
+    SRWLOCK m_lock;
+
+    /// Map the PWM controller registers and set up the controller if this has not been done.
+    HRESULT _mapIfNeeded();
+
+    /// Check that the PWM clock is running at BCM_PWM_CLOCK_HZ.
+    HRESULT _checkClock();
+
+    /// Time how long channel 1 takes to send a number of words from the FIFO.
+    HRESULT _timeFifoDrain(ULONG words, LONGLONG & ticks);
+
+    /// Write the data register of a channel for its duty cycle at the current range.
+    void _writeData(ULONG channel);
+};
+
+/// The global object used to drive the BCM2836 PWM controller.
+LIGHTNING_DLL_API extern BcmPwmControllerClass g_bcmPwm;
+
+#endif  // _BCM_PWM_CONTROLLER_H_
@@ -59,6 +59,8 @@ BcmSpiControllerClass::BcmSpiControllerClass()
 {
     m_hController = INVALID_HANDLE_VALUE;
     m_registers = nullptr;
+    m_busNumber = EXTERNAL_SPI_BUS;
+    m_selectSetTa = FALSE;
 
     // Load values for the SPI clock generator divisors.
     // SPI clock is 250mhz / Divisor.  Divisors must be even, and < 65536.
@@ -117,6 +119,7 @@ HRESULT BcmSpiControllerClass::begin(ULONG busNumber, ULONG mode, ULONG clockKhz
             if (SUCCEEDED(hr))
             {
                 m_registers = (PSPI_CONTROLLER)baseAddress;
+                m_busNumber = busNumber;
             }
         }
 
@@ -139,6 +142,7 @@ HRESULT BcmSpiControllerClass::begin(ULONG busNumber, ULONG mode, ULONG clockKhz
             cs.ALL_BITS = 0;
             cs.CPHA = m_clockPhase;
             cs.CPOL = m_clockPolarity;
+            cs.CS = BCM_SPI_UNUSED_CHIP_SELECT; // No chip select line asserted
             cs.CLEAR = 3;                       // Clear both FIFOs,
             cs.TA = 1;                          //  then start transfers.
             m_registers->CS.ALL_BITS = cs.ALL_BITS;
@@ -180,6 +184,7 @@ The SPI mode specifies the clock polarity and phase.
 HRESULT BcmSpiControllerClass::setMode(ULONG mode)
 {
     HRESULT hr = S_OK;
+    _CS cs;
 
     // Determine the clock phase and polarity settings for the requested mode.
     switch (mode)
@@ -204,6 +209,16 @@ HRESULT BcmSpiControllerClass::setMode(ULONG mode)
         hr = DMAP_E_SPI_MODE_SPECIFIED_IS_INVALID;
     }
 
+    // If the controller is mapped, set the new phase and polarity in the hardware.
+    if (SUCCEEDED(hr) && (m_registers != nullptr))
+    {
+        cs.ALL_BITS = m_registers->CS.ALL_BITS;
+        cs.CLEAR = 0;
+        cs.CPHA = m_clockPhase;
+        cs.CPOL = m_clockPolarity;
+        m_registers->CS.ALL_BITS = cs.ALL_BITS;
+    }
+
     return hr;
 }
 
@@ -315,6 +330,7 @@ inline HRESULT BcmSpiControllerClass::_transfer(ULONG dataOut, ULONG & dataIn, U
     HRESULT hr = S_OK;
     _CS cs;
     BYTE* oneByte;
+    int byteCount;
     int bytesRemaining;
 
 
@@ -331,18 +347,21 @@ inline HRESULT BcmSpiControllerClass::_transfer(ULONG dataOut, ULONG & dataIn, U
 
     if (SUCCEEDED(hr))
     {
-        bytesRemaining = bits / 8;
+        byteCount = bits / 8;
         oneByte = (BYTE*)&dataOut;
         dataIn = 0;
 
-        while (bytesRemaining > 0)
+        // Queue all the bytes of the data, most significant byte first.  The TX FIFO
+        // is empty between transfers, so it has room for them.
+        for (bytesRemaining = byteCount; bytesRemaining > 0; bytesRemaining--)
         {
-            // Wait for an available space in the TX FIFO.
-            do { cs.ALL_BITS = m_registers->CS.ALL_BITS; } while (cs.TXD == 0);
-
-            // Send a byte of the data.
             m_registers->FIFO.DATA_BYTE0 = oneByte[bytesRemaining - 1];
+        }
 
+        // Collect the received bytes as they arrive.
+        bytesRemaining = byteCount;
+        while (bytesRemaining > 0)
+        {
             // Wait for the RX FIFO to have data.
             do { cs.ALL_BITS = m_registers->CS.ALL_BITS; } while (cs.RXD == 0);
 
@@ -357,7 +376,10 @@ inline HRESULT BcmSpiControllerClass::_transfer(ULONG dataOut, ULONG & dataIn, U
 }
 
 /**
-This method transfers a buffer of data on the bus.
+This method transfers a buffer of data on the bus.  As many whole 32-bit words as
+possible are sent with the controller in DMA mode, which packs four bytes into each
+FIFO access (least significant byte first on the bus).  Any remaining bytes are sent
+one per FIFO access.
 \param[in] dataOut The data to send on the SPI bus. If the parameter is NULL, 0's will be sent
 \param[in] datIn The data received on the SPI bus. If this parameter is NULL, data in will be ignored
 \param[in] bufferBytes the size of each of the buffers
@@ -366,56 +388,191 @@ This method transfers a buffer of data on the bus.
 HRESULT BcmSpiControllerClass::transferBuffer(PBYTE dataOut, PBYTE dataIn, size_t bufferBytes)
 {
     HRESULT hr = S_OK;
-    size_t i = 0;
-    size_t bytesRead = 0;
+    size_t offset = 0;
+    size_t wordBytes = bufferBytes & ~((size_t)0x3);
+    ULONG chunkBytes = 0;
     _CS cs;
-    volatile ULONG tempDataIn = 0;
 
     if (m_registers == nullptr)
     {
         hr = DMAP_E_DMAP_INTERNAL_ERROR;
     }
 
-    if (SUCCEEDED(hr))
+    // Transfer the whole words at the start of the buffer using 32-bit FIFO accesses.
+    while (SUCCEEDED(hr) && ((wordBytes - offset) >= BCM_SPI_WORD_MODE_MIN_BYTES))
     {
-        for (i = 0; i < bufferBytes; i++)
+        chunkBytes = (ULONG)min(wordBytes - offset, BCM_SPI_MAX_WORD_MODE_BYTES);
+
+        // Put the controller in DMA mode for the length of this chunk.  The FIFOs
+        // are empty here, so no bytes are left over from earlier transfers.
+        m_registers->DLEN.ALL_BITS = chunkBytes;
+        cs.ALL_BITS = m_registers->CS.ALL_BITS;
+        cs.CLEAR = 0;
+        cs.DMAEN = 1;
+        m_registers->CS.ALL_BITS = cs.ALL_BITS;
+
+        hr = _transferFifo(
+            dataOut ? dataOut + offset : nullptr,
+            dataIn ? dataIn + offset : nullptr,
+            chunkBytes,
+            sizeof(ULONG));
+
+        // Return the controller to byte at a time FIFO accesses.
+        cs.DMAEN = 0;
+        m_registers->CS.ALL_BITS = cs.ALL_BITS;
+        m_registers->DLEN.ALL_BITS = 0;
+
+        offset = offset + chunkBytes;
+    }
+
+    // Transfer any remaining bytes one FIFO access at a time.
+    if (SUCCEEDED(hr) && (offset < bufferBytes))
+    {
+        hr = _transferFifo(
+            dataOut ? dataOut + offset : nullptr,
+            dataIn ? dataIn + offset : nullptr,
+            (ULONG)(bufferBytes - offset),
+            1);
+    }
+
+    return hr;
+}
+
+/**
+Data is written to the TX FIFO without checking the status, as long as the number of
+entries written but not yet read back is less than the depth of the FIFOs: those entries
+are the only ones that can be in the TX FIFO, the shift register or the RX FIFO.  Each
+time the TX FIFO has been topped up this way, one read of the CS register tells how many
+entries can be read from the RX FIFO.
+\param[in] dataOut The data to send. If the parameter is NULL, 0's will be sent
+\param[out] dataIn The buffer for the data received. If this parameter is NULL, data in
+will be ignored
+\param[in] byteCount The number of bytes to transfer, a multiple of entryBytes.
+\param[in] entryBytes The number of bytes in each FIFO entry: 4 if the controller is in
+DMA mode, 1 otherwise.
+\return HRESULT success or error code.
+*/
+HRESULT BcmSpiControllerClass::_transferFifo(PBYTE dataOut, PBYTE dataIn, ULONG byteCount, ULONG entryBytes)
+{
+    HRESULT hr = S_OK;
+    ULONG fifoEntries = BCM_SPI_FIFO_BYTES / entryBytes;
+    ULONG entryCount = byteCount / entryBytes;
+    ULONG entriesWritten = 0;
+    ULONG entriesRead = 0;
+    ULONG readCount = 0;
+    ULONG data = 0;
+    PBYTE outPtr = dataOut;
+    PBYTE inPtr = dataIn;
+    ULONG i = 0;
+    _CS cs;
+
+    while (entriesRead < entryCount)
+    {
+        // Top up the TX FIFO.
+        while ((entriesWritten < entryCount) && ((entriesWritten - entriesRead) < fifoEntries))
         {
-            // Wait for an available space in the TX FIFO.
-            do {
-                cs.ALL_BITS = m_registers->CS.ALL_BITS;
-                // If buffer is not empty, clear it
-                if (cs.RXD != 0)
+            data = 0;
+            if (outPtr != nullptr)
+            {
+                for (i = 0; i < entryBytes; i++)
                 {
-                    // Read one byte from the buffer
-                    tempDataIn = m_registers->FIFO.ALL_BITS;
-                    if (dataIn)
-                    {
-                        dataIn[bytesRead] = (BYTE)(tempDataIn & 0x000000FF);
-                    }
-                    bytesRead++;
+                    data = data | ((ULONG)outPtr[i] << (i * 8));
                 }
-            } while (cs.TXD == 0);
+                outPtr = outPtr + entryBytes;
+            }
+            m_registers->FIFO.ALL_BITS = data;
+            entriesWritten++;
+        }
 
-            // Send a byte of the data.
-            m_registers->FIFO.DATA_BYTE0 = dataOut ? dataOut[i] : 0;
+        // Read all the entries the status shows are in the RX FIFO.
+        cs.ALL_BITS = m_registers->CS.ALL_BITS;
+        readCount = _rxFifoCount(cs, entriesWritten - entriesRead, entryBytes);
+        while (readCount > 0)
+        {
+            data = m_registers->FIFO.ALL_BITS;
+            if (inPtr != nullptr)
+            {
+                for (i = 0; i < entryBytes; i++)
+                {
+                    inPtr[i] = (BYTE)(data >> (i * 8));
+                }
+                inPtr = inPtr + entryBytes;
+            }
+            entriesRead++;
+            readCount--;
         }
+    }
+
+    return hr;
+}
+
+/**
+Only SPI0 has chip select lines brought out to the header: CE0 on pin 24 and CE1 on pin 26.
+\param[in] csPin The number of the pin to be used as a chip select.
+\param[out] csLine The chip select line (0 or 1) that drives the pin.
+\return TRUE if the controller can drive the pin, FALSE otherwise.
+*/
+BOOL BcmSpiControllerClass::_hardwareChipSelectLine(ULONG csPin, ULONG & csLine)
+{
+    BOOL isHardware = FALSE;
 
-        // Read any remaining bytes in the buffer
-        while (bytesRead < bufferBytes)
+    if (m_busNumber == EXTERNAL_SPI_BUS)
+    {
+        if (csPin == PI2_PIN_SPI0_CS0)
         {
-            // Wait for the RX FIFO to have data.
-            do {
-                cs.ALL_BITS = m_registers->CS.ALL_BITS;
-            } while (cs.RXD == 0);
+            csLine = 0;
+            isHardware = TRUE;
+        }
+        else if (csPin == PI2_PIN_SPI0_CS1)
+        {
+            csLine = 1;
+            isHardware = TRUE;
+        }
+    }
 
-            // Read the received data.
-            tempDataIn = m_registers->FIFO.ALL_BITS;
-            if (dataIn)
+    return isHardware;
+}
+
+/**
+The controller asserts the selected chip select line while a transfer is active (CS.TA set).
+begin() leaves TA set with a chip select line that is not brought out to a pin, so the
+device is selected by switching to its line and deselected by switching back to the
+unused line, leaving TA set for transfers done outside selectChip() and deselectChip().
+TA is only cleared on deselect if it was clear when the chip was selected and this
+method set it.
+\param[in] selected TRUE to assert the chip select, FALSE to deassert it.
+\return HRESULT success or error code.
+*/
+HRESULT BcmSpiControllerClass::_driveHardwareChipSelect(BOOL selected)
+{
+    HRESULT hr = S_OK;
+    _CS cs;
+
+    if (m_registers == nullptr)
+    {
+        hr = DMAP_E_DMAP_INTERNAL_ERROR;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        cs.ALL_BITS = m_registers->CS.ALL_BITS;
+        cs.CLEAR = 0;
+        if (m_hardwareChipSelect && selected)
+        {
+            m_selectSetTa = (cs.TA == 0);
+            cs.CS = m_csLine;
+            cs.TA = 1;
+        }
+        else
+        {
+            cs.CS = BCM_SPI_UNUSED_CHIP_SELECT;
+            if (m_selectSetTa)
             {
-                dataIn[bytesRead] = (BYTE)(tempDataIn & 0x000000FF);
+                cs.TA = 0;
+                m_selectSetTa = FALSE;
             }
-            bytesRead++;
         }
+        m_registers->CS.ALL_BITS = cs.ALL_BITS;
     }
 
     return hr;
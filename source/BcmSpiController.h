@@ -10,6 +10,20 @@
 #include "DmapSupport.h"
 #include "BoardPins.h"
 
+// Depth of the SPI Controller TX and RX FIFOs in bytes.
+#define BCM_SPI_FIFO_BYTES 64
+
+// RX FIFO bytes guaranteed while CS.RXR is set (the FIFO is at least 3/4 full).
+#define BCM_SPI_RXR_BYTES 48
+
+// Smallest buffer transfer done with 32-bit FIFO accesses.
+#define BCM_SPI_WORD_MODE_MIN_BYTES 16
+
+// Largest whole number of 32-bit words the DLEN register can count.
+#define BCM_SPI_MAX_WORD_MODE_BYTES 0xFFFC
+
+// Chip select line that is not brought out to a pin, used when no line should be asserted.
+#define BCM_SPI_UNUSED_CHIP_SELECT 2
 
 /// BCM2836 SPI Controller Class for use with Raspberry Pi 2.
 class BcmSpiControllerClass : public SpiControllerClass
@@ -201,12 +215,57 @@ private:
     /// Pointer to SPI controller registers mapped into this process' address space.
     PSPI_CONTROLLER m_registers;
 
+    /// The number of the SPI bus this controller drives.
+    ULONG m_busNumber;
+
     /// SPI clock phase.
     ULONG m_clockPhase;
 
     /// SPI clock polarity.
     ULONG m_clockPolarity;
 
+    /// TRUE if TA was set by selecting the chip, so deselecting it should clear TA again.
+    BOOL m_selectSetTa;
+
+    /// Determine whether a pin is one of the chip select lines of this SPI controller.
+    BOOL _hardwareChipSelectLine(ULONG csPin, ULONG & csLine) override;
+
+    /// Drive the chip select line of this SPI controller.
+    HRESULT _driveHardwareChipSelect(BOOL selected) override;
+
+    /// Transfer bytes through the FIFOs, keeping the TX FIFO topped up.
+    HRESULT _transferFifo(PBYTE dataOut, PBYTE dataIn, ULONG byteCount, ULONG entryBytes);
+
+    /// Method to get the number of FIFO entries that can be read from the RX FIFO, from the status.
+    /**
+    \param[in] csReg The contents of the CS register.
+    \param[in] outstanding The number of entries written to the TX FIFO but not yet read.
+    \param[in] entryBytes The number of bytes in each FIFO entry (1, or 4 in DMA mode).
+    \return The number of entries that can be read without checking the status again.
+    */
+    static ULONG _rxFifoCount(const _CS & csReg, ULONG outstanding, ULONG entryBytes)
+    {
+        ULONG count = 0;
+
+        if (csReg.DONE == 1)
+        {
+            count = outstanding;
+        }
+        else if (csReg.RXF == 1)
+        {
+            count = BCM_SPI_FIFO_BYTES / entryBytes;
+        }
+        else if (csReg.RXR == 1)
+        {
+            count = BCM_SPI_RXR_BYTES / entryBytes;
+        }
+        else if (csReg.RXD == 1)
+        {
+            count = 1;
+        }
+        return count;
+    }
+
     /// The minimum width of a transfer on this controller.
     const UINT m_minTransferBits = 8;
 
@@ -7,6 +7,8 @@
 #include "ErrorCodes.h"
 #include "BoardPins.h"
 #include "I2c.h"
+#include "BcmPwmController.h"
+#include "PeripheralSimulator.h"
 
 // The default PWM chip I2C address on the Ika Lure is 0x40.  To use the Ika Lure with a 
 // Weather Shield which has a humidity sensor at addresss 0x40 the address of the PWM chip
@@ -81,7 +83,7 @@ const ULONG MBM_IKA_LURE_ADC_ADR = 0x48;    ///< I2C address of ADC on MBM Ika L
 // The number of connector pins on an PI2 plus one for zero, plus one for onboard led.
 const ULONG NUM_PI2_PINS = 42;  ///< Number of entries in a zero based array indexed by PI2 pin number.
 
-// The expected I2C address of an external PCA9685 PWM chip.
+// The I2C address of the external PCA9685 PWM chip used until setPwmChipAddresses() is called.
 const UCHAR EXT_PCA9685_I2C_ADR = 0x40;
 
 
@@ -269,7 +271,7 @@ const BoardPinsClass::PWM_CHANNEL g_MbmIkaPwmChannels[] =
 };
 #endif // defined(_M_IX86) || defined(_M_X64)
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
 /// The global table of pin attributes for the PI2 board.
 /**
 This table contains all the pin-specific attributes needed to configure and use an I/O pin.
@@ -291,7 +293,7 @@ const BoardPinsClass::PORT_ATTRIBUTES g_Pi2PinAttributes[] =
     { GPIO_NONE,   0,    NO_X, 0,    NO_X, 0,    NO_MUX, NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_NUL },             //  9
     { GPIO_BCM,   15,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 1,0, 0, 0, 0, 0, FUNC_DIO | FUNC_SER },  // 10
     { GPIO_BCM,   17,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 11
-    { GPIO_BCM,   18,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 12
+    { GPIO_BCM,   18,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO | FUNC_PWM },  // 12
     { GPIO_BCM,   27,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 13
     { GPIO_NONE,   0,    NO_X, 0,    NO_X, 0,    NO_MUX, NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_NUL },             // 14
     { GPIO_BCM,   22,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 15
@@ -311,10 +313,10 @@ const BoardPinsClass::PORT_ATTRIBUTES g_Pi2PinAttributes[] =
     { GPIO_BCM,    5,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 29
     { GPIO_NONE,   0,    NO_X, 0,    NO_X, 0,    NO_MUX, NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_NUL },             // 30
     { GPIO_BCM,    6,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 31
-    { GPIO_BCM,   12,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 32
-    { GPIO_BCM,   13,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 33
+    { GPIO_BCM,   12,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO | FUNC_PWM },  // 32
+    { GPIO_BCM,   13,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO | FUNC_PWM },  // 33
     { GPIO_NONE,   0,    NO_X, 0,    NO_X, 0,    NO_MUX, NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_NUL },             // 34
-    { GPIO_BCM,   19,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 35
+    { GPIO_BCM,   19,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO | FUNC_PWM },  // 35
     { GPIO_BCM,   16,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 36
     { GPIO_BCM,   26,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 37
     { GPIO_BCM,   20,    MUX0, 0,    NO_X, 0,    MUX0,   NO_MUX,  0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0, 0, 0, 0, FUNC_DIO },             // 38
@@ -350,8 +352,10 @@ const BoardPinsClass::MUX_ATTRIBUTES g_Pi2MuxAttributes[MAX_MUXES] =
 /// The global table of PWM information for the PI2 board.
 /**
 This table contains the information needed to drive the PWM channels.  It is indexed by the
-PI2 connector pin number, and specifies the chip and port-bit that implements PWM for that pin.
-This is currently not used, but is included here for compatibility with the other boards.
+PI2 connector pin number.  The pins that can be driven by the PWM controller in the BCM2836
+SOC specify the PWM channel, and the alternate function (0-5) that connects the channel to the
+pin is stored in the portBit field.  Pins 50 and up are pseudo-pins for the channels of an
+external PCA9685 PWM chip, and are not in this table.
 */
 const BoardPinsClass::PWM_CHANNEL g_Pi2PwmChannels[] =
 {
@@ -367,7 +371,7 @@ const BoardPinsClass::PWM_CHANNEL g_Pi2PwmChannels[] =
     { NO_X, 0, 0, 0 },          ///<  9
     { NO_X, 0, 0, 0 },          ///< 10
     { NO_X, 0, 0, 0 },          ///< 11
-    { NO_X, 0, 0, 0 },          ///< 12
+    { SOCBCM, 0, 5, 0 },        ///< 12
     { NO_X, 0, 0, 0 },          ///< 13
     { NO_X, 0, 0, 0 },          ///< 14
     { NO_X, 0, 0, 0 },          ///< 15
@@ -387,10 +391,10 @@ const BoardPinsClass::PWM_CHANNEL g_Pi2PwmChannels[] =
     { NO_X, 0, 0, 0 },          ///< 29
     { NO_X, 0, 0, 0 },          ///< 30
     { NO_X, 0, 0, 0 },          ///< 31
-    { NO_X, 0, 0, 0 },          ///< 32
-    { NO_X, 0, 0, 0 },          ///< 33
+    { SOCBCM, 0, 0, 0 },        ///< 32
+    { SOCBCM, 1, 0, 0 },        ///< 33
     { NO_X, 0, 0, 0 },          ///< 34
-    { NO_X, 0, 0, 0 },          ///< 35
+    { SOCBCM, 1, 5, 0 },        ///< 35
     { NO_X, 0, 0, 0 },          ///< 36
     { NO_X, 0, 0, 0 },          ///< 37
     { NO_X, 0, 0, 0 },          ///< 38
@@ -398,7 +402,7 @@ const BoardPinsClass::PWM_CHANNEL g_Pi2PwmChannels[] =
     { NO_X, 0, 0, 0 },          ///< 40
     { NO_X, 0, 0, 0 }           ///< 41 - PI2 Onboard LED
 };
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 
 /// The global table of I/O Expander attributes for the boards.
 /**
@@ -478,8 +482,12 @@ BoardPinsClass::BoardPinsClass()
     m_ExpAttributes(g_GenxExpAttributes),
     m_PinFunctions(g_GenxPinFunctions),
     m_PwmChannels(NULL),
-    m_GpioPinCount(0)
+    m_GpioPinCount(0),
+    m_PwmChipCount(1),
+    m_PwmAllCallAdr(0)
 {
+    // Until told otherwise, expect one external PWM chip at its usual address.
+    m_PwmChipAdrs[0] = EXT_PCA9685_I2C_ADR;
 }
 
 /**
@@ -665,6 +673,14 @@ HRESULT BoardPinsClass::_setPinPwm(ULONG pin)
         hr = setPinMode(pin, DIRECTION_OUT, FALSE);
     }
 
+#if LIGHTNING_PI2_SUPPORTED
+    // If the pin is driven by the PWM controller in the SOC, connect the PWM channel to the pin.
+    if (SUCCEEDED(hr) && (m_boardType == PI2_BARE) && (m_PwmChannels[pin].expander == SOCBCM))
+    {
+        hr = g_bcmGpio.setPinAltFunction(m_PinAttributes[pin].portBit, m_PwmChannels[pin].portBit);
+    }
+#endif // LIGHTNING_PI2_SUPPORTED
+
     return hr;
 }
 
@@ -817,11 +833,11 @@ HRESULT BoardPinsClass::setPinMode(ULONG pin, ULONG mode, BOOL pullup)
         // Set the pin direction on the device that supports this pin.
         switch (m_PinAttributes[pin].gpioType)
         {
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
         case GPIO_BCM:
             hr = g_bcmGpio.setPinDirection(m_PinAttributes[pin].portBit, mode);
             break;
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 #if defined(_M_IX86) || defined(_M_X64)
         case GPIO_S0:
             hr = g_btFabricGpio.setS0PinDirection(m_PinAttributes[pin].portBit, mode);
@@ -878,11 +894,11 @@ HRESULT BoardPinsClass::_setExpBitToState(ULONG pin, ULONG expNo, ULONG bitNo, U
         // Set the bit of the PWM chip to the desired state.
         hr = PCA9685Device::SetBitState(i2cAdr, bitNo, state);
         break;
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
     case BCM2836:
         hr = g_bcmGpio.setPinFunction(m_PinAttributes[pin].portBit, state);
         break;
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 #if defined(_M_IX86) || defined(_M_X64)
     case BAYTRAIL:
         if (m_PinAttributes[pin].gpioType == GPIO_S0)
@@ -966,9 +982,12 @@ HRESULT BoardPinsClass::_configurePinPullup(ULONG pin, BOOL pullup)
 
     if (SUCCEEDED(hr))
     {
-#if defined (_M_ARM)
-        hr = g_bcmGpio.setPinPullup(m_PinAttributes[pin].portBit, pullup);
-#endif // defined (_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
+        if (m_boardType == PI2_BARE)
+        {
+            hr = g_bcmGpio.setPinPullup(m_PinAttributes[pin].portBit, pullup);
+        }
+#endif // LIGHTNING_PI2_SUPPORTED
 
         // Nothing is needed here for MBM pins.  MBM GPIO pins have pullups
         // from the level converters, whether they are wanted or not.
@@ -1039,10 +1058,10 @@ HRESULT BoardPinsClass::setPinState(ULONG pin, ULONG state)
         // Dispatch to the correct method according to the type of GPIO pin we are dealing with.
         switch (m_PinAttributes[pin].gpioType)
         {
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
         case GPIO_BCM:
             return g_bcmGpio.setPinState(m_PinAttributes[pin].portBit, state);
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 #if defined(_M_IX86) || defined(_M_X64)
         case GPIO_S0:
             return g_btFabricGpio.setS0PinState(m_PinAttributes[pin].portBit, state);
@@ -1057,6 +1076,82 @@ HRESULT BoardPinsClass::setPinState(ULONG pin, ULONG state)
     return hr;
 }
 
+/**
+Method to find the GPIO port a pin is on, and the bit mask that selects the pin in writes
+to that port with setPortState().  Only GPIO controllers with port-wide set and clear
+registers support this; for pins on other controllers the error returned indicates each
+pin must be written with setPinState() instead.
+\param[in] pin The number of the pin in question.
+\param[out] port The GPIO port the pin is on.
+\param[out] mask The bit mask for the pin within the port.
+\return HRESULT success or error code.
+*/
+HRESULT BoardPinsClass::getPinPortMask(ULONG pin, ULONG & port, ULONG & mask)
+{
+    HRESULT hr = S_OK;
+
+    hr = _verifyBoardType();
+
+    if (SUCCEEDED(hr) && !pinNumberIsSafe(pin))
+    {
+        hr = DMAP_E_PIN_NUMBER_TOO_LARGE_FOR_BOARD;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        switch (m_PinAttributes[pin].gpioType)
+        {
+#if LIGHTNING_PI2_SUPPORTED
+        case GPIO_BCM:
+            port = m_PinAttributes[pin].portBit / 32;
+            mask = 1 << (m_PinAttributes[pin].portBit % 32);
+            break;
+#endif // LIGHTNING_PI2_SUPPORTED
+        default:
+            hr = DMAP_E_FUNCTION_NOT_SUPPORTED_ON_PIN;
+        }
+    }
+
+    return hr;
+}
+
+/**
+Method to set and clear several GPIO output pins on one port at the same time.  The
+pins are selected with the masks returned by getPinPortMask().
+\param[in] port The GPIO port to write.
+\param[in] setMask The masks of the pins to set HIGH, ORed together.
+\param[in] clearMask The masks of the pins to set LOW, ORed together.
+\return HRESULT success or error code.
+*/
+HRESULT BoardPinsClass::setPortState(ULONG port, ULONG setMask, ULONG clearMask)
+{
+    HRESULT hr = S_OK;
+
+    hr = _verifyBoardType();
+
+    if (SUCCEEDED(hr))
+    {
+#if LIGHTNING_PI2_SUPPORTED
+        if (m_boardType != PI2_BARE)
+        {
+            hr = DMAP_E_FUNCTION_NOT_SUPPORTED_ON_PIN;
+        }
+        else if (port > 1)
+        {
+            hr = DMAP_E_INVALID_PORT_BIT_FOR_DEVICE;
+        }
+        else
+        {
+            hr = g_bcmGpio.setPortState(port, setMask, clearMask);
+        }
+#else
+        hr = DMAP_E_FUNCTION_NOT_SUPPORTED_ON_PIN;
+#endif // LIGHTNING_PI2_SUPPORTED
+    }
+
+    return hr;
+}
+
 /**
 Method to read a GPIO input pin.
 \param[in] pin The number of the pin in question.
@@ -1079,10 +1174,10 @@ HRESULT BoardPinsClass::getPinState(ULONG pin, ULONG & state)
         // Dispatch to the correct method according to the type of GPIO pin we are dealing with.
         switch (m_PinAttributes[pin].gpioType)
         {
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
         case GPIO_BCM:
             return g_bcmGpio.getPinState(m_PinAttributes[pin].portBit, state);
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 #if defined(_M_IX86) || defined(_M_X64)
         case GPIO_S0:
             return g_btFabricGpio.getS0PinState(m_PinAttributes[pin].portBit, state);
@@ -1137,13 +1232,33 @@ HRESULT BoardPinsClass::setPwmDutyCycle(ULONG pin, ULONG dutyCycle)
             break;
 
         case BOARD_TYPE::MBM_BARE:
-        case BOARD_TYPE::PI2_BARE:
-            // Conver the pseudo-pin number passed in to a channel number.
-            channel = pin - PWM0;
+            // Convert the pseudo-pin number passed in to a chip and channel number.
+            hr = _getExtPwmChannel(pin, i2cAdr, channel);
 
-            // If we have a PWM chip, it is external to the board.  The only one we
+            // If we have PWM chips, they are external to the board.  The only one we
             // currently support is the PCA9685.  Assume that is what we are using.
-            hr = PCA9685Device::SetPwmDutyCycle(EXT_PCA9685_I2C_ADR, channel, dutyCycle);
+            if (SUCCEEDED(hr))
+            {
+                hr = PCA9685Device::SetPwmDutyCycle(i2cAdr, channel, dutyCycle);
+            }
+            break;
+
+        case BOARD_TYPE::PI2_BARE:
+            if ((pin < PWM0) && (m_PwmChannels[pin].expander == SOCBCM))
+            {
+                // The pin is driven by a channel of the PWM controller in the SOC.
+                hr = g_bcmPwm.setDutyCycle(m_PwmChannels[pin].channel, dutyCycle);
+            }
+            else
+            {
+                // Convert the pseudo-pin number passed in to a channel number on one of
+                // the external PCA9685 chips.
+                hr = _getExtPwmChannel(pin, i2cAdr, channel);
+                if (SUCCEEDED(hr))
+                {
+                    hr = PCA9685Device::SetPwmDutyCycle(i2cAdr, channel, dutyCycle);
+                }
+            }
             break;
 
         default:
@@ -1155,6 +1270,109 @@ HRESULT BoardPinsClass::setPwmDutyCycle(ULONG pin, ULONG dutyCycle)
 }
 
 
+/**
+This method expects the call to have verified the pin numbers are in range, support
+PWM functions, and are in PWM mode.  The duty cycles are staged on the PWM chips first,
+then sent in one pass over the chips, with one I2C transaction for each chip that changed,
+so the pins can be listed in any order.
+\param[in] pins The numbers of the GPIO pins to set the duty cycles of.
+\param[in] dutyCycles The desired duty-cycle of the positive pulses for each pin
+(0-0xFFFFFFFF for 0-100%).
+\param[in] count The number of pins.
+\return HRESULT success or error code.
+*/
+HRESULT BoardPinsClass::setPwmDutyCycles(const ULONG pins[], const ULONG dutyCycles[], ULONG count)
+{
+    HRESULT hr = S_OK;
+    HRESULT flushHr = S_OK;
+    ULONG expNo;
+    ULONG channel = 0;
+    ULONG expType = PCA9685;
+    ULONG i2cAdr = 0;
+    BOOL socPin = FALSE;
+    BOOL staged = FALSE;
+
+
+    if ((pins == nullptr) || (dutyCycles == nullptr))
+    {
+        hr = E_POINTER;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = _verifyBoardType();
+    }
+
+    for (ULONG i = 0; SUCCEEDED(hr) && (i < count); i++)
+    {
+        socPin = FALSE;
+
+        switch (m_boardType)
+        {
+        case BOARD_TYPE::MBM_IKA_LURE:
+            expNo = m_PwmChannels[pins[i]].expander;
+            channel = m_PwmChannels[pins[i]].channel;
+            expType = m_ExpAttributes[expNo].Exp_Type;
+            i2cAdr = m_ExpAttributes[expNo].I2c_Address;
+            break;
+
+        case BOARD_TYPE::PI2_BARE:
+            if ((pins[i] < PWM0) && (m_PwmChannels[pins[i]].expander == SOCBCM))
+            {
+                // The pin is driven by a channel of the PWM controller in the SOC, which
+                // is set with a register write rather than an I2C transaction.
+                hr = g_bcmPwm.setDutyCycle(m_PwmChannels[pins[i]].channel, dutyCycles[i]);
+                socPin = TRUE;
+            }
+            else
+            {
+                expType = PCA9685;
+                hr = _getExtPwmChannel(pins[i], i2cAdr, channel);
+            }
+            break;
+
+        case BOARD_TYPE::MBM_BARE:
+            // Convert the pseudo-pin number passed in to a chip and channel number on the
+            // external PCA9685 chips (the only PWM chip currently supported on these boards).
+            expType = PCA9685;
+            hr = _getExtPwmChannel(pins[i], i2cAdr, channel);
+            break;
+
+        default:
+            hr = DMAP_E_BOARD_TYPE_NOT_RECOGNIZED;
+        }
+
+        if (socPin)
+        {
+            continue;
+        }
+
+        if (SUCCEEDED(hr) && (expType != PCA9685))
+        {
+            hr = DMAP_E_DMAP_INTERNAL_ERROR;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = PCA9685Device::StagePwmDutyCycle(i2cAdr, channel, dutyCycles[i]);
+            staged = TRUE;
+        }
+    }
+
+    // Send what was staged even if a later pin failed, so nothing is left waiting.
+    if (staged)
+    {
+        flushHr = PCA9685Device::FlushPwmDutyCycles();
+        if (SUCCEEDED(hr))
+        {
+            hr = flushHr;
+        }
+    }
+
+    return hr;
+}
+
+
 /**
 This method expects the call to have verified the pin number is in range, supports
 PWM functions, and is in PWM mode.
@@ -1169,6 +1387,7 @@ HRESULT BoardPinsClass::setPwmFrequency(ULONG pin, ULONG frequency)
 {
     HRESULT hr = S_OK;
     ULONG expNo;
+    ULONG channel;
     ULONG expType;
     ULONG i2cAdr;
 
@@ -1196,11 +1415,32 @@ HRESULT BoardPinsClass::setPwmFrequency(ULONG pin, ULONG frequency)
             break;
 
         case BOARD_TYPE::MBM_BARE:
-        case BOARD_TYPE::PI2_BARE:
+            // Find the chip that drives the pseudo-pin, all of its channels run at the
+            // frequency set.
+            hr = _getExtPwmChannel(pin, i2cAdr, channel);
 
-            // If we have a PWM chip, it is external to the board.  The only one we
+            // If we have PWM chips, they are external to the board.  The only one we
             // currently support is the PCA9685.  Assume that is what we are using.
-            hr = PCA9685Device::SetPwmFrequency(EXT_PCA9685_I2C_ADR, frequency);
+            if (SUCCEEDED(hr))
+            {
+                hr = PCA9685Device::SetPwmFrequency(i2cAdr, frequency);
+            }
+            break;
+
+        case BOARD_TYPE::PI2_BARE:
+            if ((pin < PWM0) && (m_PwmChannels[pin].expander == SOCBCM))
+            {
+                // Both channels of the PWM controller in the SOC run at the same frequency.
+                hr = g_bcmPwm.setFrequency(frequency);
+            }
+            else
+            {
+                hr = _getExtPwmChannel(pin, i2cAdr, channel);
+                if (SUCCEEDED(hr))
+                {
+                    hr = PCA9685Device::SetPwmFrequency(i2cAdr, frequency);
+                }
+            }
             break;
 
         default:
@@ -1249,10 +1489,23 @@ ULONG BoardPinsClass::getActualPwmFrequency(ULONG pin)
             break;
 
         case BOARD_TYPE::MBM_BARE:
-        case BOARD_TYPE::PI2_BARE:
-            // If we have a PWM chip, it is external to the board.  The only one we
+            // If we have PWM chips, they are external to the board.  The only one we
             // currently support is the PCA9685.  Assume that is what we are using.
-            pwmFrequency = PCA9685Device::GetActualPwmFrequency(EXT_PCA9685_I2C_ADR);
+            if (SUCCEEDED(_getExtPwmChannel(pin, i2cAdr, channel)))
+            {
+                pwmFrequency = PCA9685Device::GetActualPwmFrequency(i2cAdr);
+            }
+            break;
+
+        case BOARD_TYPE::PI2_BARE:
+            if ((pin < PWM0) && (m_PwmChannels[pin].expander == SOCBCM))
+            {
+                pwmFrequency = g_bcmPwm.getActualFrequency();
+            }
+            else if (SUCCEEDED(_getExtPwmChannel(pin, i2cAdr, channel)))
+            {
+                pwmFrequency = PCA9685Device::GetActualPwmFrequency(i2cAdr);
+            }
             break;
         }
     }
@@ -1260,6 +1513,237 @@ ULONG BoardPinsClass::getActualPwmFrequency(ULONG pin)
     return pwmFrequency;
 }
 
+/**
+Method to find the channel of the PWM controller in the SOC that can drive a pin.  Only the
+PI2 has a PWM controller in the SOC that is used for PWM pins.
+\param[in] pin The number of the pin in question.
+\param[out] channel The PWM channel that can be connected to the pin.
+\return HRESULT success or error code.
+*/
+HRESULT BoardPinsClass::getSocPwmChannel(ULONG pin, ULONG & channel)
+{
+    HRESULT hr = S_OK;
+
+    hr = _verifyBoardType();
+
+    if (SUCCEEDED(hr) && !pinNumberIsSafe(pin))
+    {
+        hr = DMAP_E_PIN_NUMBER_TOO_LARGE_FOR_BOARD;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if ((m_boardType == PI2_BARE) && (pin < PWM0) && (m_PwmChannels[pin].expander == SOCBCM))
+        {
+            channel = m_PwmChannels[pin].channel;
+        }
+        else
+        {
+            hr = DMAP_E_FUNCTION_NOT_SUPPORTED_ON_PIN;
+        }
+    }
+
+    return hr;
+}
+
+/**
+The channels of the external PWM chips are numbered as PWM pseudo pins in the order the
+chips are listed: the 16 channels of the first chip are PWM0-PWM15, those of the second
+chip follow on from PWM0 + 16, and so on.  This should be called before any of the PWM
+pseudo pins are used.
+\param[in] i2cAdrs The I2C addresses of the PWM chips (0x40-0x77, but not 0x70).
+\param[in] count The number of PWM chips, 1 to PCA9685_MAX_CHIPS.
+\param[in] allCallAdr An ALL CALL address for all the PWM chips to respond to, or 0 to
+not use ALL CALL writes.  With an ALL CALL address, setAllPwmDutyCycles() and
+setAllPwmFrequency() change all the chips with one I2C transfer.
+\return HRESULT success or error code.
+*/
+HRESULT BoardPinsClass::setPwmChipAddresses(const ULONG i2cAdrs[], ULONG count, ULONG allCallAdr)
+{
+    HRESULT hr = S_OK;
+    ULONG previousAllCallAdr = m_PwmAllCallAdr;
+
+    if (i2cAdrs == nullptr)
+    {
+        hr = E_POINTER;
+    }
+
+    if (SUCCEEDED(hr) && (count == 0))
+    {
+        hr = E_INVALIDARG;
+    }
+
+    if (SUCCEEDED(hr) && (count > PCA9685_MAX_CHIPS))
+    {
+        hr = DMAP_E_PWM_TOO_MANY_CHIPS;
+    }
+
+    if (SUCCEEDED(hr) && (allCallAdr != 0) &&
+        ((allCallAdr < PCA9685_MIN_I2C_ADR) || (allCallAdr > PCA9685_MAX_I2C_ADR)))
+    {
+        hr = DMAP_E_PWM_CHIP_ADDRESS_INVALID;
+    }
+
+    // Each chip needs its own address, which can't be the ALL CALL address.
+    for (ULONG i = 0; SUCCEEDED(hr) && (i < count); i++)
+    {
+        if (!PCA9685Device::IsChipAddressValid(i2cAdrs[i]) || (i2cAdrs[i] == allCallAdr))
+        {
+            hr = DMAP_E_PWM_CHIP_ADDRESS_INVALID;
+        }
+
+        for (ULONG j = 0; SUCCEEDED(hr) && (j < i); j++)
+        {
+            if (i2cAdrs[j] == i2cAdrs[i])
+            {
+                hr = DMAP_E_PWM_CHIP_ADDRESS_INVALID;
+            }
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        for (ULONG i = 0; i < count; i++)
+        {
+            m_PwmChipAdrs[i] = i2cAdrs[i];
+        }
+        m_PwmChipCount = count;
+        m_PwmAllCallAdr = allCallAdr;
+    }
+
+    // Set the chips to respond to the ALL CALL address, or to stop responding to the one
+    // used before.
+    if (SUCCEEDED(hr) && ((allCallAdr != 0) || (previousAllCallAdr != 0)))
+    {
+        for (ULONG i = 0; SUCCEEDED(hr) && (i < m_PwmChipCount); i++)
+        {
+            hr = PCA9685Device::EnableAllCall(m_PwmChipAdrs[i], allCallAdr);
+        }
+    }
+
+    return hr;
+}
+
+/**
+Only boards that use external PWM chips (MBM_BARE and PI2_BARE) have PWM pseudo pins.
+\param[out] channelCount The number of PWM pseudo pins, starting at PWM0.
+\return HRESULT success or error code.
+*/
+HRESULT BoardPinsClass::getPwmChannelCount(ULONG & channelCount)
+{
+    HRESULT hr = S_OK;
+
+    hr = _verifyBoardType();
+
+    if (SUCCEEDED(hr))
+    {
+        if ((m_boardType == MBM_BARE) || (m_boardType == PI2_BARE))
+        {
+            channelCount = m_PwmChipCount * PCA9685_CHANNEL_COUNT;
+        }
+        else
+        {
+            channelCount = 0;
+        }
+    }
+
+    return hr;
+}
+
+/**
+If the PWM chips have an ALL CALL address, all their channels are set with one I2C
+transfer.  Otherwise the ALL_LED registers of each chip are written in turn.  This does
+nothing on boards that have no PWM pseudo pins.
+\param[in] dutyCycle The desired duty-cycle of the positive pulses (0-0xFFFFFFFF for 0-100%).
+\return HRESULT success or error code.
+*/
+HRESULT BoardPinsClass::setAllPwmDutyCycles(ULONG dutyCycle)
+{
+    HRESULT hr = S_OK;
+    ULONG dutyCycles[PCA9685_CHANNEL_COUNT];
+
+    hr = _verifyBoardType();
+
+    if (SUCCEEDED(hr) && ((m_boardType == MBM_BARE) || (m_boardType == PI2_BARE)))
+    {
+        if (m_PwmAllCallAdr != 0)
+        {
+            hr = PCA9685Device::SetAllCallDutyCycle(m_PwmAllCallAdr, dutyCycle);
+        }
+        else
+        {
+            for (ULONG i = 0; i < PCA9685_CHANNEL_COUNT; i++)
+            {
+                dutyCycles[i] = dutyCycle;
+            }
+
+            for (ULONG i = 0; SUCCEEDED(hr) && (i < m_PwmChipCount); i++)
+            {
+                hr = PCA9685Device::SetPwmDutyCycles(m_PwmChipAdrs[i], (1 << PCA9685_CHANNEL_COUNT) - 1, dutyCycles);
+            }
+        }
+    }
+
+    return hr;
+}
+
+/**
+If the PWM chips have an ALL CALL address, they are all set to the new frequency at the
+same time.  Otherwise each chip is set in turn.  This does nothing on boards that have no
+PWM pseudo pins.
+\param[in] frequency The desired PWM pulse repetition frequency in Hz.
+\return HRESULT success or error code.
+*/
+HRESULT BoardPinsClass::setAllPwmFrequency(ULONG frequency)
+{
+    HRESULT hr = S_OK;
+
+    hr = _verifyBoardType();
+
+    if (SUCCEEDED(hr) && ((m_boardType == MBM_BARE) || (m_boardType == PI2_BARE)))
+    {
+        if (m_PwmAllCallAdr != 0)
+        {
+            hr = PCA9685Device::SetAllCallPwmFrequency(m_PwmAllCallAdr, frequency);
+        }
+        else
+        {
+            for (ULONG i = 0; SUCCEEDED(hr) && (i < m_PwmChipCount); i++)
+            {
+                hr = PCA9685Device::SetPwmFrequency(m_PwmChipAdrs[i], frequency);
+            }
+        }
+    }
+
+    return hr;
+}
+
+/**
+\param[in] pin The PWM pseudo pin number (PWM0 and up).
+\param[out] i2cAdr The I2C address of the external PWM chip that drives the pin.
+\param[out] channel The channel on the PWM chip that drives the pin.
+\return HRESULT success or error code.
+*/
+HRESULT BoardPinsClass::_getExtPwmChannel(ULONG pin, ULONG & i2cAdr, ULONG & channel)
+{
+    HRESULT hr = S_OK;
+    ULONG pwmChannel = 0;
+
+    if ((pin < PWM0) || ((pin - PWM0) >= (m_PwmChipCount * PCA9685_CHANNEL_COUNT)))
+    {
+        hr = DMAP_E_INVALID_PORT_BIT_FOR_DEVICE;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        pwmChannel = pin - PWM0;
+        i2cAdr = m_PwmChipAdrs[pwmChannel / PCA9685_CHANNEL_COUNT];
+        channel = pwmChannel % PCA9685_CHANNEL_COUNT;
+    }
+
+    return hr;
+}
+
 /**
 The board type is determined by parsing the processor identifier string 
 in the Registry.
@@ -1283,6 +1767,15 @@ HRESULT BoardPinsClass::_determineBoardType()
 
 #endif // !WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
 
+#if LIGHTNING_SIMULATOR_SUPPORTED
+    // When the SOC controllers are simulated, the board is a simulated PI2 whatever
+    // processor this is running on.
+    if (g_simulator.isEnabled())
+    {
+        return _determinePi2Config();
+    }
+#endif // LIGHTNING_SIMULATOR_SUPPORTED
+
 #if WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)   // If building a Win32 app:
     HKEY baseKey = HKEY_LOCAL_MACHINE;
     HKEY regKey = nullptr;
@@ -1412,9 +1905,10 @@ HRESULT BoardPinsClass::setBoardType(BOARD_TYPE board)
         m_PwmChannels = g_MbmIkaPwmChannels;
         m_GpioPinCount = NUM_ARDUINO_PINS;
     }
+    else
 #endif // defined(_M_IX86) || defined(_M_X64)
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
     if (board == PI2_BARE)
     {
         m_PinAttributes = g_Pi2PinAttributes;
@@ -1422,9 +1916,9 @@ HRESULT BoardPinsClass::setBoardType(BOARD_TYPE board)
         m_PwmChannels = g_Pi2PwmChannels;
         m_GpioPinCount = NUM_PI2_PINS;
     }
-#endif // defined(_M_ARM)
-
     else
+#endif // LIGHTNING_PI2_SUPPORTED
+
     {
         m_boardType = NOT_SET;
         hr = DMAP_E_INVALID_BOARD_TYPE_SPECIFIED;
@@ -1484,10 +1978,10 @@ HRESULT BoardPinsClass::attachInterrupt(uint8_t pin, std::function<void(void)> f
         // Dispatch to the correct method according to the type of GPIO pin we are dealing with.
         switch (m_PinAttributes[pin].gpioType)
         {
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
         case GPIO_BCM:
             return g_bcmGpio.attachInterrupt(m_PinAttributes[pin].portBit, func, mode);
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 #if defined(_M_IX86) || defined(_M_X64)
         case GPIO_S0:
             return g_btFabricGpio.attachS0Interrupt(pin, func, mode);
@@ -1527,10 +2021,10 @@ HRESULT BoardPinsClass::attachInterruptEx(uint8_t pin, std::function<void(PDMAP_
         // Dispatch to the correct method according to the type of GPIO pin we are dealing with.
         switch (m_PinAttributes[pin].gpioType)
         {
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
         case GPIO_BCM:
             return g_bcmGpio.attachInterruptEx(m_PinAttributes[pin].portBit, func, mode);
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 #if defined(_M_IX86) || defined(_M_X64)
         case GPIO_S0:
             return g_btFabricGpio.attachS0InterruptEx(pin, func, mode);
@@ -1571,10 +2065,10 @@ HRESULT BoardPinsClass::attachInterruptContext(uint8_t pin, std::function<void(P
         // Dispatch to the correct method according to the type of GPIO pin we are dealing with.
         switch (m_PinAttributes[pin].gpioType)
         {
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
         case GPIO_BCM:
             return g_bcmGpio.attachInterruptContext(m_PinAttributes[pin].portBit, func, context, mode);
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 #if defined(_M_IX86) || defined(_M_X64)
         case GPIO_S0:
             return g_btFabricGpio.attachS0InterruptContext(pin, func, context, mode);
@@ -1612,10 +2106,10 @@ HRESULT BoardPinsClass::detachInterrupt(uint8_t pin)
         // Dispatch to the correct method according to the type of GPIO pin we are dealing with.
         switch (m_PinAttributes[pin].gpioType)
         {
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
         case GPIO_BCM:
             return g_bcmGpio.detachInterrupt(m_PinAttributes[pin].portBit);
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 #if defined(_M_IX86) || defined(_M_X64)
         case GPIO_S0:
             return g_btFabricGpio.detachS0Interrupt(pin);
@@ -123,6 +123,12 @@ public:
     /// Method to read the state of an I/O pin.
     LIGHTNING_DLL_API HRESULT getPinState(ULONG pin, ULONG & state);
 
+    /// Method to get the GPIO port and port bit mask of an I/O pin, for use with setPortState().
+    LIGHTNING_DLL_API HRESULT getPinPortMask(ULONG pin, ULONG & port, ULONG & mask);
+
+    /// Method to set and clear several pins on one GPIO port at the same time.
+    LIGHTNING_DLL_API HRESULT setPortState(ULONG port, ULONG setMask, ULONG clearMask);
+
     /// Method to set the direction of a pin (DIRECTION_IN or DIRECTION_OUT).
     LIGHTNING_DLL_API HRESULT setPinMode(ULONG pin, ULONG mode, BOOL pullUp);
 
@@ -132,12 +138,30 @@ public:
     /// Method to set the PWM duty cycle for a pin.
     LIGHTNING_DLL_API HRESULT setPwmDutyCycle(ULONG pin, ULONG dutyCycle);
 
+    /// Method to set the PWM duty cycles for a set of pins.
+    LIGHTNING_DLL_API HRESULT setPwmDutyCycles(const ULONG pins[], const ULONG dutyCycles[], ULONG count);
+
     /// Method to set the PWM pulse repetition frequency.
     LIGHTNING_DLL_API HRESULT setPwmFrequency(ULONG pin, ULONG frequency);
 
     // Method to get the actual PWM pulse repetition frequncy that is set.
     LIGHTNING_DLL_API ULONG getActualPwmFrequency(ULONG pin);
 
+    /// Method to get the channel of the SOC PWM controller that can drive a pin.
+    LIGHTNING_DLL_API HRESULT getSocPwmChannel(ULONG pin, ULONG & channel);
+
+    /// Method to set the I2C addresses of the external PWM chips that provide the PWM pseudo pins.
+    LIGHTNING_DLL_API HRESULT setPwmChipAddresses(const ULONG i2cAdrs[], ULONG count, ULONG allCallAdr);
+
+    /// Method to get the number of PWM pseudo pins provided by the external PWM chips.
+    LIGHTNING_DLL_API HRESULT getPwmChannelCount(ULONG & channelCount);
+
+    /// Method to set the PWM duty cycle of every PWM pseudo pin.
+    LIGHTNING_DLL_API HRESULT setAllPwmDutyCycles(ULONG dutyCycle);
+
+    /// Method to set the PWM pulse repetition frequency of all the external PWM chips.
+    LIGHTNING_DLL_API HRESULT setAllPwmFrequency(ULONG frequency);
+
     /// Method to override auto-detection of board type.
     LIGHTNING_DLL_API HRESULT setBoardType(BOARD_TYPE board);
 
@@ -191,6 +215,15 @@ private:
     /// The type of the board we are running on.
     BOARD_TYPE m_boardType;
 
+    /// The I2C addresses of the external PWM chips, in PWM pseudo pin order.
+    ULONG m_PwmChipAdrs[PCA9685_MAX_CHIPS];
+
+    /// The number of external PWM chips.
+    ULONG m_PwmChipCount;
+
+    /// The ALL CALL address of the external PWM chips, 0 if ALL CALL writes are not used.
+    ULONG m_PwmAllCallAdr;
+
     /// Method to configure an I/O Pin for one of the functions it suppports.
     HRESULT _setPinFunction(ULONG pin, ULONG function);
 
@@ -224,6 +257,9 @@ private:
     /// Method to set the state of an I/O Expander port pin.
     HRESULT _setExpBitToState(ULONG pin, ULONG expNo, ULONG bitNo, ULONG state);
 
+    /// Method to get the external PWM chip and channel that drive a PWM pseudo pin.
+    HRESULT _getExtPwmChannel(ULONG pin, ULONG & i2cAdr, ULONG & channel);
+
     /// Method to verify the board type has been configured.
     HRESULT _verifyBoardType();
 
@@ -322,11 +358,17 @@ inline HRESULT BoardPinsClass::enableInterrupts()
 
     if (SUCCEEDED(hr))
     {
-#if defined(_M_ARM)
-        hr = g_bcmGpio.enableInterrupts();
-#endif // defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
+        if (m_boardType == PI2_BARE)
+        {
+            hr = g_bcmGpio.enableInterrupts();
+        }
+#endif // LIGHTNING_PI2_SUPPORTED
 #if defined(_M_IX86) || defined(_M_X64)
-        hr = g_btFabricGpio.enableInterrupts();
+        if (m_boardType != PI2_BARE)
+        {
+            hr = g_btFabricGpio.enableInterrupts();
+        }
 #endif // defined(_M_IX86) || defined(_M_X64)
     }
 
@@ -347,11 +389,17 @@ inline HRESULT BoardPinsClass::disableInterrupts()
 
     if (SUCCEEDED(hr))
     {
-#if defined(_M_ARM)
-        hr = g_bcmGpio.disableInterrupts();
-#endif // defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
+        if (m_boardType == PI2_BARE)
+        {
+            hr = g_bcmGpio.disableInterrupts();
+        }
+#endif // LIGHTNING_PI2_SUPPORTED
 #if defined(_M_IX86) || defined(_M_X64)
-        hr = g_btFabricGpio.disableInterrupts();
+        if (m_boardType != PI2_BARE)
+        {
+            hr = g_btFabricGpio.disableInterrupts();
+        }
 #endif // defined(_M_IX86) || defined(_M_X64)
     }
 
@@ -48,89 +48,128 @@ HRESULT BtI2cControllerClass::configurePins(ULONG sdaPin, ULONG sclPin)
 }
 
 // Method to initialize the I2C Controller at the start of a transaction.
-HRESULT BtI2cControllerClass::_initializeForTransaction(ULONG slaveAddress, BOOL useHighSpeed)
+HRESULT BtI2cControllerClass::_initializeForTransaction(ULONG slaveAddress, const I2cTransactionClass::BUS_TIMING & timing)
 {
+    HRESULT hr = S_OK;
     ULONGLONG waitStartTicks = 0;
     BoardPinsClass::BOARD_TYPE board;
     _IC_CON icConReg;
+    ULONG ssHcnt;
+    ULONG ssLcnt;
+    ULONG fsHcnt;
+    ULONG fsLcnt;
+    ULONG hcnt = 0;
+    ULONG lcnt = 0;
 
     // If we need to initialize, or re-initialize, the I2C Controller:
-    if (!isInitialized() || (m_registers->IC_TAR.IC_TAR != slaveAddress))
+    if (!isInitialized() || (m_registers->IC_TAR.IC_TAR != slaveAddress) || (m_clockHz != timing.clockHz))
     {
-        // Disable the I2C controller.  This also clears the FIFOs.
-        m_registers->IC_ENABLE.ENABLE = 0;
-
-        // Wait for the controller to go disabled, but only for 100 mS.
-        // It can latch in a mode in which it does not go disabled, but appears 
-        // to come out of this state when used again.
-        waitStartTicks = GetTickCount64();
-        while ((m_registers->IC_ENABLE_STATUS.IC_EN == 1) && ((GetTickCount64() - waitStartTicks) < 100))
+        if ((timing.clockHz == 0) || (timing.clockHz > I2C_FAST_MODE_PLUS_HZ))
         {
-            Sleep(0);       // Give the CPU to any thread that is waiting
+            hr = DMAP_E_I2C_INVALID_CLOCK_RATE;
         }
 
-        // Set the desired I2C Clock speed.
-        g_pins.getBoardType(board);
-        if ((board == BoardPinsClass::BOARD_TYPE::MBM_BARE) ||
-            (board == BoardPinsClass::BOARD_TYPE::MBM_IKA_LURE))
+        if (SUCCEEDED(hr))
         {
-            if (useHighSpeed)
+            // Get the clock counts for 100 khz and 400 khz on this board.
+            g_pins.getBoardType(board);
+            if ((board == BoardPinsClass::BOARD_TYPE::MBM_BARE) ||
+                (board == BoardPinsClass::BOARD_TYPE::MBM_IKA_LURE))
             {
-                m_registers->IC_FS_SCL_HCNT.IC_FS_SCL_HCNT = 0x3C;
-                m_registers->IC_FS_SCL_LCNT.IC_FS_SCL_LCNT = 0x82;
-                m_registers->IC_CON.SPEED = 2;
+                ssHcnt = 0x190;
+                ssLcnt = 0x1D6;
+                fsHcnt = 0x3C;
+                fsLcnt = 0x82;
             }
             else
             {
-                m_registers->IC_SS_SCL_HCNT.IC_SS_SCL_HCNT = 0x190;
-                m_registers->IC_SS_SCL_LCNT.IC_SS_SCL_LCNT = 0x1D6;
-                m_registers->IC_CON.SPEED = 1;
+                ssHcnt = 0x92;
+                ssLcnt = 0xAB;
+                fsHcnt = 0x14;
+                fsLcnt = 0x2E;
+            }
+
+            // Scale the counts for the nearest standard speed to the requested clock rate.
+            // Fast mode timing is also used for Fast-mode Plus.
+            if (timing.clockHz <= I2C_STANDARD_MODE_HZ)
+            {
+                hcnt = (ULONG)(((ULONGLONG)ssHcnt * I2C_STANDARD_MODE_HZ) / timing.clockHz);
+                lcnt = (ULONG)(((ULONGLONG)ssLcnt * I2C_STANDARD_MODE_HZ) / timing.clockHz);
+            }
+            else
+            {
+                hcnt = (fsHcnt * I2C_FAST_MODE_HZ) / timing.clockHz;
+                lcnt = (fsLcnt * I2C_FAST_MODE_HZ) / timing.clockHz;
+            }
+
+            // Apply the minimum counts the controller supports.
+            hcnt = max(hcnt, 6UL);
+            lcnt = max(lcnt, 8UL);
+
+            if ((hcnt > 0xFFFF) || (lcnt > 0xFFFF))
+            {
+                hr = DMAP_E_I2C_INVALID_CLOCK_RATE;
             }
         }
-        else
+
+        if (SUCCEEDED(hr))
         {
-            if (useHighSpeed)
+            // Disable the I2C controller.  This also clears the FIFOs.
+            m_registers->IC_ENABLE.ENABLE = 0;
+
+            // Wait for the controller to go disabled, but only for 100 mS.
+            // It can latch in a mode in which it does not go disabled, but appears 
+            // to come out of this state when used again.
+            waitStartTicks = GetTickCount64();
+            while ((m_registers->IC_ENABLE_STATUS.IC_EN == 1) && ((GetTickCount64() - waitStartTicks) < 100))
             {
-                m_registers->IC_FS_SCL_HCNT.IC_FS_SCL_HCNT = 0x14;
-                m_registers->IC_FS_SCL_LCNT.IC_FS_SCL_LCNT = 0x2E;
-                m_registers->IC_CON.SPEED = 2;
+                Sleep(0);       // Give the CPU to any thread that is waiting
             }
-            else
+
+            // Set the desired I2C Clock speed.
+            if (timing.clockHz <= I2C_STANDARD_MODE_HZ)
             {
-                m_registers->IC_SS_SCL_HCNT.IC_SS_SCL_HCNT = 0x92;
-                m_registers->IC_SS_SCL_LCNT.IC_SS_SCL_LCNT = 0xAB;
+                m_registers->IC_SS_SCL_HCNT.IC_SS_SCL_HCNT = hcnt;
+                m_registers->IC_SS_SCL_LCNT.IC_SS_SCL_LCNT = lcnt;
                 m_registers->IC_CON.SPEED = 1;
             }
-        }
+            else
+            {
+                m_registers->IC_FS_SCL_HCNT.IC_FS_SCL_HCNT = hcnt;
+                m_registers->IC_FS_SCL_LCNT.IC_FS_SCL_LCNT = lcnt;
+                m_registers->IC_CON.SPEED = 2;
+            }
+            m_clockHz = timing.clockHz;
 
-        // Allow bus restarts.
-        m_registers->IC_CON.IC_RESTART_EN = 1;
+            // Allow bus restarts.
+            m_registers->IC_CON.IC_RESTART_EN = 1;
 
-        // Set 7-bit addressing.
-        icConReg.ALL_BITS = m_registers->IC_CON.ALL_BITS;
-        icConReg.IC_10BITADDR_MASTER = 0;
-        m_registers->IC_CON.ALL_BITS = icConReg.ALL_BITS;
+            // Set 7-bit addressing.
+            icConReg.ALL_BITS = m_registers->IC_CON.ALL_BITS;
+            icConReg.IC_10BITADDR_MASTER = 0;
+            m_registers->IC_CON.ALL_BITS = icConReg.ALL_BITS;
 
-        // Set the address of the slave this tranaction affects.
-        // All bits but the 7-bit address are intentionally cleared here.  This is needed
-        // for Bay Trail, which supports additional bits (all of which we want clear).
-        m_registers->IC_TAR.ALL_BITS = (slaveAddress & 0x7F);
+            // Set the address of the slave this tranaction affects.
+            // All bits but the 7-bit address are intentionally cleared here.  This is needed
+            // for Bay Trail, which supports additional bits (all of which we want clear).
+            m_registers->IC_TAR.ALL_BITS = (slaveAddress & 0x7F);
 
-        // Mask all interrupts.
-        m_registers->IC_INTR_MASK.ALL_BITS = 0;
+            // Mask all interrupts.
+            m_registers->IC_INTR_MASK.ALL_BITS = 0;
 
-        // Clear any outstanding interrupts.
-        ULONG dummy = m_registers->IC_CLR_INTR.ALL_BITS;
+            // Clear any outstanding interrupts.
+            ULONG dummy = m_registers->IC_CLR_INTR.ALL_BITS;
 
-        // Enable the controller.
-        m_registers->IC_ENABLE.ENABLE = 1;
+            // Enable the controller.
+            m_registers->IC_ENABLE.ENABLE = 1;
 
-        // Indicate the I2C Controller is now initialized.
-        setInitialized();
+            // Indicate the I2C Controller is now initialized.
+            setInitialized();
+        }
 
-    } // End - if (!isInitialized() || (getAddress() != m_slaveAddress))
+    } // End - if (!isInitialized() || (getAddress() != m_slaveAddress) || clock rate changed)
 
-    return S_OK;
+    return hr;
 }
 
 // Method to map the I2C controller into this process' virtual address space.
@@ -165,6 +204,13 @@ HRESULT BtI2cControllerClass::_mapController()
         if (SUCCEEDED(hr))
         {
             m_registers = (PI2C_CONTROLLER)baseAddress;
+
+            // Size the FIFO bursts from the depths the controller reports, if it does.
+            if (m_registers->IC_COMP_PARAM_1.ADD_ENCODED_PARAMS == 1)
+            {
+                m_txFifoDepth = m_registers->IC_COMP_PARAM_1.TX_BUFFER_DEPTH + 1;
+                m_rxFifoDepth = m_registers->IC_COMP_PARAM_1.RX_BUFFER_DEPTH + 1;
+            }
         }
     }
     
@@ -183,8 +229,10 @@ HRESULT BtI2cControllerClass::_performContiguousTransfers(I2cTransferClass* & pX
     ULONG cmdDat;
     LONG cmdsOutstanding = 0;
     LONG readsOutstanding = 0;
+    LONG readCmdsPending = 0;
+    LONG bytesRead;
+    ULONG txSpace = 0;
     UCHAR outByte;
-    UCHAR inByte;
 
 
     if (pXfr == nullptr)
@@ -224,60 +272,53 @@ HRESULT BtI2cControllerClass::_performContiguousTransfers(I2cTransferClass* & pX
         // For each byte in the transfer:
         while (SUCCEEDED(hr) && (cmdXfr->getNextCmd(outByte)))
         {
-            // Wait for at least one empty space in the TX FIFO.
-            while (txFifoFull());
-
-            // Issue the command.
-            if (cmdXfr->transferIsRead())
-            {
-                cmdDat = 0x100;             // Build read command (data is ignored)
-            }
-            else
-            {
-                cmdDat = outByte;           // Build write command with data byte
-            }
-
-            // If restart has been requested, signal a pre-RESTART.
-            if (restart)
+            // If the TX FIFO space found by the last level check has been used, or
+            // the RX FIFO has no room for the byte another read command would return
+            // (counting the bytes of read commands that are still outstanding):
+            while (SUCCEEDED(hr) && ((txSpace == 0) ||
+                (cmdXfr->transferIsRead() && (readCmdsPending >= (LONG)m_rxFifoDepth))))
             {
-                cmdDat = cmdDat | (1 << 10);
-                restart = FALSE;            // Only want to RESTART on first command of transfer
+                // Pull all the bytes the RX FIFO holds, and find how much room
+                // there is now in the TX FIFO.
+                bytesRead = _drainRxFifo(readXfr, readPtr);
+                readsOutstanding = readsOutstanding - bytesRead;
+                readCmdsPending = readCmdsPending - bytesRead;
+                txSpace = txFifoSpace();
+
+                hr = _handleErrors();
             }
 
-            // If this is the last command before the end of the transaction or
-            // before a callback, signal a STOP.
-            if (cmdsOutstanding == 1)
+            if (SUCCEEDED(hr))
             {
-                cmdDat = cmdDat | (1 << 9);
-            }
-
-            // Issue the command.
-            m_registers->IC_DATA_CMD.ALL_BITS = cmdDat;
-            cmdsOutstanding--;
-
-            hr = _handleErrors();
+                // Issue the command.
+                if (cmdXfr->transferIsRead())
+                {
+                    cmdDat = 0x100;             // Build read command (data is ignored)
+                    readCmdsPending++;
+                }
+                else
+                {
+                    cmdDat = outByte;           // Build write command with data byte
+                }
 
-            // Pull any available bytes out of the receive FIFO.
-            while (SUCCEEDED(hr) && rxFifoNotEmtpy())
-            {
-                // Read a byte from the I2C Controller.
-                inByte = readByte();
-                readsOutstanding--;
+                // If restart has been requested, signal a pre-RESTART.
+                if (restart)
+                {
+                    cmdDat = cmdDat | (1 << 10);
+                    restart = FALSE;            // Only want to RESTART on first command of transfer
+                }
 
-                // Store the byte if we have a place for it.
-                if (readPtr != nullptr)
+                // If this is the last command before the end of the transaction or
+                // before a callback, signal a STOP.
+                if (cmdsOutstanding == 1)
                 {
-                    *readPtr = inByte;
-
-                    // Figure out where the next byte should go.
-                    readPtr = readXfr->getNextReadLocation();
-                    while ((readPtr == nullptr) && (readXfr->getNextTransfer() != nullptr))
-                    {
-                        readXfr = readXfr->getNextTransfer();
-                        readXfr->resetRead();
-                        readPtr = readXfr->getNextReadLocation();
-                    }
+                    cmdDat = cmdDat | (1 << 9);
                 }
+
+                // Issue the command.
+                m_registers->IC_DATA_CMD.ALL_BITS = cmdDat;
+                cmdsOutstanding--;
+                txSpace--;
             }
         }
 
@@ -293,27 +334,7 @@ HRESULT BtI2cControllerClass::_performContiguousTransfers(I2cTransferClass* & pX
     while (SUCCEEDED(hr) && ((readsOutstanding > 0) || !txFifoEmpty()) && !errorOccurred())
     {
         // Pull any available bytes out of the receive FIFO.
-        while (rxFifoNotEmtpy())
-        {
-            // Read a byte from the I2C Controller.
-            inByte = readByte();
-            readsOutstanding--;
-
-            // Store the byte if we have a place for it.
-            if (readPtr != nullptr)
-            {
-                *readPtr = inByte;
-
-                // Figure out where the next byte should go.
-                readPtr = readXfr->getNextReadLocation();
-                while ((readPtr == nullptr) && (readXfr->getNextTransfer() != nullptr))
-                {
-                    readXfr = readXfr->getNextTransfer();
-                    readXfr->resetRead();
-                    readPtr = readXfr->getNextReadLocation();
-                }
-            }
-        }
+        readsOutstanding = readsOutstanding - _drainRxFifo(readXfr, readPtr);
 
         // Wait up to to 100 milliseconds for transfers to happen.
         if (readsOutstanding > 0)
@@ -361,3 +382,42 @@ HRESULT BtI2cControllerClass::_performContiguousTransfers(I2cTransferClass* & pX
     return hr;
 }
 
+/**
+All the bytes the RX FIFO holds when this method is called are read from it, using
+a single read of the FIFO level register.  Each byte is stored in the next read
+location of the transfers that make up the transaction.  Bytes that arrive when no
+read location remains are discarded (but still counted) so the caller can detect them.
+\param[in,out] readXfr The transfer currently being read into.
+\param[in,out] readPtr The location the next byte read should be stored in.
+\return The number of bytes read from the RX FIFO.
+*/
+LONG BtI2cControllerClass::_drainRxFifo(I2cTransferClass* & readXfr, PUCHAR & readPtr)
+{
+    LONG byteCount = rxFifoLevel();
+    UCHAR inByte;
+
+
+    for (LONG i = 0; i < byteCount; i++)
+    {
+        // Read a byte from the I2C Controller.
+        inByte = readByte();
+
+        // Store the byte if we have a place for it.
+        if (readPtr != nullptr)
+        {
+            *readPtr = inByte;
+
+            // Figure out where the next byte should go.
+            readPtr = readXfr->getNextReadLocation();
+            while ((readPtr == nullptr) && (readXfr->getNextTransfer() != nullptr))
+            {
+                readXfr = readXfr->getNextTransfer();
+                readXfr->resetRead();
+                readPtr = readXfr->getNextReadLocation();
+            }
+        }
+    }
+
+    return byteCount;
+}
+
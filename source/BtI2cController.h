@@ -11,6 +11,9 @@
 #include "I2cController.h"
 #include "BoardPins.h"
 
+// Depth of the BayTrail I2C Controller TX and RX FIFOs, used if the controller does not
+// report its FIFO depths in IC_COMP_PARAM_1.
+#define BT_I2C_FIFO_DEPTH 32
 
 //
 // Class that is used to interact with the BayTrail I2C Controller hardware.
@@ -20,7 +23,10 @@ class BtI2cControllerClass : public I2cControllerClass
 public:
     BtI2cControllerClass() :
         m_registers(nullptr),
-        m_controllerInitialized(FALSE)
+        m_controllerInitialized(FALSE),
+        m_clockHz(0),
+        m_txFifoDepth(BT_I2C_FIFO_DEPTH),
+        m_rxFifoDepth(BT_I2C_FIFO_DEPTH)
     {
     }
 
@@ -48,7 +54,7 @@ public:
     LIGHTNING_DLL_API HRESULT configurePins(ULONG sdaPin, ULONG sclPin) override;
 
     // Method to initialize the I2C Controller at the start of a transaction.
-    LIGHTNING_DLL_API HRESULT _initializeForTransaction(ULONG slaveAddress, BOOL useHighSpeed) override;
+    LIGHTNING_DLL_API HRESULT _initializeForTransaction(ULONG slaveAddress, const I2cTransactionClass::BUS_TIMING & timing) override;
 
     // This method records that the controller has been initialized.
     void setInitialized()
@@ -87,6 +93,18 @@ public:
         return (m_registers->IC_STATUS.RFNE == 0);
     }
 
+    /// Get the number of empty entries in the TX FIFO.
+    ULONG txFifoSpace() const
+    {
+        return m_txFifoDepth - m_registers->IC_TXFLR.TXFLR;
+    }
+
+    /// Get the number of bytes waiting in the RX FIFO.
+    ULONG rxFifoLevel() const
+    {
+        return m_registers->IC_RXFLR.RXFLR;
+    }
+
     LIGHTNING_DLL_API HRESULT _performContiguousTransfers(I2cTransferClass* & pXfr) override;
 
     UCHAR readByte() override
@@ -447,8 +465,8 @@ private:
     // I2C Transmit FIFO Level Register.
     typedef union {
         struct {
-            ULONG TXFLR : 5;                // Count of valid data entries in TX FIFO
-            ULONG _rsv : 27;                // Reserved
+            ULONG TXFLR : 6;                // Count of valid data entries in TX FIFO (0-32)
+            ULONG _rsv : 26;                // Reserved
         };
         ULONG ALL_BITS;
     } _IC_TXFLR;
@@ -456,8 +474,8 @@ private:
     // I2C Receive FIFO Level Register.
     typedef union {
         struct {
-            ULONG RXFLR : 5;                // Count of valid data entries in RX FIFO
-            ULONG _rsv : 27;                // Reserved
+            ULONG RXFLR : 6;                // Count of valid data entries in RX FIFO (0-32)
+            ULONG _rsv : 26;                // Reserved
         };
         ULONG ALL_BITS;
     } _IC_RXFLR;
@@ -508,6 +526,22 @@ private:
         ULONG ALL_BITS;
     } _IC_FS_SPKLEN;
 
+    // I2C Component Parameter Register 1.
+    typedef union {
+        struct {
+            ULONG APB_DATA_WIDTH : 2;       // APB data bus width
+            ULONG MAX_SPEED_MODE : 2;       // Fastest speed mode supported
+            ULONG HC_COUNT_VALUES : 1;      // 1: SCL count registers are read-only
+            ULONG INTR_IO : 1;              // 1: Combined interrupt output
+            ULONG HAS_DMA : 1;              // 1: DMA handshake interface present
+            ULONG ADD_ENCODED_PARAMS : 1;   // 1: This register holds the parameters, 0: reads as 0
+            ULONG RX_BUFFER_DEPTH : 8;      // Depth of the RX FIFO less one
+            ULONG TX_BUFFER_DEPTH : 8;      // Depth of the TX FIFO less one
+            ULONG _rsv : 8;                 // Reserved
+        };
+        ULONG ALL_BITS;
+    } _IC_COMP_PARAM_1;
+
     #pragma warning( pop )
 
     // Layout of the BayTrail I2C Controller registers in memory.
@@ -546,6 +580,8 @@ private:
         ULONG                       _reserved5[6];      // 0x84 - 0x9B
         volatile _IC_ENABLE_STATUS  IC_ENABLE_STATUS;   // 0x9C - Enable Status
         volatile _IC_FS_SPKLEN      IC_FS_SPKLEN;       // 0xA0 - SS and FS Spike Suppression Limit
+        ULONG                       _reserved6[20];     // 0xA4 - 0xF3
+        volatile _IC_COMP_PARAM_1   IC_COMP_PARAM_1;    // 0xF4 - Component Parameter 1
     } I2C_CONTROLLER, *PI2C_CONTROLLER;
 
     //
@@ -556,11 +592,21 @@ private:
     // they are mapped into this process' address space.
     PI2C_CONTROLLER m_registers;
 
+    // Depths of the TX and RX FIFOs of the controller.
+    ULONG m_txFifoDepth;
+    ULONG m_rxFifoDepth;
+
     // Method to map the I2C controller into this process' virtual address space.
     LIGHTNING_DLL_API HRESULT _mapController() override;
 
+    // Method to store the bytes waiting in the RX FIFO in the transfer read buffers.
+    LONG _drainRxFifo(I2cTransferClass* & readXfr, PUCHAR & readPtr);
+
     // TRUE if the controller has been initialized.
     BOOL m_controllerInitialized;
+
+    // The I2C clock rate the controller is currently set for.
+    ULONG m_clockHz;
 };
 
 #endif // _BT_I2C_CONTROLLER_H_
\ No newline at end of file
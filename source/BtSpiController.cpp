@@ -84,6 +84,7 @@ BtSpiControllerClass::BtSpiControllerClass()
 {
     m_hController = INVALID_HANDLE_VALUE;
     m_registers = nullptr;
+    m_registersUpper = nullptr;
 
     // Load values for the SPI clock generators.
     spiSpeed15mhz = { 3, 4, 4 };    // Fastest supported SPI clock on BayTrail is 15mhz
@@ -188,6 +189,12 @@ void BtSpiControllerClass::end()
 {
     if (m_registers != nullptr)
     {
+        // Release the chip select if the controller is driving it.
+        if (m_hardwareChipSelect)
+        {
+            _driveHardwareChipSelect(FALSE);
+        }
+
         // Disable the SPI controller.
         m_registers->SSCR0.SSE = 0;
         m_registers = nullptr;
@@ -201,6 +208,44 @@ void BtSpiControllerClass::end()
     }
 }
 
+/**
+The data width can only be changed while the controller is disabled, so if the width
+changes the controller is disabled.  It is enabled again by the next transfer.
+\param[in] bits The number of bits in an SPI transfer (4-32).
+\return HRESULT success or error code.
+*/
+HRESULT BtSpiControllerClass::setDataWidth(ULONG bits)
+{
+    HRESULT hr = S_OK;
+    _SSCR0 sscr0;
+
+    if ((bits < m_minTransferBits) || (bits > m_maxTransferBits))
+    {
+        hr = DMAP_E_SPI_DATA_WIDTH_SPECIFIED_IS_INVALID;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_dataBits = bits;
+
+        if (m_registers != nullptr)
+        {
+            sscr0.ALL_BITS = m_registers->SSCR0.ALL_BITS;
+            if ((sscr0.DSS != ((bits - 1) & 0x0F)) || (sscr0.EDSS != (((bits - 1) >> 4) & 0x01)))
+            {
+                sscr0.SSE = 0;
+                m_registers->SSCR0.ALL_BITS = sscr0.ALL_BITS;
+
+                sscr0.DSS = (bits - 1) & 0x0F;          // Data width ls4bits
+                sscr0.EDSS = ((bits - 1) >> 4) & 0x01;  // Data width msbit
+                m_registers->SSCR0.ALL_BITS = sscr0.ALL_BITS;
+            }
+        }
+    }
+
+    return hr;
+}
+
 /**
 This method follows the Arduino conventions for SPI mode settings.
 The SPI mode specifies the clock polarity and phase.
@@ -396,3 +441,50 @@ HRESULT BtSpiControllerClass::transferBuffer(PBYTE dataOut, PBYTE dataIn, size_t
 
     return hr;
 }
+
+/**
+The MinnowBoard Max SPI controller has one chip select line, on pin 5.
+\param[in] csPin The number of the pin to be used as a chip select.
+\param[out] csLine The chip select line (always 0) that drives the pin.
+\return TRUE if the controller can drive the pin, FALSE otherwise.
+*/
+BOOL BtSpiControllerClass::_hardwareChipSelectLine(ULONG csPin, ULONG & csLine)
+{
+    BOOL isHardware = FALSE;
+
+    if (csPin == MBM_PIN_CS0)
+    {
+        csLine = 0;
+        isHardware = TRUE;
+    }
+
+    return isHardware;
+}
+
+/**
+In hardware mode the controller frames each data word with the chip select, so the
+chip select is put in software mode, where it stays at the state written to the
+SPI_CS_CTRL register for as long as needed.
+\param[in] selected TRUE to assert the chip select, FALSE to deassert it.
+\return HRESULT success or error code.
+*/
+HRESULT BtSpiControllerClass::_driveHardwareChipSelect(BOOL selected)
+{
+    HRESULT hr = S_OK;
+    _SPI_CS_CTRL csCtrl;
+
+    if (m_registersUpper == nullptr)
+    {
+        hr = DMAP_E_DMAP_INTERNAL_ERROR;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        csCtrl.ALL_BITS = 0;
+        csCtrl.SPI_CS_MODE = 1;                 // Software chip select mode
+        csCtrl.SPI_CS_STATE = selected ? 0 : 1; // Chip select is active low
+        m_registersUpper->SPI_CS_CTRL.ALL_BITS = csCtrl.ALL_BITS;
+    }
+
+    return hr;
+}
@@ -50,15 +50,7 @@ public:
     LIGHTNING_DLL_API HRESULT setMode(ULONG mode) override;
 
     /// Set the number of bits in an SPI transfer.
-    HRESULT setDataWidth(ULONG bits) override
-    {
-        if ((bits < m_minTransferBits) || (bits > m_maxTransferBits))
-        {
-            return DMAP_E_SPI_DATA_WIDTH_SPECIFIED_IS_INVALID;
-        }
-        m_dataBits = bits;
-        return S_OK;
-    }
+    LIGHTNING_DLL_API HRESULT setDataWidth(ULONG bits) override;
 
     /// Perform a transfer on the SPI bus.
     /**
@@ -399,6 +391,12 @@ private:
     SPI_BUS_SPEED spiSpeed1khz;                ///< Parameters for 1 khz SPI bit clock
 
 
+    /// Determine whether a pin is the chip select line of this SPI controller.
+    BOOL _hardwareChipSelectLine(ULONG csPin, ULONG & csLine) override;
+
+    /// Drive the chip select line of this SPI controller.
+    HRESULT _driveHardwareChipSelect(BOOL selected) override;
+
     /// Device handle used to map SPI controller registers into user-mode address space.
     HANDLE m_hController;
 
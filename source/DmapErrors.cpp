@@ -21,6 +21,8 @@ std::map<HRESULT, LPCWSTR> DmapErrors = {
     { DMAP_E_INVALID_LOCK_HANDLE_SPECIFIED      , L"An invalid handle was specified attempting to get a controller lock." },
     { DMAP_E_TOO_MANY_DEVICES_MAPPED            , L"An attempt was made to map more than the maximum number of devices." },
     { DMAP_E_DEVICE_NOT_FOUND_ON_SYSTEM         , L"The specified device could not be found on the system. Please Make sure the Lightning driver is enabled. For more information refer to the Lightning Setup Guide: http://ms-iot.github.io/content/en-US/win10/LightningSetup.htm" },
+    { DMAP_E_SIMULATOR_NOT_SUPPORTED            , L"The peripheral simulator is not enabled, or is not supported by this build." },
+    { DMAP_E_SIMULATOR_DEVICE_CONFLICT          , L"A device is already attached to the simulated bus at the address or chip select specified." },
     { DMAP_E_I2C_ADDRESS_OUT_OF_RANGE           , L"The specified I2C address is outside the legal range for 7-bit I2C addresses." },
     { DMAP_E_I2C_NO_OR_EMPTY_WRITE_BUFFER       , L"None or empty, write buffer was specified." },
     { DMAP_E_I2C_NO_OR_ZERO_LENGTH_READ_BUFFER  , L"None or zero length, read buffer was specified." },
@@ -31,8 +33,22 @@ std::map<HRESULT, LPCWSTR> DmapErrors = {
     { DMAP_E_I2C_OPERATION_INCOMPLETE           , L"One or more transfers remained undone at the end of the I2C operation." },
     { DMAP_E_I2C_INVALID_BUS_NUMBER_SPECIFIED   , L"The I2C bus specified does not exist." },
     { DMAP_E_I2C_TRANSFER_LENGTH_OVER_MAX       , L"The specified I2C transfer length is longer than the controller supports." },
+    { DMAP_E_I2C_INVALID_CLOCK_RATE             , L"The specified I2C clock rate is not supported by the controller." },
+    { DMAP_E_I2C_REGISTER_NOT_DECLARED          , L"The I2C device register specified has not been declared." },
+    { DMAP_E_I2C_INVALID_REGISTER_DECLARATION   , L"The I2C device register declaration has an invalid width or overlaps another register." },
+    { DMAP_E_EEPROM_ADDRESS_OUT_OF_RANGE        , L"The EEPROM location specified is beyond the end of the EEPROM." },
+    { DMAP_E_EEPROM_WRITE_CYCLE_TIMEOUT         , L"The EEPROM did not finish a write cycle in the time allowed." },
+    { DMAP_E_I2C_CLOCK_STRETCH_TIMEOUT          , L"An I2C slave stretched the clock longer than the clock stretch timeout." },
     { DMAP_E_ADC_DATA_FROM_WRONG_CHANNEL        , L"ADC data for a different channel than requested was received." },
     { DMAP_E_ADC_DOES_NOT_HAVE_REQUESTED_CHANNEL, L"The ADC does not have the channel that has been requested." },
+    { DMAP_E_ADC_SAMPLE_RATE_INVALID            , L"The requested ADC sample rate is not supported." },
+    { DMAP_E_ADC_SAMPLER_RUNNING                , L"The ADC sampler is already running." },
+    { DMAP_E_ADC_SETTING_INVALID                , L"The ADC gain or data rate specified is not supported." },
+    { DMAP_E_ADC_IN_CONTINUOUS_MODE             , L"The ADC is performing continuous conversions." },
+    { DMAP_E_ADC_NOT_IN_CONTINUOUS_MODE         , L"The ADC is not performing continuous conversions." },
+    { DMAP_E_ADC_FILTER_SETTING_INVALID         , L"The ADC filter settings specified are not supported." },
+    { DMAP_E_ADC_FILTER_NOT_SET                 , L"The ADC filter has not been set up." },
+    { DMAP_E_ADC_TOO_MANY_CHIPS                 , L"More ADC chips were specified than are supported." },
     { DMAP_E_SPI_DATA_WIDTH_MISMATCH            , L"The width of data sent does not match the data width set on the SPI controller." },
     { DMAP_E_SPI_BUS_REQUESTED_DOES_NOT_EXIST   , L"The specified BUS number does not exist on this board." },
     { DMAP_E_SPI_MODE_SPECIFIED_IS_INVALID      , L"The SPI mode specified is not a legal SPI mode value (0-3)." },
@@ -40,7 +56,18 @@ std::map<HRESULT, LPCWSTR> DmapErrors = {
     { DMAP_E_SPI_BUFFER_TRANSFER_NOT_IMPLEMENTED, L"This SPI implementation does not support buffer transfers." },
     { DMAP_E_SPI_DATA_WIDTH_SPECIFIED_IS_INVALID, L"The specified number of bits per transfer is not supported by the SPI controller." },
     { DMAP_E_SPI_CONTROLLER_NOT_SUPPORTED       , L"The specified SPI controller is not supported." },
-    { DMAP_E_GPIO_PIN_IS_SET_TO_PWM             , L"A GPIO operation was performed on a pin configured as a PWM output." }
+    { DMAP_E_SPI_TOO_MANY_DEVICES               , L"All the device slots on the SPI bus are in use." },
+    { DMAP_E_SPI_CHIP_SELECT_IN_USE             , L"The chip select pin is already used by another device on the SPI bus." },
+    { DMAP_E_SPI_SEGMENT_LENGTH_INVALID         , L"The length of an SPI transfer segment is not a whole number of data words." },
+    { DMAP_E_GPIO_PIN_IS_SET_TO_PWM             , L"A GPIO operation was performed on a pin configured as a PWM output." },
+    { DMAP_E_PWM_TOO_MANY_CHIPS                 , L"No more PWM chips can be used at the same time." },
+    { DMAP_E_PWM_TOO_MANY_PINS                  , L"No more pins can be used for software PWM." },
+    { DMAP_E_PWM_PIN_NOT_ADDED                  , L"The pin has not been added to the software PWM." },
+    { DMAP_E_PWM_FREQUENCY_INVALID              , L"The PWM frequency specified is not supported." },
+    { DMAP_E_TOO_MANY_TONES                     , L"No more tones can be played at the same time." },
+    { DMAP_E_PWM_CHIP_ADDRESS_INVALID           , L"The I2C address specified for a PWM chip is not valid." },
+    { DMAP_E_PWM_CLOCK_NOT_RUNNING              , L"The clock that drives the PWM controller is not running." },
+    { DMAP_E_PWM_CLOCK_RATE_WRONG               , L"The clock that drives the PWM controller is not running at the expected rate." }
 };
 
 LIGHTNING_DLL_API void ThrowError(_In_ HRESULT hr, _In_ _Printf_format_string_ STRSAFE_LPCSTR pszFormat, ...)
@@ -7,6 +7,7 @@
 #include <concrt.h>
 #include "ErrorCodes.h"
 #include "DmapSupport.h"
+#include "PeripheralSimulator.h"
 
 #if !WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)  // If building a UWP app
 using namespace Windows::Devices::Enumeration;
@@ -254,6 +255,14 @@ HRESULT GetControllerBaseAddress(PWCHAR deviceName, HANDLE & handle, PVOID & bas
     DMAP_MAPMEMORY_OUTPUT_BUFFER buf = { 0 };
     DWORD bytesReturned = 0;
 
+#if LIGHTNING_SIMULATOR_SUPPORTED
+    // If the controllers are being simulated, map the simulated registers instead.
+    if (g_simulator.isEnabled())
+    {
+        return g_simulator.mapController(deviceName, handle, baseAddress);
+    }
+#endif // LIGHTNING_SIMULATOR_SUPPORTED
+
     hr = OpenControllerDevice(deviceName, handle, shareMode);
 
     if (SUCCEEDED(hr) && (baseAddress == nullptr))
@@ -350,6 +359,30 @@ HRESULT OpenControllerDevice(PWCHAR deviceName, HANDLE & handle, DWORD shareMode
 }
 #endif // WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
 
+#if LIGHTNING_SIMULATOR_SUPPORTED   // If building a Win32 app that can use the simulator
+/**
+Acquire an exclusive access lock on a controller.  The BCM GPIO code is only built into
+Win32 apps for the simulator.  As for UWP apps, the lock request is not yet sent to the
+driver, so this always succeeds.
+\param[in] handle Handle opened to the device to be locked.
+\return HRESULT success or error code.
+*/
+HRESULT GetControllerLock(HANDLE & handle)
+{
+    return S_OK;
+}
+
+/**
+Release an exclusive access lock on a controller.
+\param[in] handle Handle opened to the locked device.
+\return HRESULT success or error code.
+*/
+HRESULT ReleaseControllerLock(HANDLE & handle)
+{
+    return S_OK;
+}
+#endif // LIGHTNING_SIMULATOR_SUPPORTED
+
 #if !WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)  // If building a UWP app
 
 /**
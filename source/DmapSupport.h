@@ -6,6 +6,18 @@
 
 #include "DMap.h"
 
+// The register-level simulator traps register accesses with no-access pages and single
+// stepping, which is only available to Win32 code on the x86 and x64 architectures.
+#if WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP) && (defined(_M_IX86) || defined(_M_X64))
+#define LIGHTNING_SIMULATOR_SUPPORTED 1
+#endif
+
+// The PI2 pin tables and BCM2836 GPIO code are built for ARM, and for x86 and x64 Win32
+// builds so the simulator can stand in for a PI2.
+#if defined(_M_ARM) || LIGHTNING_SIMULATOR_SUPPORTED
+#define LIGHTNING_PI2_SUPPORTED 1
+#endif
+
 // Define the device name strings used to access the controllers on the MBM.
 #define mbmGpioS0DeviceName   L"\\\\.\\ACPI#INT33FC#1#{109b86ad-f53d-4b76-aa5f-821e2ddf2141}\\0"
 #define mbmGpioS5DeviceName   L"\\\\.\\ACPI#INT33FC#3#{109b86ad-f53d-4b76-aa5f-821e2ddf2141}\\0"
@@ -43,6 +55,12 @@ HRESULT SendIOControlCodeToController(
     Windows::Storage::Streams::IBuffer^ bufferToDriver,
     Windows::Storage::Streams::IBuffer^ bufferFromDriver,
     uint32_t timeOutMillis);
+#endif
+
+#if !WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP) || LIGHTNING_SIMULATOR_SUPPORTED
+/// Routine to acquire an exclusive access lock on a controller.
 HRESULT GetControllerLock(HANDLE & handle);
+
+/// Routine to release an exclusive access lock on a controller.
 HRESULT ReleaseControllerLock(HANDLE & handle);
 #endif
@@ -81,6 +81,14 @@ LIGHTNING_DLL_API extern std::map<HRESULT, LPCWSTR> DmapErrors;
 /// The specified device was not found on the systems.
 #define DMAP_E_DEVICE_NOT_FOUND_ON_SYSTEM MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9212)
 
+/// HexValue: 0x80049213
+/// The peripheral simulator is not enabled, or is not supported by this build.
+#define DMAP_E_SIMULATOR_NOT_SUPPORTED MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9213)
+
+/// HexValue: 0x80049214
+/// A device is already attached to the simulated bus at the address or chip select specified.
+#define DMAP_E_SIMULATOR_DEVICE_CONFLICT MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9214)
+
 //
 // I2C related error codes.
 //
@@ -125,6 +133,30 @@ LIGHTNING_DLL_API extern std::map<HRESULT, LPCWSTR> DmapErrors;
 /// The specified I2C transfer length is longer than the controller supports.
 #define DMAP_E_I2C_TRANSFER_LENGTH_OVER_MAX MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9229)
 
+/// HexValue: 0x8004922A
+/// The specified I2C clock rate is not supported by the controller.
+#define DMAP_E_I2C_INVALID_CLOCK_RATE MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x922A)
+
+/// HexValue: 0x8004922B
+/// The I2C device register specified has not been declared.
+#define DMAP_E_I2C_REGISTER_NOT_DECLARED MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x922B)
+
+/// HexValue: 0x8004922C
+/// The I2C device register declaration has an invalid width or overlaps another register.
+#define DMAP_E_I2C_INVALID_REGISTER_DECLARATION MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x922C)
+
+/// HexValue: 0x8004922D
+/// The EEPROM location specified is beyond the end of the EEPROM.
+#define DMAP_E_EEPROM_ADDRESS_OUT_OF_RANGE MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x922D)
+
+/// HexValue: 0x8004922E
+/// The EEPROM did not finish a write cycle in the time allowed.
+#define DMAP_E_EEPROM_WRITE_CYCLE_TIMEOUT MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x922E)
+
+/// HexValue: 0x8004922F
+/// An I2C slave stretched the clock longer than the clock stretch timeout.
+#define DMAP_E_I2C_CLOCK_STRETCH_TIMEOUT MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x922F)
+
 //
 // ADC related error codes.
 //
@@ -141,6 +173,38 @@ attempting to use the ADC at the same time.
 /// The ADC does not have the channel that has been requested.
 #define DMAP_E_ADC_DOES_NOT_HAVE_REQUESTED_CHANNEL MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9231)
 
+/// HexValue: 0x80049232
+/// The requested ADC sample rate is not supported.
+#define DMAP_E_ADC_SAMPLE_RATE_INVALID MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9232)
+
+/// HexValue: 0x80049233
+/// The ADC sampler is already running.
+#define DMAP_E_ADC_SAMPLER_RUNNING MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9233)
+
+/// HexValue: 0x80049234
+/// The ADC gain or data rate specified is not supported.
+#define DMAP_E_ADC_SETTING_INVALID MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9234)
+
+/// HexValue: 0x80049235
+/// The ADC is performing continuous conversions.
+#define DMAP_E_ADC_IN_CONTINUOUS_MODE MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9235)
+
+/// HexValue: 0x80049236
+/// The ADC is not performing continuous conversions.
+#define DMAP_E_ADC_NOT_IN_CONTINUOUS_MODE MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9236)
+
+/// HexValue: 0x80049237
+/// The ADC filter settings specified are not supported.
+#define DMAP_E_ADC_FILTER_SETTING_INVALID MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9237)
+
+/// HexValue: 0x80049238
+/// The ADC filter has not been set up.
+#define DMAP_E_ADC_FILTER_NOT_SET MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9238)
+
+/// HexValue: 0x80049239
+/// More ADC chips were specified than are supported.
+#define DMAP_E_ADC_TOO_MANY_CHIPS MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9239)
+
 //
 // SPI related error codes.
 //
@@ -178,6 +242,18 @@ set the desired width, then call SPI.begin() to start the contrller again.
 /// The specified SPI controller is not supported.
 #define DMAP_E_SPI_CONTROLLER_NOT_SUPPORTED MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9246)
 
+/// HexValue: 0x80049247
+/// All the device slots on the SPI bus are in use.
+#define DMAP_E_SPI_TOO_MANY_DEVICES MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9247)
+
+/// HexValue: 0x80049248
+/// The chip select pin is already used by another device on the SPI bus.
+#define DMAP_E_SPI_CHIP_SELECT_IN_USE MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9248)
+
+/// HexValue: 0x80049249
+/// The length of an SPI transfer segment is not a whole number of data words.
+#define DMAP_E_SPI_SEGMENT_LENGTH_INVALID MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9249)
+
 //
 // PWM related error codes.
 //
@@ -186,6 +262,38 @@ set the desired width, then call SPI.begin() to start the contrller again.
 /// A GPIO operation was performed on a pin configured as a PWM output.
 #define DMAP_E_GPIO_PIN_IS_SET_TO_PWM MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9250)
 
+/// HexValue: 0x80049251
+/// No more PWM chips can be used at the same time.
+#define DMAP_E_PWM_TOO_MANY_CHIPS MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9251)
+
+/// HexValue: 0x80049252
+/// No more pins can be used for software PWM.
+#define DMAP_E_PWM_TOO_MANY_PINS MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9252)
+
+/// HexValue: 0x80049253
+/// The pin has not been added to the software PWM.
+#define DMAP_E_PWM_PIN_NOT_ADDED MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9253)
+
+/// HexValue: 0x80049254
+/// The PWM frequency specified is not supported.
+#define DMAP_E_PWM_FREQUENCY_INVALID MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9254)
+
+/// HexValue: 0x80049255
+/// No more tones can be played at the same time.
+#define DMAP_E_TOO_MANY_TONES MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9255)
+
+/// HexValue: 0x80049256
+/// The I2C address specified for a PWM chip is not valid.
+#define DMAP_E_PWM_CHIP_ADDRESS_INVALID MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9256)
+
+/// HexValue: 0x80049257
+/// The clock that drives the PWM controller is not running.
+#define DMAP_E_PWM_CLOCK_NOT_RUNNING MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9257)
+
+/// HexValue: 0x80049258
+/// The clock that drives the PWM controller is not running at the expected rate.
+#define DMAP_E_PWM_CLOCK_RATE_WRONG MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x9258)
+
 
 
 #endif  // _ERROR_CODES_H_
@@ -69,7 +69,7 @@ HRESULT BtFabricGpioControllerClass::_mapS5Controller()
 }
 #endif // defined(_M_IX86) || defined(_M_X64)
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
 // 
 // Global extern exports
 //
@@ -108,7 +108,7 @@ HRESULT BcmGpioControllerClass::mapIfNeeded()
 
     return hr;
 }
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 
 #if defined(_M_IX86) || defined(_M_X64)
 /// Method to attach to an interrupt on an S0 GPIO port bit.
@@ -218,7 +218,7 @@ HRESULT BtFabricGpioControllerClass::attachS5InterruptContext(ULONG intNo, std::
 }
 #endif // defined(_M_IX86) || defined(_M_X64)
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
 /// Method to attach to an interrupt on a GPIO port bit.
 HRESULT BcmGpioControllerClass::attachInterrupt(ULONG intNo, std::function<void(void)> func, ULONG mode)
 {
@@ -234,9 +234,9 @@ HRESULT BcmGpioControllerClass::attachInterrupt(ULONG intNo, std::function<void(
 
     return hr;
 }
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
 /// Method to attach to an interrupt on a GPIO port bit with informaton return.
 HRESULT BcmGpioControllerClass::attachInterruptEx(ULONG intNo, std::function<void(PDMAP_WAIT_INTERRUPT_NOTIFY_BUFFER)> func, ULONG mode)
 {
@@ -252,10 +252,10 @@ HRESULT BcmGpioControllerClass::attachInterruptEx(ULONG intNo, std::function<voi
 
     return hr;
 }
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
 /// Method to attach to an interrupt on a GPIO port bit with informaton return and context.
 HRESULT BcmGpioControllerClass::attachInterruptContext(ULONG intNo, std::function<void(PDMAP_WAIT_INTERRUPT_NOTIFY_BUFFER, PVOID)> func, PVOID context, ULONG mode)
 {
@@ -271,9 +271,9 @@ HRESULT BcmGpioControllerClass::attachInterruptContext(ULONG intNo, std::functio
 
     return hr;
 }
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
 /// Method to detach an interrupt for a GPIO port bit.
 HRESULT BcmGpioControllerClass::detachInterrupt(ULONG intNo)
 {
@@ -289,7 +289,7 @@ HRESULT BcmGpioControllerClass::detachInterrupt(ULONG intNo)
 
     return hr;
 }
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 
 #if defined(_M_IX86) || defined(_M_X64)
 /// Method to detach an interrupt for an S0 GPIO port bit.
@@ -269,7 +269,7 @@ LIGHTNING_DLL_API extern BtFabricGpioControllerClass g_btFabricGpio;
 
 #endif // defined(_M_IX86) || defined(_M_X64)
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
 /// Class used to interact with the PI2 BCM2836 GPIO hardware.
 class BcmGpioControllerClass
 {
@@ -297,6 +297,9 @@ public:
     /// Method to set the state of a GPIO port bit.
     inline HRESULT setPinState(ULONG gpioNo, ULONG state);
 
+    /// Method to set and clear several GPIO port bits at once.
+    inline HRESULT setPortState(ULONG bank, ULONG setMask, ULONG clearMask);
+
     /// Method to read the state of a GPIO bit.
     inline HRESULT getPinState(ULONG gpioNo, ULONG & state);
 
@@ -306,6 +309,9 @@ public:
     /// Method to set the function (mux state) of a GPIO port bit.
     inline HRESULT setPinFunction(ULONG gpioNo, ULONG function);
 
+    /// Method to select one of the six alternate functions of a GPIO port bit.
+    inline HRESULT setPinAltFunction(ULONG gpioNo, ULONG altFunction);
+
     /// Method to turn pin pullup on or off.
     inline HRESULT setPinPullup(ULONG gpioNo, BOOL pullup);
 
@@ -415,7 +421,7 @@ private:
 /// The global object used to interact with the BayTrail Fabric GPIO hardware.
 LIGHTNING_DLL_API extern BcmGpioControllerClass g_bcmGpio;
 
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 
 #if defined(_M_IX86) || defined(_M_X64)
 /**
@@ -723,7 +729,7 @@ inline void BtFabricGpioControllerClass::_setS5PinOutput(ULONG gpioNo)
 
 
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
 /**
 This method assumes the caller has checked the input parameters.
 \param[in] gpioNo The GPIO number of the pad to set. Range: 0-31.
@@ -765,9 +771,52 @@ inline HRESULT BcmGpioControllerClass::setPinState(ULONG gpioNo, ULONG state)
 
     return hr;
 }
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
+/**
+The bits to set are written first, then the bits to clear, with no other code between
+the two register writes.
+\param[in] bank The bank of 32 GPIOs to write. 0 - GPIO 0-31, 1 - GPIO 32-53.
+\param[in] setMask Bit n is set to set GPIO n of the bank HIGH.
+\param[in] clearMask Bit n is set to set GPIO n of the bank LOW.
+\return HRESULT error or success code.
+*/
+inline HRESULT BcmGpioControllerClass::setPortState(ULONG bank, ULONG setMask, ULONG clearMask)
+{
+    HRESULT hr = mapIfNeeded();
+
+    if (SUCCEEDED(hr))
+    {
+        if (bank == 0)
+        {
+            if (setMask != 0)
+            {
+                m_registers->GPSET0 = setMask;
+            }
+            if (clearMask != 0)
+            {
+                m_registers->GPCLR0 = clearMask;
+            }
+        }
+        else
+        {
+            if (setMask != 0)
+            {
+                m_registers->GPSET1 = setMask;
+            }
+            if (clearMask != 0)
+            {
+                m_registers->GPCLR1 = clearMask;
+            }
+        }
+    }
+
+    return hr;
+}
+#endif // LIGHTNING_PI2_SUPPORTED
+
+#if LIGHTNING_PI2_SUPPORTED
 /**
 This method assumes the caller has checked the input parameters.
 \param[in] gpioNo The GPIO number of the pad to read. Range: 0-31.
@@ -792,9 +841,9 @@ inline HRESULT BcmGpioControllerClass::getPinState(ULONG gpioNo, ULONG & state)
 
     return hr;
 }
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
 /**
 This method assumes the caller has checked the input parameters.  This method has 
 the side effect of setting the pin to GPIO use (since the BCM GPIO controller uses 
@@ -836,9 +885,9 @@ inline HRESULT BcmGpioControllerClass::setPinDirection(ULONG gpioNo, ULONG mode)
 
     return hr;
 }
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
 /**
 This method assumes the caller has checked the input parameters.
 \param[in] gpioNo The GPIO number of the pad to configure.  Range: 0-53.
@@ -884,9 +933,52 @@ inline HRESULT BcmGpioControllerClass::setPinFunction(ULONG gpioNo, ULONG functi
 
     return hr;
 }
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
+
+#if LIGHTNING_PI2_SUPPORTED
+/**
+\param[in] gpioNo The number of the GPIO port bit.
+\param[in] altFunction The alternate function to select (0-5, for ALT0-ALT5).
+\return HRESULT success or error code.
+*/
+inline HRESULT BcmGpioControllerClass::setPinAltFunction(ULONG gpioNo, ULONG altFunction)
+{
+    HRESULT hr = S_OK;
+    ULONG funcSelData = 0;
+
+    // The function select codes for ALT0-ALT5 are not in order.
+    const ULONG altFunctionCodes[] = { 0x04, 0x05, 0x06, 0x07, 0x03, 0x02 };
+
+    if (altFunction >= ARRAYSIZE(altFunctionCodes))
+    {
+        hr = DMAP_E_FUNCTION_NOT_SUPPORTED_ON_PIN;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = mapIfNeeded();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = GetControllerLock(m_hController);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        funcSelData = m_registers->GPFSELN[gpioNo / 10];   // Read function register data
+        funcSelData &= ~(0x07 << ((gpioNo % 10) * 3));
+        funcSelData |= (altFunctionCodes[altFunction] << ((gpioNo % 10) * 3));
+        m_registers->GPFSELN[gpioNo / 10] = funcSelData;   // Write function register data back
+
+        ReleaseControllerLock(m_hController);
+    }
+
+    return hr;
+}
+#endif // LIGHTNING_PI2_SUPPORTED
 
-#if defined(_M_ARM)
+#if LIGHTNING_PI2_SUPPORTED
 /**
 This method assumes the caller has checked the input parameters.
 \param[in] gpioNo The GPIO number of the pad to configure.  Range: 0-53.
@@ -950,6 +1042,6 @@ inline HRESULT BcmGpioControllerClass::setPinPullup(ULONG gpioNo, BOOL pullup)
 
     return hr;
 }
-#endif // defined(_M_ARM)
+#endif // LIGHTNING_PI2_SUPPORTED
 
 #endif  // _GPIO_CONTROLLER_H_
\ No newline at end of file
@@ -6,6 +6,44 @@
 #define _HI_RES_TIMER_H_
 
 #include <Windows.h>
+#include <mmsystem.h>
+
+#pragma comment (lib, "Winmm.lib")
+
+// When a wait ends in less than this many microseconds, WaitUntil() spins on the high
+// resolution timer instead of sleeping.
+#define HI_RES_TIMER_SPIN_US 2000
+
+/// Class that sets the system timer resolution to 1 ms for as long as an object of it exists.
+/**
+Sleep() wakes on the system timer tick, which defaults to about 15.6 ms.  A thread that uses
+HiResTimerClass::WaitUntil() should hold one of these while it runs, or its sleeps can end
+up to a tick after the point at which WaitUntil() meant to start spinning.
+*/
+class TimerResolutionClass
+{
+public:
+    /// Constructor.
+    TimerResolutionClass()
+    {
+        m_periodSet = (timeBeginPeriod(1) == TIMERR_NOERROR);
+    }
+
+    /// Destructor.
+    virtual ~TimerResolutionClass()
+    {
+        if (m_periodSet)
+        {
+            timeEndPeriod(1);
+            m_periodSet = FALSE;
+        }
+    }
+
+private:
+
+    /// TRUE if the timer resolution was set and must be restored.
+    BOOL m_periodSet;
+};
 
 /// Class that is used to work with the system high resolution timer.
 class HiResTimerClass
@@ -50,6 +88,38 @@ public:
         return (nowTime.QuadPart >= m_targetReading.QuadPart);
     }
 
+    /// Method to wait until the high resolution timer reaches a reading.
+    /**
+    Sleeps while the time to wait is long, then spins on the high resolution timer, since
+    Sleep() only has a resolution of about a millisecond.  That resolution requires the
+    calling thread to hold a TimerResolutionClass object.
+    \param[in] ticks The high resolution timer reading to wait for.
+    \param[in] stopRequested Flag set by another thread to end the wait early.
+    */
+    template <typename FLAG>
+    static void WaitUntil(LONGLONG ticks, const volatile FLAG & stopRequested)
+    {
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER nowTicks;
+        LONGLONG remainingUs;
+
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&nowTicks);
+        while (!stopRequested && (nowTicks.QuadPart < ticks))
+        {
+            remainingUs = ((ticks - nowTicks.QuadPart) * 1000000LL) / frequency.QuadPart;
+            if (remainingUs > HI_RES_TIMER_SPIN_US)
+            {
+                Sleep((DWORD)((remainingUs - HI_RES_TIMER_SPIN_US) / 1000));
+            }
+            else
+            {
+                YieldProcessor();
+            }
+            QueryPerformanceCounter(&nowTicks);
+        }
+    }
+
 private:
 
     /// The high resolution timer frequencey on this system.
@@ -56,7 +56,7 @@ public:
     LIGHTNING_DLL_API HRESULT mapIfNeeded();
 
     // Method to initialize the I2C Controller at the start of a transaction.
-    virtual HRESULT _initializeForTransaction(ULONG slaveAddress, BOOL useHighSpeed) = 0;
+    virtual HRESULT _initializeForTransaction(ULONG slaveAddress, const I2cTransactionClass::BUS_TIMING & timing) = 0;
 
     //
     // I2C Controller accessor methods.  These methods assume the I2C Controller
@@ -128,6 +128,9 @@ public:
     /// Method to get the handle to the I2C Controller this object has open.
     inline HANDLE getControllerHandle() { return m_hController; }
 
+    /// Method to get the number of the I2C bus this object is associated with.
+    inline ULONG getBusNumber() { return m_busNumber; }
+
 protected:
     /// Handle to the open device.
     /**
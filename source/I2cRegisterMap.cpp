@@ -0,0 +1,392 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#include "pch.h"
+
+#include "I2cRegisterMap.h"
+#include "I2c.h"
+#include "ErrorCodes.h"
+
+
+// Constructor.
+I2cRegisterMapClass::I2cRegisterMapClass() :
+    m_dirtyCount(0),
+    m_controller(nullptr),
+    m_autoIncrement(FALSE),
+    m_msbFirst(TRUE)
+{
+    ZeroMemory(m_registers, sizeof(m_registers));
+}
+
+/**
+Registers must be declared before they are accessed.  A register occupies the register
+addresses from regAdr through regAdr + widthBytes - 1, which must not be used by any
+other register.
+\param[in] regAdr The address of the register on the device (0-255).
+\param[in] widthBytes The width of the register in bytes (1-4).
+\param[in] flags REG_CACHEABLE or REG_VOLATILE.
+\return HRESULT success or error code.
+*/
+HRESULT I2cRegisterMapClass::declareRegister(ULONG regAdr, ULONG widthBytes, ULONG flags)
+{
+    HRESULT hr = S_OK;
+
+    if ((widthBytes == 0) || (widthBytes > sizeof(ULONG)) || ((regAdr + widthBytes) > REG_MAP_MAX_REGISTERS))
+    {
+        hr = DMAP_E_I2C_INVALID_REGISTER_DECLARATION;
+    }
+
+    // Make sure no other register overlaps the addresses used by this register.
+    for (ULONG adr = 0; SUCCEEDED(hr) && (adr < (regAdr + widthBytes)); adr++)
+    {
+        if ((adr != regAdr) && _isDeclared(adr) && ((adr + m_registers[adr].width) > regAdr))
+        {
+            hr = DMAP_E_I2C_INVALID_REGISTER_DECLARATION;
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (m_registers[regAdr].dirty)
+        {
+            m_dirtyCount--;
+        }
+        m_registers[regAdr].width = (UCHAR)widthBytes;
+        m_registers[regAdr].flags = (UCHAR)flags;
+        m_registers[regAdr].valid = 0;
+        m_registers[regAdr].dirty = 0;
+        m_registers[regAdr].value = 0;
+    }
+
+    return hr;
+}
+
+/**
+Cached registers are read from the device the first time they are read, after that the
+cached value is returned.  Volatile registers are always read from the device.  Any
+staged writes are flushed before a register is read from the device.
+\param[in] regAdr The address of the register to read.
+\param[out] value The value of the register.
+\return HRESULT success or error code.
+*/
+HRESULT I2cRegisterMapClass::readRegister(ULONG regAdr, ULONG & value)
+{
+    HRESULT hr = S_OK;
+    PREG_STATE reg = nullptr;
+    BOOL needRead = FALSE;
+    UCHAR regAdrBuf[1];
+    UCHAR readBuf[sizeof(ULONG)] = { 0 };
+
+    if (!_isDeclared(regAdr))
+    {
+        hr = DMAP_E_I2C_REGISTER_NOT_DECLARED;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        reg = &m_registers[regAdr];
+
+        // If the cache has the value, no bus traffic is needed.
+        if (reg->valid && ((reg->flags & REG_VOLATILE) == 0))
+        {
+            value = reg->value;
+        }
+        else
+        {
+            needRead = TRUE;
+
+            // Get the device up to date before reading from it.
+            hr = flush();
+        }
+    }
+
+    if (SUCCEEDED(hr) && needRead)
+    {
+        // Queue sending the register address, then reading the register contents.
+        regAdrBuf[0] = (UCHAR)regAdr;
+        m_transaction.reset();
+        hr = m_transaction.queueWrite(regAdrBuf, 1);
+    }
+
+    if (SUCCEEDED(hr) && needRead)
+    {
+        hr = m_transaction.queueRead(readBuf, reg->width, TRUE);
+    }
+
+    if (SUCCEEDED(hr) && needRead)
+    {
+        hr = _execute();
+    }
+
+    if (SUCCEEDED(hr) && needRead)
+    {
+        value = 0;
+        for (ULONG i = 0; i < reg->width; i++)
+        {
+            if (m_msbFirst)
+            {
+                value = (value << 8) | readBuf[i];
+            }
+            else
+            {
+                value = value | (((ULONG)readBuf[i]) << (8 * i));
+            }
+        }
+
+        if ((reg->flags & REG_VOLATILE) == 0)
+        {
+            reg->value = value;
+            reg->valid = 1;
+        }
+    }
+
+    return hr;
+}
+
+/**
+The value is written to the device immediately (along with any staged writes) unless
+the register is cached and already has the value.
+\param[in] regAdr The address of the register to write.
+\param[in] value The value to write to the register.
+\return HRESULT success or error code.
+*/
+HRESULT I2cRegisterMapClass::writeRegister(ULONG regAdr, ULONG value)
+{
+    HRESULT hr = S_OK;
+
+    hr = stageRegister(regAdr, value);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = flush();
+    }
+
+    return hr;
+}
+
+/**
+The value is written to the device by the next call to flush() or writeRegister(), unless
+the register is cached and already has the value.  Reads of a cached register return the
+staged value.
+\param[in] regAdr The address of the register to write.
+\param[in] value The value to write to the register.
+\return HRESULT success or error code.
+*/
+HRESULT I2cRegisterMapClass::stageRegister(ULONG regAdr, ULONG value)
+{
+    HRESULT hr = S_OK;
+    PREG_STATE reg = nullptr;
+    ULONG mask = 0;
+
+    if (!_isDeclared(regAdr))
+    {
+        hr = DMAP_E_I2C_REGISTER_NOT_DECLARED;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        reg = &m_registers[regAdr];
+
+        // Only keep the bits that fit in the register.
+        mask = (reg->width == sizeof(ULONG)) ? 0xFFFFFFFF : ((1UL << (8 * reg->width)) - 1);
+        value = value & mask;
+
+        // Stage the write unless the device already has this value.
+        if (!reg->valid || reg->dirty || (reg->value != value) || ((reg->flags & REG_VOLATILE) != 0))
+        {
+            if (!reg->dirty)
+            {
+                reg->dirty = 1;
+                m_dirtyCount++;
+            }
+            reg->value = value;
+            reg->valid = 1;
+        }
+    }
+
+    return hr;
+}
+
+/**
+Staged writes are flushed in register address order.  If the device supports register
+address auto-increment, registers at adjacent addresses are written in a single transfer,
+and short runs of unchanged cached registers are re-written to join two such transfers.
+All transfers are done in one I2C transaction.
+\return HRESULT success or error code.
+*/
+HRESULT I2cRegisterMapClass::flush()
+{
+    HRESULT hr = S_OK;
+    ULONG adr = 0;
+    ULONG runStart = 0;
+    ULONG runEnd = 0;
+    ULONG gapEnd = 0;
+    ULONG bufIndex = 0;
+    ULONG runIndex = 0;
+    BOOL firstRun = TRUE;
+
+    // If nothing is staged, there is nothing to do.
+    if (m_dirtyCount == 0)
+    {
+        adr = REG_MAP_MAX_REGISTERS;
+    }
+
+    m_transaction.reset();
+
+    while (SUCCEEDED(hr) && (adr < REG_MAP_MAX_REGISTERS))
+    {
+        // Find the next register with a staged write.
+        if (!_isDeclared(adr) || !m_registers[adr].dirty)
+        {
+            adr++;
+            continue;
+        }
+
+        // Extend the run over following registers that can be written in the same transfer.
+        runStart = adr;
+        runEnd = adr + m_registers[adr].width;
+        while (m_autoIncrement && (runEnd < REG_MAP_MAX_REGISTERS))
+        {
+            if (_isDeclared(runEnd) && m_registers[runEnd].dirty)
+            {
+                runEnd = runEnd + m_registers[runEnd].width;
+            }
+            else
+            {
+                // See if a short gap of unchanged registers leads to another staged write.
+                gapEnd = runEnd;
+                while (_isCleanAndCached(gapEnd) && ((gapEnd - runEnd) < REG_MAP_MAX_GAP_BYTES))
+                {
+                    gapEnd = gapEnd + m_registers[gapEnd].width;
+                }
+
+                if ((gapEnd != runEnd) && ((gapEnd - runEnd) <= REG_MAP_MAX_GAP_BYTES) &&
+                    _isDeclared(gapEnd) && m_registers[gapEnd].dirty)
+                {
+                    runEnd = gapEnd;
+                }
+                else
+                {
+                    break;
+                }
+            }
+        }
+
+        // Build the transfer: register address followed by the register contents.
+        runIndex = bufIndex;
+        m_flushBuffer[bufIndex++] = (UCHAR)runStart;
+        for (adr = runStart; adr < runEnd; adr = adr + m_registers[adr].width)
+        {
+            _packValue(adr, &m_flushBuffer[bufIndex]);
+            bufIndex = bufIndex + m_registers[adr].width;
+        }
+
+        // Queue the transfer, with a restart between transfers.
+        hr = m_transaction.queueWrite(&m_flushBuffer[runIndex], bufIndex - runIndex, !firstRun);
+        firstRun = FALSE;
+    }
+
+    if (SUCCEEDED(hr) && !firstRun)
+    {
+        hr = _execute();
+    }
+
+    // Whether the writes succeeded or not, nothing is staged any more.  If they failed
+    // the contents of the staged registers are unknown.
+    for (adr = 0; (m_dirtyCount > 0) && (adr < REG_MAP_MAX_REGISTERS); adr++)
+    {
+        if (m_registers[adr].dirty)
+        {
+            m_registers[adr].dirty = 0;
+            m_dirtyCount--;
+            if (FAILED(hr) || ((m_registers[adr].flags & REG_VOLATILE) != 0))
+            {
+                m_registers[adr].valid = 0;
+            }
+        }
+    }
+
+    return hr;
+}
+
+/**
+This can be used to record register values that are known without reading them, for
+example the power-on values of registers after the device has been reset.
+\param[in] regAdr The address of the register.
+\param[in] value The value the register is known to have.
+\return HRESULT success or error code.
+*/
+HRESULT I2cRegisterMapClass::setCachedValue(ULONG regAdr, ULONG value)
+{
+    HRESULT hr = S_OK;
+
+    if (!_isDeclared(regAdr))
+    {
+        hr = DMAP_E_I2C_REGISTER_NOT_DECLARED;
+    }
+
+    if (SUCCEEDED(hr) && ((m_registers[regAdr].flags & REG_VOLATILE) == 0))
+    {
+        if (m_registers[regAdr].dirty)
+        {
+            m_registers[regAdr].dirty = 0;
+            m_dirtyCount--;
+        }
+        m_registers[regAdr].value = value;
+        m_registers[regAdr].valid = 1;
+    }
+
+    return hr;
+}
+
+/**
+After this call all registers are read from the device the next time they are read.
+This should be called if the device may have been changed by other code, or reset.
+*/
+void I2cRegisterMapClass::invalidate()
+{
+    for (ULONG adr = 0; adr < REG_MAP_MAX_REGISTERS; adr++)
+    {
+        m_registers[adr].valid = 0;
+        m_registers[adr].dirty = 0;
+    }
+    m_dirtyCount = 0;
+}
+
+// Method to put the bytes of a register value in a buffer in device order.
+void I2cRegisterMapClass::_packValue(ULONG regAdr, PUCHAR buffer)
+{
+    ULONG width = m_registers[regAdr].width;
+    ULONG value = m_registers[regAdr].value;
+
+    for (ULONG i = 0; i < width; i++)
+    {
+        if (m_msbFirst)
+        {
+            buffer[width - 1 - i] = (UCHAR)(value >> (8 * i));
+        }
+        else
+        {
+            buffer[i] = (UCHAR)(value >> (8 * i));
+        }
+    }
+}
+
+// Method to perform the transfers queued on the transaction.
+HRESULT I2cRegisterMapClass::_execute()
+{
+    HRESULT hr = S_OK;
+    I2cControllerClass* controller = m_controller;
+
+    if (controller == nullptr)
+    {
+        controller = g_i2c.getController();
+    }
+
+    hr = m_transaction.execute(controller);
+
+    m_transaction.reset();
+
+    return hr;
+}
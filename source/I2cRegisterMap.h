@@ -0,0 +1,174 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#ifndef _I2C_REGISTER_MAP_H_
+#define _I2C_REGISTER_MAP_H_
+
+#include <Windows.h>
+
+#include "I2cTransaction.h"
+
+class I2cControllerClass;
+
+// Register attribute flags.
+#define REG_CACHEABLE 0x00      ///< Register only changes when written, its value can be cached
+#define REG_VOLATILE 0x01       ///< Register can change on its own, always access the device
+
+// Number of register addresses a device can have (register addresses are 8-bits).
+#define REG_MAP_MAX_REGISTERS 256
+
+// Largest run of unchanged registers that is re-written to join two runs of changed
+// registers into one auto-increment transfer (the cost of starting a new transfer).
+#define REG_MAP_MAX_GAP_BYTES 2
+
+//
+// Class used to access the registers of an I2C device through a write-through cache.
+//
+// The registers of the device are declared with their address, width and whether their
+// values can be cached.  Writes that would not change a cached register are skipped, and
+// reads of cached registers are answered without bus traffic.  Writes can also be staged
+// and later flushed together, in which case registers at adjacent addresses are written
+// in a single transfer using the register address auto-increment of the device.
+//
+class I2cRegisterMapClass
+{
+public:
+    LIGHTNING_DLL_API I2cRegisterMapClass();
+
+    virtual ~I2cRegisterMapClass()
+    {
+    }
+
+    /// Method to set the I2C address of the device.
+    HRESULT setAddress(ULONG i2cAdr)
+    {
+        return m_transaction.setAddress(i2cAdr);
+    }
+
+    /// Method to get the I2C address of the device.
+    ULONG getAddress()
+    {
+        return m_transaction.getAddress();
+    }
+
+    /// Method to set the I2C bus clock rate used to access the device.
+    HRESULT setClockRate(ULONG clockHz)
+    {
+        return m_transaction.setClockRate(clockHz);
+    }
+
+    /// Method to set the I2C controller used to access the device.
+    /**
+    \param[in] controller The I2C controller the device is attached to, or nullptr to
+    use the controller for the main I2C bus.
+    */
+    void setController(I2cControllerClass* controller)
+    {
+        m_controller = controller;
+    }
+
+    /// Method to specify whether the device auto-increments the register address.
+    /**
+    With auto-increment, the device is expected to advance the register address by one
+    for each data byte transferred, so multi-byte registers occupy consecutive addresses.
+    \param[in] autoIncrement TRUE if the device supports register address auto-increment.
+    */
+    void setAutoIncrement(BOOL autoIncrement)
+    {
+        m_autoIncrement = autoIncrement;
+    }
+
+    /// Method to specify the order in which the bytes of multi-byte registers are sent.
+    /**
+    \param[in] msbFirst TRUE to send the most significant byte first, FALSE to send the
+    least significant byte first.
+    */
+    void setMsbFirst(BOOL msbFirst)
+    {
+        m_msbFirst = msbFirst;
+    }
+
+    // Method to declare one of the registers of the device.
+    LIGHTNING_DLL_API HRESULT declareRegister(ULONG regAdr, ULONG widthBytes, ULONG flags);
+
+    // Method to get the value of a register, from the cache if possible.
+    LIGHTNING_DLL_API HRESULT readRegister(ULONG regAdr, ULONG & value);
+
+    // Method to write a register value to the device, unless the register already has it.
+    LIGHTNING_DLL_API HRESULT writeRegister(ULONG regAdr, ULONG value);
+
+    // Method to record a register value to be written by the next flush().
+    LIGHTNING_DLL_API HRESULT stageRegister(ULONG regAdr, ULONG value);
+
+    // Method to write all staged register values to the device.
+    LIGHTNING_DLL_API HRESULT flush();
+
+    // Method to record a register value that is known without reading the device.
+    LIGHTNING_DLL_API HRESULT setCachedValue(ULONG regAdr, ULONG value);
+
+    // Method to discard all cached register values and staged writes.
+    LIGHTNING_DLL_API void invalidate();
+
+    /// Method to determine if any staged writes are waiting to be flushed.
+    BOOL isDirty()
+    {
+        return (m_dirtyCount > 0);
+    }
+
+private:
+
+    /// Struct used to track the state of one register.
+    typedef struct {
+        UCHAR width;            ///< Width of the register in bytes, 0 if not declared
+        UCHAR flags;            ///< REG_CACHEABLE or REG_VOLATILE
+        UCHAR valid : 1;        ///< 1: value is the current register contents
+        UCHAR dirty : 1;        ///< 1: value has been staged but not written yet
+        UCHAR _pad : 6;         ///< Pad to byte boundary
+        ULONG value;            ///< The cached or staged value of the register
+    } REG_STATE, *PREG_STATE;
+
+    /// The state of each register, indexed by register address.
+    REG_STATE m_registers[REG_MAP_MAX_REGISTERS];
+
+    /// The number of registers with staged writes.
+    ULONG m_dirtyCount;
+
+    /// The transaction used for all transfers to the device.
+    I2cTransactionClass m_transaction;
+
+    /// The I2C controller the device is attached to, nullptr for the main I2C bus.
+    I2cControllerClass* m_controller;
+
+    /// TRUE if the device supports register address auto-increment.
+    BOOL m_autoIncrement;
+
+    /// TRUE if multi-byte registers are sent most significant byte first.
+    BOOL m_msbFirst;
+
+    /// Buffer for the register addresses and data of a flush.
+    UCHAR m_flushBuffer[2 * REG_MAP_MAX_REGISTERS];
+
+    /// Method to determine if a register address has a declared register.
+    BOOL _isDeclared(ULONG regAdr)
+    {
+        return (regAdr < REG_MAP_MAX_REGISTERS) && (m_registers[regAdr].width != 0);
+    }
+
+    /// Method to determine if a register can be re-written with its cached value.
+    BOOL _isCleanAndCached(ULONG regAdr)
+    {
+        return _isDeclared(regAdr) &&
+            !m_registers[regAdr].dirty &&
+            m_registers[regAdr].valid &&
+            ((m_registers[regAdr].flags & REG_VOLATILE) == 0);
+    }
+
+    // Method to put the bytes of a register value in a buffer in device order.
+    void _packValue(ULONG regAdr, PUCHAR buffer);
+
+    // Method to perform the transfers queued on the transaction.
+    HRESULT _execute();
+};
+
+#endif  // _I2C_REGISTER_MAP_H_
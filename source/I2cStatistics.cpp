@@ -0,0 +1,300 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#include "pch.h"
+
+#include <intrin.h>
+#include <stdio.h>
+
+#include "I2cStatistics.h"
+#include "I2cTransaction.h"
+#include "ErrorCodes.h"
+
+//
+// Global extern exports
+//
+I2cStatisticsClass g_i2cStats;
+
+// Constructor.
+I2cStatisticsClass::I2cStatisticsClass() :
+    m_enabled(TRUE)
+{
+    QueryPerformanceFrequency(&m_frequency);
+    ZeroMemory(m_stats, sizeof(m_stats));
+}
+
+/**
+This is called by I2cTransactionClass::execute() for each transaction it performs.
+Only the counters for the slave address are updated, so transactions to different slaves
+do not contend with each other.
+\param[in] busNumber The number of the I2C bus the transaction was performed on.
+\param[in] slaveAddress The 7-bit address of the slave the transaction was sent to.
+\param[in] sample The measurements of the transaction.
+*/
+void I2cStatisticsClass::recordTransaction(ULONG busNumber, ULONG slaveAddress, const TRANSACTION_SAMPLE & sample)
+{
+    PSLAVE_STATS stats = nullptr;
+    ULONG lockWaitUs = 0;
+    ULONG queueUs = 0;
+    ULONG wireUs = 0;
+
+    if (m_enabled && (busNumber < I2C_STATS_MAX_BUSES) && (slaveAddress < I2C_STATS_MAX_ADDRESSES))
+    {
+        stats = &m_stats[busNumber][slaveAddress];
+
+        InterlockedIncrement((volatile LONG*)&stats->transactions);
+
+        // If the bus lock was acquired, record the lock wait and the time on the bus.
+        if (sample.lockedTicks != 0)
+        {
+            lockWaitUs = _ticksToUs(sample.lockedTicks - sample.startTicks);
+            wireUs = _ticksToUs(sample.endTicks - sample.lockedTicks);
+            _addSample(lockWaitUs, stats->lockWaitUs, &stats->maxLockWaitUs, stats->lockWaitHistogram);
+            _addSample(wireUs, stats->wireUs, &stats->maxWireUs, stats->wireHistogram);
+        }
+        else if (sample.failed)
+        {
+            InterlockedIncrement((volatile LONG*)&stats->lockFailures);
+        }
+
+        if (sample.queuedTicks != 0)
+        {
+            queueUs = _ticksToUs(sample.startTicks - sample.queuedTicks);
+            _addSample(queueUs, stats->queueUs, nullptr, stats->queueHistogram);
+        }
+
+        _addSample(sample.bytes, stats->bytes, nullptr, stats->bytesHistogram);
+
+        if (sample.failed)
+        {
+            InterlockedIncrement((volatile LONG*)&stats->failures);
+        }
+
+        if (sample.error == I2cTransactionClass::ADR_NACK)
+        {
+            InterlockedIncrement((volatile LONG*)&stats->adrNacks);
+        }
+        else if (sample.error == I2cTransactionClass::DATA_NACK)
+        {
+            InterlockedIncrement((volatile LONG*)&stats->dataNacks);
+        }
+        else if (sample.error == I2cTransactionClass::CLOCK_TIMEOUT)
+        {
+            InterlockedIncrement((volatile LONG*)&stats->clockTimeouts);
+        }
+    }
+}
+
+/**
+The counters are copied one at a time, so a copy made while transactions are being
+performed may include part of a transaction.
+\param[in] busNumber The number of the I2C bus.
+\param[in] slaveAddress The 7-bit address of the slave.
+\param[out] stats The statistics for the slave.
+\return HRESULT success or error code.
+*/
+HRESULT I2cStatisticsClass::getSlaveStatistics(ULONG busNumber, ULONG slaveAddress, SLAVE_STATS & stats)
+{
+    HRESULT hr = S_OK;
+
+    if (busNumber >= I2C_STATS_MAX_BUSES)
+    {
+        hr = DMAP_E_I2C_INVALID_BUS_NUMBER_SPECIFIED;
+    }
+    else if (slaveAddress >= I2C_STATS_MAX_ADDRESSES)
+    {
+        hr = DMAP_E_I2C_ADDRESS_OUT_OF_RANGE;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        stats = m_stats[busNumber][slaveAddress];
+    }
+
+    return hr;
+}
+
+/**
+\param[in] busNumber The number of the I2C bus.
+\param[out] stats The combined statistics for all slaves on the bus.  The maximum times
+are the largest of any slave.
+\return HRESULT success or error code.
+*/
+HRESULT I2cStatisticsClass::getBusStatistics(ULONG busNumber, SLAVE_STATS & stats)
+{
+    HRESULT hr = S_OK;
+
+    if (busNumber >= I2C_STATS_MAX_BUSES)
+    {
+        hr = DMAP_E_I2C_INVALID_BUS_NUMBER_SPECIFIED;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        ZeroMemory(&stats, sizeof(stats));
+        for (ULONG adr = 0; adr < I2C_STATS_MAX_ADDRESSES; adr++)
+        {
+            _accumulate(stats, m_stats[busNumber][adr]);
+        }
+    }
+
+    return hr;
+}
+
+// Method to clear all statistics.
+void I2cStatisticsClass::reset()
+{
+    ZeroMemory(m_stats, sizeof(m_stats));
+}
+
+/**
+One block of text is produced for each bus and slave address that has had at least one
+transaction, with the counters, the average and maximum times, and the non-empty
+histogram buckets.
+\param[out] text The formatted statistics.
+\return HRESULT success or error code.
+*/
+HRESULT I2cStatisticsClass::formatStatistics(std::string & text)
+{
+    HRESULT hr = S_OK;
+    char line[80];
+
+    text.clear();
+
+    for (ULONG bus = 0; bus < I2C_STATS_MAX_BUSES; bus++)
+    {
+        for (ULONG adr = 0; adr < I2C_STATS_MAX_ADDRESSES; adr++)
+        {
+            if (m_stats[bus][adr].transactions != 0)
+            {
+                sprintf_s(line, sizeof(line), "I2C bus %lu slave 0x%02lX:\n", bus, adr);
+                text.append(line);
+                _formatStats(text, m_stats[bus][adr]);
+            }
+        }
+    }
+
+    if (text.empty())
+    {
+        text.append("No I2C transactions recorded.\n");
+    }
+
+    return hr;
+}
+
+// Method to convert a high resolution timer interval to microseconds.
+ULONG I2cStatisticsClass::_ticksToUs(LONGLONG ticks)
+{
+    LONGLONG us = 0;
+
+    if ((ticks > 0) && (m_frequency.QuadPart != 0))
+    {
+        us = (ticks * 1000000LL) / m_frequency.QuadPart;
+    }
+    if (us > MAXLONG)
+    {
+        us = MAXLONG;
+    }
+
+    return (ULONG)us;
+}
+
+// Method to get the histogram bucket for a value.
+ULONG I2cStatisticsClass::_bucketIndex(ULONG value)
+{
+    ULONG bucket = 0;
+    unsigned long highBit = 0;
+
+    if (_BitScanReverse(&highBit, value))
+    {
+        bucket = highBit + 1;
+    }
+    if (bucket >= I2C_STATS_HISTOGRAM_BUCKETS)
+    {
+        bucket = I2C_STATS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    return bucket;
+}
+
+// Method to add a value to a running total, maximum and histogram.
+void I2cStatisticsClass::_addSample(ULONG value, ULONGLONG & total, ULONG * maximum, ULONG * histogram)
+{
+    LONG oldMax = 0;
+
+    InterlockedExchangeAdd64((volatile LONGLONG*)&total, value);
+    InterlockedIncrement((volatile LONG*)&histogram[_bucketIndex(value)]);
+
+    if (maximum != nullptr)
+    {
+        oldMax = *((volatile LONG*)maximum);
+        while (((ULONG)oldMax < value) &&
+            (InterlockedCompareExchange((volatile LONG*)maximum, (LONG)value, oldMax) != oldMax))
+        {
+            oldMax = *((volatile LONG*)maximum);
+        }
+    }
+}
+
+// Method to add the statistics for one slave address into a combined set.
+void I2cStatisticsClass::_accumulate(SLAVE_STATS & sum, const SLAVE_STATS & stats)
+{
+    sum.transactions += stats.transactions;
+    sum.failures += stats.failures;
+    sum.adrNacks += stats.adrNacks;
+    sum.dataNacks += stats.dataNacks;
+    sum.clockTimeouts += stats.clockTimeouts;
+    sum.lockFailures += stats.lockFailures;
+    sum.bytes += stats.bytes;
+    sum.lockWaitUs += stats.lockWaitUs;
+    sum.queueUs += stats.queueUs;
+    sum.wireUs += stats.wireUs;
+    sum.maxLockWaitUs = max(sum.maxLockWaitUs, stats.maxLockWaitUs);
+    sum.maxWireUs = max(sum.maxWireUs, stats.maxWireUs);
+    for (ULONG i = 0; i < I2C_STATS_HISTOGRAM_BUCKETS; i++)
+    {
+        sum.lockWaitHistogram[i] += stats.lockWaitHistogram[i];
+        sum.queueHistogram[i] += stats.queueHistogram[i];
+        sum.wireHistogram[i] += stats.wireHistogram[i];
+        sum.bytesHistogram[i] += stats.bytesHistogram[i];
+    }
+}
+
+// Method to format one set of statistics as text.
+void I2cStatisticsClass::_formatStats(std::string & text, const SLAVE_STATS & stats)
+{
+    char line[160];
+    ULONG count = max(stats.transactions, 1UL);
+    const char* names[] = { "lock wait us", "queued us", "on wire us", "bytes" };
+    const ULONG* histograms[] = { stats.lockWaitHistogram, stats.queueHistogram, stats.wireHistogram, stats.bytesHistogram };
+
+    sprintf_s(line, sizeof(line),
+        "  transactions %lu, failures %lu (adr nack %lu, data nack %lu, clock timeout %lu, lock %lu), bytes %llu\n",
+        stats.transactions, stats.failures, stats.adrNacks, stats.dataNacks, stats.clockTimeouts,
+        stats.lockFailures, stats.bytes);
+    text.append(line);
+
+    sprintf_s(line, sizeof(line),
+        "  lock wait avg %llu us max %lu us, on wire avg %llu us max %lu us, queued avg %llu us\n",
+        stats.lockWaitUs / count, stats.maxLockWaitUs, stats.wireUs / count, stats.maxWireUs,
+        stats.queueUs / count);
+    text.append(line);
+
+    for (ULONG h = 0; h < ARRAYSIZE(histograms); h++)
+    {
+        sprintf_s(line, sizeof(line), "  %-12s", names[h]);
+        text.append(line);
+        for (ULONG i = 0; i < I2C_STATS_HISTOGRAM_BUCKETS; i++)
+        {
+            if (histograms[h][i] != 0)
+            {
+                sprintf_s(line, sizeof(line), " %s%lu:%lu",
+                    (i == (I2C_STATS_HISTOGRAM_BUCKETS - 1)) ? ">=" : "",
+                    bucketLowerLimit(i), histograms[h][i]);
+                text.append(line);
+            }
+        }
+        text.append("\n");
+    }
+}
@@ -0,0 +1,137 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#ifndef _I2C_STATISTICS_H_
+#define _I2C_STATISTICS_H_
+
+#include <Windows.h>
+#include <string>
+
+// Number of I2C buses statistics are kept for.
+#define I2C_STATS_MAX_BUSES 2
+
+// Number of 7-bit I2C slave addresses.
+#define I2C_STATS_MAX_ADDRESSES 128
+
+// Number of buckets in each histogram.  Bucket 0 counts values of zero, bucket n counts
+// values from 2^(n-1) through 2^n - 1, and the last bucket also counts all larger values.
+#define I2C_STATS_HISTOGRAM_BUCKETS 20
+
+//
+// Class used to collect statistics about the I2C transactions performed on each I2C
+// bus, for each slave address.
+//
+// Every executed transaction is recorded with the time it spent waiting for the bus lock,
+// the time from queueing its first transfer until it was executed, the time it spent
+// using the bus, the number of bytes it transferred, and any error that occurred.  Times
+// are kept in microseconds.  Counters are updated with interlocked operations, so
+// recording a transaction is cheap and does not need a lock.
+//
+class I2cStatisticsClass
+{
+public:
+    LIGHTNING_DLL_API I2cStatisticsClass();
+
+    virtual ~I2cStatisticsClass()
+    {
+    }
+
+    /// Struct used to pass the measurements of one transaction to be recorded.
+    typedef struct {
+        LONGLONG queuedTicks;       ///< QPC reading when the first transfer was queued, 0 if none
+        LONGLONG startTicks;        ///< QPC reading when execution started
+        LONGLONG lockedTicks;       ///< QPC reading when the bus lock was acquired, 0 if it was not
+        LONGLONG endTicks;          ///< QPC reading when execution finished
+        ULONG bytes;                ///< Number of bytes written and read
+        ULONG error;                ///< I2cTransactionClass::ERROR_CODE for the transaction
+        BOOL failed;                ///< TRUE if the transaction failed
+    } TRANSACTION_SAMPLE, *PTRANSACTION_SAMPLE;
+
+    /// Struct used to return the statistics for one slave address.
+    typedef struct {
+        ULONG transactions;         ///< Number of transactions executed
+        ULONG failures;             ///< Number of transactions that failed
+        ULONG adrNacks;             ///< Number of transactions with the slave address not acknowledged
+        ULONG dataNacks;            ///< Number of transactions with data not acknowledged
+        ULONG clockTimeouts;        ///< Number of transactions with a clock stretch timeout
+        ULONG lockFailures;         ///< Number of transactions that could not get the bus lock
+        ULONGLONG bytes;            ///< Total bytes written and read
+        ULONGLONG lockWaitUs;       ///< Total time spent waiting for the bus lock
+        ULONGLONG queueUs;          ///< Total time from queueing the first transfer to execution
+        ULONGLONG wireUs;           ///< Total time spent using the bus
+        ULONG maxLockWaitUs;        ///< Longest wait for the bus lock
+        ULONG maxWireUs;            ///< Longest time spent using the bus
+        ULONG lockWaitHistogram[I2C_STATS_HISTOGRAM_BUCKETS];   ///< Lock wait times
+        ULONG queueHistogram[I2C_STATS_HISTOGRAM_BUCKETS];      ///< Queueing times
+        ULONG wireHistogram[I2C_STATS_HISTOGRAM_BUCKETS];       ///< Bus use times
+        ULONG bytesHistogram[I2C_STATS_HISTOGRAM_BUCKETS];      ///< Transaction sizes
+    } SLAVE_STATS, *PSLAVE_STATS;
+
+    /// Method to turn statistics collection on or off.
+    /**
+    \param[in] enable TRUE to record transactions (the default), FALSE to ignore them.
+    */
+    void setEnabled(BOOL enable)
+    {
+        m_enabled = enable;
+    }
+
+    /// Method to determine whether statistics are being collected.
+    BOOL isEnabled()
+    {
+        return m_enabled;
+    }
+
+    // Method to record the measurements of one transaction.
+    LIGHTNING_DLL_API void recordTransaction(ULONG busNumber, ULONG slaveAddress, const TRANSACTION_SAMPLE & sample);
+
+    // Method to get a copy of the statistics for one slave address.
+    LIGHTNING_DLL_API HRESULT getSlaveStatistics(ULONG busNumber, ULONG slaveAddress, SLAVE_STATS & stats);
+
+    // Method to get a copy of the statistics for all slave addresses on a bus combined.
+    LIGHTNING_DLL_API HRESULT getBusStatistics(ULONG busNumber, SLAVE_STATS & stats);
+
+    // Method to clear all statistics.
+    LIGHTNING_DLL_API void reset();
+
+    // Method to format the statistics for all active slave addresses as text.
+    LIGHTNING_DLL_API HRESULT formatStatistics(std::string & text);
+
+    /// Method to get the lower limit of the values counted in a histogram bucket.
+    static ULONG bucketLowerLimit(ULONG bucket)
+    {
+        return (bucket == 0) ? 0 : (1UL << (bucket - 1));
+    }
+
+private:
+
+    /// TRUE if transactions are being recorded.
+    BOOL m_enabled;
+
+    /// The high resolution timer frequency on this system.
+    LARGE_INTEGER m_frequency;
+
+    /// The statistics for each slave address on each bus.
+    SLAVE_STATS m_stats[I2C_STATS_MAX_BUSES][I2C_STATS_MAX_ADDRESSES];
+
+    // Method to convert a high resolution timer interval to microseconds.
+    ULONG _ticksToUs(LONGLONG ticks);
+
+    // Method to get the histogram bucket for a value.
+    static ULONG _bucketIndex(ULONG value);
+
+    // Method to add a value to a running total, maximum and histogram.
+    static void _addSample(ULONG value, ULONGLONG & total, ULONG * maximum, ULONG * histogram);
+
+    // Method to add the statistics for one slave address into a combined set.
+    static void _accumulate(SLAVE_STATS & sum, const SLAVE_STATS & stats);
+
+    // Method to format one set of statistics as text.
+    static void _formatStats(std::string & text, const SLAVE_STATS & stats);
+};
+
+/// The statistics for all I2C transactions performed by this process.
+LIGHTNING_DLL_API extern I2cStatisticsClass g_i2cStats;
+
+#endif  // _I2C_STATISTICS_H_
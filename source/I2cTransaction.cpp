@@ -9,6 +9,7 @@
 #include "HiResTimer.h"
 #include "ErrorCodes.h"
 #include "DmapSupport.h"
+#include "I2cStatistics.h"
 
 
 // Prepare this transaction for re-use.
@@ -31,6 +32,8 @@ void I2cTransactionClass::reset()
     m_abort = FALSE;
     m_error = SUCCESS;
     m_isIncomplete = FALSE;
+    m_queuedTicks = 0;
+    m_queuedBytes = 0;
 }
 
 // Sets the 7-bit address of the slave for this tranaction.
@@ -51,6 +54,25 @@ HRESULT I2cTransactionClass::setAddress(ULONG slaveAdr)
     return hr;
 }
 
+// Sets the I2C bus clock rate for this transaction.
+HRESULT I2cTransactionClass::setClockRate(ULONG clockHz)
+{
+    HRESULT hr = S_OK;
+
+    // The controller checks the lower limit, which depends on its clock dividers.
+    if ((clockHz == 0) || (clockHz > I2C_FAST_MODE_PLUS_HZ))
+    {
+        hr = DMAP_E_I2C_INVALID_CLOCK_RATE;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_busTiming.clockHz = clockHz;
+    }
+
+    return hr;
+}
+
 // Add a write transfer to the transaction.
 HRESULT I2cTransactionClass::queueWrite(PUCHAR buffer, ULONG bufferBytes, BOOL preRestart)
 {
@@ -188,6 +210,13 @@ HRESULT I2cTransactionClass::execute(I2cControllerClass* controller)
     I2cTransferClass* pReadXfr = nullptr;
     DWORD lockResult = 0;
     BOOL haveLock = FALSE;
+    LARGE_INTEGER nowTicks;
+    I2cStatisticsClass::TRANSACTION_SAMPLE sample = { 0 };
+
+    QueryPerformanceCounter(&nowTicks);
+    sample.startTicks = nowTicks.QuadPart;
+    sample.queuedTicks = m_queuedTicks;
+    sample.bytes = m_queuedBytes;
     
     // Get the I2C Controller mapped if it is not mapped yet.
     m_controller = controller;
@@ -207,8 +236,11 @@ HRESULT I2cTransactionClass::execute(I2cControllerClass* controller)
     // If we have the I2C bus locked:
     if (SUCCEEDED(hr))
     {
+        QueryPerformanceCounter(&nowTicks);
+        sample.lockedTicks = nowTicks.QuadPart;
+
         // Initialize the controller.
-        hr = m_controller->_initializeForTransaction(m_slaveAddress, m_useHighSpeed);
+        hr = m_controller->_initializeForTransaction(m_slaveAddress, m_busTiming);
 
         if (SUCCEEDED(hr))
         {
@@ -227,15 +259,31 @@ HRESULT I2cTransactionClass::execute(I2cControllerClass* controller)
         _releaseI2cLock();
     }
 
+    // Record how long the transaction took and how it turned out.
+    if (g_i2cStats.isEnabled())
+    {
+        QueryPerformanceCounter(&nowTicks);
+        sample.endTicks = nowTicks.QuadPart;
+        sample.error = m_error;
+        sample.failed = FAILED(hr) || (m_error != SUCCESS);
+        g_i2cStats.recordTransaction(m_controller->getBusNumber(), m_slaveAddress, sample);
+    }
+
     return hr;
 }
 
 // Method to queue a transfer as part of this transaction.
 void I2cTransactionClass::_queueTransfer(I2cTransferClass* pXfr)
 {
+    LARGE_INTEGER nowTicks;
+
     // If the transfer queue is empty:
     if (m_pXfrQueueTail == nullptr)
     {
+        // Note when the transaction started being built, for statistics.
+        QueryPerformanceCounter(&nowTicks);
+        m_queuedTicks = nowTicks.QuadPart;
+
         // Add this transfer as the first entry in the queue.
         m_pFirstXfr = pXfr;
         m_pXfrQueueTail = pXfr;
@@ -248,6 +296,8 @@ void I2cTransactionClass::_queueTransfer(I2cTransferClass* pXfr)
         m_pXfrQueueTail->chainNextTransfer(pXfr);
         m_pXfrQueueTail = pXfr;
     }
+
+    m_queuedBytes = m_queuedBytes + pXfr->getBufferSize();
 }
 
 // Method to process the transfers in this transaction.
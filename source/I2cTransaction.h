@@ -11,6 +11,14 @@
 
 class I2cControllerClass;
 
+// Standard I2C bus clock rates, in Hz.
+#define I2C_STANDARD_MODE_HZ 100000
+#define I2C_FAST_MODE_HZ 400000
+#define I2C_FAST_MODE_PLUS_HZ 1000000
+
+// The data delay used if none is specified (the BCM2836 power-on default).
+#define I2C_DEFAULT_DATA_DELAY 0x30
+
 //
 // Here, "transaction" is used to mean a set of I2C transfers that occurs 
 // to/from a single I2C slave address.
@@ -29,8 +37,13 @@ public:
         m_abort(FALSE),
         m_error(SUCCESS),
         m_isIncomplete(FALSE),
-        m_useHighSpeed(FALSE)
+        m_queuedTicks(0),
+        m_queuedBytes(0)
     {
+        m_busTiming.clockHz = I2C_STANDARD_MODE_HZ;
+        m_busTiming.stretchTimeout = 0;
+        m_busTiming.risingEdgeDelay = I2C_DEFAULT_DATA_DELAY;
+        m_busTiming.fallingEdgeDelay = I2C_DEFAULT_DATA_DELAY;
     }
 
     virtual inline ~I2cTransactionClass()
@@ -49,8 +62,16 @@ public:
 #endif // WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
     }
 
+    /// Struct for the I2C bus timing used by a transaction.
+    typedef struct {
+        ULONG clockHz;              ///< SCL clock rate in Hz
+        ULONG stretchTimeout;       ///< Clock stretch timeout in SCL clock cycles, 0 for no timeout
+        ULONG risingEdgeDelay;      ///< Core clocks from SCL rising edge to sampling SDA
+        ULONG fallingEdgeDelay;     ///< Core clocks from SCL falling edge to driving SDA
+    } BUS_TIMING, *PBUS_TIMING;
+
     // Prepare this transaction for re-use.
-    // Any previously set slave address is not affected by this method.
+    // Any previously set slave address and bus timing are not affected by this method.
     LIGHTNING_DLL_API void reset();
 
     // Sets the 7-bit address of the slave for this transaction.
@@ -107,6 +128,7 @@ public:
         SUCCESS,                ///< No Error has occured
         ADR_NACK,               ///< Slave address was not acknowledged
         DATA_NACK,              ///< Slave did not acknowledge data
+        CLOCK_TIMEOUT,          ///< Slave stretched the clock too long
         OTHER                   ///< Some other error occured
     };
 
@@ -128,10 +150,43 @@ public:
         return m_isIncomplete;
     }
 
-    /// Method to signal high speed can be used for this transaction.
+    /// Method to signal high speed (400 khz) can be used for this transaction.
     void useHighSpeed()
     {
-        m_useHighSpeed = TRUE;
+        m_busTiming.clockHz = I2C_FAST_MODE_HZ;
+    }
+
+    // Method to set the I2C bus clock rate used for this transaction.
+    LIGHTNING_DLL_API HRESULT setClockRate(ULONG clockHz);
+
+    /// Method to get the I2C bus clock rate requested for this transaction.
+    ULONG getClockRate()
+    {
+        return m_busTiming.clockHz;
+    }
+
+    /// Method to set the clock stretch timeout for this transaction.
+    /**
+    \param[in] sclCycles Number of SCL clock cycles a slave may stretch the clock
+    before the transfer fails, or 0 to wait indefinitely.
+    \note Controllers without a clock stretch timeout ignore this setting.
+    */
+    void setClockStretchTimeout(ULONG sclCycles)
+    {
+        m_busTiming.stretchTimeout = sclCycles;
+    }
+
+    /// Method to set the SDA data delays for this transaction.
+    /**
+    \param[in] risingEdgeDelay Core clocks to wait after SCL rises before sampling SDA.
+    \param[in] fallingEdgeDelay Core clocks to wait after SCL falls before driving SDA.
+    \note Delays longer than the controller allows at the bus clock rate are reduced to
+    the maximum allowed.  Controllers without data delay control ignore this setting.
+    */
+    void setDataDelays(ULONG risingEdgeDelay, ULONG fallingEdgeDelay)
+    {
+        m_busTiming.risingEdgeDelay = risingEdgeDelay;
+        m_busTiming.fallingEdgeDelay = fallingEdgeDelay;
     }
 
 private:
@@ -168,8 +223,14 @@ private:
     /// TRUE if one or more incompleted transfers exist on this transaction.
     BOOL m_isIncomplete;
 
-    /// TRUE to allow use of high speed for this transaction.
-    BOOL m_useHighSpeed;
+    /// The bus clock rate and timing to use for this transaction.
+    BUS_TIMING m_busTiming;
+
+    /// High resolution timer reading when the first transfer was queued, for statistics.
+    LONGLONG m_queuedTicks;
+
+    /// Total bytes in the transfers queued on this transaction, for statistics.
+    ULONG m_queuedBytes;
 
     //
     // I2cTransactionClass private member functions.
@@ -8,6 +8,7 @@
 #include <Windows.h>
 
 #include "Spi.h"
+#include "SpiBus.h"
 #include "GpioController.h"
 
 #define MBM_SPI_CS_PIN 5
@@ -15,15 +16,49 @@
 
 #define MCP3008_SPI_MODE SPI_MODE0
 #define MCP3008_MAX_SPI_KHZ 1350
-#define MCP3008_SPI_TRANSFER_BITS 24
+#define MCP3208_MAX_SPI_KHZ 1000
 
+// Conversions are sent and received as a buffer of bytes, so the SPI transfers are 8 bits.
+#define MCP3008_SPI_TRANSFER_BITS 8
+
+#define MCP3008_CHANNELS 8
+#define MCP3008_CONVERSION_BYTES 3
+
+// The size of a reading from each type of chip, in bits.
+#define MCP3008_BITS 10
+#define MCP3208_BITS 12
+
+// The most chips one MCP3008Device can use, each chip has its own chip select pin.
+#define MCP3008_MAX_CHIPS SPI_BUS_MAX_DEVICES
+
+//
+// Class used to read one or more MCP3008 (10-bit) or MCP3208 (12-bit) ADCs on the SPI bus.
+//
+// Each chip has its own chip select pin.  The channels of all the chips are numbered as
+// one set: channels 0-7 are on the first chip, channels 8-15 on the second chip, and so on.
+//
 class MCP3008Device
 {
 public:
+    /// The types of ADC chip supported.
+    typedef enum {
+        MCP3008,        ///< 8-channel 10-bit ADC
+        MCP3208         ///< 8-channel 12-bit ADC
+    } CHIP_TYPE;
+
     /// Constructor.
     MCP3008Device() :
-        m_csPin(0)
+        m_chipType(MCP3008),
+        m_bits(MCP3008_BITS),
+        m_chipCount(0)
     {
+        for (ULONG i = 0; i < MCP3008_MAX_CHIPS; i++)
+        {
+            m_csPins[i] = 0;
+            m_spiDevices[i] = SPI_BUS_NO_DEVICE;
+        }
+
+        _buildCommands();
     }
 
     /// Destructor.
@@ -31,14 +66,16 @@ public:
     {
     }
 
-    /// Prepare to use this ADC.
+    /// Prepare to use the MCP3008 ADC on the standard chip select pin of this board.
     /**
+    If chips have already been added, they are left as they are.
     \return HRESULT success or error code.
     */
     inline HRESULT begin()
     {
         HRESULT hr;
         BoardPinsClass::BOARD_TYPE board;
+        ULONG csPin = 0;
 
         hr = g_pins.getBoardType(board);
 
@@ -47,136 +84,344 @@ public:
             hr = DMAP_E_BOARD_TYPE_NOT_RECOGNIZED;
         }
 
-        // Create and initialize the SPI Controller object if we don't already have one.
+        // Find the CS pin used for the ADC on this board.
         if (SUCCEEDED(hr))
         {
             if (board == BoardPinsClass::BOARD_TYPE::MBM_BARE)
             {
-                m_csPin = MBM_SPI_CS_PIN;
-                m_spi = new BtSpiControllerClass;
-                hr = m_spi->configurePins(MBM_PIN_MISO, MBM_PIN_MOSI, MBM_PIN_SCK);
+                csPin = MBM_SPI_CS_PIN;
             }
             else if (board == BoardPinsClass::BOARD_TYPE::PI2_BARE)
             {
-                m_csPin = PI2_SPI_CS_PIN;
-                m_spi = new BcmSpiControllerClass;
-                hr = m_spi->configurePins(PI2_PIN_SPI0_MISO, PI2_PIN_SPI0_MOSI, PI2_PIN_SPI0_SCK);
+                csPin = PI2_SPI_CS_PIN;
             }
             else
             {
                 hr = DMAP_E_BOARD_TYPE_NOT_RECOGNIZED;
             }
+        }
 
-            if (SUCCEEDED(hr))
+        // Add the ADC to the SPI bus, if it has not already been added.
+        if (SUCCEEDED(hr) && (m_chipCount == 0))
+        {
+            hr = begin(&csPin, 1, MCP3008);
+        }
+        
+        return hr;
+    }
+
+    /// Prepare to use a set of ADC chips, each on its own chip select pin.
+    /**
+    Any chips already in use are released first.  All the chips must be of the same type.
+    \param[in] csPins The chip select pins of the chips, in channel number order.
+    \param[in] chipCount The number of entries in csPins.
+    \param[in] chipType The type of all the chips.
+    \return HRESULT success or error code.  If an error is returned no chips are in use.
+    */
+    inline HRESULT begin(const ULONG csPins[], ULONG chipCount, CHIP_TYPE chipType)
+    {
+        HRESULT hr = S_OK;
+
+        if ((csPins == nullptr) || (chipCount == 0))
+        {
+            hr = E_INVALIDARG;
+        }
+        else if (chipCount > MCP3008_MAX_CHIPS)
+        {
+            hr = DMAP_E_ADC_TOO_MANY_CHIPS;
+        }
+        else if ((chipType != MCP3008) && (chipType != MCP3208))
+        {
+            hr = DMAP_E_ADC_SETTING_INVALID;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            end();
+
+            m_chipType = chipType;
+            m_bits = (chipType == MCP3208) ? MCP3208_BITS : MCP3008_BITS;
+            _buildCommands();
+
+            // Add each chip to the SPI bus with its own chip select.  The chips all have
+            // the same SPI settings, so the bus can switch between them cheaply.  The
+            // conversions are byte buffers, so every chip is added with 8-bit transfers.
+            for (ULONG i = 0; SUCCEEDED(hr) && (i < chipCount); i++)
             {
-                hr = g_pins.setPinMode(m_csPin, DIRECTION_OUT, FALSE);
+                hr = g_spi.addDevice(csPins[i],
+                                     MCP3008_SPI_MODE,
+                                     (chipType == MCP3208) ? MCP3208_MAX_SPI_KHZ : MCP3008_MAX_SPI_KHZ,
+                                     MCP3008_SPI_TRANSFER_BITS,
+                                     FALSE,
+                                     m_spiDevices[i]);
 
                 if (SUCCEEDED(hr))
                 {
-                    hr = g_pins.setPinState(m_csPin, HIGH);
+                    m_csPins[i] = csPins[i];
+                    m_chipCount++;
                 }
+            }
 
-                if (SUCCEEDED(hr))
-                {
-                    hr = g_pins.verifyPinFunction(m_csPin, FUNC_DIO, BoardPinsClass::LOCK_FUNCTION);
-                }
+            if (FAILED(hr))
+            {
+                end();
             }
         }
 
-        if (SUCCEEDED(hr))
-        {
-            // Set the SPI bit shifting order to MSB First.
-            m_spi->setMsbFirstBitOrder();
-
-            // Map the SPI1 controller registers into memory.
-            hr = m_spi->begin(EXTERNAL_SPI_BUS,
-                              MCP3008_SPI_MODE,
-                              MCP3008_MAX_SPI_KHZ,
-                              MCP3008_SPI_TRANSFER_BITS);
-        }
-        
         return hr;
     }
 
-    /// Release the ADC.
+    /// Release the ADC chips.
     inline void end()
     {
-        // Release the ADC SPI bus.
-        m_spi->end();
+        // Remove the chips from the SPI bus, which releases the CS pins (and the SPI
+        // bus pins, if no other device is using the bus).
+        for (ULONG i = 0; i < m_chipCount; i++)
+        {
+            g_spi.removeDevice(m_spiDevices[i]);
+            m_spiDevices[i] = SPI_BUS_NO_DEVICE;
+        }
+        m_chipCount = 0;
+    }
 
-        // Revert the dedicated SPI pins to GPIO.
-        m_spi->revertPinsToGpio();
+    /// Get the number of channels on all the chips in use.
+    inline ULONG getChannelCount()
+    {
+        return m_chipCount * MCP3008_CHANNELS;
+    }
 
-        // Unlock the CS line so it can be used for non-GPIO function.
-        g_pins.verifyPinFunction(m_csPin, FUNC_DIO, BoardPinsClass::UNLOCK_FUNCTION);
+    /// Get the size of a reading in bits.
+    inline ULONG getBits()
+    {
+        return m_bits;
     }
 
-    /// Take a reading with the ADC used on the Gen2 board.
+    /// Take a reading of one channel.
     /**
-    \param[in] channel Number of channel on ADC to read.
+    \param[in] channel Number of channel to read.
     \param[out] value The value read from the ADC.
     \param[out] bits The size of the reading in "value" in bits.
     \return HRESULT success or error code.
     */
     inline HRESULT readValue(ULONG channel, ULONG & value, ULONG & bits)
+    {
+        return readChannels(&channel, 1, &value, bits);
+    }
+
+    /// Take readings of a set of channels with one use of the SPI bus.
+    /**
+    Only the first 32 channels can be read with this method, use readChannels() to read
+    channels beyond them.
+    \param[in] channelMask Bit n is set to read channel n.
+    \param[out] values Array with an entry for each channel up to the highest one in
+    channelMask.  Entry n receives the value read from channel n, entries for channels not
+    in channelMask are not changed.
+    \param[out] bits The size of each reading in "values" in bits.
+    \return HRESULT success or error code.
+    */
+    inline HRESULT readValues(ULONG channelMask, ULONG values[], ULONG & bits)
     {
         HRESULT hr = S_OK;
-        
-        // Make sure the channel number is in range.
-        if (channel >= ADC_CHANNELS)
+        ULONG channels[32];
+        ULONG readings[32];
+        ULONG count = 0;
+
+        // Make sure all the channel numbers are in range.
+        if ((getChannelCount() < 32) && ((channelMask & ~((1UL << getChannelCount()) - 1)) != 0))
         {
             hr = DMAP_E_ADC_DOES_NOT_HAVE_REQUESTED_CHANNEL;
         }
 
-        ULONG dataIn = 0;
-        BYTE command = (BYTE)(channel & 0x03);  // Using only 3 bits of the passed in ULONG for channel ID
-
-        command |= 0x08;     // Single-Ended read - comparing the sample voltage to AGND
-        command <<= 4;      // Channel number and Single-Ended bit are in the upper 4 bits of the command byte
+        if (SUCCEEDED(hr))
+        {
+            for (ULONG channel = 0; channel < 32; channel++)
+            {
+                if ((channelMask & (1UL << channel)) != 0)
+                {
+                    channels[count] = channel;
+                    count++;
+                }
+            }
 
-        BYTE dataOut[4] = 
-        { 
-            0x00,       // Upper byte is not used (24 bit transfer)
-            0x01,       // Start Bit
-            command,    // 4 Command bits in top of byte
-            0x00        // MCP3008 ignores these bits.
-        };
+            hr = readChannels(channels, count, readings, bits);
+        }
 
         if (SUCCEEDED(hr))
         {
-            // Perform a conversion and get the result.
-            g_pins.setPinState(m_csPin, LOW);
+            for (ULONG i = 0; i < count; i++)
+            {
+                values[channels[i]] = readings[i];
+            }
+        }
+
+        return hr;
+    }
+
+    /// Take readings of a list of channels with one use of the SPI bus.
+    /**
+    The SPI bus is acquired once for all the conversions, so no other user of the bus can
+    get in between them.  The conversions go round the chips in turn, taking the next
+    channel in the list from each chip that has one, so the same channels on different
+    chips are converted close together in time.  The MCP3008 only starts a new conversion
+    after its chip select has been deasserted, so the chip select is toggled between
+    conversions (by a register write if the controller drives it).
+    \param[in] channels The numbers of the channels to read.
+    \param[in] count The number of entries in channels.
+    \param[out] values Array of count entries.  Entry n receives the value read from the
+    channel in entry n of channels.
+    \param[out] bits The size of each reading in "values" in bits.
+    \return HRESULT success or error code.
+    */
+    inline HRESULT readChannels(const ULONG channels[], ULONG count, ULONG values[], ULONG & bits)
+    {
+        HRESULT hr = S_OK;
+        SpiControllerClass* spi = nullptr;
+        ULONG next[MCP3008_MAX_CHIPS];
+        ULONG converted = 0;
+        ULONG entry;
+
+        if ((count > 0) && ((channels == nullptr) || (values == nullptr)))
+        {
+            hr = E_POINTER;
+        }
+
+        if (SUCCEEDED(hr) && (m_chipCount == 0))
+        {
+            hr = DMAP_E_ADC_DOES_NOT_HAVE_REQUESTED_CHANNEL;
+        }
+
+        // Make sure all the channel numbers are in range.
+        for (ULONG i = 0; SUCCEEDED(hr) && (i < count); i++)
+        {
+            if (channels[i] >= getChannelCount())
+            {
+                hr = DMAP_E_ADC_DOES_NOT_HAVE_REQUESTED_CHANNEL;
+            }
+        }
+
+        if (SUCCEEDED(hr) && (count > 0))
+        {
+            hr = g_spi.acquire(m_spiDevices[channels[0] / MCP3008_CHANNELS], spi);
+
+            if (SUCCEEDED(hr))
+            {
+                // next[chip] is the first list entry not yet looked at for each chip.
+                ZeroMemory(next, sizeof(next));
 
-            hr = m_spi->transfer24(*reinterpret_cast<ULONG*>(&dataOut[0]), dataIn);
-                
-            g_pins.setPinState(m_csPin, HIGH);
+                while (SUCCEEDED(hr) && (converted < count))
+                {
+                    for (ULONG chip = 0; SUCCEEDED(hr) && (chip < m_chipCount); chip++)
+                    {
+                        // Find the next channel in the list that is on this chip.
+                        entry = next[chip];
+                        while ((entry < count) && ((channels[entry] / MCP3008_CHANNELS) != chip))
+                        {
+                            entry++;
+                        }
+                        next[chip] = entry + 1;
+
+                        if (entry < count)
+                        {
+                            hr = g_spi.switchDevice(m_spiDevices[chip]);
+
+                            if (SUCCEEDED(hr))
+                            {
+                                hr = _convert(spi, channels[entry] % MCP3008_CHANNELS, values[entry]);
+                            }
+
+                            converted++;
+                        }
+                    }
+                }
+
+                g_spi.release();
+            }
         }
 
         if (SUCCEEDED(hr))
         {
-            // Extract the reading from the data sent back from the ADC.
-            value = dataIn & ((1 << ADC_BITS) - 1);
-            bits = ADC_BITS;
+            bits = m_bits;
         }
         
         return hr;
     }
 
 private:
-    /// The number of channels on the ADC.
-    const ULONG ADC_CHANNELS = 8;
+    /// The type of the chips in use.
+    CHIP_TYPE m_chipType;
 
     /// The number of bits in an ADC conversion.
-    const ULONG ADC_BITS = 10;
+    ULONG m_bits;
+
+    /// The number of chips in use.
+    ULONG m_chipCount;
+
+    /// The pin number of the CS pin of each chip.
+    ULONG m_csPins[MCP3008_MAX_CHIPS];
+
+    /// The handle of each chip on the SPI bus.
+    ULONG m_spiDevices[MCP3008_MAX_CHIPS];
+
+    /// The command bytes that start a conversion on each channel.
+    BYTE m_commands[MCP3008_CHANNELS][MCP3008_CONVERSION_BYTES];
+
+    /// Build the command sent for a single-ended conversion on each channel.
+    inline void _buildCommands()
+    {
+        for (ULONG i = 0; i < MCP3008_CHANNELS; i++)
+        {
+            if (m_chipType == MCP3208)
+            {
+                // The MCP3208 takes the start bit and the SGL/DIFF bit at the end of the
+                // first byte, followed by the three channel select bits.  The 12-bit result
+                // arrives in the last 12 bits of the three bytes received.
+                m_commands[i][0] = (BYTE)(0x06 | (i >> 2));
+                m_commands[i][1] = (BYTE)((i & 0x03) << 6);
+            }
+            else
+            {
+                // The MCP3008 takes a start bit at the end of the first byte, then the
+                // SGL/DIFF bit and the three channel select bits at the top of the second
+                // byte.  The 10-bit result arrives in the last 10 bits of the three bytes
+                // received.
+                m_commands[i][0] = 0x01;
+                m_commands[i][1] = (BYTE)((0x08 | i) << 4);
+            }
+            m_commands[i][2] = 0x00;
+        }
+    }
+
+    /// Perform one conversion on the chip the acquired SPI bus is set up for.
+    /**
+    \param[in] spi The SPI controller, as returned when the bus was acquired.
+    \param[in] chipChannel The channel number on the chip (0-7).
+    \param[out] value The value read from the channel.
+    \return HRESULT success or error code.
+    */
+    inline HRESULT _convert(SpiControllerClass* spi, ULONG chipChannel, ULONG & value)
+    {
+        HRESULT hr;
+        HRESULT tmpHr;
+        BYTE dataIn[MCP3008_CONVERSION_BYTES];
+
+        hr = spi->selectChip();
+
+        if (SUCCEEDED(hr))
+        {
+            hr = spi->transferBuffer(m_commands[chipChannel], dataIn, MCP3008_CONVERSION_BYTES);
 
-    /// The shift amount to put the channel number into a 24-bit value.
-    const ULONG CHAN_SHIFT = 12;
+            tmpHr = spi->deselectChip();
+            if (SUCCEEDED(hr)) { hr = tmpHr; }
+        }
 
-    /// The pin number of the CS pin.
-    ULONG m_csPin;
+        if (SUCCEEDED(hr))
+        {
+            // Extract the reading from the data sent back from the ADC.
+            value = ((dataIn[1] << 8) | dataIn[2]) & ((1 << m_bits) - 1);
+        }
 
-    /// The SPI Controller object used to talk to the ADC.
-    SpiControllerClass* m_spi;
+        return hr;
+    }
 
 };
 
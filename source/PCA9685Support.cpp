@@ -7,15 +7,19 @@
 #include "PCA9685Support.h"
 #include "ExpanderDefs.h"
 #include "I2c.h"
+#include "I2cRegisterMap.h"
+#include "HiResTimer.h"
 #include "ErrorCodes.h"
 #include "ArduinoCommon.h"
 
-// Start with "chip not initialized" status.
-BOOL PCA9685Device::m_chipIsInitialized = FALSE;
+// Start with no PWM chips in use.
+PCA9685Device::CHIP_STATE PCA9685Device::m_chips[PCA9685_MAX_CHIPS] = { 0 };
 
-// PWM prescale value for default pulse rate of 1000 pulses per second.
-// Prescale = round(25000000/(4096 * pulse_rate)) - 1
-UCHAR PCA9685Device::m_freqPreScale = 5;
+// The ALL CALL registers are set up the first time they are used.
+I2cRegisterMapClass* PCA9685Device::m_allCallRegisters = nullptr;
+
+// The lock is statically initialized, so it is ready before any PWM chip is used.
+SRWLOCK PCA9685Device::m_lock = SRWLOCK_INIT;
 
 const ULONG PCA9685Device::PWM_BITS         =   12;     // This PWM chip has 12 bits of resolution
 
@@ -27,11 +31,24 @@ const ULONG PCA9685Device::SUBADR3_ADR      = 0x04;     // Address of SUBADR1 re
 const ULONG PCA9685Device::ALLCALLADR_ADR   = 0x05;     // Address of ALLCALLADR register
 const ULONG PCA9685Device::LEDS_BASE_ADR    = 0x06;     // Base address of LED output registers
 const ULONG PCA9685Device::REGS_PER_LED     = 0x04;     // Number of registers for each LED
+const ULONG PCA9685Device::ALL_LED_ADR      = 0xFA;     // Address of ALL_LED output registers
 const ULONG PCA9685Device::PRE_SCALE_ADR    = 0xFE;     // Address of frequency prescale register
 const ULONG PCA9685Device::TestMode_ADR     = 0xFF;     // Address of TestMode register
 const ULONG PCA9685Device::LED_COUNT        = 0x10;     // Number of "LED" ports on the chip
+const ULONG PCA9685Device::FULL_ON_OFF      = 0x1000;   // Bit 4 of LEDn_ON_H or LEDn_OFF_H
+
+// PWM prescale value for default pulse rate of 1000 pulses per second.
+// Prescale = round(25000000/(4096 * pulse_rate)) - 1
+const ULONG PCA9685Device::DEFAULT_PRE_SCALE = 5;
+
+//
+// The LED registers of each channel are cached as two 16-bit registers: LEDn_ON at
+// LEDS_BASE_ADR + (n * REGS_PER_LED) and LEDn_OFF two addresses above that.
+//
+
 /**
 This method takes the actions needed to set a port bit of the PWM chip to the desired state.
+Nothing is sent to the chip if the port bit is already in that state.
 \param[in] i2cAdr The I2C address of the PWM chip.
 \param[in] portBit The number of the port bit to modify.
 \param[in] state The state to set the port bit to: HIGH or LOW.
@@ -40,10 +57,8 @@ This method takes the actions needed to set a port bit of the PWM chip to the de
 HRESULT PCA9685Device::SetBitState(ULONG i2cAdr, ULONG portBit, ULONG state)
 {
     HRESULT hr = S_OK;
-    I2cTransactionClass transaction;
-    UCHAR bitRegsAdr = 0;                       // Address of start of registers for bit in question
-    UCHAR lowBitData[REGS_PER_LED] = { 0x00, 0x00, 0x00, 0x10 };    // Registers data to set bit low
-    UCHAR highBitData[REGS_PER_LED] = { 0x00, 0x10, 0x00, 0x00 };   // Registers data to set bit high
+    PCHIP_STATE chip = nullptr;
+    ULONG bitRegsAdr = 0;                       // Address of start of registers for bit in question
 
     if (portBit >= LED_COUNT)
     {
@@ -55,55 +70,52 @@ HRESULT PCA9685Device::SetBitState(ULONG i2cAdr, ULONG portBit, ULONG state)
         hr = DMAP_E_INVALID_PIN_STATE_SPECIFIED;
     }
 
-    if (SUCCEEDED(hr))
-    {
-        // Make sure the PWM chip is initialized.
-        hr = _InitializeChip(i2cAdr);
-    }
+    AcquireSRWLockExclusive(&m_lock);
 
     if (SUCCEEDED(hr))
     {
-        // Set the I2C address of the PWM chip.
-        hr = transaction.setAddress(i2cAdr);
+        // Make sure the PWM chip is initialized.
+        hr = _GetChip(i2cAdr, chip);
     }
 
     if (SUCCEEDED(hr))
     {
-        // Indicate this chip supports high speed I2C transfers.
-        transaction.useHighSpeed();
-
         // Calculate the address of the first register for the port in question.
-        bitRegsAdr = (UCHAR)(LEDS_BASE_ADR + (portBit * REGS_PER_LED));
+        bitRegsAdr = LEDS_BASE_ADR + (portBit * REGS_PER_LED);
 
-        // Queue sending the base address of the port registers to the chip.
-        hr = transaction.queueWrite(&bitRegsAdr, 1);
-    }
-
-    if (SUCCEEDED(hr))
-    {
-        // Queue sending the registers contents to set the specified bit state.
+        // Stage the register contents to set the specified bit state.
         if (state == LOW)
         {
-            hr = transaction.queueWrite(lowBitData, REGS_PER_LED);
+            hr = chip->registers->stageRegister(bitRegsAdr, 0);
+            if (SUCCEEDED(hr))
+            {
+                hr = chip->registers->stageRegister(bitRegsAdr + 2, FULL_ON_OFF);
+            }
         }
         else
         {
-            hr = transaction.queueWrite(highBitData, REGS_PER_LED);
+            hr = chip->registers->stageRegister(bitRegsAdr, FULL_ON_OFF);
+            if (SUCCEEDED(hr))
+            {
+                hr = chip->registers->stageRegister(bitRegsAdr + 2, 0);
+            }
         }
-        
     }
 
     if (SUCCEEDED(hr))
     {
-        // Actually perform the I2C transfers specified above.
-        hr = transaction.execute(g_i2c.getController());
+        // Send the registers that changed to the chip.
+        hr = chip->registers->flush();
     }
-    
+
+    ReleaseSRWLockExclusive(&m_lock);
+
     return hr;
 }
 
 /**
-This expects the port bit to be configured to be constantly on or off.
+This expects the port bit to be configured to be constantly on or off.  The port bit
+registers are read from the cache if their contents are known.
 \param[in] i2cAdr The I2C address of the PWM chip.
 \param[in] portBit The number of the port bit to read.
 \param[out] state The state of the port bit: HIGH or LOW.
@@ -112,9 +124,10 @@ This expects the port bit to be configured to be constantly on or off.
 HRESULT PCA9685Device::GetBitState(ULONG i2cAdr, ULONG portBit, ULONG & state)
 {
     HRESULT hr = S_OK;
-    I2cTransactionClass transaction;
-    UCHAR bitRegsAdr = 0;                       // Address of start of registers for bit in question
-    UCHAR bitData[REGS_PER_LED] = { 0 };        // Buffer for bit register contents
+    PCHIP_STATE chip = nullptr;
+    ULONG bitRegsAdr = 0;                       // Address of start of registers for bit in question
+    ULONG onValue = 0;
+    ULONG offValue = 0;
 
 
     if (portBit >= LED_COUNT)
@@ -122,65 +135,54 @@ HRESULT PCA9685Device::GetBitState(ULONG i2cAdr, ULONG portBit, ULONG & state)
         hr = DMAP_E_INVALID_PORT_BIT_FOR_DEVICE;
     }
 
-    if (SUCCEEDED(hr))
-    {
-        // Make sure the PWM chip is initialized.
-        hr = _InitializeChip(i2cAdr);
-    }
+    AcquireSRWLockExclusive(&m_lock);
 
     if (SUCCEEDED(hr))
     {
-        // Set the I2C address of the PWM chip.
-        hr = transaction.setAddress(i2cAdr);
+        // Make sure the PWM chip is initialized.
+        hr = _GetChip(i2cAdr, chip);
     }
 
     if (SUCCEEDED(hr))
     {
-        // Indicate this chip supports high speed I2C transfers.
-        transaction.useHighSpeed();
-
         // Calculate the address of the first register for the port in question.
-        bitRegsAdr = (UCHAR)(LEDS_BASE_ADR + (portBit * REGS_PER_LED));
-
-        // Queue sending the base address of the port registers to the chip.
-        hr = transaction.queueWrite(&bitRegsAdr, 1);
-    }
+        bitRegsAdr = LEDS_BASE_ADR + (portBit * REGS_PER_LED);
 
-    if (SUCCEEDED(hr))
-    {
-        // Queue reading the registers for the bit in question.
-        hr = transaction.queueRead(bitData, REGS_PER_LED);
+        hr = chip->registers->readRegister(bitRegsAdr, onValue);
     }
 
     if (SUCCEEDED(hr))
     {
-        // Actually perform the I2C transfers specified above.
-        hr = transaction.execute(g_i2c.getController());
+        hr = chip->registers->readRegister(bitRegsAdr + 2, offValue);
     }
 
     if (SUCCEEDED(hr))
     {
         // If constant OFF bit is 1, the port bit is LOW, regardless of constant ON bit.
-        if ((bitData[3] & 0x10) != 0)
+        if ((offValue & FULL_ON_OFF) != 0)
         {
             state = LOW;
         }
         // If constant OFF bit is 0, and constant ON bit is 1, the port bit is HIGH.
-        else if ((bitData[1] & 0x10) != 0)
+        else if ((onValue & FULL_ON_OFF) != 0)
         {
             state = HIGH;
         }
         // If both constant state bits are zero, the port bit is not in a constant state.
+        else
         {
             hr = DMAP_E_GPIO_PIN_IS_SET_TO_PWM;
         }
     }
-    
+
+    ReleaseSRWLockExclusive(&m_lock);
+
     return hr;
 }
 
 /**
-Set the width of the positive pulses on one of the PWM channels.
+Set the width of the positive pulses on one of the PWM channels.  Nothing is sent to the
+chip if the channel already has this pulse width.
 \param[in] i2cAdr The I2C address of the PWM chip.
 \param[in] channel The channel on the PWM chip for which to set the pulse width.
 \param[in] dutyCycle The desired duty-cycle of the positive pulses (0-0xFFFFFFFF for 0-100%).
@@ -189,10 +191,7 @@ Set the width of the positive pulses on one of the PWM channels.
 HRESULT PCA9685Device::SetPwmDutyCycle(ULONG i2cAdr, ULONG channel, ULONG dutyCycle)
 {
     HRESULT hr = S_OK;
-    I2cTransactionClass transaction;
-    ULONGLONG tmpPulsetime = 0;
-    UCHAR bitRegsAdr = 0;                       // Address of start of registers for bit in question
-    UCHAR pulseData[REGS_PER_LED] = { 0x00, 0x00, 0x00, 0x00 };    // Registers data to set pulse time
+    PCHIP_STATE chip = nullptr;
 
 
     if (channel >= LED_COUNT)
@@ -200,306 +199,850 @@ HRESULT PCA9685Device::SetPwmDutyCycle(ULONG i2cAdr, ULONG channel, ULONG dutyCy
         hr = DMAP_E_INVALID_PORT_BIT_FOR_DEVICE;
     }
 
+    AcquireSRWLockExclusive(&m_lock);
+
     if (SUCCEEDED(hr))
     {
         // Make sure the PWM chip is initialized.
-        hr = _InitializeChip(i2cAdr);
+        hr = _GetChip(i2cAdr, chip);
     }
 
     if (SUCCEEDED(hr))
     {
-        // Set the I2C address of the PWM chip.
-        hr = transaction.setAddress(i2cAdr);
+        hr = _StageDutyCycle(chip, channel, dutyCycle);
     }
 
     if (SUCCEEDED(hr))
     {
-        // Indicate this chip supports high speed I2C transfers.
-        transaction.useHighSpeed();
-
-        // Calculate the address of the first register for the port in question.
-        bitRegsAdr = (UCHAR)(LEDS_BASE_ADR + (channel * REGS_PER_LED));
-
-        // Queue sending the base address of the port registers to the chip.
-        hr = transaction.queueWrite(&bitRegsAdr, 1);
+        // Send the registers that changed to the chip.
+        hr = chip->registers->flush();
     }
 
-    if (SUCCEEDED(hr))
-    {
-        // Get the pulse high time in PWM chip terms.
-        tmpPulsetime = ((((ULONGLONG)dutyCycle) * (1LL << PWM_BITS)) + 0x80000000LL) / 0x100000000LL;
-        tmpPulsetime = tmpPulsetime & ((1LL << PWM_BITS) - 1LL);
-        pulseData[2] = (UCHAR)(tmpPulsetime & 0xFF);
-        pulseData[3] = (UCHAR)((tmpPulsetime >> 8) & 0xFF);
-
-        // Queue sending the registers contents for the desired pulse width.
-        hr = transaction.queueWrite(pulseData, REGS_PER_LED);
-    }
+    ReleaseSRWLockExclusive(&m_lock);
 
-    if (SUCCEEDED(hr))
-    {
-        // Actually perform the I2C transfers specified above.
-        hr = transaction.execute(g_i2c.getController());
-    }
-    
     return hr;
 }
 
 /**
-Set the pulse repetition rate for the PWM channels on the specified chip.
+Set the width of the positive pulses on a set of the PWM channels.  Only the LED registers
+that change are sent to the chip.  Each run of adjacent registers is written as one block
+(the chip is set up to auto-increment the register address), and all the runs are sent in
+one I2C transaction.  If all the channels are being changed to the same pulse width, the
+ALL_LED registers are written instead.
 \param[in] i2cAdr The I2C address of the PWM chip.
-\param[in] frequency The desired PWM pulse repetition rate in pulses per second.
+\param[in] channelMask Bit n is set to set the pulse width of channel n.
+\param[in] dutyCycles The desired duty-cycle of the positive pulses for each channel,
+indexed by channel number (0-0xFFFFFFFF for 0-100%).  Only the entries for the channels
+in the mask are used.
 \return HRESULT success or error code.
 */
-HRESULT PCA9685Device::SetPwmFrequency(ULONG i2cAdr, ULONG frequency)
+HRESULT PCA9685Device::SetPwmDutyCycles(ULONG i2cAdr, ULONG channelMask, const ULONG dutyCycles[])
 {
     HRESULT hr = S_OK;
-    I2cTransactionClass transaction;
-    ULONG preScale;
-    UCHAR readBuf[1] = { 0 };                       // Buffer for reading data from chip
-    UCHAR mode1RegAdr[1] = { MODE1_ADR };           // Buffer for MODE1 register address
-    UCHAR preScaleAdr[1] = { PRE_SCALE_ADR };       // Buffer for PRE_SCALE register address
-    MODE1 mode1Sleep = { 0, 0, 0, 0, 1, 1, 0, 0 };  // Sleep, auto-increment, internal clock
-    MODE1 mode1Run = { 0, 0, 0, 0, 0, 1, 0, 0 };    // No sleep, auto-increment, internal clock
+    PCHIP_STATE chip = nullptr;
+    ULONG allChannels = (1 << LED_COUNT) - 1;
+    ULONG channel = 0;
+    ULONG onValue = 0;
+    ULONG offValue = 0;
+    BOOL allSame = FALSE;
 
 
-                                                    // Make sure the PWM chip is initialized.
-    hr = _InitializeChip(i2cAdr);
+    if ((channelMask == 0) || ((channelMask & ~allChannels) != 0))
+    {
+        hr = DMAP_E_INVALID_PORT_BIT_FOR_DEVICE;
+    }
 
-    if (SUCCEEDED(hr))
+    if (SUCCEEDED(hr) && (dutyCycles == nullptr))
     {
-        // Set the I2C address of the PWM chip.
-        hr = transaction.setAddress(i2cAdr);
+        hr = E_POINTER;
     }
 
+    AcquireSRWLockExclusive(&m_lock);
+
     if (SUCCEEDED(hr))
     {
-        // Indicate this chip supports high speed I2C transfers.
-        transaction.useHighSpeed();
+        // Make sure the PWM chip is initialized.
+        hr = _GetChip(i2cAdr, chip);
+    }
 
-        // Calculate the nearest prescale value for the requested pulse rate.
-        if (frequency < 24)
+    // Stage the registers for each channel in the mask, the cache drops the ones that
+    // would not change.
+    for (channel = 0; SUCCEEDED(hr) && (channel < LED_COUNT); channel++)
+    {
+        if ((channelMask & (1 << channel)) != 0)
         {
-            preScale = 0xFF;
+            hr = _StageDutyCycle(chip, channel, dutyCycles[channel]);
         }
-        else
+    }
+
+    if (SUCCEEDED(hr) && (channelMask == allChannels) && chip->registers->isDirty())
+    {
+        allSame = TRUE;
+        for (channel = 1; allSame && (channel < LED_COUNT); channel++)
         {
-            // From PCA9685 datasheet: prescale = round(25,000,000 / (4096 * pulse_rate)) - 1
-            preScale = (((25000000 + ((4096 * frequency) / 2))) / (4096 * frequency)) - 1;
+            allSame = (dutyCycles[channel] == dutyCycles[0]);
         }
-        preScale = preScale & 0xFF;
     }
 
-    // If we need to set a new prescale value.
-    if (SUCCEEDED(hr) && (m_freqPreScale != preScale))
+    if (SUCCEEDED(hr) && allSame)
     {
-        // Queue a write to set the Sleep bit (so we can change the PWM frequency).
-        hr = transaction.queueWrite(mode1RegAdr, sizeof(mode1RegAdr));
-        if (SUCCEEDED(hr))
+        // Record the new contents of the channel registers (which also drops the staged
+        // channel writes), then set all the channels with the ALL_LED registers.
+        _GetPulseRegisters(dutyCycles[0], onValue, offValue);
+        for (channel = 0; SUCCEEDED(hr) && (channel < LED_COUNT); channel++)
         {
-            hr = transaction.queueWrite((PUCHAR)&mode1Sleep, 1);
+            hr = chip->registers->setCachedValue(LEDS_BASE_ADR + (channel * REGS_PER_LED), onValue);
+            if (SUCCEEDED(hr))
+            {
+                hr = chip->registers->setCachedValue(LEDS_BASE_ADR + (channel * REGS_PER_LED) + 2, offValue);
+            }
         }
 
-        // Queue a write to set the frequency prescale value.
         if (SUCCEEDED(hr))
         {
-            hr = transaction.queueWrite(preScaleAdr, sizeof(preScaleAdr), TRUE);
+            hr = chip->registers->stageRegister(ALL_LED_ADR, onValue);
         }
         if (SUCCEEDED(hr))
         {
-            hr = transaction.queueWrite((PUCHAR)&preScale, 1);
+            hr = chip->registers->stageRegister(ALL_LED_ADR + 2, offValue);
         }
+    }
 
-        // Queue a write to clear the Sleep bit.
-        if (SUCCEEDED(hr))
+    if (SUCCEEDED(hr))
+    {
+        // Send the registers that changed to the chip.
+        hr = chip->registers->flush();
+    }
+
+    // If the ALL_LED write failed, the contents of the channel registers are unknown.
+    if (FAILED(hr) && allSame)
+    {
+        chip->registers->invalidate();
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return hr;
+}
+
+/**
+Record the width of the positive pulses on one of the PWM channels without sending it to
+the chip.  The pulse widths staged for all the chips are sent by FlushPwmDutyCycles(), so
+a frame of changes spread over many chips costs one I2C transaction per chip that changed.
+\param[in] i2cAdr The I2C address of the PWM chip.
+\param[in] channel The channel on the PWM chip for which to set the pulse width.
+\param[in] dutyCycle The desired duty-cycle of the positive pulses (0-0xFFFFFFFF for 0-100%).
+\return HRESULT success or error code.
+*/
+HRESULT PCA9685Device::StagePwmDutyCycle(ULONG i2cAdr, ULONG channel, ULONG dutyCycle)
+{
+    HRESULT hr = S_OK;
+    PCHIP_STATE chip = nullptr;
+
+
+    if (channel >= LED_COUNT)
+    {
+        hr = DMAP_E_INVALID_PORT_BIT_FOR_DEVICE;
+    }
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    if (SUCCEEDED(hr))
+    {
+        // Make sure the PWM chip is initialized.
+        hr = _GetChip(i2cAdr, chip);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = _StageDutyCycle(chip, channel, dutyCycle);
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return hr;
+}
+
+/**
+Makes one pass over the PWM chips in use, and sends the LED registers staged for each chip
+that has changes in one I2C transaction.  Chips with no changes cause no I2C traffic.  If the
+transaction for a chip fails, the remaining chips are still sent their changes, so nothing
+is left staged.
+\return HRESULT success or the error code of the first chip that failed.
+*/
+HRESULT PCA9685Device::FlushPwmDutyCycles()
+{
+    HRESULT hr = S_OK;
+    HRESULT chipHr = S_OK;
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    for (ULONG i = 0; i < PCA9685_MAX_CHIPS; i++)
+    {
+        if ((m_chips[i].i2cAdr != 0) && m_chips[i].registers->isDirty())
         {
-            hr = transaction.queueWrite(mode1RegAdr, sizeof(mode1RegAdr), TRUE);
+            chipHr = m_chips[i].registers->flush();
+            if (SUCCEEDED(hr))
+            {
+                hr = chipHr;
+            }
         }
-        if (SUCCEEDED(hr))
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return hr;
+}
+
+/**
+Sets the ALL CALL address of the chip and turns on its response to that address, so the
+chip acts on writes by SetAllCallDutyCycle() and SetAllCallPwmFrequency() for that address.
+\param[in] i2cAdr The I2C address of the PWM chip.
+\param[in] allCallAdr The ALL CALL address for the chip to respond to, or 0 to turn off
+its response to ALL CALL writes.
+\return HRESULT success or error code.
+*/
+HRESULT PCA9685Device::EnableAllCall(ULONG i2cAdr, ULONG allCallAdr)
+{
+    HRESULT hr = S_OK;
+    PCHIP_STATE chip = nullptr;
+    ULONG mode1Value = 0;
+    PMODE1 mode1Reg = (PMODE1)&mode1Value;
+
+
+    if ((allCallAdr != 0) &&
+        ((allCallAdr < PCA9685_MIN_I2C_ADR) || (allCallAdr > PCA9685_MAX_I2C_ADR) || (allCallAdr == i2cAdr)))
+    {
+        hr = DMAP_E_PWM_CHIP_ADDRESS_INVALID;
+    }
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    if (SUCCEEDED(hr))
+    {
+        // Make sure the PWM chip is initialized.
+        hr = _GetChip(i2cAdr, chip);
+    }
+
+    // The ALL CALL address is held in the upper seven bits of the ALLCALLADR register.
+    if (SUCCEEDED(hr) && (allCallAdr != 0))
+    {
+        hr = chip->registers->writeRegister(ALLCALLADR_ADR, allCallAdr << 1);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = chip->registers->readRegister(MODE1_ADR, mode1Value);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        mode1Reg->RESTART = 0;
+        mode1Reg->ALLCALL = (allCallAdr != 0) ? 1 : 0;
+        hr = chip->registers->writeRegister(MODE1_ADR, mode1Value);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        chip->allCallAdr = allCallAdr;
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return hr;
+}
+
+/**
+Set the width of the positive pulses on every channel of every chip that responds to an
+ALL CALL address.  The ALL_LED registers are written through the ALL CALL address, so all
+the chips change in one I2C transfer.  The cached LED registers of the chips are updated to
+match, and any pulse widths staged for them are dropped.
+\param[in] allCallAdr The ALL CALL address the chips respond to.
+\param[in] dutyCycle The desired duty-cycle of the positive pulses (0-0xFFFFFFFF for 0-100%).
+\return HRESULT success or error code.
+*/
+HRESULT PCA9685Device::SetAllCallDutyCycle(ULONG allCallAdr, ULONG dutyCycle)
+{
+    HRESULT hr = S_OK;
+    I2cRegisterMapClass* registers = nullptr;
+    ULONG channel = 0;
+    ULONG onValue = 0;
+    ULONG offValue = 0;
+
+    _GetPulseRegisters(dutyCycle, onValue, offValue);
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    hr = _GetAllCallRegisters(allCallAdr, registers);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = registers->stageRegister(ALL_LED_ADR, onValue);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = registers->stageRegister(ALL_LED_ADR + 2, offValue);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = registers->flush();
+    }
+
+    for (ULONG i = 0; i < PCA9685_MAX_CHIPS; i++)
+    {
+        if ((m_chips[i].i2cAdr != 0) && (m_chips[i].allCallAdr == allCallAdr))
         {
-            hr = transaction.queueWrite((PUCHAR)&mode1Run, 1);
+            if (SUCCEEDED(hr))
+            {
+                for (channel = 0; SUCCEEDED(hr) && (channel < LED_COUNT); channel++)
+                {
+                    hr = m_chips[i].registers->setCachedValue(LEDS_BASE_ADR + (channel * REGS_PER_LED), onValue);
+                    if (SUCCEEDED(hr))
+                    {
+                        hr = m_chips[i].registers->setCachedValue(LEDS_BASE_ADR + (channel * REGS_PER_LED) + 2, offValue);
+                    }
+                }
+            }
+            else
+            {
+                // The write may have reached some of the chips, so their contents are unknown.
+                m_chips[i].registers->invalidate();
+            }
         }
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
 
-        // Delay for 500 microseconds for clock to start.
-        for (int i = 0; SUCCEEDED(hr) && (i < 5); i++)
+    return hr;
+}
+
+/**
+Set the pulse repetition rate of every chip that responds to an ALL CALL address.  The
+chips are put to sleep, given the new prescale value and woken up through the ALL CALL
+address, so their pulses are interrupted for the same short time.  Nothing is done if all
+the chips are already set to the nearest rate they support.
+\param[in] allCallAdr The ALL CALL address the chips respond to.
+\param[in] frequency The desired PWM pulse repetition rate in pulses per second.
+\return HRESULT success or error code.
+*/
+HRESULT PCA9685Device::SetAllCallPwmFrequency(ULONG allCallAdr, ULONG frequency)
+{
+    HRESULT hr = S_OK;
+    I2cRegisterMapClass* registers = nullptr;
+    ULONG preScale = 0;
+    ULONG currentPreScale = 0;
+    BOOL changeNeeded = FALSE;
+    MODE1 mode1Run = { 1, 0, 0, 0, 0, 1, 0, 0 };    // ALL CALL, no sleep, auto-increment, internal clock
+
+    preScale = _GetPreScale(frequency);
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    // See if any of the chips needs a new prescale value.
+    for (ULONG i = 0; !changeNeeded && (i < PCA9685_MAX_CHIPS); i++)
+    {
+        if ((m_chips[i].i2cAdr != 0) && (m_chips[i].allCallAdr == allCallAdr))
         {
-            hr = transaction.queueWrite(mode1RegAdr, sizeof(mode1RegAdr), TRUE);
-            if (SUCCEEDED(hr))
+            if (FAILED(m_chips[i].registers->readRegister(PRE_SCALE_ADR, currentPreScale)) ||
+                (currentPreScale != preScale))
             {
-                hr = transaction.queueRead(readBuf, sizeof(readBuf));
+                changeNeeded = TRUE;
             }
         }
+    }
+
+    if (changeNeeded)
+    {
+        hr = _GetAllCallRegisters(allCallAdr, registers);
 
         if (SUCCEEDED(hr))
         {
-            // Actually perform the I2C transfers specified above.
-            hr = transaction.execute(g_i2c.getController());
+            hr = _WritePreScale(registers, preScale, TRUE);
         }
 
-        // Record the prescale value just set.
-        if (SUCCEEDED(hr))
+        for (ULONG i = 0; i < PCA9685_MAX_CHIPS; i++)
         {
-            m_freqPreScale = (UCHAR)preScale;
+            if ((m_chips[i].i2cAdr != 0) && (m_chips[i].allCallAdr == allCallAdr))
+            {
+                if (SUCCEEDED(hr))
+                {
+                    hr = m_chips[i].registers->setCachedValue(PRE_SCALE_ADR, preScale);
+                    if (SUCCEEDED(hr))
+                    {
+                        hr = m_chips[i].registers->setCachedValue(MODE1_ADR, *((PUCHAR)&mode1Run));
+                    }
+                }
+                else
+                {
+                    // The write may have reached some of the chips, so their contents are unknown.
+                    m_chips[i].registers->invalidate();
+                }
+            }
         }
     }
 
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return hr;
+}
+
+/**
+Set the pulse repetition rate for the PWM channels on the specified chip.  The chip has
+to be put to sleep to change the rate, which interrupts the pulses on all its channels,
+so nothing is done if the chip is already set to the nearest rate it supports.
+\param[in] i2cAdr The I2C address of the PWM chip.
+\param[in] frequency The desired PWM pulse repetition rate in pulses per second.
+\return HRESULT success or error code.
+*/
+HRESULT PCA9685Device::SetPwmFrequency(ULONG i2cAdr, ULONG frequency)
+{
+    HRESULT hr = S_OK;
+    PCHIP_STATE chip = nullptr;
+    ULONG preScale = 0;
+    ULONG currentPreScale = 0;
+
+
+    preScale = _GetPreScale(frequency);
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    // Make sure the PWM chip is initialized.
+    hr = _GetChip(i2cAdr, chip);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = chip->registers->readRegister(PRE_SCALE_ADR, currentPreScale);
+    }
+
+    // If we need to set a new prescale value.
+    if (SUCCEEDED(hr) && (currentPreScale != preScale))
+    {
+        hr = _WritePreScale(chip->registers, preScale, (chip->allCallAdr != 0));
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
     return hr;
 }
 
 /**
-Get the actual pulse repetition rate for the PWM channels on the specified chip.
+Get the actual pulse repetition rate for the PWM channels on the specified chip.  This is
+calculated from the cached prescale value, so it normally causes no I2C traffic.
 \param[in] i2cAdr The I2C address of the PWM chip.
 \return The approximate actual pulse repetion rate of the PWM channels.
 */
 ULONG PCA9685Device::GetActualPwmFrequency(ULONG i2cAdr)
 {
     HRESULT hr = S_OK;
+    PCHIP_STATE chip = nullptr;
+    ULONG preScale = DEFAULT_PRE_SCALE;
     ULONG frequency;
     ULONG divisor;
 
+    AcquireSRWLockExclusive(&m_lock);
+
+    hr = _GetChip(i2cAdr, chip);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = chip->registers->readRegister(PRE_SCALE_ADR, preScale);
+    }
+
+    // If the prescale value can't be read, assume the value the chip is initialized with.
+    if (FAILED(hr))
+    {
+        preScale = DEFAULT_PRE_SCALE;
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
     // From PCA9685 datasheet: prescale = round(25,000,000 / (4096 * pulse_rate)) - 1
     // so pulse_rate = round( 25,000,000 / ((prescale + 1) * 4096) )
 
-    divisor = (m_freqPreScale + 1) * 4096;
+    divisor = (preScale + 1) * 4096;
     frequency = (25000000 + (divisor / 2)) / divisor;
 
     return frequency;
 }
 
 /**
-This method takes any actions needed to initialize the PWM chip for use by other methods.
-If the chip has already been initialized it does nothing, otherwise it sets the pulse rate
-prescale value, turns on the chip and sets the mode registers for how other methods access 
-the chip.
-\param[in] i2cAdr The I2C address of the PWM chip.
+The first time a chip is used its register cache is created and the chip is initialized.
+The caller must hold the lock.
+\param[in] i2cAdr The I2C address of the PWM chip, which IsChipAddressValid() must accept.
+\param[out] chip The state of the PWM chip.
 \return HRESULT success or error code.
 */
-HRESULT PCA9685Device::_InitializeChip(ULONG i2cAdr)
+HRESULT PCA9685Device::_GetChip(ULONG i2cAdr, PCHIP_STATE & chip)
 {
     HRESULT hr = S_OK;
+    I2cRegisterMapClass* registers = nullptr;
+    ULONG i;
+    ULONG regAdr;
 
-    // If we don't know that the chip is already initialized:
-    if (!m_chipIsInitialized)
+    chip = nullptr;
+
+    // An address of 0 marks a free entry, so it must not be looked up as a chip.
+    if (!IsChipAddressValid(i2cAdr))
     {
-        //
-        // Queue a read of the chip MODE1 register to get the state of the SLEEP bit.
-        //
+        hr = DMAP_E_PWM_CHIP_ADDRESS_INVALID;
+    }
 
-        I2cTransactionClass transaction;
-        UCHAR readBuf[1] = { 0 };                   // Buffer for reading data from chip
-        UCHAR mode1RegAdr[1] = { MODE1_ADR };       // Buffer for MODE1 register address
-        UCHAR mode2RegAdr[1] = { MODE2_ADR };       // Buffer for MODE2 register address
-        UCHAR preScaleAdr[1] = { PRE_SCALE_ADR };   // Buffer for PRE_SCALE register address
-        MODE1 mode1Reg = { 0, 0, 0, 0, 0, 1, 0, 0 }; // No sleep, auto-increment, internal clock
-        MODE2 mode2Reg = { 0, 1, 1, 0, 0 };         // Drive outputs both high & low, change on ACK, non-inverted
+    // Look for the chip among the ones already in use, and for a free entry.
+    for (i = 0; SUCCEEDED(hr) && (i < PCA9685_MAX_CHIPS) && ((chip == nullptr) || (chip->i2cAdr != i2cAdr)); i++)
+    {
+        if ((m_chips[i].i2cAdr == i2cAdr) || ((chip == nullptr) && (m_chips[i].i2cAdr == 0)))
+        {
+            chip = &m_chips[i];
+        }
+    }
 
-        // Set the I2C address of the PWM chip.
-        hr = transaction.setAddress(i2cAdr);
+    if (SUCCEEDED(hr) && (chip == nullptr))
+    {
+        hr = DMAP_E_PWM_TOO_MANY_CHIPS;
+    }
+
+    // If this is the first use of the chip, set up its register cache.
+    if (SUCCEEDED(hr) && (chip->i2cAdr != i2cAdr))
+    {
+        registers = new I2cRegisterMapClass;
+        if (registers == nullptr)
+        {
+            hr = E_OUTOFMEMORY;
+        }
 
         if (SUCCEEDED(hr))
         {
-            // Indicate this chip supports high speed I2C transfers.
-            transaction.useHighSpeed();
+            hr = registers->setAddress(i2cAdr);
+        }
 
-            // Queue sending the address of the MODE1 regeister to the PWM chip.
-            hr = transaction.queueWrite(mode1RegAdr, sizeof(mode1RegAdr));
+        if (SUCCEEDED(hr))
+        {
+            // Indicate this chip supports high speed I2C transfers.
+            hr = registers->setClockRate(I2C_FAST_MODE_HZ);
         }
 
         if (SUCCEEDED(hr))
         {
-            // Queue reading the contents of the MODE1 register.
-            hr = transaction.queueRead(readBuf, sizeof(readBuf));
+            // Multi-byte LED registers are sent low byte first.
+            registers->setAutoIncrement(TRUE);
+            registers->setMsbFirst(FALSE);
+
+            hr = registers->declareRegister(MODE1_ADR, 1, REG_CACHEABLE);
         }
 
-        //
-        // If the SLEEP bit is clear, the chip has been initialize: abort the rest of the transaction.
-        //
+        if (SUCCEEDED(hr))
+        {
+            hr = registers->declareRegister(MODE2_ADR, 1, REG_CACHEABLE);
+        }
 
         if (SUCCEEDED(hr))
         {
-            // Register a callback to test if the chip is initialized.
-            hr = transaction.queueCallback([&readBuf, &transaction]()
-            {
-                PMODE1 mode1RegPtr = (PMODE1)readBuf;
-                if (mode1RegPtr->SLEEP == 0)   // If chip is not in sleep mode,
-                {
-                    transaction.abort();
-                }
-                return S_OK;
-            }
-            );
+            hr = registers->declareRegister(ALLCALLADR_ADR, 1, REG_CACHEABLE);
         }
 
-        //
-        // Queue writes to initialize the PWM chip.
-        //
+        for (regAdr = LEDS_BASE_ADR; SUCCEEDED(hr) && (regAdr < (LEDS_BASE_ADR + (LED_COUNT * REGS_PER_LED))); regAdr += 2)
+        {
+            hr = registers->declareRegister(regAdr, 2, REG_CACHEABLE);
+        }
 
+        // Writes to the ALL_LED registers are always sent, since they change the
+        // LED registers of every channel.
         if (SUCCEEDED(hr))
         {
-            // Queue sending the address of the PRE_SCALE register to the PWM chip.
-            hr = transaction.queueWrite(preScaleAdr, sizeof(preScaleAdr), TRUE);
+            hr = registers->declareRegister(ALL_LED_ADR, 2, REG_VOLATILE);
         }
 
         if (SUCCEEDED(hr))
         {
-            // Queue sendng the prescale value.
-            hr = transaction.queueWrite(&m_freqPreScale, 1);
+            hr = registers->declareRegister(ALL_LED_ADR + 2, 2, REG_VOLATILE);
         }
 
         if (SUCCEEDED(hr))
         {
-            // Queue sending the address of the MODE1 register to the PWM chip.
-            hr = transaction.queueWrite(mode1RegAdr, sizeof(mode1RegAdr), TRUE);
+            hr = registers->declareRegister(PRE_SCALE_ADR, 1, REG_CACHEABLE);
         }
 
         if (SUCCEEDED(hr))
         {
-            // Queue sending the contents of MODE1 register.
-            hr = transaction.queueWrite((PUCHAR)&mode1Reg, 1);
+            chip->i2cAdr = i2cAdr;
+            chip->initialized = FALSE;
+            chip->allCallAdr = 0;
+            chip->registers = registers;
+        }
+        else if (registers != nullptr)
+        {
+            delete registers;
         }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = _InitializeChip(chip);
+    }
+
+    return hr;
+}
+
+/**
+This method takes any actions needed to initialize the PWM chip for use by other methods.
+If the chip has already been initialized it only makes sure register address auto-increment
+is on, otherwise it sets the pulse rate prescale value, turns on the chip and sets the mode
+registers for how other methods access the chip.
+\param[in] chip The state of the PWM chip.
+\return HRESULT success or error code.
+*/
+HRESULT PCA9685Device::_InitializeChip(PCHIP_STATE chip)
+{
+    HRESULT hr = S_OK;
+    HiResTimerClass timer;
+    ULONG mode1Value = 0;
+    PMODE1 mode1Reg = (PMODE1)&mode1Value;
+    MODE1 mode1Run = { 0, 0, 0, 0, 0, 1, 0, 0 };    // No sleep, auto-increment, internal clock
+    MODE2 mode2Reg = { 0, 1, 1, 0, 0 };             // Drive outputs both high & low, change on ACK, non-inverted
+
+    // If we don't know that the chip is already initialized:
+    if (!chip->initialized)
+    {
+        // Read the chip MODE1 register to get the state of the SLEEP bit.
+        hr = chip->registers->readRegister(MODE1_ADR, mode1Value);
 
         if (SUCCEEDED(hr))
         {
-            // Delay for 500 microseconds for clock to start.
-            for (int i = 0; i < 5; i++)
+            // If the SLEEP bit is clear, the chip has been initialized, but the batched
+            // LED register writes need auto-increment to be on.
+            if (mode1Reg->SLEEP == 0)
             {
-                transaction.queueWrite(mode1RegAdr, sizeof(mode1RegAdr), TRUE);
-                transaction.queueRead(readBuf, sizeof(readBuf));
+                mode1Reg->RESTART = 0;
+                mode1Reg->AI = 1;
+                hr = chip->registers->writeRegister(MODE1_ADR, mode1Value);
+            }
+            else
+            {
+                hr = chip->registers->writeRegister(PRE_SCALE_ADR, DEFAULT_PRE_SCALE);
+
+                if (SUCCEEDED(hr))
+                {
+                    mode1Value = *((PUCHAR)&mode1Run);
+                    hr = chip->registers->writeRegister(MODE1_ADR, mode1Value);
+                }
+
+                // Delay for 500 microseconds for clock to start.
+                if (SUCCEEDED(hr))
+                {
+                    timer.StartTimeout(500);
+                    while (!timer.TimeIsUp());
+
+                    hr = chip->registers->writeRegister(MODE2_ADR, *((PUCHAR)&mode2Reg));
+                }
             }
         }
 
+        //
+        // Whether we initialized the chip or found it initialized, we now know it is initialized.
+        //
+
         if (SUCCEEDED(hr))
         {
-            // Queue RESTART and sending the address of the MODE2 register to the PWM chip.
-            hr = transaction.queueWrite(mode2RegAdr, sizeof(mode2RegAdr), TRUE);
+            // Indicate chip is initialized.
+            chip->initialized = TRUE;
+        }
+    }
+    
+    return hr;
+}
+
+/**
+The ALL CALL registers are only ever written, so they are declared volatile and every
+write is sent.  The caller must hold the lock.
+\param[in] allCallAdr The ALL CALL address to write to.
+\param[out] registers The registers written through the ALL CALL address.
+\return HRESULT success or error code.
+*/
+HRESULT PCA9685Device::_GetAllCallRegisters(ULONG allCallAdr, I2cRegisterMapClass* & registers)
+{
+    HRESULT hr = S_OK;
+
+    registers = nullptr;
+
+    if ((allCallAdr < PCA9685_MIN_I2C_ADR) || (allCallAdr > PCA9685_MAX_I2C_ADR))
+    {
+        hr = DMAP_E_PWM_CHIP_ADDRESS_INVALID;
+    }
+
+    if (SUCCEEDED(hr) && (m_allCallRegisters == nullptr))
+    {
+        m_allCallRegisters = new I2cRegisterMapClass;
+        if (m_allCallRegisters == nullptr)
+        {
+            hr = E_OUTOFMEMORY;
         }
 
         if (SUCCEEDED(hr))
         {
-            // Queue sending the contents of MODE2 register.
-            hr = transaction.queueWrite((PUCHAR)&mode2Reg, 1);
+            hr = m_allCallRegisters->setClockRate(I2C_FAST_MODE_HZ);
         }
 
-        //
-        // Perform the read, decision, and writes to initialize the chip (if needed).
-        //
+        if (SUCCEEDED(hr))
+        {
+            m_allCallRegisters->setAutoIncrement(TRUE);
+            m_allCallRegisters->setMsbFirst(FALSE);
+
+            hr = m_allCallRegisters->declareRegister(MODE1_ADR, 1, REG_VOLATILE);
+        }
 
         if (SUCCEEDED(hr))
         {
-            // Actually perform the I2C transfers specified above.
-            hr = transaction.execute(g_i2c.getController());
+            hr = m_allCallRegisters->declareRegister(ALL_LED_ADR, 2, REG_VOLATILE);
         }
 
-        //
-        // Whether we initialized the chip or found it initialized, we now know it is initialized.
-        //
+        if (SUCCEEDED(hr))
+        {
+            hr = m_allCallRegisters->declareRegister(ALL_LED_ADR + 2, 2, REG_VOLATILE);
+        }
 
         if (SUCCEEDED(hr))
         {
-            // Indicate chip is initialized.
-            m_chipIsInitialized = TRUE;
+            hr = m_allCallRegisters->declareRegister(PRE_SCALE_ADR, 1, REG_VOLATILE);
+        }
+
+        if (FAILED(hr) && (m_allCallRegisters != nullptr))
+        {
+            delete m_allCallRegisters;
+            m_allCallRegisters = nullptr;
         }
     }
-    
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_allCallRegisters->setAddress(allCallAdr);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        registers = m_allCallRegisters;
+    }
+
     return hr;
+}
+
+/**
+\param[in] frequency The desired PWM pulse repetition rate in pulses per second.
+\return The prescale value for the nearest pulse repetition rate the chip supports.
+*/
+ULONG PCA9685Device::_GetPreScale(ULONG frequency)
+{
+    ULONG preScale = 0;
+
+    if (frequency < 24)
+    {
+        preScale = 0xFF;
+    }
+    else
+    {
+        // From PCA9685 datasheet: prescale = round(25,000,000 / (4096 * pulse_rate)) - 1
+        preScale = (((25000000 + ((4096 * frequency) / 2))) / (4096 * frequency)) - 1;
+    }
+
+    return preScale & 0xFF;
+}
+
+/**
+The prescale value can only be changed while the oscillator is stopped, so the chip is put
+to sleep, given the prescale value and woken up again.  The caller must hold the lock.
+\param[in] registers The registers of the chip, or the ALL CALL registers.
+\param[in] preScale The new prescale value.
+\param[in] allCall TRUE if the chip (or chips) should keep responding to ALL CALL writes.
+\return HRESULT success or error code.
+*/
+HRESULT PCA9685Device::_WritePreScale(I2cRegisterMapClass* registers, ULONG preScale, BOOL allCall)
+{
+    HRESULT hr = S_OK;
+    HiResTimerClass timer;
+    ULONG mode1Value = 0;
+    MODE1 mode1Sleep = { 0, 0, 0, 0, 1, 1, 0, 0 };  // Sleep, auto-increment, internal clock
+    MODE1 mode1Run = { 0, 0, 0, 0, 0, 1, 0, 0 };    // No sleep, auto-increment, internal clock
+
+    mode1Sleep.ALLCALL = allCall ? 1 : 0;
+    mode1Run.ALLCALL = allCall ? 1 : 0;
+
+    // Set the Sleep bit (so we can change the PWM frequency).
+    mode1Value = *((PUCHAR)&mode1Sleep);
+    hr = registers->writeRegister(MODE1_ADR, mode1Value);
+
+    // Set the frequency prescale value.
+    if (SUCCEEDED(hr))
+    {
+        hr = registers->writeRegister(PRE_SCALE_ADR, preScale);
+    }
+
+    // Clear the Sleep bit.
+    if (SUCCEEDED(hr))
+    {
+        mode1Value = *((PUCHAR)&mode1Run);
+        hr = registers->writeRegister(MODE1_ADR, mode1Value);
+    }
+
+    // Delay for 500 microseconds for clock to start.
+    if (SUCCEEDED(hr))
+    {
+        timer.StartTimeout(500);
+        while (!timer.TimeIsUp());
+    }
+
+    return hr;
+}
+
+/**
+The caller must hold the lock.
+\param[in] chip The state of the PWM chip.
+\param[in] channel The channel on the PWM chip for which to set the pulse width.
+\param[in] dutyCycle The desired duty-cycle of the positive pulses (0-0xFFFFFFFF for 0-100%).
+\return HRESULT success or error code.
+*/
+HRESULT PCA9685Device::_StageDutyCycle(PCHIP_STATE chip, ULONG channel, ULONG dutyCycle)
+{
+    HRESULT hr = S_OK;
+    ULONG bitRegsAdr = LEDS_BASE_ADR + (channel * REGS_PER_LED);
+    ULONG onValue = 0;
+    ULONG offValue = 0;
+
+    _GetPulseRegisters(dutyCycle, onValue, offValue);
+
+    hr = chip->registers->stageRegister(bitRegsAdr, onValue);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = chip->registers->stageRegister(bitRegsAdr + 2, offValue);
+    }
+
+    return hr;
+}
+
+/**
+The pulses start at the beginning of each PWM period, so the ON time is zero and the OFF
+time is the pulse width.  A pulse width that rounds to the full period sets the channel
+constantly on.
+\param[in] dutyCycle The desired duty-cycle of the positive pulses (0-0xFFFFFFFF for 0-100%).
+\param[out] onValue The value for the LEDn_ON registers of the channel.
+\param[out] offValue The value for the LEDn_OFF registers of the channel.
+*/
+void PCA9685Device::_GetPulseRegisters(ULONG dutyCycle, ULONG & onValue, ULONG & offValue)
+{
+    ULONGLONG tmpPulsetime = 0;
+
+    // Get the pulse high time in PWM chip terms.
+    tmpPulsetime = ((((ULONGLONG)dutyCycle) * (1LL << PWM_BITS)) + 0x80000000LL) / 0x100000000LL;
+
+    if (tmpPulsetime >= (1LL << PWM_BITS))
+    {
+        onValue = FULL_ON_OFF;
+        offValue = 0;
+    }
+    else
+    {
+        onValue = 0;
+        offValue = (ULONG)tmpPulsetime;
+    }
 }
\ No newline at end of file
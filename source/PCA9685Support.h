@@ -7,6 +7,25 @@
 
 #include <Windows.h>
 
+class I2cRegisterMapClass;
+
+// The number of PWM channels on the chip.
+#define PCA9685_CHANNEL_COUNT 16
+
+// The range of I2C addresses the chip can be strapped for with its six address pins, less
+// 0x78-0x7F, which the I2C specification reserves for 10-bit addressing and device IDs.
+#define PCA9685_MIN_I2C_ADR 0x40
+#define PCA9685_MAX_I2C_ADR 0x77
+
+// The ALL CALL address the chip powers up with.  All chips that respond to the ALL CALL
+// address act on a write to it, so a change to many chips can be made with one transfer.
+// No chip can use it as its own address.
+#define PCA9685_DEFAULT_ALL_CALL_ADR 0x70
+
+// The most PWM chips (at different I2C addresses) that can be used at the same time: one at
+// each address in the range above but the default ALL CALL address.
+#define PCA9685_MAX_CHIPS (PCA9685_MAX_I2C_ADR - PCA9685_MIN_I2C_ADR)
+
 class PCA9685Device
 {
 public:
@@ -20,6 +39,24 @@ public:
     /// Set the PWM pulse width.
     static HRESULT SetPwmDutyCycle(ULONG i2cAdr, ULONG bit, ULONG pulseWidth);
 
+    /// Set the PWM pulse widths of a set of channels with one I2C transaction.
+    static HRESULT SetPwmDutyCycles(ULONG i2cAdr, ULONG channelMask, const ULONG dutyCycles[]);
+
+    /// Record a PWM pulse width to be sent by the next FlushPwmDutyCycles() call.
+    static HRESULT StagePwmDutyCycle(ULONG i2cAdr, ULONG bit, ULONG pulseWidth);
+
+    /// Send the staged PWM pulse widths of all the PWM chips, one I2C transaction per chip.
+    static HRESULT FlushPwmDutyCycles();
+
+    /// Make a PWM chip respond to an ALL CALL address.
+    static HRESULT EnableAllCall(ULONG i2cAdr, ULONG allCallAdr);
+
+    /// Set the PWM pulse width of every channel of the chips that respond to an ALL CALL address.
+    static HRESULT SetAllCallDutyCycle(ULONG allCallAdr, ULONG pulseWidth);
+
+    /// Set the PWM pulse repetition rate of the chips that respond to an ALL CALL address.
+    static HRESULT SetAllCallPwmFrequency(ULONG allCallAdr, ULONG frequencyHz);
+
     /// Set the PWM pulse repetition rate.
     static HRESULT SetPwmFrequency(ULONG i2cAdr, ULONG frequencyHz);
 
@@ -32,6 +69,13 @@ public:
         return PWM_BITS;
     }
 
+    /// Method to determine whether a PWM chip can be used at an I2C address.
+    static BOOL IsChipAddressValid(ULONG i2cAdr)
+    {
+        return ((i2cAdr >= PCA9685_MIN_I2C_ADR) && (i2cAdr <= PCA9685_MAX_I2C_ADR) &&
+            (i2cAdr != PCA9685_DEFAULT_ALL_CALL_ADR));
+    }
+
 private:
     static const ULONG PWM_BITS;        ///< Number of bits of resolution this PWM chip has
     static const ULONG MODE1_ADR;       ///< Address of MODE1 register
@@ -42,9 +86,12 @@ private:
     static const ULONG ALLCALLADR_ADR;  ///< Address of ALLCALLADR register
     static const ULONG LEDS_BASE_ADR;   ///< Base address of LED output registers
     static const ULONG REGS_PER_LED;    ///< Number of registers for each LED
+    static const ULONG ALL_LED_ADR;     ///< Address of ALL_LED output registers
     static const ULONG PRE_SCALE_ADR;   ///< Address of frequency prescale register
     static const ULONG TestMode_ADR;    ///< Address of TestMode register
     static const ULONG LED_COUNT;       ///< Number of LEDs supported by PWM chip
+    static const ULONG FULL_ON_OFF;     ///< Full on (LEDn_ON) or full off (LEDn_OFF) bit
+    static const ULONG DEFAULT_PRE_SCALE;   ///< PWM prescale value for 1000 pulses per second
 
     /// Struct with the layout of the PWM chip MODE1 register.
     typedef struct {
@@ -82,17 +129,43 @@ private:
     {
     }
 
-    // If/when multiple PCA9685 chips are supported, the data unique to the chip
-    //    should be indexed by I2C address.
+    /// Struct with the state kept for each PWM chip in use.
+    typedef struct {
+        ULONG i2cAdr;                   ///< I2C address of the chip, 0 if the entry is not in use
+        BOOL initialized;               ///< TRUE when the chip is known to have been initialized
+        ULONG allCallAdr;               ///< ALL CALL address the chip responds to, 0 if none
+        I2cRegisterMapClass* registers; ///< Cache of the chip register contents
+    } CHIP_STATE, *PCHIP_STATE;
+
+    /// The state of each PWM chip in use.
+    static CHIP_STATE m_chips[PCA9685_MAX_CHIPS];
+
+    /// The registers written through the ALL CALL address, nullptr until first used.
+    static I2cRegisterMapClass* m_allCallRegisters;
 
-    /// Set to TRUE when the chip is known to have been initialized.
-    static BOOL m_chipIsInitialized;
+    /// Lock used to serialize access to the PWM chips and their state.
+    static SRWLOCK m_lock;
 
-    /// The current PWM pulse rate pre-scale value for all channels.
-    static UCHAR m_freqPreScale;
+    /// Method to get the state of a PWM chip, setting it up if this is the first use of the chip.
+    static HRESULT _GetChip(ULONG i2cAdr, PCHIP_STATE & chip);
 
     /// Method to take any necessary actions to initialize the PWM chip.
-    static HRESULT _InitializeChip(ULONG i2cAdr);
+    static HRESULT _InitializeChip(PCHIP_STATE chip);
+
+    /// Method to get the registers written through an ALL CALL address.
+    static HRESULT _GetAllCallRegisters(ULONG allCallAdr, I2cRegisterMapClass* & registers);
+
+    /// Method to get the prescale value for the nearest pulse rate the chip supports.
+    static ULONG _GetPreScale(ULONG frequency);
+
+    /// Method to put a chip (or the chips on an ALL CALL address) to sleep and set the prescale value.
+    static HRESULT _WritePreScale(I2cRegisterMapClass* registers, ULONG preScale, BOOL allCall);
+
+    /// Method to stage the LED register values for a PWM duty cycle on one channel.
+    static HRESULT _StageDutyCycle(PCHIP_STATE chip, ULONG channel, ULONG dutyCycle);
+
+    /// Method to get the LED register values for a PWM duty cycle.
+    static void _GetPulseRegisters(ULONG dutyCycle, ULONG & onValue, ULONG & offValue);
 };
 
 #endif  // _PCA9685_SUPPORT_H_
\ No newline at end of file
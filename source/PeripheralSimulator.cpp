@@ -0,0 +1,1670 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#include "pch.h"
+
+#include <TlHelp32.h>
+
+#include "PeripheralSimulator.h"
+#include "DmapSupport.h"
+#include "ErrorCodes.h"
+#include "I2cController.h"
+#include "SpiController.h"
+
+// Size of the block of memory used to hold the registers of one controller (one page).
+#define SIM_REGISTER_BLOCK_BYTES 4096
+
+// The core clock that drives the I2C and SPI clock dividers.
+#define SIM_CORE_CLOCK_HZ 250000000ULL
+
+// Depth of the controller FIFOs in bytes.
+#define SIM_I2C_FIFO_BYTES 16
+#define SIM_SPI_FIFO_BYTES 64
+
+// Trap flag in the x86/x64 EFLAGS register.
+#define SIM_EFLAGS_TRAP_FLAG 0x100
+
+//
+// Global extern exports
+//
+PeripheralSimulatorClass g_simulator;
+
+//
+// Base class for the controller register models.
+//
+class SimControllerClass
+{
+public:
+    SimControllerClass() :
+        m_registers(nullptr)
+    {
+    }
+
+    virtual ~SimControllerClass()
+    {
+#if LIGHTNING_SIMULATOR_SUPPORTED
+        if (m_registers != nullptr)
+        {
+            VirtualFree(m_registers, 0, MEM_RELEASE);
+            m_registers = nullptr;
+        }
+#endif // LIGHTNING_SIMULATOR_SUPPORTED
+    }
+
+    /// Method to allocate the inaccessible block of memory used to trap register accesses.
+    HRESULT allocateRegisters()
+    {
+        HRESULT hr = S_OK;
+
+#if LIGHTNING_SIMULATOR_SUPPORTED
+        m_registers = (PUCHAR)VirtualAlloc(nullptr, SIM_REGISTER_BLOCK_BYTES, MEM_RESERVE | MEM_COMMIT, PAGE_NOACCESS);
+        if (m_registers == nullptr)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+#else
+        hr = DMAP_E_SIMULATOR_NOT_SUPPORTED;
+#endif // LIGHTNING_SIMULATOR_SUPPORTED
+
+        return hr;
+    }
+
+    /// Method to get the address of the register block of this controller.
+    PUCHAR getRegisters()
+    {
+        return m_registers;
+    }
+
+    /// Method to determine if an address is in the register block of this controller.
+    BOOL ownsAddress(ULONG_PTR address)
+    {
+        return (m_registers != nullptr) &&
+            (address >= (ULONG_PTR)m_registers) &&
+            (address < ((ULONG_PTR)m_registers + SIM_REGISTER_BLOCK_BYTES));
+    }
+
+    /// Method to get the value of a register without any side effects of reading it.
+    virtual ULONG peekRegister(ULONG offset) = 0;
+
+    /// Method to read a register, including any side effects of reading it.
+    virtual ULONG readRegister(ULONG offset)
+    {
+        return peekRegister(offset);
+    }
+
+    /// Method to write a value to a register.
+    virtual void writeRegister(ULONG offset, ULONG value) = 0;
+
+protected:
+
+    /// The block of memory the controller code uses as the controller registers.
+    PUCHAR m_registers;
+};
+
+//
+// Model of the BCM2836 GPIO controller.
+//
+class SimBcmGpioClass : public SimControllerClass
+{
+public:
+    SimBcmGpioClass()
+    {
+        ZeroMemory(m_fsel, sizeof(m_fsel));
+        ZeroMemory(m_enables, sizeof(m_enables));
+        m_outputs = 0;
+        m_events = 0;
+        m_driven = 0;
+        m_inputs = 0;
+        m_pullUps = 0;
+        m_pullDowns = 0;
+        m_pudControl = 0;
+        m_levels = 0;
+    }
+
+    ULONG peekRegister(ULONG offset) override
+    {
+        ULONG value = 0;
+
+        if (offset < 0x18)
+        {
+            value = m_fsel[offset / 4];
+        }
+        else if ((offset == 0x34) || (offset == 0x38))
+        {
+            value = _bank(m_levels, offset - 0x34);
+        }
+        else if ((offset == 0x40) || (offset == 0x44))
+        {
+            value = _bank(m_events | _levelEvents(), offset - 0x40);
+        }
+        else if ((offset >= 0x4C) && (offset < 0x94) && (((offset - 0x4C) % 12) < 8))
+        {
+            value = _bank(m_enables[(offset - 0x4C) / 12], (offset - 0x4C) % 12);
+        }
+        else if (offset == 0x94)
+        {
+            value = m_pudControl;
+        }
+
+        return value;
+    }
+
+    void writeRegister(ULONG offset, ULONG value) override
+    {
+        ULONGLONG bits = 0;
+
+        // The set, clear, event status and pull clock registers have one bit per pin, with
+        // the pins above 31 in the second register of each pair.
+        if ((offset == 0x20) || (offset == 0x2C) || (offset == 0x44) || (offset == 0x9C))
+        {
+            bits = ((ULONGLONG)value) << 32;
+        }
+        else
+        {
+            bits = value;
+        }
+
+        if (offset < 0x18)
+        {
+            m_fsel[offset / 4] = value & 0x3FFFFFFF;
+        }
+        else if ((offset == 0x1C) || (offset == 0x20))
+        {
+            m_outputs = m_outputs | bits;
+        }
+        else if ((offset == 0x28) || (offset == 0x2C))
+        {
+            m_outputs = m_outputs & ~bits;
+        }
+        else if ((offset == 0x40) || (offset == 0x44))
+        {
+            m_events = m_events & ~bits;
+        }
+        else if ((offset >= 0x4C) && (offset < 0x94) && (((offset - 0x4C) % 12) < 8))
+        {
+            _setBank(m_enables[(offset - 0x4C) / 12], (offset - 0x4C) % 12, value);
+        }
+        else if (offset == 0x94)
+        {
+            m_pudControl = value & 0x3;
+        }
+        else if ((offset == 0x98) || (offset == 0x9C))
+        {
+            // Clocking the pull control into pins applies the pull selected by GPPUD.
+            m_pullUps = m_pullUps & ~bits;
+            m_pullDowns = m_pullDowns & ~bits;
+            if (m_pudControl == 1)
+            {
+                m_pullDowns = m_pullDowns | bits;
+            }
+            else if (m_pudControl == 2)
+            {
+                m_pullUps = m_pullUps | bits;
+            }
+        }
+
+        _updateLevels();
+    }
+
+    /// Method to drive a pin from outside the SOC.
+    void setInput(ULONG pin, ULONG level)
+    {
+        m_driven = m_driven | (1ULL << pin);
+        m_inputs = (level != 0) ? (m_inputs | (1ULL << pin)) : (m_inputs & ~(1ULL << pin));
+        _updateLevels();
+    }
+
+    /// Method to stop driving a pin from outside the SOC.
+    void releaseInput(ULONG pin)
+    {
+        m_driven = m_driven & ~(1ULL << pin);
+        _updateLevels();
+    }
+
+    /// Method to get the level of a pin.
+    ULONG getLevel(ULONG pin)
+    {
+        return (ULONG)((m_levels >> pin) & 1);
+    }
+
+private:
+
+    /// Indexes of the edge and level detect enables in m_enables.
+    enum {
+        RISING, FALLING, HIGH_LEVEL, LOW_LEVEL, ASYNC_RISING, ASYNC_FALLING, DETECT_TYPES
+    };
+
+    /// Function select registers (3 bits per pin, 1 selects output).
+    ULONG m_fsel[6];
+
+    /// Output latch, one bit per pin.
+    ULONGLONG m_outputs;
+
+    /// Event detect status, one bit per pin.
+    ULONGLONG m_events;
+
+    /// Edge and level detect enables, one bit per pin for each type of detect.
+    ULONGLONG m_enables[DETECT_TYPES];
+
+    /// Pins driven from outside the SOC, and the levels they are driven to.
+    ULONGLONG m_driven;
+    ULONGLONG m_inputs;
+
+    /// Pins with pull-ups and pull-downs enabled.
+    ULONGLONG m_pullUps;
+    ULONGLONG m_pullDowns;
+
+    /// Value of the pull-up/down control register.
+    ULONG m_pudControl;
+
+    /// The current level of each pin.
+    ULONGLONG m_levels;
+
+    /// Method to get the 32-bit register for a bank of a 64-bit pin set.
+    static ULONG _bank(ULONGLONG pins, ULONG bankOffset)
+    {
+        return (bankOffset == 0) ? (ULONG)pins : (ULONG)(pins >> 32);
+    }
+
+    /// Method to set the 32-bit register for a bank of a 64-bit pin set.
+    static void _setBank(ULONGLONG & pins, ULONG bankOffset, ULONG value)
+    {
+        if (bankOffset == 0)
+        {
+            pins = (pins & 0xFFFFFFFF00000000ULL) | value;
+        }
+        else
+        {
+            pins = (pins & 0x00000000FFFFFFFFULL) | (((ULONGLONG)value) << 32);
+        }
+    }
+
+    /// Method to get the pins with a level that matches an enabled level detect.
+    ULONGLONG _levelEvents()
+    {
+        return (m_levels & m_enables[HIGH_LEVEL]) | (~m_levels & m_enables[LOW_LEVEL]);
+    }
+
+    /// Method to recalculate the pin levels, and record edge events.
+    void _updateLevels()
+    {
+        ULONGLONG outputPins = 0;
+        ULONGLONG newLevels = 0;
+        ULONGLONG rising = 0;
+        ULONGLONG falling = 0;
+        ULONGLONG changed = 0;
+
+        for (ULONG pin = 0; pin < SIM_GPIO_PINS; pin++)
+        {
+            if (((m_fsel[pin / 10] >> ((pin % 10) * 3)) & 0x7) == 1)
+            {
+                outputPins = outputPins | (1ULL << pin);
+            }
+        }
+
+        // Outputs drive their pins, other pins are driven externally or pulled.
+        newLevels = (m_outputs & outputPins) |
+            (m_inputs & m_driven & ~outputPins) |
+            (m_pullUps & ~m_driven & ~outputPins);
+
+        rising = newLevels & ~m_levels;
+        falling = ~newLevels & m_levels;
+        m_events = m_events |
+            (rising & (m_enables[RISING] | m_enables[ASYNC_RISING])) |
+            (falling & (m_enables[FALLING] | m_enables[ASYNC_FALLING]));
+
+        changed = rising | falling;
+        m_levels = newLevels;
+
+        for (ULONG pin = 0; (changed != 0) && (pin < SIM_GPIO_PINS); pin++)
+        {
+            if ((changed & (1ULL << pin)) != 0)
+            {
+                g_simulator._gpioLevelChanged(pin, getLevel(pin));
+            }
+        }
+    }
+};
+
+//
+// Model of a BCM2836 BSC (I2C master) controller.
+//
+class SimBcmI2cClass : public SimControllerClass
+{
+public:
+    SimBcmI2cClass()
+    {
+        ZeroMemory(m_devices, sizeof(m_devices));
+        m_control = 0;
+        m_dlen = 0;
+        m_address = 0;
+        m_div = 0x05DC;
+        m_del = 0x00300030;
+        m_clkt = 0x40;
+        m_done = FALSE;
+        m_err = FALSE;
+        m_active = FALSE;
+        m_read = FALSE;
+        m_addressPhase = FALSE;
+        m_remaining = 0;
+        m_stalled = FALSE;
+        m_nextEventTicks = 0;
+        m_device = nullptr;
+        m_restartLatched = FALSE;
+        m_restartRead = FALSE;
+        m_restartLength = 0;
+        m_restartGap = FALSE;
+        _clearFifos(3);
+    }
+
+    /// Method to attach a device model at a slave address.
+    HRESULT attachDevice(ULONG slaveAddress, SimI2cDeviceClass* device)
+    {
+        HRESULT hr = S_OK;
+
+        if (slaveAddress > 0x7F)
+        {
+            hr = DMAP_E_I2C_ADDRESS_OUT_OF_RANGE;
+        }
+        else if ((device != nullptr) && (m_devices[slaveAddress] != nullptr))
+        {
+            hr = DMAP_E_SIMULATOR_DEVICE_CONFLICT;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            m_devices[slaveAddress] = device;
+        }
+
+        return hr;
+    }
+
+    ULONG peekRegister(ULONG offset) override
+    {
+        ULONG value = 0;
+
+        _advance();
+
+        switch (offset)
+        {
+        case 0x00:
+            value = m_control;
+            break;
+        case 0x04:
+            value = _status();
+            break;
+        case 0x08:
+            value = m_active ? m_remaining : m_dlen;
+            break;
+        case 0x0C:
+            value = m_address;
+            break;
+        case 0x10:
+            value = (m_rxCount > 0) ? m_rxFifo[m_rxHead] : 0;
+            break;
+        case 0x14:
+            value = m_div;
+            break;
+        case 0x18:
+            value = m_del;
+            break;
+        case 0x1C:
+            value = m_clkt;
+            break;
+        }
+
+        return value;
+    }
+
+    ULONG readRegister(ULONG offset) override
+    {
+        ULONG value = peekRegister(offset);
+
+        if ((offset == 0x04) && m_restartGap)
+        {
+            // The controller has been seen idle between the write and the read of a
+            // write-restart-read sequence, so start the read.
+            value = value & ~1UL;
+            m_restartGap = FALSE;
+            _startTransfer(m_restartRead, m_restartLength);
+        }
+        else if ((offset == 0x10) && (m_rxCount > 0))
+        {
+            m_rxHead = (m_rxHead + 1) % SIM_I2C_FIFO_BYTES;
+            m_rxCount--;
+            _advance();
+        }
+
+        return value;
+    }
+
+    void writeRegister(ULONG offset, ULONG value) override
+    {
+        _advance();
+
+        switch (offset)
+        {
+        case 0x00:
+            _clearFifos((value >> 4) & 0x3);
+            m_control = value & 0x8701;
+            if ((m_control & 0x8000) == 0)
+            {
+                // Disabling the controller abandons any transfer in progress.
+                _endTransfer(FALSE);
+            }
+            else if ((value & 0x80) != 0)
+            {
+                if (m_active)
+                {
+                    // A start while a transfer is active is latched until the current
+                    // transfer is done, which gives a RESTART.
+                    m_restartLatched = TRUE;
+                    m_restartRead = (value & 0x1) != 0;
+                    m_restartLength = m_dlen;
+                }
+                else
+                {
+                    _startTransfer((value & 0x1) != 0, m_dlen);
+                }
+            }
+            break;
+        case 0x04:
+            if ((value & 0x2) != 0)
+            {
+                m_done = FALSE;
+            }
+            if ((value & 0x100) != 0)
+            {
+                m_err = FALSE;
+            }
+            break;
+        case 0x08:
+            m_dlen = value & 0xFFFF;
+            break;
+        case 0x0C:
+            m_address = value & 0x7F;
+            break;
+        case 0x10:
+            if (m_txCount < SIM_I2C_FIFO_BYTES)
+            {
+                m_txFifo[(m_txHead + m_txCount) % SIM_I2C_FIFO_BYTES] = (UCHAR)value;
+                m_txCount++;
+            }
+            break;
+        case 0x14:
+            m_div = value & 0xFFFF;
+            break;
+        case 0x18:
+            m_del = value;
+            break;
+        case 0x1C:
+            m_clkt = value & 0xFFFF;
+            break;
+        }
+
+        _advance();
+    }
+
+private:
+
+    /// The device models, indexed by slave address.
+    SimI2cDeviceClass* m_devices[0x80];
+
+    /// Register contents.
+    ULONG m_control;
+    ULONG m_dlen;
+    ULONG m_address;
+    ULONG m_div;
+    ULONG m_del;
+    ULONG m_clkt;
+
+    /// Latched status flags.
+    BOOL m_done;
+    BOOL m_err;
+
+    /// The TX and RX FIFOs.
+    UCHAR m_txFifo[SIM_I2C_FIFO_BYTES];
+    ULONG m_txHead;
+    ULONG m_txCount;
+    UCHAR m_rxFifo[SIM_I2C_FIFO_BYTES];
+    ULONG m_rxHead;
+    ULONG m_rxCount;
+
+    /// State of the transfer in progress.
+    BOOL m_active;
+    BOOL m_read;
+    BOOL m_addressPhase;
+    ULONG m_remaining;
+    BOOL m_stalled;
+    LONGLONG m_nextEventTicks;
+    SimI2cDeviceClass* m_device;
+
+    /// A transfer latched to start with a RESTART when the current transfer is done.
+    BOOL m_restartLatched;
+    BOOL m_restartRead;
+    ULONG m_restartLength;
+
+    /// TRUE between the two parts of a write-restart-read sequence.
+    BOOL m_restartGap;
+
+    /// Method to clear the FIFOs.
+    void _clearFifos(ULONG clear)
+    {
+        if (clear != 0)
+        {
+            m_txHead = 0;
+            m_txCount = 0;
+            m_rxHead = 0;
+            m_rxCount = 0;
+        }
+    }
+
+    /// Method to build the status register value.
+    ULONG _status()
+    {
+        ULONG status = 0;
+
+        status |= m_active ? 0x001 : 0;
+        status |= m_done ? 0x002 : 0;
+
+        // TXW and RXR only promise that the FIFO is not full, or not empty, so they are
+        // modeled at those levels.  Code that takes them to mean more room or more data than
+        // that overruns or underruns the FIFOs.
+        status |= (m_active && !m_read && (m_txCount < SIM_I2C_FIFO_BYTES)) ? 0x004 : 0;
+        status |= (m_active && m_read && (m_rxCount > 0)) ? 0x008 : 0;
+        status |= (m_txCount < SIM_I2C_FIFO_BYTES) ? 0x010 : 0;
+        status |= (m_rxCount > 0) ? 0x020 : 0;
+        status |= (m_txCount == 0) ? 0x040 : 0;
+        status |= (m_rxCount == SIM_I2C_FIFO_BYTES) ? 0x080 : 0;
+        status |= m_err ? 0x100 : 0;
+
+        return status;
+    }
+
+    /// Method to get the time taken to transfer one byte (and its ACK bit).
+    LONGLONG _byteTicks()
+    {
+        ULONGLONG cdiv = (m_div & 0xFFFE);
+
+        if (cdiv == 0)
+        {
+            cdiv = 0x8000;
+        }
+
+        return g_simulator.nsToTicks((9ULL * cdiv * 1000000000ULL) / SIM_CORE_CLOCK_HZ);
+    }
+
+    /// Method to start a transfer.
+    void _startTransfer(BOOL read, ULONG length)
+    {
+        m_active = TRUE;
+        m_read = read;
+        m_remaining = length;
+        m_addressPhase = TRUE;
+        m_stalled = FALSE;
+        m_nextEventTicks = g_simulator.getTicks() + _byteTicks();
+    }
+
+    /// Method to end the transfer in progress.
+    void _endTransfer(BOOL sendStop)
+    {
+        if (m_active && sendStop && (m_device != nullptr))
+        {
+            m_device->stop();
+        }
+        m_active = FALSE;
+        m_device = nullptr;
+        m_restartLatched = FALSE;
+        m_restartGap = FALSE;
+    }
+
+    /// Method to move the transfer in progress forward to the current time.
+    void _advance()
+    {
+        BOOL timing = g_simulator.isTimingEnabled();
+        LONGLONG now = g_simulator.getTicks();
+        BOOL waiting = FALSE;
+
+        while (m_active && !waiting && (!timing || (now >= m_nextEventTicks)))
+        {
+            if (m_addressPhase)
+            {
+                // Send the slave address.  After a RESTART to a different address, the
+                // device addressed before sees a STOP.
+                if ((m_device != nullptr) && (m_device != m_devices[m_address]))
+                {
+                    m_device->stop();
+                }
+                m_device = m_devices[m_address];
+                m_addressPhase = FALSE;
+                if ((m_device == nullptr) || !m_device->start(m_read))
+                {
+                    m_err = TRUE;
+                    m_done = TRUE;
+                    _endTransfer(TRUE);
+                }
+            }
+            else if (m_remaining == 0)
+            {
+                m_done = TRUE;
+                if (m_restartLatched)
+                {
+                    // The latched transfer starts after a RESTART.
+                    m_restartLatched = FALSE;
+                    m_restartGap = TRUE;
+                    m_active = FALSE;
+                }
+                else
+                {
+                    _endTransfer(TRUE);
+                }
+            }
+            else if (!m_read && (m_txCount == 0))
+            {
+                // Hold the clock low until there is data to send.
+                m_stalled = TRUE;
+                waiting = TRUE;
+            }
+            else if (m_read && (m_rxCount == SIM_I2C_FIFO_BYTES))
+            {
+                // Hold the clock low until there is room for the data.
+                m_stalled = TRUE;
+                waiting = TRUE;
+            }
+            else if (!m_read)
+            {
+                m_remaining--;
+                if (!m_device->writeByte(m_txFifo[m_txHead]))
+                {
+                    m_err = TRUE;
+                    m_done = TRUE;
+                    _endTransfer(TRUE);
+                }
+                m_txHead = (m_txHead + 1) % SIM_I2C_FIFO_BYTES;
+                m_txCount--;
+            }
+            else
+            {
+                m_remaining--;
+                m_rxFifo[(m_rxHead + m_rxCount) % SIM_I2C_FIFO_BYTES] = m_device->readByte();
+                m_rxCount++;
+            }
+
+            if (!waiting)
+            {
+                if (m_stalled)
+                {
+                    // After a stall the next byte takes a full byte time from now.
+                    m_stalled = FALSE;
+                    m_nextEventTicks = now;
+                }
+                m_nextEventTicks = m_nextEventTicks + _byteTicks();
+            }
+        }
+
+    }
+};
+
+//
+// Model of a BCM2836 SPI master controller (polled mode).
+//
+// When CS.DMAEN is set each FIFO access moves a 32-bit word holding four bytes, least
+// significant byte first.  Only transfers of whole words are modeled in this mode.
+//
+class SimBcmSpiClass : public SimControllerClass
+{
+public:
+    SimBcmSpiClass()
+    {
+        ZeroMemory(m_csDevices, sizeof(m_csDevices));
+        ZeroMemory(m_gpioDevices, sizeof(m_gpioDevices));
+        ZeroMemory(m_gpioPins, sizeof(m_gpioPins));
+        m_gpioDeviceCount = 0;
+        m_control = 0;
+        m_clk = 0;
+        m_dlen = 0;
+        m_ltoh = 0x1;
+        m_dc = 0x30201020;
+        m_nextEventTicks = 0;
+        m_stalled = TRUE;
+        m_selected = nullptr;
+        _clearFifos(3);
+    }
+
+    /// Method to attach a device model to a hardware chip select.
+    HRESULT attachDevice(ULONG chipSelect, SimSpiDeviceClass* device)
+    {
+        HRESULT hr = S_OK;
+
+        if (chipSelect >= SIM_SPI_CHIP_SELECTS)
+        {
+            hr = DMAP_E_SPI_BUS_REQUESTED_DOES_NOT_EXIST;
+        }
+        else if ((device != nullptr) && (m_csDevices[chipSelect] != nullptr))
+        {
+            hr = DMAP_E_SIMULATOR_DEVICE_CONFLICT;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            m_csDevices[chipSelect] = device;
+        }
+
+        return hr;
+    }
+
+    /// Method to attach a device model selected by a GPIO pin (active low).
+    HRESULT attachGpioDevice(ULONG gpioPin, SimSpiDeviceClass* device)
+    {
+        HRESULT hr = S_OK;
+
+        if (gpioPin >= SIM_GPIO_PINS)
+        {
+            hr = DMAP_E_PIN_NUMBER_TOO_LARGE_FOR_BOARD;
+        }
+        else if (m_gpioDeviceCount >= SIM_SPI_MAX_DEVICES)
+        {
+            hr = DMAP_E_SIMULATOR_DEVICE_CONFLICT;
+        }
+
+        for (ULONG i = 0; SUCCEEDED(hr) && (i < m_gpioDeviceCount); i++)
+        {
+            if (m_gpioPins[i] == gpioPin)
+            {
+                hr = DMAP_E_SIMULATOR_DEVICE_CONFLICT;
+            }
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            m_gpioPins[m_gpioDeviceCount] = gpioPin;
+            m_gpioDevices[m_gpioDeviceCount] = device;
+            m_gpioDeviceCount++;
+        }
+
+        return hr;
+    }
+
+    /// Method called when the level of a GPIO pin changes.
+    void gpioLevelChanged(ULONG gpioPin, ULONG level)
+    {
+        _advance();
+
+        for (ULONG i = 0; i < m_gpioDeviceCount; i++)
+        {
+            if (m_gpioPins[i] == gpioPin)
+            {
+                if (level == 0)
+                {
+                    m_gpioDevices[i]->select();
+                }
+                else
+                {
+                    m_gpioDevices[i]->deselect();
+                }
+            }
+        }
+    }
+
+    ULONG peekRegister(ULONG offset) override
+    {
+        ULONG value = 0;
+
+        _advance();
+
+        switch (offset)
+        {
+        case 0x00:
+            value = m_control | _status();
+            break;
+        case 0x04:
+            for (ULONG i = 0; (i < _entryBytes()) && (i < m_rxCount); i++)
+            {
+                value = value | ((ULONG)m_rxFifo[(m_rxHead + i) % SIM_SPI_FIFO_BYTES] << (i * 8));
+            }
+            break;
+        case 0x08:
+            value = m_clk;
+            break;
+        case 0x0C:
+            value = m_dlen;
+            break;
+        case 0x10:
+            value = m_ltoh;
+            break;
+        case 0x14:
+            value = m_dc;
+            break;
+        }
+
+        return value;
+    }
+
+    ULONG readRegister(ULONG offset) override
+    {
+        ULONG value = peekRegister(offset);
+
+        if ((offset == 0x04) && (m_rxCount >= _entryBytes()))
+        {
+            m_rxHead = (m_rxHead + _entryBytes()) % SIM_SPI_FIFO_BYTES;
+            m_rxCount = m_rxCount - _entryBytes();
+            _advance();
+        }
+
+        return value;
+    }
+
+    void writeRegister(ULONG offset, ULONG value) override
+    {
+        SimSpiDeviceClass* oldSelected = nullptr;
+
+        _advance();
+
+        switch (offset)
+        {
+        case 0x00:
+            oldSelected = _hardwareSelected();
+            _clearFifos((value >> 4) & 0x3);
+            m_control = value & 0x01E0FFCF;
+            if (_hardwareSelected() != oldSelected)
+            {
+                if (oldSelected != nullptr)
+                {
+                    oldSelected->deselect();
+                }
+                if (_hardwareSelected() != nullptr)
+                {
+                    _hardwareSelected()->select();
+                }
+            }
+            break;
+        case 0x04:
+            if (((m_control & 0x80) != 0) && ((m_txCount + _entryBytes()) <= SIM_SPI_FIFO_BYTES))
+            {
+                if (m_txCount == 0)
+                {
+                    // Shifting starts again one byte time after data is available.
+                    m_stalled = TRUE;
+                }
+                for (ULONG i = 0; i < _entryBytes(); i++)
+                {
+                    m_txFifo[(m_txHead + m_txCount) % SIM_SPI_FIFO_BYTES] = (UCHAR)(value >> (i * 8));
+                    m_txCount++;
+                }
+            }
+            break;
+        case 0x08:
+            m_clk = value & 0xFFFF;
+            break;
+        case 0x0C:
+            m_dlen = value & 0xFFFF;
+            break;
+        case 0x10:
+            m_ltoh = value & 0xF;
+            break;
+        case 0x14:
+            m_dc = value;
+            break;
+        }
+
+        _advance();
+    }
+
+private:
+
+    /// Device models attached to the hardware chip selects.
+    SimSpiDeviceClass* m_csDevices[SIM_SPI_CHIP_SELECTS];
+
+    /// Device models selected by GPIO pins, and their pins.
+    SimSpiDeviceClass* m_gpioDevices[SIM_SPI_MAX_DEVICES];
+    ULONG m_gpioPins[SIM_SPI_MAX_DEVICES];
+    ULONG m_gpioDeviceCount;
+
+    /// Register contents.
+    ULONG m_control;
+    ULONG m_clk;
+    ULONG m_dlen;
+    ULONG m_ltoh;
+    ULONG m_dc;
+
+    /// The TX and RX FIFOs.
+    UCHAR m_txFifo[SIM_SPI_FIFO_BYTES];
+    ULONG m_txHead;
+    ULONG m_txCount;
+    UCHAR m_rxFifo[SIM_SPI_FIFO_BYTES];
+    ULONG m_rxHead;
+    ULONG m_rxCount;
+
+    /// Time the byte being shifted is done, and TRUE if shifting has stopped.
+    LONGLONG m_nextEventTicks;
+    BOOL m_stalled;
+
+    /// The device model currently selected.
+    SimSpiDeviceClass* m_selected;
+
+    /// Method to clear the FIFOs.
+    void _clearFifos(ULONG clear)
+    {
+        if ((clear & 0x1) != 0)
+        {
+            m_txHead = 0;
+            m_txCount = 0;
+        }
+        if ((clear & 0x2) != 0)
+        {
+            m_rxHead = 0;
+            m_rxCount = 0;
+        }
+    }
+
+    /// Method to build the status bits of the CS register.
+    ULONG _status()
+    {
+        ULONG status = 0;
+
+        status |= (m_txCount == 0) ? 0x00010000 : 0;
+        status |= (m_rxCount >= _entryBytes()) ? 0x00020000 : 0;
+        status |= ((m_txCount + _entryBytes()) <= SIM_SPI_FIFO_BYTES) ? 0x00040000 : 0;
+        status |= (m_rxCount >= (SIM_SPI_FIFO_BYTES * 3 / 4)) ? 0x00080000 : 0;
+        status |= (m_rxCount == SIM_SPI_FIFO_BYTES) ? 0x00100000 : 0;
+
+        return status;
+    }
+
+    /// Method to get the number of bytes moved by each FIFO access (4 in DMA mode).
+    ULONG _entryBytes()
+    {
+        return ((m_control & 0x100) != 0) ? 4 : 1;
+    }
+
+    /// Method to get the device selected by the hardware chip select lines.
+    SimSpiDeviceClass* _hardwareSelected()
+    {
+        SimSpiDeviceClass* device = nullptr;
+        ULONG cs = m_control & 0x3;
+
+        if (((m_control & 0x80) != 0) && (cs < SIM_SPI_CHIP_SELECTS))
+        {
+            device = m_csDevices[cs];
+        }
+
+        return device;
+    }
+
+    /// Method to get the device that responds to the byte being shifted.
+    SimSpiDeviceClass* _selectedDevice()
+    {
+        SimSpiDeviceClass* device = _hardwareSelected();
+
+        for (ULONG i = 0; (device == nullptr) && (i < m_gpioDeviceCount); i++)
+        {
+            if (g_simulator.getGpioLevel(m_gpioPins[i]) == 0)
+            {
+                device = m_gpioDevices[i];
+            }
+        }
+
+        return device;
+    }
+
+    /// Method to get the time taken to shift one byte.
+    LONGLONG _byteTicks()
+    {
+        ULONGLONG cdiv = (m_clk & 0xFFFE);
+
+        if (cdiv == 0)
+        {
+            cdiv = 0x10000;
+        }
+
+        return g_simulator.nsToTicks((8ULL * cdiv * 1000000000ULL) / SIM_CORE_CLOCK_HZ);
+    }
+
+    /// Method to move the shifting of the FIFO contents forward to the current time.
+    void _advance()
+    {
+        BOOL timing = g_simulator.isTimingEnabled();
+        LONGLONG now = g_simulator.getTicks();
+        SimSpiDeviceClass* device = nullptr;
+        UCHAR dataIn = 0;
+
+        if (m_stalled && (m_txCount > 0))
+        {
+            m_stalled = FALSE;
+            m_nextEventTicks = now + _byteTicks();
+        }
+
+        while (((m_control & 0x80) != 0) && (m_txCount > 0) && (m_rxCount < SIM_SPI_FIFO_BYTES) &&
+            (!timing || (now >= m_nextEventTicks)))
+        {
+            device = _selectedDevice();
+            dataIn = (device != nullptr) ? device->transferByte(m_txFifo[m_txHead]) : 0xFF;
+            m_txHead = (m_txHead + 1) % SIM_SPI_FIFO_BYTES;
+            m_txCount--;
+            m_rxFifo[(m_rxHead + m_rxCount) % SIM_SPI_FIFO_BYTES] = dataIn;
+            m_rxCount++;
+            m_nextEventTicks = m_nextEventTicks + _byteTicks();
+        }
+
+        if (m_txCount == 0)
+        {
+            m_stalled = TRUE;
+        }
+    }
+};
+
+//
+// PeripheralSimulatorClass methods.
+//
+
+// Per-thread record of a trapped register access waiting to be single stepped.
+#if LIGHTNING_SIMULATOR_SUPPORTED
+static __declspec(thread) SimControllerClass* t_trapController = nullptr;
+static __declspec(thread) ULONG t_trapOffset = 0;
+static __declspec(thread) BOOL t_trapWrite = FALSE;
+#endif // LIGHTNING_SIMULATOR_SUPPORTED
+
+// Constructor.
+PeripheralSimulatorClass::PeripheralSimulatorClass() :
+    m_enabled(FALSE),
+    m_timingEnabled(TRUE),
+    m_hExceptionHandler(nullptr),
+    m_gpio(nullptr),
+    m_registerReads(0),
+    m_registerWrites(0)
+{
+    QueryPerformanceFrequency(&m_frequency);
+    InitializeCriticalSectionEx(&m_accessLock, 0, 0);
+    ZeroMemory(m_i2c, sizeof(m_i2c));
+    ZeroMemory(m_spi, sizeof(m_spi));
+}
+
+// Destructor.
+PeripheralSimulatorClass::~PeripheralSimulatorClass()
+{
+    disable();
+    DeleteCriticalSection(&m_accessLock);
+}
+
+/**
+After this call, GetControllerBaseAddress() returns the simulated register blocks for
+the BCM2836 GPIO, I2C and SPI controllers.  This should be called before any of these
+controllers are used, and device models should be attached before they are accessed.
+\return HRESULT success or error code.
+*/
+HRESULT PeripheralSimulatorClass::enable()
+{
+    HRESULT hr = S_OK;
+
+#if LIGHTNING_SIMULATOR_SUPPORTED
+    if (!m_enabled)
+    {
+        m_gpio = new SimBcmGpioClass;
+        hr = m_gpio->allocateRegisters();
+
+        for (ULONG i = 0; SUCCEEDED(hr) && (i < SIM_I2C_BUSES); i++)
+        {
+            m_i2c[i] = new SimBcmI2cClass;
+            hr = m_i2c[i]->allocateRegisters();
+        }
+
+        for (ULONG i = 0; SUCCEEDED(hr) && (i < SIM_SPI_BUSES); i++)
+        {
+            m_spi[i] = new SimBcmSpiClass;
+            hr = m_spi[i]->allocateRegisters();
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            m_hExceptionHandler = AddVectoredExceptionHandler(1, _exceptionHandler);
+            if (m_hExceptionHandler == nullptr)
+            {
+                hr = E_OUTOFMEMORY;
+            }
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            m_enabled = TRUE;
+        }
+        else
+        {
+            disable();
+        }
+    }
+#else
+    hr = DMAP_E_SIMULATOR_NOT_SUPPORTED;
+#endif // LIGHTNING_SIMULATOR_SUPPORTED
+
+    return hr;
+}
+
+/**
+Any controller objects still using the simulated registers must be ended first.
+*/
+void PeripheralSimulatorClass::disable()
+{
+#if LIGHTNING_SIMULATOR_SUPPORTED
+    if (m_hExceptionHandler != nullptr)
+    {
+        RemoveVectoredExceptionHandler(m_hExceptionHandler);
+        m_hExceptionHandler = nullptr;
+    }
+#endif // LIGHTNING_SIMULATOR_SUPPORTED
+
+    m_enabled = FALSE;
+
+    if (m_gpio != nullptr)
+    {
+        delete m_gpio;
+        m_gpio = nullptr;
+    }
+
+    for (ULONG i = 0; i < SIM_I2C_BUSES; i++)
+    {
+        if (m_i2c[i] != nullptr)
+        {
+            delete m_i2c[i];
+            m_i2c[i] = nullptr;
+        }
+    }
+
+    for (ULONG i = 0; i < SIM_SPI_BUSES; i++)
+    {
+        if (m_spi[i] != nullptr)
+        {
+            delete m_spi[i];
+            m_spi[i] = nullptr;
+        }
+    }
+}
+
+/**
+\param[in] busNumber The I2C bus to attach the device to (EXTERNAL_I2C_BUS or
+SECOND_EXTERNAL_I2C_BUS).
+\param[in] slaveAddress The 7-bit I2C address the device responds to.
+\param[in] device The device model, or nullptr to remove the device at the address.
+The device model must remain in existence while it is attached.
+\return HRESULT success or error code.
+*/
+HRESULT PeripheralSimulatorClass::attachI2cDevice(ULONG busNumber, ULONG slaveAddress, SimI2cDeviceClass* device)
+{
+    HRESULT hr = S_OK;
+
+    if (!m_enabled)
+    {
+        hr = DMAP_E_SIMULATOR_NOT_SUPPORTED;
+    }
+    else if (busNumber >= SIM_I2C_BUSES)
+    {
+        hr = DMAP_E_I2C_INVALID_BUS_NUMBER_SPECIFIED;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        EnterCriticalSection(&m_accessLock);
+        hr = m_i2c[busNumber]->attachDevice(slaveAddress, device);
+        LeaveCriticalSection(&m_accessLock);
+    }
+
+    return hr;
+}
+
+/**
+\param[in] busNumber The SPI bus to attach the device to (EXTERNAL_SPI_BUS or
+SECOND_EXTERNAL_SPI_BUS).
+\param[in] chipSelect The hardware chip select line (0-2) that selects the device.
+\param[in] device The device model, or nullptr to remove the device on the chip select.
+The device model must remain in existence while it is attached.
+\return HRESULT success or error code.
+*/
+HRESULT PeripheralSimulatorClass::attachSpiDevice(ULONG busNumber, ULONG chipSelect, SimSpiDeviceClass* device)
+{
+    HRESULT hr = S_OK;
+
+    if (!m_enabled)
+    {
+        hr = DMAP_E_SIMULATOR_NOT_SUPPORTED;
+    }
+    else if ((busNumber < EXTERNAL_SPI_BUS) || ((busNumber - EXTERNAL_SPI_BUS) >= SIM_SPI_BUSES))
+    {
+        hr = DMAP_E_SPI_BUS_REQUESTED_DOES_NOT_EXIST;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        EnterCriticalSection(&m_accessLock);
+        hr = m_spi[busNumber - EXTERNAL_SPI_BUS]->attachDevice(chipSelect, device);
+        LeaveCriticalSection(&m_accessLock);
+    }
+
+    return hr;
+}
+
+/**
+The device is selected while the GPIO pin is low, which is how an SPI controller
+addresses a device whose chip select pin is not driven by a controller chip select line.
+\param[in] busNumber The SPI bus to attach the device to.
+\param[in] gpioPin The GPIO pin that selects the device.
+\param[in] device The device model.  It must remain in existence while the simulator
+is enabled.
+\return HRESULT success or error code.
+*/
+HRESULT PeripheralSimulatorClass::attachSpiDeviceOnGpio(ULONG busNumber, ULONG gpioPin, SimSpiDeviceClass* device)
+{
+    HRESULT hr = S_OK;
+
+    if (!m_enabled)
+    {
+        hr = DMAP_E_SIMULATOR_NOT_SUPPORTED;
+    }
+    else if ((busNumber < EXTERNAL_SPI_BUS) || ((busNumber - EXTERNAL_SPI_BUS) >= SIM_SPI_BUSES))
+    {
+        hr = DMAP_E_SPI_BUS_REQUESTED_DOES_NOT_EXIST;
+    }
+    else if (device == nullptr)
+    {
+        hr = E_INVALIDARG;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        EnterCriticalSection(&m_accessLock);
+        hr = m_spi[busNumber - EXTERNAL_SPI_BUS]->attachGpioDevice(gpioPin, device);
+        LeaveCriticalSection(&m_accessLock);
+    }
+
+    return hr;
+}
+
+/**
+\param[in] gpioPin The number of the GPIO pin.
+\param[in] level The level to drive the pin to (0 or 1).  The level is seen on the pin
+unless the pin is configured as an output.
+\return HRESULT success or error code.
+*/
+HRESULT PeripheralSimulatorClass::setGpioInput(ULONG gpioPin, ULONG level)
+{
+    HRESULT hr = S_OK;
+
+    if (!m_enabled)
+    {
+        hr = DMAP_E_SIMULATOR_NOT_SUPPORTED;
+    }
+    else if (gpioPin >= SIM_GPIO_PINS)
+    {
+        hr = DMAP_E_PIN_NUMBER_TOO_LARGE_FOR_BOARD;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        EnterCriticalSection(&m_accessLock);
+        m_gpio->setInput(gpioPin, level);
+        LeaveCriticalSection(&m_accessLock);
+    }
+
+    return hr;
+}
+
+/**
+After this call the pin floats to the level selected by its pull-up or pull-down.
+\param[in] gpioPin The number of the GPIO pin.
+\return HRESULT success or error code.
+*/
+HRESULT PeripheralSimulatorClass::releaseGpioInput(ULONG gpioPin)
+{
+    HRESULT hr = S_OK;
+
+    if (!m_enabled)
+    {
+        hr = DMAP_E_SIMULATOR_NOT_SUPPORTED;
+    }
+    else if (gpioPin >= SIM_GPIO_PINS)
+    {
+        hr = DMAP_E_PIN_NUMBER_TOO_LARGE_FOR_BOARD;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        EnterCriticalSection(&m_accessLock);
+        m_gpio->releaseInput(gpioPin);
+        LeaveCriticalSection(&m_accessLock);
+    }
+
+    return hr;
+}
+
+/**
+\param[in] gpioPin The number of the GPIO pin.
+\return The level of the pin (0 or 1), 1 if the pin does not exist.
+*/
+ULONG PeripheralSimulatorClass::getGpioLevel(ULONG gpioPin)
+{
+    ULONG level = 1;
+
+    if (m_enabled && (gpioPin < SIM_GPIO_PINS))
+    {
+        level = m_gpio->getLevel(gpioPin);
+    }
+
+    return level;
+}
+
+/**
+\param[in] deviceName The name of the device for the controller, as used with DMap.
+\param[inout] handle If INVALID_HANDLE_VALUE, an event handle is created to stand in for
+the device handle, so closing the controller works as usual.
+\param[inout] baseAddress If nullptr, the address of the simulated registers.
+\return HRESULT success or error code.
+*/
+HRESULT PeripheralSimulatorClass::mapController(PWCHAR deviceName, HANDLE & handle, PVOID & baseAddress)
+{
+    HRESULT hr = S_OK;
+    SimControllerClass* controller = nullptr;
+
+    if (!m_enabled)
+    {
+        hr = DMAP_E_SIMULATOR_NOT_SUPPORTED;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (_wcsicmp(deviceName, pi2GpioDeviceName) == 0)
+        {
+            controller = m_gpio;
+        }
+        else if (_wcsicmp(deviceName, pi2I2c1DeviceName) == 0)
+        {
+            controller = m_i2c[EXTERNAL_I2C_BUS];
+        }
+        else if (_wcsicmp(deviceName, pi2I2c0DeviceName) == 0)
+        {
+            controller = m_i2c[SECOND_EXTERNAL_I2C_BUS];
+        }
+        else if (_wcsicmp(deviceName, pi2Spi0DeviceName) == 0)
+        {
+            controller = m_spi[EXTERNAL_SPI_BUS - EXTERNAL_SPI_BUS];
+        }
+        else if (_wcsicmp(deviceName, pi2Spi1DeviceName) == 0)
+        {
+            controller = m_spi[SECOND_EXTERNAL_SPI_BUS - EXTERNAL_SPI_BUS];
+        }
+        else
+        {
+            hr = DMAP_E_DEVICE_NOT_FOUND_ON_SYSTEM;
+        }
+    }
+
+    if (SUCCEEDED(hr) && (handle == INVALID_HANDLE_VALUE))
+    {
+        handle = CreateEventEx(nullptr, nullptr, CREATE_EVENT_MANUAL_RESET, EVENT_ALL_ACCESS);
+        if (handle == nullptr)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            handle = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    if (SUCCEEDED(hr) && (baseAddress == nullptr))
+    {
+        baseAddress = controller->getRegisters();
+    }
+
+    return hr;
+}
+
+// Method called by the GPIO model when the level of a pin changes.
+void PeripheralSimulatorClass::_gpioLevelChanged(ULONG gpioPin, ULONG level)
+{
+    for (ULONG i = 0; i < SIM_SPI_BUSES; i++)
+    {
+        if (m_spi[i] != nullptr)
+        {
+            m_spi[i]->gpioLevelChanged(gpioPin, level);
+        }
+    }
+}
+
+// Method to find the controller model that owns an address.
+SimControllerClass* PeripheralSimulatorClass::_findController(ULONG_PTR address)
+{
+    SimControllerClass* controller = nullptr;
+
+    if ((m_gpio != nullptr) && m_gpio->ownsAddress(address))
+    {
+        controller = m_gpio;
+    }
+    for (ULONG i = 0; (controller == nullptr) && (i < SIM_I2C_BUSES); i++)
+    {
+        if ((m_i2c[i] != nullptr) && m_i2c[i]->ownsAddress(address))
+        {
+            controller = m_i2c[i];
+        }
+    }
+    for (ULONG i = 0; (controller == nullptr) && (i < SIM_SPI_BUSES); i++)
+    {
+        if ((m_spi[i] != nullptr) && m_spi[i]->ownsAddress(address))
+        {
+            controller = m_spi[i];
+        }
+    }
+
+    return controller;
+}
+
+// Method to suspend the other threads of this process.
+void PeripheralSimulatorClass::_suspendOtherThreads()
+{
+#if LIGHTNING_SIMULATOR_SUPPORTED
+    HANDLE snapshot = INVALID_HANDLE_VALUE;
+    HANDLE thread = nullptr;
+    THREADENTRY32 entry;
+    CONTEXT context;
+    DWORD processId = GetCurrentProcessId();
+    DWORD threadId = GetCurrentThreadId();
+
+    // Open all the threads before any are suspended, so no memory is allocated while a
+    // suspended thread could be holding the heap lock.
+    snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot != INVALID_HANDLE_VALUE)
+    {
+        entry.dwSize = sizeof(entry);
+        for (BOOL found = Thread32First(snapshot, &entry); found; found = Thread32Next(snapshot, &entry))
+        {
+            if ((entry.th32OwnerProcessID == processId) && (entry.th32ThreadID != threadId))
+            {
+                thread = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT, FALSE, entry.th32ThreadID);
+                if (thread != nullptr)
+                {
+                    m_suspendedThreads.push_back(thread);
+                }
+            }
+        }
+        CloseHandle(snapshot);
+    }
+
+    for (HANDLE suspendedThread : m_suspendedThreads)
+    {
+        // SuspendThread() does not wait for the thread to stop, getting its context does.
+        SuspendThread(suspendedThread);
+        context.ContextFlags = CONTEXT_CONTROL;
+        GetThreadContext(suspendedThread, &context);
+    }
+#endif // LIGHTNING_SIMULATOR_SUPPORTED
+}
+
+// Method to resume the threads suspended by _suspendOtherThreads().
+void PeripheralSimulatorClass::_resumeOtherThreads()
+{
+    for (HANDLE suspendedThread : m_suspendedThreads)
+    {
+        ResumeThread(suspendedThread);
+        CloseHandle(suspendedThread);
+    }
+    m_suspendedThreads.clear();
+}
+
+#if LIGHTNING_SIMULATOR_SUPPORTED
+/**
+Determine whether an instruction that writes to memory reads the memory first, as
+instructions such as OR, AND, ADD, INC and XCHG with a memory destination do.  Only
+the plain store instructions write memory without reading it.
+\param[in] instruction The address of the instruction.
+\return TRUE if the instruction reads the memory it writes.
+*/
+static BOOL simIsReadModifyWrite(PUCHAR instruction)
+{
+    BOOL readModifyWrite = TRUE;
+    ULONG i = 0;
+
+    // Skip the operand size, address size, segment, LOCK and REP prefixes.
+    while ((instruction[i] == 0x66) || (instruction[i] == 0x67) ||
+        (instruction[i] == 0x26) || (instruction[i] == 0x2E) || (instruction[i] == 0x36) ||
+        (instruction[i] == 0x3E) || (instruction[i] == 0x64) || (instruction[i] == 0x65) ||
+        (instruction[i] == 0xF0) || (instruction[i] == 0xF2) || (instruction[i] == 0xF3))
+    {
+        i++;
+    }
+
+#if defined(_M_X64)
+    // Skip a REX prefix.
+    if ((instruction[i] & 0xF0) == 0x40)
+    {
+        i++;
+    }
+#endif // defined(_M_X64)
+
+    switch (instruction[i])
+    {
+    case 0x88:      // MOV r/m8, r8
+    case 0x89:      // MOV r/m, r
+    case 0xA2:      // MOV moffs8, AL
+    case 0xA3:      // MOV moffs, eAX
+    case 0xAA:      // STOSB
+    case 0xAB:      // STOS
+    case 0xC6:      // MOV r/m8, imm8
+    case 0xC7:      // MOV r/m, imm
+        readModifyWrite = FALSE;
+        break;
+    case 0x0F:
+        switch (instruction[i + 1])
+        {
+        case 0x11:  // MOVUPS/MOVUPD/MOVSS/MOVSD m, xmm
+        case 0x13:  // MOVLPS/MOVLPD m64, xmm
+        case 0x17:  // MOVHPS/MOVHPD m64, xmm
+        case 0x29:  // MOVAPS/MOVAPD m, xmm
+        case 0x2B:  // MOVNTPS/MOVNTPD m, xmm
+        case 0x7E:  // MOVD/MOVQ r/m, mm or xmm
+        case 0x7F:  // MOVQ/MOVDQA/MOVDQU m, mm or xmm
+        case 0xC3:  // MOVNTI m, r
+        case 0xD6:  // MOVQ m64, xmm
+        case 0xE7:  // MOVNTQ/MOVNTDQ m, mm or xmm
+            readModifyWrite = FALSE;
+            break;
+        default:
+            // SETcc r/m8 stores without reading.
+            readModifyWrite = ((instruction[i + 1] & 0xF0) != 0x90);
+        }
+        break;
+    }
+
+    return readModifyWrite;
+}
+#endif // LIGHTNING_SIMULATOR_SUPPORTED
+
+/**
+A register access faults because the register block is inaccessible.  The other
+threads of the process are suspended, the register block is made accessible with the
+current register value in place, and the accessing instruction is single stepped.  On
+the single step trap, the register block is made inaccessible again, the other threads
+are resumed, and a written value is passed to the controller model.  The access lock
+is held from the fault to the single step trap, so only one register access is
+simulated at a time, and no other thread can reach the register block without trapping.
+
+An instruction such as OR or INC that reads a register as part of writing it performs
+a register read, with its side effects, as well as a register write.
+*/
+LONG CALLBACK PeripheralSimulatorClass::_exceptionHandler(PEXCEPTION_POINTERS exceptionInfo)
+{
+    LONG result = EXCEPTION_CONTINUE_SEARCH;
+
+#if LIGHTNING_SIMULATOR_SUPPORTED
+    PEXCEPTION_RECORD record = exceptionInfo->ExceptionRecord;
+    SimControllerClass* controller = nullptr;
+    ULONG_PTR address = 0;
+    PULONG registerAddress = nullptr;
+    PUCHAR instruction = nullptr;
+    ULONG value = 0;
+    DWORD oldProtect = 0;
+
+    if ((record->ExceptionCode == EXCEPTION_ACCESS_VIOLATION) && (record->NumberParameters >= 2))
+    {
+        address = record->ExceptionInformation[1];
+        controller = g_simulator._findController(address);
+
+        if (controller != nullptr)
+        {
+            EnterCriticalSection(&g_simulator.m_accessLock);
+
+            t_trapController = controller;
+            t_trapOffset = (ULONG)(address - (ULONG_PTR)controller->getRegisters()) & ~0x3UL;
+            t_trapWrite = (record->ExceptionInformation[0] == 1);
+            registerAddress = (PULONG)(controller->getRegisters() + t_trapOffset);
+
+#if defined(_M_X64)
+            instruction = (PUCHAR)exceptionInfo->ContextRecord->Rip;
+#else
+            instruction = (PUCHAR)exceptionInfo->ContextRecord->Eip;
+#endif // defined(_M_X64)
+
+            // A write may only change some bits of a register, so start it with the
+            // current value.  A write that reads the register first is also a read.
+            if (!t_trapWrite || simIsReadModifyWrite(instruction))
+            {
+                value = controller->readRegister(t_trapOffset);
+                g_simulator.m_registerReads++;
+            }
+            else
+            {
+                value = controller->peekRegister(t_trapOffset);
+            }
+
+            if (t_trapWrite)
+            {
+                g_simulator.m_registerWrites++;
+            }
+
+            g_simulator._suspendOtherThreads();
+
+            VirtualProtect(controller->getRegisters(), SIM_REGISTER_BLOCK_BYTES, PAGE_READWRITE, &oldProtect);
+            *registerAddress = value;
+
+            exceptionInfo->ContextRecord->EFlags |= SIM_EFLAGS_TRAP_FLAG;
+            result = EXCEPTION_CONTINUE_EXECUTION;
+        }
+    }
+    else if ((record->ExceptionCode == EXCEPTION_SINGLE_STEP) && (t_trapController != nullptr))
+    {
+        controller = t_trapController;
+        t_trapController = nullptr;
+
+        registerAddress = (PULONG)(controller->getRegisters() + t_trapOffset);
+        value = *registerAddress;
+
+        VirtualProtect(controller->getRegisters(), SIM_REGISTER_BLOCK_BYTES, PAGE_NOACCESS, &oldProtect);
+
+        g_simulator._resumeOtherThreads();
+
+        if (t_trapWrite)
+        {
+            controller->writeRegister(t_trapOffset, value);
+        }
+
+        LeaveCriticalSection(&g_simulator.m_accessLock);
+        result = EXCEPTION_CONTINUE_EXECUTION;
+    }
+#endif // LIGHTNING_SIMULATOR_SUPPORTED
+
+    return result;
+}
@@ -0,0 +1,242 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#ifndef _PERIPHERAL_SIMULATOR_H_
+#define _PERIPHERAL_SIMULATOR_H_
+
+#include <Windows.h>
+#include <vector>
+
+#include "DmapSupport.h"
+
+// Number of simulated I2C and SPI buses, and GPIO pins.
+#define SIM_I2C_BUSES 2
+#define SIM_SPI_BUSES 2
+#define SIM_GPIO_PINS 54
+
+// Number of hardware chip select lines on a simulated SPI bus.
+#define SIM_SPI_CHIP_SELECTS 3
+
+// Maximum number of devices that can be attached to a simulated SPI bus.
+#define SIM_SPI_MAX_DEVICES 8
+
+class SimControllerClass;
+class SimBcmGpioClass;
+class SimBcmI2cClass;
+class SimBcmSpiClass;
+
+//
+// Base class for models of I2C slave devices attached to a simulated I2C bus.
+//
+class SimI2cDeviceClass
+{
+public:
+    virtual ~SimI2cDeviceClass()
+    {
+    }
+
+    /// Method called when the device address is sent after a START or RESTART.
+    /**
+    \param[in] read TRUE if the master is starting a read, FALSE for a write.
+    \return TRUE to acknowledge the address, FALSE to NACK it.
+    */
+    virtual BOOL start(BOOL read) = 0;
+
+    /// Method called for each byte the master writes to the device.
+    /**
+    \param[in] data The byte written.
+    \return TRUE to acknowledge the byte, FALSE to NACK it.
+    */
+    virtual BOOL writeByte(UCHAR data) = 0;
+
+    /// Method called for each byte the master reads from the device.
+    virtual UCHAR readByte() = 0;
+
+    /// Method called when the master ends a transfer with a STOP.
+    virtual void stop()
+    {
+    }
+};
+
+//
+// Base class for models of SPI slave devices attached to a simulated SPI bus.
+//
+class SimSpiDeviceClass
+{
+public:
+    virtual ~SimSpiDeviceClass()
+    {
+    }
+
+    /// Method called when the chip select of the device is asserted.
+    virtual void select()
+    {
+    }
+
+    /// Method called for each byte shifted while the device is selected.
+    /**
+    \param[in] dataOut The byte shifted out by the master, MSB first.
+    \return The byte shifted back in to the master.
+    */
+    virtual UCHAR transferByte(UCHAR dataOut) = 0;
+
+    /// Method called when the chip select of the device is de-asserted.
+    virtual void deselect()
+    {
+    }
+};
+
+//
+// Class that simulates the BCM2836 GPIO, I2C and SPI controllers at the register level.
+//
+// When the simulator is enabled, GetControllerBaseAddress() returns simulated register
+// blocks instead of mapping the real controllers through DMap.  The register blocks are
+// kept inaccessible, so each access by the controller code traps to the simulator,
+// which updates the controller model and then single steps the accessing instruction.
+// This lets the unmodified BcmI2cControllerClass and BcmSpiControllerClass code run on a
+// development PC, against models of the devices attached to the buses.
+//
+// Bus transfers take as long as they would on the hardware at the programmed clock rate
+// unless timing is turned off, in which case each transfer completes as soon as the
+// controller code allows it to.
+//
+// While one register access is being stepped, the register block it is in is accessible,
+// so the other threads of the process are suspended until the step is complete.  Every
+// access by any thread therefore reaches the controller model.
+//
+// On x86 and x64 builds, enabling the simulator makes board type detection report a
+// PI2, so the I2C, SPI and GPIO code uses the BCM2836 controllers being simulated.
+//
+class PeripheralSimulatorClass
+{
+public:
+    LIGHTNING_DLL_API PeripheralSimulatorClass();
+
+    LIGHTNING_DLL_API virtual ~PeripheralSimulatorClass();
+
+    // Method to start simulating the controllers.
+    LIGHTNING_DLL_API HRESULT enable();
+
+    // Method to stop simulating the controllers.
+    LIGHTNING_DLL_API void disable();
+
+    /// Method to determine whether the controllers are being simulated.
+    BOOL isEnabled()
+    {
+        return m_enabled;
+    }
+
+    /// Method to specify whether bus transfers take simulated time.
+    /**
+    \param[in] enable TRUE for transfers to take as long as on the hardware (the default),
+    FALSE for transfers to complete as quickly as possible.
+    */
+    void setTimingEnabled(BOOL enable)
+    {
+        m_timingEnabled = enable;
+    }
+
+    /// Method to determine whether bus transfers take simulated time.
+    BOOL isTimingEnabled()
+    {
+        return m_timingEnabled;
+    }
+
+    // Method to attach a device model to a simulated I2C bus.
+    LIGHTNING_DLL_API HRESULT attachI2cDevice(ULONG busNumber, ULONG slaveAddress, SimI2cDeviceClass* device);
+
+    // Method to attach a device model to a hardware chip select of a simulated SPI bus.
+    LIGHTNING_DLL_API HRESULT attachSpiDevice(ULONG busNumber, ULONG chipSelect, SimSpiDeviceClass* device);
+
+    // Method to attach a device model to a simulated SPI bus, selected by a GPIO pin.
+    LIGHTNING_DLL_API HRESULT attachSpiDeviceOnGpio(ULONG busNumber, ULONG gpioPin, SimSpiDeviceClass* device);
+
+    // Method to set the level driven onto a GPIO pin from outside the SOC.
+    LIGHTNING_DLL_API HRESULT setGpioInput(ULONG gpioPin, ULONG level);
+
+    // Method to stop driving a GPIO pin from outside the SOC.
+    LIGHTNING_DLL_API HRESULT releaseGpioInput(ULONG gpioPin);
+
+    // Method to get the current level of a GPIO pin.
+    LIGHTNING_DLL_API ULONG getGpioLevel(ULONG gpioPin);
+
+    /// Method to get the number of register reads and writes simulated.
+    void getAccessCounts(ULONGLONG & reads, ULONGLONG & writes)
+    {
+        reads = m_registerReads;
+        writes = m_registerWrites;
+    }
+
+    // Method to get the simulated register block for a controller.
+    HRESULT mapController(PWCHAR deviceName, HANDLE & handle, PVOID & baseAddress);
+
+    /// Method to get the current simulated time in high resolution timer ticks.
+    LONGLONG getTicks()
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        return now.QuadPart;
+    }
+
+    /// Method to convert a time in nanoseconds to high resolution timer ticks.
+    LONGLONG nsToTicks(ULONGLONG ns)
+    {
+        return (LONGLONG)((ns * (ULONGLONG)m_frequency.QuadPart) / 1000000000ULL);
+    }
+
+    // Method called by the GPIO model when the level of a pin changes.
+    void _gpioLevelChanged(ULONG gpioPin, ULONG level);
+
+private:
+
+    /// TRUE if the controllers are being simulated.
+    BOOL m_enabled;
+
+    /// TRUE if bus transfers take simulated time.
+    BOOL m_timingEnabled;
+
+    /// The high resolution timer frequency on this system.
+    LARGE_INTEGER m_frequency;
+
+    /// Lock held from a register access trap until the access has been single stepped.
+    CRITICAL_SECTION m_accessLock;
+
+    /// Handle of the vectored exception handler used to trap register accesses.
+    PVOID m_hExceptionHandler;
+
+    /// The GPIO controller model.
+    SimBcmGpioClass* m_gpio;
+
+    /// The I2C controller models, indexed by bus number.
+    SimBcmI2cClass* m_i2c[SIM_I2C_BUSES];
+
+    /// The SPI controller models, indexed by bus number less EXTERNAL_SPI_BUS.
+    SimBcmSpiClass* m_spi[SIM_SPI_BUSES];
+
+    /// Number of register reads simulated.
+    ULONGLONG m_registerReads;
+
+    /// Number of register writes simulated.
+    ULONGLONG m_registerWrites;
+
+    /// Handles of the threads suspended while a register access is single stepped.
+    std::vector<HANDLE> m_suspendedThreads;
+
+    // Method to suspend the other threads of this process.
+    void _suspendOtherThreads();
+
+    // Method to resume the threads suspended by _suspendOtherThreads().
+    void _resumeOtherThreads();
+
+    // Method to find the controller model that owns an address.
+    SimControllerClass* _findController(ULONG_PTR address);
+
+    // Vectored exception handler used to trap register accesses.
+    static LONG CALLBACK _exceptionHandler(PEXCEPTION_POINTERS exceptionInfo);
+};
+
+/// The global object used to simulate the SOC controllers.
+LIGHTNING_DLL_API extern PeripheralSimulatorClass g_simulator;
+
+#endif  // _PERIPHERAL_SIMULATOR_H_
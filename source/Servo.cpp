@@ -6,6 +6,7 @@
 
 #include "arduino.h"
 #include "Servo.h"
+#include "ServoGroup.h"
 
 
 ///
@@ -16,11 +17,20 @@ Servo::Servo() :
     _max(MAX_PULSE_WIDTH),
     _attachedPin(-1),
     _currentPulseMicroseconds(0),
-    _actualPeriodMicroseconds(0)
+    _actualPeriodMicroseconds(0),
+    _group(nullptr)
 {
 
 }
 
+///
+/// \brief Destroys a servo object, removing it from its servo group
+///
+Servo::~Servo()
+{
+    _leaveGroup();
+}
+
 ///
 /// \brief Attaches a servo instance to a pin
 /// \details This will designate which pin the Servo instance will change.
@@ -33,7 +43,8 @@ void Servo::attach(int pin)
 
 ///
 /// \brief Attaches a servo instance to a pin, specifying pulse width range.
-/// \details This will designate which pin the Servo instance will change.
+/// \details This will designate which pin the Servo instance will change.  A servo that
+///        is in a servo group is removed from the group first.
 /// \param [in] pin - The PWM pin on which to generate the pulse (PWM0 - PWM15)
 /// \param [in] min - The minimum microseconds for servo pulses, range: 0 - (max-1) )
 /// \param [in] max - The maximum microseconds for servo pulses, range: (min+1) - 10000
@@ -49,6 +60,10 @@ void Servo::attach(int pin, int min, int max)
     {
         ThrowError(E_INVALIDARG, "Servo pulse microsecond range specified is invalid");
     }
+
+    // The frame thread of a group uses the pin and pulse range, so don't change them under it.
+    _leaveGroup();
+
     _min = min;
     _max = max;
 
@@ -104,10 +119,11 @@ void Servo::attach(int pin, int min, int max)
 }
 
 ///
-/// \brief Detaches a servo instance from a pin
+/// \brief Detaches a servo instance from a pin, removing it from its servo group
 ///
 void Servo::detach()
 {
+    _leaveGroup();
     _attachedPin = -1;
 }
 
@@ -128,18 +144,7 @@ void Servo::write(int value)
     }
 
     // Value is in degrees from 0-180, convert it to microSeconds
-    if (value <= 0)
-    {
-        pulseMicroseconds = _min;
-    }
-    else if (value >= 180)
-    {
-        pulseMicroseconds = _max;
-    }
-    else
-    {
-        pulseMicroseconds = ( (((_max - _min) * value) + 90) / 180 ) + _min;
-    }
+    pulseMicroseconds = _anglePulse(value);
 
     writeMicroseconds(pulseMicroseconds);
 }
@@ -163,21 +168,10 @@ void Servo::writeMicroseconds(int value)
     }
 
     // Limit the pulse microseconds to the range previously specifed as the min and max.
-    if (value < _min)
-    {
-        pulseMicroseconds = _min;
-    }
-    else if (value > _max)
-    {
-        pulseMicroseconds = _max;
-    }
-    else
-    {
-        pulseMicroseconds = value;
-    }
+    pulseMicroseconds = _limitPulse(value);
 
     // Scale the duty cycle to the range used by the driver (0-0xFFFFFFFF)
-    dutyCycle = (ULONG)(((pulseMicroseconds * 0xFFFFFFFFLL) + (ULONGLONG)(_actualPeriodMicroseconds / 2)) / ((ULONGLONG)_actualPeriodMicroseconds));
+    dutyCycle = _pulseDutyCycle((ULONG)pulseMicroseconds);
 
     // Prepare the pin for PWM use.
     hr = g_pins.setPwmDutyCycle(_attachedPin, (ULONG)dutyCycle);
@@ -187,7 +181,7 @@ void Servo::writeMicroseconds(int value)
     }
 
     // Record the currently set pulse time in microseconds.
-    _currentPulseMicroseconds = (ULONG)pulseMicroseconds;
+    InterlockedExchange(&_currentPulseMicroseconds, (LONG)pulseMicroseconds);
 }
 
 ///
@@ -196,7 +190,78 @@ void Servo::writeMicroseconds(int value)
 int Servo::read()
 {
     int servoDegrees;
-    servoDegrees = (((_currentPulseMicroseconds - _min) * 180) + ((_max - _min) / 2)) / (_max - _min);
+    servoDegrees = (((readMicroseconds() - _min) * 180) + ((_max - _min) / 2)) / (_max - _min);
     return servoDegrees;
 }
 
+///
+/// \brief Removes the servo from its servo group, if it is in one
+/// \details Once this returns the frame thread of the group no longer uses the servo.
+///
+void Servo::_leaveGroup()
+{
+    if (_group != nullptr)
+    {
+        _group->remove(*this);
+    }
+}
+
+///
+/// \brief Converts an angle to a pulse width in the range set when the servo was attached
+/// \param [in] angle - the angle in degrees, range: 0 - 180
+/// \return The pulse width in microseconds
+///
+ULONG Servo::_anglePulse(int angle)
+{
+    ULONG pulseMicroseconds;
+
+    if (angle <= 0)
+    {
+        pulseMicroseconds = _min;
+    }
+    else if (angle >= 180)
+    {
+        pulseMicroseconds = _max;
+    }
+    else
+    {
+        pulseMicroseconds = ( (((_max - _min) * angle) + 90) / 180 ) + _min;
+    }
+
+    return pulseMicroseconds;
+}
+
+///
+/// \brief Limits a pulse width to the range set when the servo was attached
+/// \param [in] value - the desired pulse width in microseconds
+/// \return The pulse width in microseconds, from min to max
+///
+ULONG Servo::_limitPulse(int value)
+{
+    ULONG pulseMicroseconds;
+
+    if (value < _min)
+    {
+        pulseMicroseconds = _min;
+    }
+    else if (value > _max)
+    {
+        pulseMicroseconds = _max;
+    }
+    else
+    {
+        pulseMicroseconds = value;
+    }
+
+    return pulseMicroseconds;
+}
+
+///
+/// \brief Converts a pulse width to a PWM duty cycle at the PWM period of the attached pin
+/// \param [in] pulseMicroseconds - the pulse width in microseconds
+/// \return The duty cycle in the range used by the driver (0-0xFFFFFFFF)
+///
+ULONG Servo::_pulseDutyCycle(ULONG pulseMicroseconds)
+{
+    return (ULONG)((((ULONGLONG)pulseMicroseconds * 0xFFFFFFFFLL) + (ULONGLONG)(_actualPeriodMicroseconds / 2)) / ((ULONGLONG)_actualPeriodMicroseconds));
+}
@@ -2,6 +2,9 @@
 // Licensed under the BSD 2-Clause License.  
 // See License.txt in the project root for license information.
 
+#ifndef _SERVO_H_
+#define _SERVO_H_
+
 #define MIN_PULSE_WIDTH 544
 #define MAX_PULSE_WIDTH 2400
 #define DEFAULT_PULSE_WIDTH 1500
@@ -10,17 +13,32 @@
 // Use a pulse rate of 50 pulses per second to drive servos
 #define SERVO_FREQUENCY_HZ 50
 
+class ServoGroup;
+
 class Servo
 {
 private:
     int _attachedPin;
     int _min;
     int _max;
-    ULONG _currentPulseMicroseconds;
+    // Written by the frame thread of a ServoGroup, so it is only accessed with interlocked operations.
+    volatile LONG _currentPulseMicroseconds;
     ULONG _actualPeriodMicroseconds;
+    // The group the servo is in, or nullptr.  Set and cleared by the group with its lock held.
+    ServoGroup* _group;
+
+    void _leaveGroup();
+    ULONG _anglePulse(int angle);
+    ULONG _limitPulse(int value);
+    ULONG _pulseDutyCycle(ULONG pulseMicroseconds);
+
+    // A ServoGroup drives the pulse width of its servos directly, so it can set many
+    // servos in one PWM chip transaction.
+    friend class ServoGroup;
 
 public:
     Servo();
+    virtual ~Servo();
     void attach(int pin);
     void attach(int pin, int min, int max);
     void detach();
@@ -45,6 +63,7 @@ inline bool Servo::attached()
 /// \return the last pulse width that was set, in microseconds.
 inline ULONG Servo::readMicroseconds()
 {
-    return _currentPulseMicroseconds;
+    return (ULONG)InterlockedCompareExchange(&_currentPulseMicroseconds, 0, 0);
 }
 
+#endif  // _SERVO_H_
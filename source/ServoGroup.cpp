@@ -0,0 +1,491 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#include "pch.h"
+
+#include "arduino.h"
+#include "ServoGroup.h"
+#include "HiResTimer.h"
+
+
+// The fraction of a trapezoidal move spent speeding up, and again slowing down.
+#define TRAPEZOID_RAMP_FRACTION 0.25
+
+///
+/// \brief Creates an empty servo group
+///
+ServoGroup::ServoGroup() :
+    _frameMicroseconds(SERVO_GROUP_DEFAULT_FRAME_US),
+    _frameCount(0),
+    _stopRequested(false),
+    _frameOverruns(0),
+    _frameError(S_OK)
+{
+    InitializeSRWLock(&_lock);
+    QueryPerformanceFrequency(&_frequency);
+}
+
+///
+/// \brief Stops the frame thread, leaving each servo where it is
+///
+ServoGroup::~ServoGroup()
+{
+    end();
+
+    AcquireSRWLockExclusive(&_lock);
+
+    for (ULONG i = 0; i < _servos.size(); i++)
+    {
+        _servos[i].servo->_group = nullptr;
+    }
+    _servos.clear();
+
+    ReleaseSRWLockExclusive(&_lock);
+}
+
+///
+/// \brief Adds a servo to the group
+/// \details The servo must be attached to a pin, and not be in another group.  It stays at
+///        its current position until it is moved with moveTo(), moveToMicroseconds() or
+///        moveAll().
+/// \param [in] servo - The servo to add
+///
+void ServoGroup::add(Servo & servo)
+{
+    SERVO_MOVE move = { 0 };
+
+    if (!servo.attached())
+    {
+        ThrowError(HRESULT_FROM_WIN32(ERROR_INVALID_STATE), "Error adding servo to group, servo is not attached.");
+    }
+
+    AcquireSRWLockExclusive(&_lock);
+
+    if (servo._group != nullptr)
+    {
+        ReleaseSRWLockExclusive(&_lock);
+        ThrowError(E_INVALIDARG, "Servo is already in a group.");
+    }
+
+    if (_servos.size() >= SERVO_GROUP_MAX_SERVOS)
+    {
+        ReleaseSRWLockExclusive(&_lock);
+        ThrowError(E_INVALIDARG, "A servo group can have at most %d servos.", SERVO_GROUP_MAX_SERVOS);
+    }
+
+    move.servo = &servo;
+    move.moving = false;
+    _servos.push_back(move);
+    servo._group = this;
+
+    ReleaseSRWLockExclusive(&_lock);
+}
+
+///
+/// \brief Removes a servo from the group, stopping it where it is
+/// \param [in] servo - The servo to remove
+///
+void ServoGroup::remove(Servo & servo)
+{
+    int index;
+
+    AcquireSRWLockExclusive(&_lock);
+
+    index = _findServo(servo);
+    if (index != -1)
+    {
+        _servos.erase(_servos.begin() + index);
+        servo._group = nullptr;
+    }
+
+    ReleaseSRWLockExclusive(&_lock);
+}
+
+///
+/// \brief Sets the time between position updates
+/// \details Shorter frames give smoother motion but more I2C traffic.  The new interval
+///        is used for moves started after this call.
+/// \param [in] microseconds - The frame interval, range: 5000 - 1000000
+///
+void ServoGroup::setFrameInterval(ULONG microseconds)
+{
+    if ((microseconds < SERVO_GROUP_MIN_FRAME_US) || (microseconds > SERVO_GROUP_MAX_FRAME_US))
+    {
+        ThrowError(E_INVALIDARG, "Servo group frame interval must be from %d to %d microseconds.", SERVO_GROUP_MIN_FRAME_US, SERVO_GROUP_MAX_FRAME_US);
+    }
+
+    if (_thread.joinable())
+    {
+        ThrowError(HRESULT_FROM_WIN32(ERROR_INVALID_STATE), "The frame interval can't be changed while the servo group is running.");
+    }
+
+    _frameMicroseconds = microseconds;
+}
+
+///
+/// \brief Starts the frame thread that moves the servos
+///
+void ServoGroup::begin()
+{
+    if (!_thread.joinable())
+    {
+        _frameOverruns = 0;
+        _frameError = S_OK;
+        _stopRequested = false;
+
+        _thread = std::thread(&ServoGroup::_frameLoop, this);
+    }
+}
+
+///
+/// \brief Stops the frame thread, leaving each servo where it is
+///
+void ServoGroup::end()
+{
+    if (_thread.joinable())
+    {
+        _stopRequested = true;
+        _thread.join();
+    }
+
+    stop();
+}
+
+///
+/// \brief Starts moving a servo to an angle
+/// \param [in] servo - The servo to move, which must be in the group
+/// \param [in] angle - The angle to move to, range: 0 - 180
+/// \param [in] durationMs - The time the move takes, in milliseconds
+/// \param [in] profile - How the speed of the servo changes during the move
+///
+void ServoGroup::moveTo(Servo & servo, int angle, ULONG durationMs, ServoProfile profile)
+{
+    moveToMicroseconds(servo, servo._anglePulse(angle), durationMs, profile);
+}
+
+///
+/// \brief Starts moving a servo to a pulse width
+/// \param [in] servo - The servo to move, which must be in the group
+/// \param [in] value - The pulse width to move to, in microseconds
+/// \param [in] durationMs - The time the move takes, in milliseconds
+/// \param [in] profile - How the speed of the servo changes during the move
+///
+void ServoGroup::moveToMicroseconds(Servo & servo, int value, ULONG durationMs, ServoProfile profile)
+{
+    int index;
+
+    _checkFrameError();
+
+    AcquireSRWLockExclusive(&_lock);
+
+    index = _findServo(servo);
+    if (index != -1)
+    {
+        _startMove(index, value, durationMs, profile);
+    }
+
+    ReleaseSRWLockExclusive(&_lock);
+
+    if (index == -1)
+    {
+        ThrowError(E_INVALIDARG, "Servo is not in the group.");
+    }
+}
+
+///
+/// \brief Starts moving the servos in the group to a set of angles together
+/// \details All the moves start in the same frame and end in the same frame.
+/// \param [in] angles - The angle to move each servo to, in the order the servos were added
+/// \param [in] count - The number of angles, the first count servos are moved
+/// \param [in] durationMs - The time the moves take, in milliseconds
+/// \param [in] profile - How the speed of the servos changes during the moves
+///
+void ServoGroup::moveAll(const int angles[], ULONG count, ULONG durationMs, ServoProfile profile)
+{
+    bool countValid;
+
+    _checkFrameError();
+
+    if (angles == nullptr)
+    {
+        ThrowError(E_POINTER, "No servo angles were specified.");
+    }
+
+    AcquireSRWLockExclusive(&_lock);
+
+    countValid = (count <= _servos.size());
+    for (ULONG i = 0; countValid && (i < count); i++)
+    {
+        _startMove(i, _servos[i].servo->_anglePulse(angles[i]), durationMs, profile);
+    }
+
+    ReleaseSRWLockExclusive(&_lock);
+
+    if (!countValid)
+    {
+        ThrowError(E_INVALIDARG, "More angles were specified than there are servos in the group.");
+    }
+}
+
+///
+/// \brief Stops all the servos in the group where they are
+///
+void ServoGroup::stop()
+{
+    AcquireSRWLockExclusive(&_lock);
+
+    for (ULONG i = 0; i < _servos.size(); i++)
+    {
+        _servos[i].moving = false;
+    }
+
+    ReleaseSRWLockExclusive(&_lock);
+}
+
+///
+/// \brief Determines if any servo in the group is moving
+/// \return True if a move is in progress, False otherwise.
+///
+bool ServoGroup::moving()
+{
+    bool anyMoving = false;
+
+    _checkFrameError();
+
+    AcquireSRWLockExclusive(&_lock);
+
+    for (ULONG i = 0; !anyMoving && (i < _servos.size()); i++)
+    {
+        anyMoving = _servos[i].moving;
+    }
+
+    ReleaseSRWLockExclusive(&_lock);
+
+    return anyMoving;
+}
+
+///
+/// \brief Waits until all the servos in the group have reached their targets
+///
+void ServoGroup::waitForMoves()
+{
+    if (!_thread.joinable())
+    {
+        ThrowError(HRESULT_FROM_WIN32(ERROR_INVALID_STATE), "The servo group has not been started.");
+    }
+
+    while (moving())
+    {
+        Sleep(_frameMicroseconds / 1000);
+    }
+}
+
+///
+/// \brief Finds a servo in the group, called with the lock held
+/// \param [in] servo - The servo to find
+/// \return The index of the servo in the group, or -1 if the servo is not in the group.
+///
+int ServoGroup::_findServo(Servo & servo)
+{
+    int index = -1;
+
+    for (ULONG i = 0; (index == -1) && (i < _servos.size()); i++)
+    {
+        if (_servos[i].servo == &servo)
+        {
+            index = i;
+        }
+    }
+
+    return index;
+}
+
+///
+/// \brief Sets up the move of a servo, called with the lock held
+/// \details The move starts at the pulse width last set for the servo, or jumps straight
+///        to the target if no pulse width has been set yet.
+/// \param [in] index - The index of the servo in the group
+/// \param [in] pulseMicroseconds - The pulse width to move to, in microseconds
+/// \param [in] durationMs - The time the move takes, in milliseconds
+/// \param [in] profile - How the speed of the servo changes during the move
+///
+void ServoGroup::_startMove(ULONG index, int pulseMicroseconds, ULONG durationMs, ServoProfile profile)
+{
+    SERVO_MOVE & move = _servos[index];
+    ULONGLONG frames;
+
+    move.targetMicroseconds = move.servo->_limitPulse(pulseMicroseconds);
+    move.startMicroseconds = move.servo->readMicroseconds();
+    if (move.startMicroseconds == 0)
+    {
+        move.startMicroseconds = move.targetMicroseconds;
+    }
+
+    frames = (((ULONGLONG)durationMs * 1000) + (_frameMicroseconds / 2)) / _frameMicroseconds;
+    move.frames = (frames == 0) ? 1 : (ULONG)frames;
+    move.startFrame = _frameCount;
+    move.profile = profile;
+    move.moving = true;
+}
+
+///
+/// \brief Works out how far through a move a servo is
+/// \param [in] profile - The speed profile of the move
+/// \param [in] fraction - The fraction of the move time that has passed, range: 0 - 1
+/// \return The fraction of the distance moved, range: 0 - 1
+///
+double ServoGroup::_profilePosition(ServoProfile profile, double fraction)
+{
+    const double ramp = TRAPEZOID_RAMP_FRACTION;
+    const double cruiseSpeed = 1.0 / (1.0 - ramp);
+    double position;
+
+    switch (profile)
+    {
+    case SERVO_PROFILE_EASE:
+        position = (1.0 - cos(fraction * PI)) / 2.0;
+        break;
+
+    case SERVO_PROFILE_TRAPEZOIDAL:
+        if (fraction < ramp)
+        {
+            position = (cruiseSpeed * fraction * fraction) / (2.0 * ramp);
+        }
+        else if (fraction <= (1.0 - ramp))
+        {
+            position = cruiseSpeed * (fraction - (ramp / 2.0));
+        }
+        else
+        {
+            position = 1.0 - ((cruiseSpeed * (1.0 - fraction) * (1.0 - fraction)) / (2.0 * ramp));
+        }
+        break;
+
+    default:
+        position = fraction;
+    }
+
+    return position;
+}
+
+///
+/// \brief Reports an error the frame thread had setting servo positions
+///
+void ServoGroup::_checkFrameError()
+{
+    HRESULT hr = _frameError;
+
+    if (FAILED(hr))
+    {
+        _frameError = S_OK;
+        ThrowError(hr, "Error occurred setting servo positions, Error: %08x", hr);
+    }
+}
+
+///
+/// \brief The frame thread
+/// \details Each frame the position of every moving servo is worked out from the number
+///        of frames since its move started, and the pulse widths of all of them are set
+///        with one call.  Missed frames are skipped rather than made up, so a move that
+///        falls behind catches up and still ends on time.
+///
+void ServoGroup::_frameLoop()
+{
+    ULONG pins[SERVO_GROUP_MAX_SERVOS];
+    ULONG dutyCycles[SERVO_GROUP_MAX_SERVOS];
+    ULONG count;
+    ULONG elapsed;
+    ULONG pulseMicroseconds;
+    double position;
+    LONGLONG frameTicks;
+    LONGLONG frameStart;
+    LONGLONG lateTicks;
+    LONGLONG skipped;
+    LARGE_INTEGER nowTicks;
+    HRESULT hr;
+
+    // Keep Sleep() at 1 ms resolution while the thread runs.
+    TimerResolutionClass timerResolution;
+
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+    frameTicks = ((LONGLONG)_frameMicroseconds * _frequency.QuadPart) / 1000000LL;
+
+    QueryPerformanceCounter(&nowTicks);
+    frameStart = nowTicks.QuadPart;
+
+    while (!_stopRequested)
+    {
+        count = 0;
+
+        AcquireSRWLockExclusive(&_lock);
+
+        _frameCount++;
+
+        for (ULONG i = 0; i < _servos.size(); i++)
+        {
+            SERVO_MOVE & move = _servos[i];
+
+            // Servos leave the group before they are detached, so the pin is valid here.
+            if (move.moving)
+            {
+                elapsed = move.frames;
+                if ((_frameCount - move.startFrame) < move.frames)
+                {
+                    elapsed = (ULONG)(_frameCount - move.startFrame);
+                }
+                position = _profilePosition(move.profile, (double)elapsed / (double)move.frames);
+                pulseMicroseconds = (ULONG)((LONG)move.startMicroseconds +
+                    (LONG)floor((((double)move.targetMicroseconds - (double)move.startMicroseconds) * position) + 0.5));
+
+                pins[count] = move.servo->_attachedPin;
+                dutyCycles[count] = move.servo->_pulseDutyCycle(pulseMicroseconds);
+                count++;
+
+                InterlockedExchange(&move.servo->_currentPulseMicroseconds, (LONG)pulseMicroseconds);
+                if (elapsed == move.frames)
+                {
+                    move.moving = false;
+                }
+            }
+        }
+
+        ReleaseSRWLockExclusive(&_lock);
+
+        if (count > 0)
+        {
+            hr = g_pins.setPwmDutyCycles(pins, dutyCycles, count);
+            if (FAILED(hr))
+            {
+                _frameError = hr;
+                stop();
+            }
+        }
+
+        frameStart = frameStart + frameTicks;
+
+        QueryPerformanceCounter(&nowTicks);
+        lateTicks = nowTicks.QuadPart - frameStart;
+        if (lateTicks >= 0)
+        {
+            // This frame ran into the next one.
+            _frameOverruns = _frameOverruns + 1;
+
+            if (lateTicks >= frameTicks)
+            {
+                // Skip the frames that are already over, so the moves still end on time.
+                skipped = lateTicks / frameTicks;
+                _frameOverruns = _frameOverruns + (ULONG)skipped;
+
+                AcquireSRWLockExclusive(&_lock);
+                _frameCount = _frameCount + skipped;
+                ReleaseSRWLockExclusive(&_lock);
+
+                frameStart = frameStart + (skipped * frameTicks);
+            }
+        }
+
+        HiResTimerClass::WaitUntil(frameStart, _stopRequested);
+    }
+}
@@ -0,0 +1,97 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#ifndef _SERVO_GROUP_H_
+#define _SERVO_GROUP_H_
+
+#include <thread>
+#include <vector>
+
+#include "Servo.h"
+
+// The most servos one group can move.
+#define SERVO_GROUP_MAX_SERVOS 32
+
+// The default time between position updates, one servo pulse period.
+#define SERVO_GROUP_DEFAULT_FRAME_US REFRESH_INTERVAL
+
+// The shortest and longest times between position updates.
+#define SERVO_GROUP_MIN_FRAME_US 5000
+#define SERVO_GROUP_MAX_FRAME_US 1000000
+
+// The ways a servo can move from its current position to its target position.
+enum ServoProfile
+{
+    SERVO_PROFILE_LINEAR,           ///< Constant speed for the whole move
+    SERVO_PROFILE_EASE,             ///< Speed follows a half cosine, starting and stopping smoothly
+    SERVO_PROFILE_TRAPEZOIDAL       ///< Constant acceleration for the first and last quarter of the move
+};
+
+//
+// Class used to move several servos together.
+//
+// A frame thread works out the position of every servo that is moving once each frame,
+// and sets the pulse widths of all of them with one call to setPwmDutyCycles(), so the
+// servos on each PWM chip are updated with a single I2C transaction and move without skew.
+// Moves started with one call to moveAll() begin in the same frame.  If the thread falls
+// behind, the frames it missed are counted as overruns, and the moves still end on time.
+// A servo that is in a group should not be written with Servo::write() while it is moving.
+// A servo can be in only one group, and leaves it when it is detached, attached again or
+// destroyed.
+//
+class ServoGroup
+{
+private:
+    typedef struct _SERVO_MOVE {
+        Servo* servo;               ///< The servo
+        bool moving;                ///< True while the servo is moving to its target
+        ServoProfile profile;       ///< The speed profile of the move
+        ULONG startMicroseconds;    ///< The pulse width at the start of the move
+        ULONG targetMicroseconds;   ///< The pulse width at the end of the move
+        ULONGLONG startFrame;       ///< The frame before the first frame of the move
+        ULONG frames;               ///< The number of frames the move takes
+    } SERVO_MOVE;
+
+    std::vector<SERVO_MOVE> _servos;
+    ULONG _frameMicroseconds;
+    ULONGLONG _frameCount;
+    LARGE_INTEGER _frequency;
+    SRWLOCK _lock;
+    std::thread _thread;
+    volatile bool _stopRequested;
+    volatile ULONG _frameOverruns;
+    volatile HRESULT _frameError;
+
+    int _findServo(Servo & servo);
+    void _startMove(ULONG index, int pulseMicroseconds, ULONG durationMs, ServoProfile profile);
+    double _profilePosition(ServoProfile profile, double fraction);
+    void _checkFrameError();
+    void _frameLoop();
+
+public:
+    ServoGroup();
+    virtual ~ServoGroup();
+    void add(Servo & servo);
+    void remove(Servo & servo);
+    void setFrameInterval(ULONG microseconds);
+    void begin();
+    void end();
+    void moveTo(Servo & servo, int angle, ULONG durationMs, ServoProfile profile = SERVO_PROFILE_TRAPEZOIDAL);
+    void moveToMicroseconds(Servo & servo, int value, ULONG durationMs, ServoProfile profile = SERVO_PROFILE_TRAPEZOIDAL);
+    void moveAll(const int angles[], ULONG count, ULONG durationMs, ServoProfile profile = SERVO_PROFILE_TRAPEZOIDAL);
+    void stop();
+    bool moving();
+    void waitForMoves();
+    inline ULONG frameOverruns();
+
+};
+
+/// Get the number of frames the frame thread missed because it fell behind.
+/// \return the number of frames missed since begin() was called.
+inline ULONG ServoGroup::frameOverruns()
+{
+    return _frameOverruns;
+}
+
+#endif  // _SERVO_GROUP_H_
@@ -0,0 +1,574 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#include "pch.h"
+
+#include <algorithm>
+
+#include "SimulatedDevices.h"
+#include "ErrorCodes.h"
+
+// Time taken by an EEPROM write cycle.
+#define SIM_EEPROM_WRITE_CYCLE_NS 5000000ULL
+
+//
+// SimPCA9685Device methods.
+//
+
+// Constructor.
+SimPCA9685Device::SimPCA9685Device() :
+    m_pointer(0),
+    m_addressNext(FALSE)
+{
+    // Power-on register values.
+    ZeroMemory(m_registers, sizeof(m_registers));
+    m_registers[MODE1] = 0x11;
+    m_registers[MODE2] = 0x04;
+    m_registers[PRE_SCALE] = 0x1E;
+    for (ULONG i = 0; i < 16; i++)
+    {
+        m_registers[LED0_ON_L + (4 * i) + 3] = 0x10;    // Full OFF
+    }
+}
+
+BOOL SimPCA9685Device::start(BOOL read)
+{
+    // The first byte of a write is the register address.
+    m_addressNext = !read;
+    return TRUE;
+}
+
+BOOL SimPCA9685Device::writeByte(UCHAR data)
+{
+    if (m_addressNext)
+    {
+        m_pointer = data;
+        m_addressNext = FALSE;
+    }
+    else
+    {
+        _writeRegister(m_pointer, data);
+        _advancePointer();
+    }
+    return TRUE;
+}
+
+UCHAR SimPCA9685Device::readByte()
+{
+    UCHAR value = 0;
+
+    // The ALL_LED registers read as zero.
+    if ((m_pointer < ALL_LED_ON_L) || (m_pointer > ALL_LED_OFF_H))
+    {
+        value = m_registers[m_pointer];
+    }
+    _advancePointer();
+
+    return value;
+}
+
+/**
+\param[in] channel The PWM channel (0-15).
+\param[out] onCount The ON count, including the full ON bit (0x1000).
+\param[out] offCount The OFF count, including the full OFF bit (0x1000).
+\return HRESULT success or error code.
+*/
+HRESULT SimPCA9685Device::getChannel(ULONG channel, ULONG & onCount, ULONG & offCount)
+{
+    HRESULT hr = S_OK;
+    ULONG base = LED0_ON_L + (4 * channel);
+
+    if (channel >= 16)
+    {
+        hr = DMAP_E_PIN_NUMBER_TOO_LARGE_FOR_BOARD;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        onCount = m_registers[base] | ((m_registers[base + 1] & 0x1F) << 8);
+        offCount = m_registers[base + 2] | ((m_registers[base + 3] & 0x1F) << 8);
+    }
+
+    return hr;
+}
+
+// Method to write a value to a register.
+void SimPCA9685Device::_writeRegister(UCHAR regAdr, UCHAR value)
+{
+    if (regAdr == MODE1)
+    {
+        // Writing 1 to RESTART clears it.
+        m_registers[MODE1] = value & 0x7F;
+    }
+    else if (regAdr == PRE_SCALE)
+    {
+        // The prescaler can only be changed while the oscillator is off.
+        if (isSleeping())
+        {
+            m_registers[PRE_SCALE] = (value < 3) ? 3 : value;
+        }
+    }
+    else if ((regAdr >= ALL_LED_ON_L) && (regAdr <= ALL_LED_OFF_H))
+    {
+        // The ALL_LED registers write the same register of every channel.
+        for (ULONG i = 0; i < 16; i++)
+        {
+            m_registers[LED0_ON_L + (4 * i) + (regAdr - ALL_LED_ON_L)] = value;
+        }
+    }
+    else
+    {
+        m_registers[regAdr] = value;
+    }
+}
+
+// Method to advance the register address pointer after an access.
+void SimPCA9685Device::_advancePointer()
+{
+    // The pointer only moves if auto-increment (MODE1 AI bit) is set.
+    if ((m_registers[MODE1] & 0x20) != 0)
+    {
+        if (m_pointer == LED15_OFF_H)
+        {
+            m_pointer = MODE1;
+        }
+        else
+        {
+            m_pointer++;    // Wraps from 0xFF to 0x00
+        }
+    }
+}
+
+//
+// SimADS1015Device methods.
+//
+
+// Constructor.
+SimADS1015Device::SimADS1015Device() :
+    m_pointer(0),
+    m_conversion(0),
+    m_config(0x8583),
+    m_loThresh(0x8000),
+    m_hiThresh(0x7FFF),
+    m_converting(FALSE),
+    m_conversionDoneTicks(0),
+    m_byteCount(0),
+    m_value(0)
+{
+    ZeroMemory(m_inputs, sizeof(m_inputs));
+}
+
+BOOL SimADS1015Device::start(BOOL read)
+{
+    m_byteCount = 0;
+    if (read)
+    {
+        m_value = _readRegister(m_pointer);
+    }
+    return TRUE;
+}
+
+BOOL SimADS1015Device::writeByte(UCHAR data)
+{
+    // The first byte is the register pointer, followed by the register value MSB first.
+    if (m_byteCount == 0)
+    {
+        m_pointer = data & 0x3;
+    }
+    else if (m_byteCount == 1)
+    {
+        m_value = data;
+    }
+    else if (m_byteCount == 2)
+    {
+        _writeRegister(m_pointer, (m_value << 8) | data);
+    }
+    m_byteCount++;
+
+    return TRUE;
+}
+
+UCHAR SimADS1015Device::readByte()
+{
+    UCHAR value = 0;
+
+    // The register value is sent MSB first, and repeats if more bytes are read.
+    if ((m_byteCount % 2) == 0)
+    {
+        value = (UCHAR)(m_value >> 8);
+    }
+    else
+    {
+        value = (UCHAR)m_value;
+    }
+    m_byteCount++;
+
+    return value;
+}
+
+/**
+\param[in] channel The analog input (AIN0-AIN3).
+\param[in] volts The voltage on the input.
+\return HRESULT success or error code.
+*/
+HRESULT SimADS1015Device::setInputVoltage(ULONG channel, double volts)
+{
+    HRESULT hr = S_OK;
+
+    if (channel >= ARRAYSIZE(m_inputs))
+    {
+        hr = DMAP_E_ADC_DOES_NOT_HAVE_REQUESTED_CHANNEL;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_inputs[channel] = volts;
+    }
+
+    return hr;
+}
+
+// Method to get the value of a register.
+ULONG SimADS1015Device::_readRegister(ULONG regAdr)
+{
+    ULONG value = 0;
+
+    _update();
+
+    switch (regAdr)
+    {
+    case 0:
+        value = m_conversion;
+        break;
+    case 1:
+        // OS reads 0 while a conversion is in progress.
+        value = m_converting ? (m_config & ~0x8000UL) : (m_config | 0x8000);
+        break;
+    case 2:
+        value = m_loThresh;
+        break;
+    case 3:
+        value = m_hiThresh;
+        break;
+    }
+
+    return value;
+}
+
+// Method to set the value of a register.
+void SimADS1015Device::_writeRegister(ULONG regAdr, ULONG value)
+{
+    // Conversion times for each data rate setting, in microseconds.
+    static const ULONG conversionUs[] = { 7813, 4000, 2041, 1087, 625, 417, 304, 304 };
+
+    _update();
+
+    if (regAdr == 1)
+    {
+        m_config = value & 0x7FFF;
+
+        // Writing OS = 1 in single-shot mode starts a conversion.
+        if (((value & 0x8000) != 0) && ((value & 0x0100) != 0))
+        {
+            m_converting = TRUE;
+            m_conversionDoneTicks = g_simulator.getTicks() +
+                g_simulator.nsToTicks(conversionUs[(m_config >> 5) & 0x7] * 1000ULL);
+            _update();
+        }
+    }
+    else if (regAdr == 2)
+    {
+        m_loThresh = value;
+    }
+    else if (regAdr == 3)
+    {
+        m_hiThresh = value;
+    }
+}
+
+// Method to bring the conversion register up to date.
+void SimADS1015Device::_update()
+{
+    if (m_converting)
+    {
+        if (!g_simulator.isTimingEnabled() || (g_simulator.getTicks() >= m_conversionDoneTicks))
+        {
+            m_conversion = _convert();
+            m_converting = FALSE;
+        }
+    }
+    else if ((m_config & 0x0100) == 0)
+    {
+        // In continuous mode the latest conversion reflects the current inputs.
+        m_conversion = _convert();
+    }
+}
+
+// Method to perform a conversion with the current configuration.
+ULONG SimADS1015Device::_convert()
+{
+    // Full scale range for each PGA setting, in volts.
+    static const double fullScale[] = { 6.144, 4.096, 2.048, 1.024, 0.512, 0.256, 0.256, 0.256 };
+    ULONG mux = (m_config >> 12) & 0x7;
+    double volts = 0.0;
+    LONG code = 0;
+
+    switch (mux)
+    {
+    case 0:
+        volts = m_inputs[0] - m_inputs[1];
+        break;
+    case 1:
+        volts = m_inputs[0] - m_inputs[3];
+        break;
+    case 2:
+        volts = m_inputs[1] - m_inputs[3];
+        break;
+    case 3:
+        volts = m_inputs[2] - m_inputs[3];
+        break;
+    default:
+        volts = m_inputs[mux - 4];
+        break;
+    }
+
+    code = (LONG)((volts * 2048.0) / fullScale[(m_config >> 9) & 0x7]);
+    if (code > 2047)
+    {
+        code = 2047;
+    }
+    else if (code < -2048)
+    {
+        code = -2048;
+    }
+
+    // The 12-bit result is left justified in the 16-bit register.
+    return ((ULONG)code << 4) & 0xFFFF;
+}
+
+//
+// SimMCP3008Device methods.
+//
+
+// Constructor.
+SimMCP3008Device::SimMCP3008Device() :
+    m_clock(0),
+    m_config(0),
+    m_result(0),
+    m_conversions(0)
+{
+    ZeroMemory(m_values, sizeof(m_values));
+}
+
+void SimMCP3008Device::select()
+{
+    m_clock = 0;
+}
+
+UCHAR SimMCP3008Device::transferByte(UCHAR dataOut)
+{
+    ULONG dataIn = 0;
+
+    for (LONG bit = 7; bit >= 0; bit--)
+    {
+        dataIn = (dataIn << 1) | _clockBit((dataOut >> bit) & 0x1);
+    }
+
+    return (UCHAR)dataIn;
+}
+
+void SimMCP3008Device::deselect()
+{
+    m_clock = 0;
+}
+
+/**
+\param[in] channel The analog input (CH0-CH7).
+\param[in] value The value the input converts to (0-1023).
+\return HRESULT success or error code.
+*/
+HRESULT SimMCP3008Device::setChannelValue(ULONG channel, ULONG value)
+{
+    HRESULT hr = S_OK;
+
+    if (channel >= ARRAYSIZE(m_values))
+    {
+        hr = DMAP_E_ADC_DOES_NOT_HAVE_REQUESTED_CHANNEL;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_values[channel] = (value > 1023) ? 1023 : value;
+    }
+
+    return hr;
+}
+
+/**
+The bit returned is the bit the master samples on the rising clock edge that clocks in
+the bit passed in.
+\param[in] dataIn The bit shifted in to the device.
+\return The bit shifted out of the device.
+*/
+ULONG SimMCP3008Device::_clockBit(ULONG dataIn)
+{
+    ULONG dataOut = 0;
+    ULONG channel = 0;
+    LONG positive = 0;
+    LONG negative = 0;
+
+    if (m_clock == 0)
+    {
+        // Waiting for the start bit.
+        if (dataIn != 0)
+        {
+            m_clock = 1;
+            m_config = 0;
+        }
+    }
+    else
+    {
+        if (m_clock <= 4)
+        {
+            // SGL/DIFF, D2, D1 and D0.
+            m_config = (m_config << 1) | dataIn;
+        }
+        else if (m_clock == 5)
+        {
+            // The input is sampled, then the conversion starts.
+            channel = m_config & 0x7;
+            if ((m_config & 0x8) != 0)
+            {
+                m_result = m_values[channel];
+            }
+            else
+            {
+                positive = m_values[channel];
+                negative = m_values[channel ^ 0x1];
+                m_result = (positive > negative) ? (positive - negative) : 0;
+            }
+            m_conversions++;
+        }
+        else if ((m_clock >= 7) && (m_clock <= 16))
+        {
+            // The result MSB first, after the null bit.
+            dataOut = (m_result >> (16 - m_clock)) & 0x1;
+        }
+        else if ((m_clock >= 17) && (m_clock <= 25))
+        {
+            // The result LSB first, sharing the LSB sent above.
+            dataOut = (m_result >> (m_clock - 16)) & 0x1;
+        }
+
+        m_clock++;
+
+        // After the whole result has been sent, look for another start bit.
+        if (m_clock > 26)
+        {
+            m_clock = 0;
+        }
+    }
+
+    return dataOut;
+}
+
+//
+// Sim24CxxEepromDevice methods.
+//
+
+/**
+\param[in] sizeBytes The size of the memory in bytes.
+\param[in] pageBytes The size of a write page in bytes.
+*/
+Sim24CxxEepromDevice::Sim24CxxEepromDevice(ULONG sizeBytes, ULONG pageBytes) :
+    m_memory(sizeBytes, 0xFF),
+    m_pageBytes(pageBytes),
+    m_addressBytes((sizeBytes > 256) ? 2 : 1),
+    m_address(0),
+    m_addressCount(0),
+    m_writing(FALSE),
+    m_pageData(pageBytes, 0),
+    m_pageWritten(pageBytes, FALSE),
+    m_pageAddress(0),
+    m_dataCount(0),
+    m_busyUntilTicks(0),
+    m_writeCycles(0)
+{
+}
+
+BOOL Sim24CxxEepromDevice::start(BOOL read)
+{
+    BOOL ack = TRUE;
+
+    // The device does not respond during a write cycle.
+    if (g_simulator.isTimingEnabled() && (g_simulator.getTicks() < m_busyUntilTicks))
+    {
+        ack = FALSE;
+    }
+
+    if (ack)
+    {
+        m_writing = !read;
+        m_addressCount = 0;
+        m_dataCount = 0;
+    }
+
+    return ack;
+}
+
+BOOL Sim24CxxEepromDevice::writeByte(UCHAR data)
+{
+    if (m_addressCount < m_addressBytes)
+    {
+        // Memory address bytes, MSB first.
+        if (m_addressCount == 0)
+        {
+            m_address = 0;
+        }
+        m_address = ((m_address << 8) | data) % getSize();
+        m_addressCount++;
+
+        m_pageAddress = m_address - (m_address % m_pageBytes);
+        std::fill(m_pageWritten.begin(), m_pageWritten.end(), FALSE);
+    }
+    else
+    {
+        // Data bytes go to the page buffer, wrapping within the page.
+        m_pageData[m_address % m_pageBytes] = data;
+        m_pageWritten[m_address % m_pageBytes] = TRUE;
+        m_address = m_pageAddress + (((m_address % m_pageBytes) + 1) % m_pageBytes);
+        m_dataCount++;
+    }
+
+    return TRUE;
+}
+
+UCHAR Sim24CxxEepromDevice::readByte()
+{
+    UCHAR data = m_memory[m_address];
+
+    m_address = (m_address + 1) % getSize();
+
+    return data;
+}
+
+void Sim24CxxEepromDevice::stop()
+{
+    // A STOP after data has been written starts the write cycle.
+    if (m_writing && (m_dataCount > 0))
+    {
+        for (ULONG i = 0; i < m_pageBytes; i++)
+        {
+            if (m_pageWritten[i] && ((m_pageAddress + i) < getSize()))
+            {
+                m_memory[m_pageAddress + i] = m_pageData[i];
+            }
+        }
+        m_busyUntilTicks = g_simulator.getTicks() + g_simulator.nsToTicks(SIM_EEPROM_WRITE_CYCLE_NS);
+        m_writeCycles++;
+    }
+
+    m_writing = FALSE;
+    m_dataCount = 0;
+}
@@ -0,0 +1,280 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#ifndef _SIMULATED_DEVICES_H_
+#define _SIMULATED_DEVICES_H_
+
+#include <Windows.h>
+#include <vector>
+
+#include "PeripheralSimulator.h"
+
+//
+// Model of a PCA9685 16-channel PWM controller, for use with the peripheral simulator.
+//
+class SimPCA9685Device : public SimI2cDeviceClass
+{
+public:
+    LIGHTNING_DLL_API SimPCA9685Device();
+
+    virtual ~SimPCA9685Device()
+    {
+    }
+
+    BOOL start(BOOL read) override;
+    BOOL writeByte(UCHAR data) override;
+    UCHAR readByte() override;
+
+    // Method to get the on and off counts programmed for a channel.
+    LIGHTNING_DLL_API HRESULT getChannel(ULONG channel, ULONG & onCount, ULONG & offCount);
+
+    /// Method to get the contents of a register.
+    UCHAR getRegister(ULONG regAdr)
+    {
+        return m_registers[regAdr & 0xFF];
+    }
+
+    /// Method to get the PWM frequency prescaler value.
+    ULONG getPrescale()
+    {
+        return m_registers[PRE_SCALE];
+    }
+
+    /// Method to get the PWM output frequency in Hz, using the internal oscillator.
+    ULONG getOutputFrequency()
+    {
+        return 25000000 / (4096 * (getPrescale() + 1));
+    }
+
+    /// Method to determine whether the oscillator is off (MODE1 SLEEP bit set).
+    BOOL isSleeping()
+    {
+        return (m_registers[MODE1] & 0x10) != 0;
+    }
+
+private:
+
+    /// Register addresses.
+    enum {
+        MODE1 = 0x00,
+        MODE2 = 0x01,
+        LED0_ON_L = 0x06,
+        LED15_OFF_H = 0x45,
+        ALL_LED_ON_L = 0xFA,
+        ALL_LED_OFF_H = 0xFD,
+        PRE_SCALE = 0xFE
+    };
+
+    /// The register contents.
+    UCHAR m_registers[256];
+
+    /// The register address pointer.
+    UCHAR m_pointer;
+
+    /// TRUE if the next byte written is the register address.
+    BOOL m_addressNext;
+
+    // Method to write a value to a register.
+    void _writeRegister(UCHAR regAdr, UCHAR value);
+
+    // Method to advance the register address pointer after an access.
+    void _advancePointer();
+};
+
+//
+// Model of an ADS1015 12-bit ADC, for use with the peripheral simulator.
+//
+// Single-shot conversions take the time set by the programmed data rate (when simulator
+// timing is enabled).  In continuous mode the conversion register tracks the inputs.
+//
+class SimADS1015Device : public SimI2cDeviceClass
+{
+public:
+    LIGHTNING_DLL_API SimADS1015Device();
+
+    virtual ~SimADS1015Device()
+    {
+    }
+
+    BOOL start(BOOL read) override;
+    BOOL writeByte(UCHAR data) override;
+    UCHAR readByte() override;
+
+    // Method to set the voltage on an analog input.
+    LIGHTNING_DLL_API HRESULT setInputVoltage(ULONG channel, double volts);
+
+    /// Method to get the contents of the config register.
+    ULONG getConfig()
+    {
+        return m_config;
+    }
+
+private:
+
+    /// The voltage on each analog input.
+    double m_inputs[4];
+
+    /// The register address pointer.
+    ULONG m_pointer;
+
+    /// The register contents.
+    ULONG m_conversion;
+    ULONG m_config;
+    ULONG m_loThresh;
+    ULONG m_hiThresh;
+
+    /// TRUE while a single-shot conversion is in progress, and when it will be done.
+    BOOL m_converting;
+    LONGLONG m_conversionDoneTicks;
+
+    /// Number of bytes written or read since the last START.
+    ULONG m_byteCount;
+
+    /// The first byte of a register value being written, or the register value being read.
+    ULONG m_value;
+
+    // Method to get the value of a register.
+    ULONG _readRegister(ULONG regAdr);
+
+    // Method to set the value of a register.
+    void _writeRegister(ULONG regAdr, ULONG value);
+
+    // Method to bring the conversion register up to date.
+    void _update();
+
+    // Method to perform a conversion with the current configuration.
+    ULONG _convert();
+};
+
+//
+// Model of an MCP3008 8-channel 10-bit ADC, for use with the peripheral simulator.
+//
+// The model works bit by bit as described in the data sheet: it waits for a start bit,
+// takes the SGL/DIFF and channel select bits, outputs a null bit and then the result MSB
+// first followed by the result LSB first.  The conversion is reset when the device is
+// deselected, or after the full result has been sent.
+//
+class SimMCP3008Device : public SimSpiDeviceClass
+{
+public:
+    LIGHTNING_DLL_API SimMCP3008Device();
+
+    virtual ~SimMCP3008Device()
+    {
+    }
+
+    void select() override;
+    UCHAR transferByte(UCHAR dataOut) override;
+    void deselect() override;
+
+    // Method to set the value an input converts to.
+    LIGHTNING_DLL_API HRESULT setChannelValue(ULONG channel, ULONG value);
+
+    /// Method to get the number of conversions performed.
+    ULONG getConversionCount()
+    {
+        return m_conversions;
+    }
+
+private:
+
+    /// The value each input converts to (0-1023).
+    ULONG m_values[8];
+
+    /// Number of clocks since the start bit, 0 while waiting for a start bit.
+    ULONG m_clock;
+
+    /// The SGL/DIFF and channel select bits received.
+    ULONG m_config;
+
+    /// The result of the conversion in progress.
+    ULONG m_result;
+
+    /// Number of conversions performed.
+    ULONG m_conversions;
+
+    // Method to clock one bit through the device.
+    ULONG _clockBit(ULONG dataIn);
+};
+
+//
+// Model of a 24Cxx I2C serial EEPROM, for use with the peripheral simulator.
+//
+// Writes are buffered a page at a time, wrapping within the page, and are committed at
+// the STOP.  After a write the device does not acknowledge its address until the write
+// cycle is complete (when simulator timing is enabled).  Reads continue sequentially,
+// wrapping at the end of the memory.  Parts that take memory address bits from the slave
+// address (24C04 through 24C16) are not modeled.
+//
+class Sim24CxxEepromDevice : public SimI2cDeviceClass
+{
+public:
+    // Constructor.
+    LIGHTNING_DLL_API Sim24CxxEepromDevice(ULONG sizeBytes, ULONG pageBytes);
+
+    virtual ~Sim24CxxEepromDevice()
+    {
+    }
+
+    BOOL start(BOOL read) override;
+    BOOL writeByte(UCHAR data) override;
+    UCHAR readByte() override;
+    void stop() override;
+
+    /// Method to get the memory contents.
+    PUCHAR getMemory()
+    {
+        return m_memory.data();
+    }
+
+    /// Method to get the size of the memory in bytes.
+    ULONG getSize()
+    {
+        return (ULONG)m_memory.size();
+    }
+
+    /// Method to get the number of write cycles performed.
+    ULONG getWriteCycles()
+    {
+        return m_writeCycles;
+    }
+
+private:
+
+    /// The memory contents.
+    std::vector<UCHAR> m_memory;
+
+    /// The write page size in bytes.
+    ULONG m_pageBytes;
+
+    /// Number of memory address bytes sent at the start of a write.
+    ULONG m_addressBytes;
+
+    /// The current memory address.
+    ULONG m_address;
+
+    /// Number of memory address bytes received since the last START.
+    ULONG m_addressCount;
+
+    /// TRUE if the transfer in progress is a write.
+    BOOL m_writing;
+
+    /// The data written to the current page, and which bytes of the page were written.
+    std::vector<UCHAR> m_pageData;
+    std::vector<BOOL> m_pageWritten;
+
+    /// The address of the page being written.
+    ULONG m_pageAddress;
+
+    /// Number of data bytes written since the last START.
+    ULONG m_dataCount;
+
+    /// When the write cycle in progress will be complete.
+    LONGLONG m_busyUntilTicks;
+
+    /// Number of write cycles performed.
+    ULONG m_writeCycles;
+};
+
+#endif  // _SIMULATED_DEVICES_H_
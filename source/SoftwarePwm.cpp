@@ -0,0 +1,551 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#include "pch.h"
+
+#include <algorithm>
+
+#include "SoftwarePwm.h"
+#include "BoardPins.h"
+#include "ErrorCodes.h"
+#include "HiResTimer.h"
+
+// Constructor.
+SoftwarePwmClass::SoftwarePwmClass() :
+    m_frequencyHz(0),
+    m_periodTicks(0),
+    m_scheduleChanged(FALSE),
+    m_threadPriority(THREAD_PRIORITY_TIME_CRITICAL),
+    m_missedPeriods(0),
+    m_stopRequested(FALSE)
+{
+    ZeroMemory(m_pins, sizeof(m_pins));
+    ZeroMemory(&m_parkEdge, sizeof(m_parkEdge));
+    InitializeSRWLock(&m_lock);
+    QueryPerformanceFrequency(&m_frequency);
+}
+
+/**
+The PWM frequency must have been set with setFrequency() before the thread is started.
+If the thread is already running, only its priority is changed.
+\param[in] threadPriority The priority to run the PWM thread at, THREAD_PRIORITY_NORMAL
+to THREAD_PRIORITY_TIME_CRITICAL.
+\return HRESULT success or error code.
+*/
+HRESULT SoftwarePwmClass::begin(int threadPriority)
+{
+    HRESULT hr = S_OK;
+
+    if (m_periodTicks == 0)
+    {
+        hr = DMAP_E_PWM_FREQUENCY_INVALID;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (m_thread.joinable())
+        {
+            hr = setThreadPriority(threadPriority);
+        }
+        else
+        {
+            m_threadPriority = threadPriority;
+            m_missedPeriods = 0;
+            m_stopRequested = FALSE;
+            m_scheduleChanged = TRUE;
+
+            m_thread = std::thread(&SoftwarePwmClass::_pwmLoop, this);
+        }
+    }
+
+    return hr;
+}
+
+/**
+Waits for the PWM thread to finish.  The pins are left in the state the last edge the
+thread made put them in.
+*/
+void SoftwarePwmClass::end()
+{
+    if (m_thread.joinable())
+    {
+        m_stopRequested = TRUE;
+        m_thread.join();
+    }
+}
+
+/**
+\param[in] priority The priority to run the PWM thread at.  The priority is used the
+next time the thread is started if it is not running now.
+\return HRESULT success or error code.
+*/
+HRESULT SoftwarePwmClass::setThreadPriority(int priority)
+{
+    HRESULT hr = S_OK;
+
+    if (m_thread.joinable())
+    {
+        if (!SetThreadPriority((HANDLE)m_thread.native_handle(), priority))
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_threadPriority = priority;
+    }
+
+    return hr;
+}
+
+/**
+The period is a whole number of high resolution timer ticks, so the frequency produced
+can differ very slightly from the one requested.  A frequency change takes effect at
+the start of the next PWM period.
+\param[in] frequencyHz The number of PWM periods per second.
+\return HRESULT success or error code.
+*/
+HRESULT SoftwarePwmClass::setFrequency(ULONG frequencyHz)
+{
+    HRESULT hr = S_OK;
+
+    if ((frequencyHz < SOFT_PWM_MIN_FREQUENCY_HZ) || (frequencyHz > SOFT_PWM_MAX_FREQUENCY_HZ))
+    {
+        hr = DMAP_E_PWM_FREQUENCY_INVALID;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        AcquireSRWLockExclusive(&m_lock);
+
+        m_frequencyHz = frequencyHz;
+        m_periodTicks = m_frequency.QuadPart / frequencyHz;
+        _buildSchedule();
+
+        ReleaseSRWLockExclusive(&m_lock);
+    }
+
+    return hr;
+}
+
+/**
+\return The PWM frequency produced in Hz, or 0 if no frequency has been set.
+*/
+double SoftwarePwmClass::getActualFrequency()
+{
+    double frequency = 0.0;
+
+    if (m_periodTicks != 0)
+    {
+        frequency = (double)m_frequency.QuadPart / (double)m_periodTicks;
+    }
+
+    return frequency;
+}
+
+/**
+The pin must already be configured as a GPIO output.  It is added disabled, with a duty
+cycle of 0.
+\param[in] pin The board pin number.
+\return HRESULT success or error code.
+*/
+HRESULT SoftwarePwmClass::addPin(ULONG pin)
+{
+    HRESULT hr = S_OK;
+    ULONG index = 0;
+    ULONG port = 0;
+    ULONG portMask = 0;
+    BOOL portWrite = FALSE;
+
+    // Pins on GPIO controllers with port-wide set and clear registers are written with
+    // masks, the others are written one at a time.
+    if (SUCCEEDED(g_pins.getPinPortMask(pin, port, portMask)) && (port < SOFT_PWM_MAX_PORTS))
+    {
+        portWrite = TRUE;
+    }
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    if (SUCCEEDED(_findPin(pin, index)))
+    {
+        hr = DMAP_E_PIN_FUNCTION_LOCKED;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        for (index = 0; (index < SOFT_PWM_MAX_PINS) && m_pins[index].inUse; index++);
+
+        if (index >= SOFT_PWM_MAX_PINS)
+        {
+            hr = DMAP_E_PWM_TOO_MANY_PINS;
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        ZeroMemory(&m_pins[index], sizeof(m_pins[index]));
+        m_pins[index].pin = pin;
+        m_pins[index].portWrite = portWrite;
+        m_pins[index].port = port;
+        m_pins[index].portMask = portMask;
+        m_pins[index].inUse = TRUE;
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return hr;
+}
+
+/**
+The pin stops being driven at the start of the next PWM period.
+\param[in] pin The board pin number.
+\return HRESULT success or error code.
+*/
+HRESULT SoftwarePwmClass::removePin(ULONG pin)
+{
+    HRESULT hr = S_OK;
+    ULONG index = 0;
+    ULONG port;
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    hr = _findPin(pin, index);
+
+    if (SUCCEEDED(hr))
+    {
+        // Don't park a pin that has been given up, its entry could be used for another pin.
+        m_parkEdge.pinSet &= ~(1UL << index);
+        m_parkEdge.pinClear &= ~(1UL << index);
+        if (m_pins[index].portWrite)
+        {
+            port = m_pins[index].port;
+            m_parkEdge.portSet[port] &= ~m_pins[index].portMask;
+            m_parkEdge.portClear[port] &= ~m_pins[index].portMask;
+        }
+
+        m_pins[index].inUse = FALSE;
+        _buildSchedule();
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return hr;
+}
+
+/**
+The new duty cycle takes effect at the start of the next PWM period.
+\param[in] pin The board pin number.
+\param[in] dutyCycle The active fraction of the period, 0 (never active) to 0xFFFFFFFF
+(always active).
+\param[in] invertPolarity TRUE if the pin is LOW while active, FALSE if it is HIGH.
+\return HRESULT success or error code.
+*/
+HRESULT SoftwarePwmClass::setDutyCycle(ULONG pin, ULONG dutyCycle, BOOL invertPolarity)
+{
+    HRESULT hr = S_OK;
+    ULONG index = 0;
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    hr = _findPin(pin, index);
+
+    if (SUCCEEDED(hr) &&
+        ((m_pins[index].dutyCycle != dutyCycle) || (m_pins[index].invertPolarity != invertPolarity)))
+    {
+        m_pins[index].dutyCycle = dutyCycle;
+        m_pins[index].invertPolarity = invertPolarity;
+        if (m_pins[index].enabled)
+        {
+            _buildSchedule();
+        }
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return hr;
+}
+
+/**
+\param[in] pin The board pin number.
+\return HRESULT success or error code.
+*/
+HRESULT SoftwarePwmClass::enablePin(ULONG pin)
+{
+    HRESULT hr = S_OK;
+    ULONG index = 0;
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    hr = _findPin(pin, index);
+
+    if (SUCCEEDED(hr) && !m_pins[index].enabled)
+    {
+        m_pins[index].enabled = TRUE;
+        _buildSchedule();
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return hr;
+}
+
+/**
+The pin is set to its inactive level at the start of the next PWM period.
+\param[in] pin The board pin number.
+\return HRESULT success or error code.
+*/
+HRESULT SoftwarePwmClass::disablePin(ULONG pin)
+{
+    HRESULT hr = S_OK;
+    ULONG index = 0;
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    hr = _findPin(pin, index);
+
+    if (SUCCEEDED(hr) && m_pins[index].enabled)
+    {
+        m_pins[index].enabled = FALSE;
+        _addPinState(m_parkEdge, index, m_pins[index].invertPolarity ? HIGH : LOW);
+        _buildSchedule();
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return hr;
+}
+
+/**
+This method must be called with the lock held.
+\param[in] pin The board pin number.
+\param[out] index The entry in m_pins used for the pin.
+\return HRESULT success or error code.
+*/
+HRESULT SoftwarePwmClass::_findPin(ULONG pin, ULONG & index)
+{
+    HRESULT hr = DMAP_E_PWM_PIN_NOT_ADDED;
+
+    for (ULONG i = 0; i < SOFT_PWM_MAX_PINS; i++)
+    {
+        if (m_pins[i].inUse && (m_pins[i].pin == pin))
+        {
+            index = i;
+            hr = S_OK;
+            break;
+        }
+    }
+
+    return hr;
+}
+
+/**
+Every enabled pin is set to its active level by the edge at the start of the period (or
+to its inactive level if its duty cycle is 0), and pins with a duty cycle between 0 and
+100% are set back to their inactive level by a later edge.  Pins that change at the same
+time share an edge.  This method must be called with the lock held.
+*/
+void SoftwarePwmClass::_buildSchedule()
+{
+    PWM_EDGE startEdge;
+    PWM_EDGE endEdge;
+    std::vector<PWM_EDGE> endEdges;
+    ULONG activeState;
+    ULONG inactiveState;
+    LONGLONG offsetTicks;
+    BOOL pinsEnabled = FALSE;
+    ULONG i;
+    ULONG j;
+
+    ZeroMemory(&startEdge, sizeof(startEdge));
+
+    for (i = 0; i < SOFT_PWM_MAX_PINS; i++)
+    {
+        if (m_pins[i].inUse && m_pins[i].enabled)
+        {
+            pinsEnabled = TRUE;
+            activeState = m_pins[i].invertPolarity ? LOW : HIGH;
+            inactiveState = m_pins[i].invertPolarity ? HIGH : LOW;
+            offsetTicks = (LONGLONG)(((ULONGLONG)m_pins[i].dutyCycle * (ULONGLONG)m_periodTicks) >> 32);
+
+            if (offsetTicks == 0)
+            {
+                _addPinState(startEdge, i, inactiveState);
+            }
+            else
+            {
+                _addPinState(startEdge, i, activeState);
+
+                if (m_pins[i].dutyCycle != 0xFFFFFFFF)
+                {
+                    for (j = 0; (j < endEdges.size()) && (endEdges[j].offsetTicks != offsetTicks); j++);
+
+                    if (j == endEdges.size())
+                    {
+                        ZeroMemory(&endEdge, sizeof(endEdge));
+                        endEdge.offsetTicks = offsetTicks;
+                        endEdges.push_back(endEdge);
+                    }
+
+                    _addPinState(endEdges[j], i, inactiveState);
+                }
+            }
+        }
+    }
+
+    std::sort(endEdges.begin(), endEdges.end(),
+        [](const PWM_EDGE & a, const PWM_EDGE & b) { return a.offsetTicks < b.offsetTicks; });
+
+    // With no pins enabled the schedule is left empty, so the PWM thread can idle.
+    m_schedule.clear();
+    if (pinsEnabled)
+    {
+        m_schedule.push_back(startEdge);
+        m_schedule.insert(m_schedule.end(), endEdges.begin(), endEdges.end());
+    }
+
+    m_scheduleChanged = TRUE;
+}
+
+/**
+\param[in,out] edge The edge to add the pin change to.
+\param[in] index The entry in m_pins used for the pin.
+\param[in] state The state to set the pin to (HIGH or LOW).
+*/
+void SoftwarePwmClass::_addPinState(PWM_EDGE & edge, ULONG index, ULONG state)
+{
+    if (m_pins[index].portWrite)
+    {
+        if (state == HIGH)
+        {
+            edge.portSet[m_pins[index].port] |= m_pins[index].portMask;
+            edge.portClear[m_pins[index].port] &= ~m_pins[index].portMask;
+        }
+        else
+        {
+            edge.portClear[m_pins[index].port] |= m_pins[index].portMask;
+            edge.portSet[m_pins[index].port] &= ~m_pins[index].portMask;
+        }
+    }
+    else
+    {
+        if (state == HIGH)
+        {
+            edge.pinSet |= 1UL << index;
+            edge.pinClear &= ~(1UL << index);
+        }
+        else
+        {
+            edge.pinClear |= 1UL << index;
+            edge.pinSet &= ~(1UL << index);
+        }
+    }
+}
+
+/**
+Period n starts at the time the schedule was first used plus n periods.  If the thread
+falls more than a period behind, the periods it missed are skipped (and counted) rather
+than run late.  The thread only takes the lock to pick up a new schedule, which it does
+at the start of a period.
+*/
+void SoftwarePwmClass::_pwmLoop()
+{
+    std::vector<PWM_EDGE> schedule;
+    PWM_EDGE parkEdge;
+    ULONG pins[SOFT_PWM_MAX_PINS];
+    LONGLONG periodTicks = 0;
+    LONGLONG periodStart;
+    LONGLONG lateTicks;
+    LARGE_INTEGER nowTicks;
+
+    // Keep Sleep() at 1 ms resolution while the thread runs.
+    TimerResolutionClass timerResolution;
+
+    SetThreadPriority(GetCurrentThread(), m_threadPriority);
+
+    QueryPerformanceCounter(&nowTicks);
+    periodStart = nowTicks.QuadPart;
+
+    while (!m_stopRequested)
+    {
+        if (m_scheduleChanged)
+        {
+            AcquireSRWLockExclusive(&m_lock);
+
+            schedule = m_schedule;
+            periodTicks = m_periodTicks;
+            parkEdge = m_parkEdge;
+            ZeroMemory(&m_parkEdge, sizeof(m_parkEdge));
+            for (ULONG i = 0; i < SOFT_PWM_MAX_PINS; i++)
+            {
+                pins[i] = m_pins[i].pin;
+            }
+            m_scheduleChanged = FALSE;
+
+            ReleaseSRWLockExclusive(&m_lock);
+
+            _writeEdge(parkEdge, pins);
+        }
+
+        if (schedule.empty())
+        {
+            // No pins to drive, check for a new schedule from time to time.
+            Sleep(1);
+            QueryPerformanceCounter(&nowTicks);
+            periodStart = nowTicks.QuadPart;
+        }
+        else
+        {
+            for (ULONG i = 0; (i < schedule.size()) && !m_stopRequested; i++)
+            {
+                HiResTimerClass::WaitUntil(periodStart + schedule[i].offsetTicks, m_stopRequested);
+                _writeEdge(schedule[i], pins);
+            }
+
+            periodStart = periodStart + periodTicks;
+
+            QueryPerformanceCounter(&nowTicks);
+            lateTicks = nowTicks.QuadPart - periodStart;
+            if (lateTicks >= periodTicks)
+            {
+                m_missedPeriods = m_missedPeriods + (ULONG)(lateTicks / periodTicks);
+                periodStart = periodStart + ((lateTicks / periodTicks) * periodTicks);
+            }
+        }
+    }
+}
+
+/**
+The pins written with port-wide masks all change with one register write for each port,
+then the other pins are written one at a time.
+\param[in] edge The pin changes to make.
+\param[in] pins The board pin number of the pin in each entry of m_pins.
+*/
+void SoftwarePwmClass::_writeEdge(const PWM_EDGE & edge, const ULONG* pins)
+{
+    ULONG bits;
+    ULONG index;
+
+    for (ULONG port = 0; port < SOFT_PWM_MAX_PORTS; port++)
+    {
+        if ((edge.portSet[port] | edge.portClear[port]) != 0)
+        {
+            g_pins.setPortState(port, edge.portSet[port], edge.portClear[port]);
+        }
+    }
+
+    bits = edge.pinSet;
+    while (_BitScanForward(&index, bits))
+    {
+        g_pins.setPinState(pins[index], HIGH);
+        bits = bits & ~(1UL << index);
+    }
+
+    bits = edge.pinClear;
+    while (_BitScanForward(&index, bits))
+    {
+        g_pins.setPinState(pins[index], LOW);
+        bits = bits & ~(1UL << index);
+    }
+}
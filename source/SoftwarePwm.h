@@ -0,0 +1,170 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#ifndef _SOFTWARE_PWM_H_
+#define _SOFTWARE_PWM_H_
+
+#include <Windows.h>
+#include <thread>
+#include <vector>
+
+// The most pins one software PWM controller can drive.
+#define SOFT_PWM_MAX_PINS 32
+
+// The lowest and highest PWM frequencies that can be requested.
+#define SOFT_PWM_MIN_FREQUENCY_HZ 1
+#define SOFT_PWM_MAX_FREQUENCY_HZ 10000
+
+// The number of GPIO ports that can be written with port-wide set and clear masks.
+#define SOFT_PWM_MAX_PORTS 2
+
+//
+// Class used to generate PWM signals on GPIO pins in software.
+//
+// A dedicated thread drives the pins from a schedule of the edges in one PWM period.
+// The schedule is only rebuilt when a pin, duty cycle or the frequency changes, and the
+// thread picks up a new schedule at the start of a period so no pulse is cut short.
+// All the pins that change at the same time are set and cleared with one write to each
+// GPIO port where the GPIO controller has port-wide set and clear registers, and one
+// pin at a time otherwise.  The thread sleeps through long gaps between edges and only
+// spins on the high resolution timer when an edge is close.
+//
+class SoftwarePwmClass
+{
+public:
+    LIGHTNING_DLL_API SoftwarePwmClass();
+
+    /// Destructor.
+    /**
+    Call end() before the object is destroyed.  The destructor does not wait for the PWM
+    thread or touch the pins, since it can run during static destruction while the loader
+    lock is held.  If the thread is still running it is told to stop and detached.
+    */
+    virtual ~SoftwarePwmClass()
+    {
+        if (m_thread.joinable())
+        {
+            m_stopRequested = TRUE;
+            m_thread.detach();
+        }
+    }
+
+    /// Start the PWM thread.
+    LIGHTNING_DLL_API HRESULT begin(int threadPriority);
+
+    /// Stop the PWM thread.  Must be called before the object is destroyed.
+    LIGHTNING_DLL_API void end();
+
+    /// Set the priority of the PWM thread.
+    LIGHTNING_DLL_API HRESULT setThreadPriority(int priority);
+
+    /// Method to get the priority of the PWM thread.
+    int getThreadPriority()
+    {
+        return m_threadPriority;
+    }
+
+    /// Set the PWM frequency used by all the pins.
+    LIGHTNING_DLL_API HRESULT setFrequency(ULONG frequencyHz);
+
+    /// Get the PWM frequency produced, after rounding to high resolution timer ticks.
+    LIGHTNING_DLL_API double getActualFrequency();
+
+    /// Add a pin to the pins driven by the PWM thread.
+    LIGHTNING_DLL_API HRESULT addPin(ULONG pin);
+
+    /// Stop driving a pin.
+    LIGHTNING_DLL_API HRESULT removePin(ULONG pin);
+
+    /// Set the duty cycle and polarity of a pin.
+    LIGHTNING_DLL_API HRESULT setDutyCycle(ULONG pin, ULONG dutyCycle, BOOL invertPolarity);
+
+    /// Start the PWM signal on a pin.
+    LIGHTNING_DLL_API HRESULT enablePin(ULONG pin);
+
+    /// Stop the PWM signal on a pin, leaving the pin at its inactive level.
+    LIGHTNING_DLL_API HRESULT disablePin(ULONG pin);
+
+    /// Method to get the number of PWM periods skipped because the thread fell behind.
+    ULONG getMissedPeriods()
+    {
+        return m_missedPeriods;
+    }
+
+private:
+
+    /// The settings for one pin driven by the PWM thread.
+    typedef struct _PWM_PIN {
+        BOOL inUse;                 ///< TRUE if this entry is used for a pin
+        BOOL enabled;               ///< TRUE if the PWM signal is on
+        BOOL invertPolarity;        ///< TRUE if the pin is LOW for the active part of the period
+        ULONG pin;                  ///< The board pin number
+        ULONG dutyCycle;            ///< Active fraction of the period, 0-0xFFFFFFFF
+        BOOL portWrite;             ///< TRUE if the pin is written with port-wide masks
+        ULONG port;                 ///< The GPIO port the pin is on, if portWrite is TRUE
+        ULONG portMask;             ///< The bit mask of the pin in its port, if portWrite is TRUE
+    } PWM_PIN;
+
+    /// The pin changes made at one time in a PWM period.
+    typedef struct _PWM_EDGE {
+        LONGLONG offsetTicks;                   ///< Time of the edge from the start of the period
+        ULONG portSet[SOFT_PWM_MAX_PORTS];      ///< Bits to set HIGH in each GPIO port
+        ULONG portClear[SOFT_PWM_MAX_PORTS];    ///< Bits to set LOW in each GPIO port
+        ULONG pinSet;                           ///< Bit n set to set the pin in entry n HIGH
+        ULONG pinClear;                         ///< Bit n set to set the pin in entry n LOW
+    } PWM_EDGE;
+
+    /// The pins driven by the PWM thread.
+    PWM_PIN m_pins[SOFT_PWM_MAX_PINS];
+
+    /// The requested PWM frequency.
+    ULONG m_frequencyHz;
+
+    /// The high resolution timer frequency on this system.
+    LARGE_INTEGER m_frequency;
+
+    /// The length of a PWM period in high resolution timer ticks.
+    LONGLONG m_periodTicks;
+
+    /// The edges of a PWM period in time order, the first edge is at the start of the period.
+    std::vector<PWM_EDGE> m_schedule;
+
+    /// Pins to set to their inactive level once, before the new schedule is used.
+    PWM_EDGE m_parkEdge;
+
+    /// Set to TRUE when the PWM thread should pick up a new schedule.
+    volatile BOOL m_scheduleChanged;
+
+    /// Lock protecting the pin settings and the schedule.
+    SRWLOCK m_lock;
+
+    /// The priority the PWM thread runs at.
+    int m_threadPriority;
+
+    /// Number of PWM periods skipped because the thread fell behind.
+    volatile ULONG m_missedPeriods;
+
+    /// Set to TRUE to tell the PWM thread to stop.
+    volatile BOOL m_stopRequested;
+
+    /// The PWM thread.
+    std::thread m_thread;
+
+    // Method to find the entry used for a pin.
+    HRESULT _findPin(ULONG pin, ULONG & index);
+
+    // Method to rebuild the schedule from the pin settings, called with the lock held.
+    void _buildSchedule();
+
+    // Method to add setting a pin to a state to an edge.
+    void _addPinState(PWM_EDGE & edge, ULONG index, ULONG state);
+
+    // Method run by the PWM thread.
+    void _pwmLoop();
+
+    // Method to make the pin changes of one edge.
+    void _writeEdge(const PWM_EDGE & edge, const ULONG* pins);
+};
+
+#endif  // _SOFTWARE_PWM_H_
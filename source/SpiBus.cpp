@@ -0,0 +1,385 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#include "pch.h"
+
+#include "SpiBus.h"
+#include "BoardPins.h"
+#include "BcmSpiController.h"
+#include "BtSpiController.h"
+
+
+// 
+// Global extern exports
+//
+SpiBusClass g_spi(EXTERNAL_SPI_BUS);
+SpiBusClass g_spi2nd(SECOND_EXTERNAL_SPI_BUS);
+
+//
+// SpiBusClass methods.
+//
+
+/**
+The first device added to the bus opens the SPI controller.  The chip select pin of the
+device is prepared for use, and the settings of the device are checked by programming
+them into the controller.  A device added with NO_CHIP_SELECT_PIN drives its own chip
+select (for example with digitalWrite()), so no pin is prepared for it.
+\param[in] csPin The chip select pin of the device, or NO_CHIP_SELECT_PIN.
+\param[in] mode The SPI mode used by the device (0-3).
+\param[in] clockKhz The SPI clock rate used by the device.
+\param[in] dataBits The number of bits in each transfer to the device.
+\param[in] lsbFirst TRUE if the device shifts data LSB first, FALSE for MSB first.
+\param[out] device The handle used to acquire the bus for the device.
+\return HRESULT success or error code.
+*/
+HRESULT SpiBusClass::addDevice(ULONG csPin, ULONG mode, ULONG clockKhz, ULONG dataBits, BOOL lsbFirst, ULONG & device)
+{
+    HRESULT hr = S_OK;
+    ULONG slot = SPI_BUS_NO_DEVICE;
+
+    device = SPI_BUS_NO_DEVICE;
+
+    EnterCriticalSection(&m_lock);
+
+    // Make sure no other device uses the chip select pin, and find a free entry.
+    for (ULONG i = 0; SUCCEEDED(hr) && (i < SPI_BUS_MAX_DEVICES); i++)
+    {
+        if (m_devices[i].inUse)
+        {
+            if ((csPin != NO_CHIP_SELECT_PIN) && (m_devices[i].csPin == csPin))
+            {
+                hr = DMAP_E_SPI_CHIP_SELECT_IN_USE;
+            }
+        }
+        else if (slot == SPI_BUS_NO_DEVICE)
+        {
+            slot = i;
+        }
+    }
+
+    if (SUCCEEDED(hr) && (slot == SPI_BUS_NO_DEVICE))
+    {
+        hr = DMAP_E_SPI_TOO_MANY_DEVICES;
+    }
+
+    if (SUCCEEDED(hr) && (m_controller == nullptr))
+    {
+        hr = _openController(mode, clockKhz, dataBits);
+    }
+
+    if (SUCCEEDED(hr) && (csPin != NO_CHIP_SELECT_PIN))
+    {
+        hr = m_controller->configureChipSelectPin(csPin);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_devices[slot].inUse = TRUE;
+        m_devices[slot].csPin = csPin;
+        m_devices[slot].mode = mode;
+        m_devices[slot].clockKhz = clockKhz;
+        m_devices[slot].dataBits = dataBits;
+        m_devices[slot].lsbFirst = lsbFirst;
+        m_deviceCount++;
+
+        hr = _applyProfile(slot);
+
+        if (SUCCEEDED(hr))
+        {
+            device = slot;
+        }
+        else
+        {
+            removeDevice(slot);
+        }
+    }
+
+    // If the controller was opened for this device but the device could not be added, close it.
+    if (FAILED(hr) && (m_deviceCount == 0) && (m_controller != nullptr))
+    {
+        _closeController();
+    }
+
+    LeaveCriticalSection(&m_lock);
+
+    return hr;
+}
+
+/**
+The chip select pin of the device is released.  When the last device is removed from
+the bus the SPI controller is closed.
+\param[in] device The handle of the device, as returned by addDevice().
+*/
+void SpiBusClass::removeDevice(ULONG device)
+{
+    EnterCriticalSection(&m_lock);
+
+    if ((device < SPI_BUS_MAX_DEVICES) && m_devices[device].inUse)
+    {
+        if (m_devices[device].csPin != NO_CHIP_SELECT_PIN)
+        {
+            g_pins.verifyPinFunction(m_devices[device].csPin, FUNC_DIO, BoardPinsClass::UNLOCK_FUNCTION);
+        }
+
+        m_devices[device].inUse = FALSE;
+        m_deviceCount--;
+
+        if (m_activeDevice == device)
+        {
+            m_activeDevice = SPI_BUS_NO_DEVICE;
+        }
+
+        if (m_deviceCount == 0)
+        {
+            _closeController();
+        }
+    }
+
+    LeaveCriticalSection(&m_lock);
+}
+
+/**
+The new settings are checked by programming them into the controller.  If this fails the
+device keeps the settings it had before.
+\param[in] device The handle of the device, as returned by addDevice().
+\param[in] mode The SPI mode used by the device (0-3).
+\param[in] clockKhz The SPI clock rate used by the device.
+\param[in] dataBits The number of bits in each transfer to the device.
+\param[in] lsbFirst TRUE if the device shifts data LSB first, FALSE for MSB first.
+\return HRESULT success or error code.
+*/
+HRESULT SpiBusClass::changeDevice(ULONG device, ULONG mode, ULONG clockKhz, ULONG dataBits, BOOL lsbFirst)
+{
+    HRESULT hr = S_OK;
+    SPI_DEVICE_PROFILE oldProfile;
+
+    EnterCriticalSection(&m_lock);
+
+    if ((device >= SPI_BUS_MAX_DEVICES) || !m_devices[device].inUse)
+    {
+        hr = E_HANDLE;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        oldProfile = m_devices[device];
+
+        m_devices[device].mode = mode;
+        m_devices[device].clockKhz = clockKhz;
+        m_devices[device].dataBits = dataBits;
+        m_devices[device].lsbFirst = lsbFirst;
+
+        hr = _applyProfile(device);
+
+        if (FAILED(hr))
+        {
+            m_devices[device] = oldProfile;
+        }
+    }
+
+    LeaveCriticalSection(&m_lock);
+
+    return hr;
+}
+
+/**
+On success the bus stays locked until release() is called, and the controller is set up
+for the device, with the chip select of the device as the one selectChip() drives.
+The chip select is not asserted by this method.
+\param[in] device The handle of the device, as returned by addDevice().
+\param[out] controller The SPI controller object used to talk to the device.
+\return HRESULT success or error code.  If an error is returned the bus is not locked.
+*/
+HRESULT SpiBusClass::acquire(ULONG device, SpiControllerClass* & controller)
+{
+    HRESULT hr = S_OK;
+
+    controller = nullptr;
+
+    EnterCriticalSection(&m_lock);
+
+    if ((device >= SPI_BUS_MAX_DEVICES) || !m_devices[device].inUse)
+    {
+        hr = E_HANDLE;
+    }
+
+    if (SUCCEEDED(hr) && (device != m_activeDevice))
+    {
+        hr = _applyProfile(device);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        controller = m_controller;
+    }
+    else
+    {
+        LeaveCriticalSection(&m_lock);
+    }
+
+    return hr;
+}
+
+/**
+This method must only be called between a successful call to acquire() and the call to
+release().  It lets one sequence of transfers talk to several devices in turn, without
+giving other users of the bus a chance to use it in between.  When the devices have the
+same SPI settings only the chip select the controller drives is changed, which is cheap.
+The chip select is not asserted by this method.
+\param[in] device The handle of the device, as returned by addDevice().
+\return HRESULT success or error code.  The bus stays locked whether or not an error is
+returned.
+*/
+HRESULT SpiBusClass::switchDevice(ULONG device)
+{
+    HRESULT hr = S_OK;
+
+    if ((device >= SPI_BUS_MAX_DEVICES) || !m_devices[device].inUse)
+    {
+        hr = E_HANDLE;
+    }
+
+    if (SUCCEEDED(hr) && (device != m_activeDevice))
+    {
+        hr = _applyProfile(device);
+    }
+
+    return hr;
+}
+
+/**
+\param[in] mode The SPI mode to start the controller with.
+\param[in] clockKhz The SPI clock rate to start the controller with.
+\param[in] dataBits The transfer width to start the controller with.
+\return HRESULT success or error code.
+*/
+HRESULT SpiBusClass::_openController(ULONG mode, ULONG clockKhz, ULONG dataBits)
+{
+    HRESULT hr;
+    BoardPinsClass::BOARD_TYPE board;
+
+    hr = g_pins.getBoardType(board);
+
+    if (SUCCEEDED(hr))
+    {
+        switch (board)
+        {
+        case BoardPinsClass::BOARD_TYPE::PI2_BARE:
+            m_controller = new BcmSpiControllerClass;
+            if (m_busNumber == SECOND_EXTERNAL_SPI_BUS)
+            {
+                hr = m_controller->configurePins(PI2_PIN_SPI1_MISO, PI2_PIN_SPI1_MOSI, PI2_PIN_SPI1_SCK);
+            }
+            else
+            {
+                hr = m_controller->configurePins(PI2_PIN_SPI0_MISO, PI2_PIN_SPI0_MOSI, PI2_PIN_SPI0_SCK);
+            }
+            break;
+        case BoardPinsClass::BOARD_TYPE::MBM_BARE:
+            m_controller = new BtSpiControllerClass;
+            hr = m_controller->configurePins(MBM_PIN_MISO, MBM_PIN_MOSI, MBM_PIN_SCK);
+            break;
+        case BoardPinsClass::BOARD_TYPE::MBM_IKA_LURE:
+            m_controller = new BtSpiControllerClass;
+            hr = m_controller->configurePins(ARDUINO_PIN_MISO, ARDUINO_PIN_MOSI, ARDUINO_PIN_SCK);
+            break;
+        default:
+            hr = DMAP_E_BOARD_TYPE_NOT_RECOGNIZED;
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_controller->setMsbFirstBitOrder();
+
+        hr = m_controller->begin(m_busNumber, mode, clockKhz, dataBits);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // Record the settings the controller now has.
+        m_programmed.inUse = TRUE;
+        m_programmed.csPin = NO_CHIP_SELECT_PIN;
+        m_programmed.mode = mode;
+        m_programmed.clockKhz = clockKhz;
+        m_programmed.dataBits = dataBits;
+        m_programmed.lsbFirst = FALSE;
+    }
+    else if (m_controller != nullptr)
+    {
+        _closeController();
+    }
+
+    return hr;
+}
+
+/**
+The pins of the controller, including the chip select pin it last used, are reverted to GPIO.
+*/
+void SpiBusClass::_closeController()
+{
+    if (m_controller != nullptr)
+    {
+        m_controller->revertPinsToGpio();
+        delete m_controller;
+        m_controller = nullptr;
+    }
+
+    m_programmed.inUse = FALSE;
+    m_activeDevice = SPI_BUS_NO_DEVICE;
+}
+
+/**
+Only the settings that differ from those already in the controller are programmed.
+\param[in] device The handle of the device to set the controller up for.
+\return HRESULT success or error code.
+*/
+HRESULT SpiBusClass::_applyProfile(ULONG device)
+{
+    HRESULT hr = S_OK;
+    PSPI_DEVICE_PROFILE profile = &m_devices[device];
+
+    if (!m_programmed.inUse || (m_programmed.mode != profile->mode))
+    {
+        hr = m_controller->setMode(profile->mode);
+    }
+
+    if (SUCCEEDED(hr) && (!m_programmed.inUse || (m_programmed.clockKhz != profile->clockKhz)))
+    {
+        hr = m_controller->setClock(profile->clockKhz);
+    }
+
+    if (SUCCEEDED(hr) && (!m_programmed.inUse || (m_programmed.dataBits != profile->dataBits)))
+    {
+        hr = m_controller->setDataWidth(profile->dataBits);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (profile->lsbFirst)
+        {
+            m_controller->setLsbFirstBitOrder();
+        }
+        else
+        {
+            m_controller->setMsbFirstBitOrder();
+        }
+
+        hr = m_controller->useChipSelectPin(profile->csPin);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_programmed = *profile;
+        m_activeDevice = device;
+    }
+    else
+    {
+        // Some settings may have been changed, so program all of them next time.
+        m_programmed.inUse = FALSE;
+        m_activeDevice = SPI_BUS_NO_DEVICE;
+    }
+
+    return hr;
+}
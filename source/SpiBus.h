@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#ifndef _SPI_BUS_H_
+#define _SPI_BUS_H_
+
+#include <Windows.h>
+
+#include "SpiController.h"
+
+// The most devices that can share one SPI bus.
+#define SPI_BUS_MAX_DEVICES 8
+
+// Device handle value that does not refer to any device.
+#define SPI_BUS_NO_DEVICE 0xFFFFFFFF
+
+// Number of times to spin on the bus lock before waiting (SPI transfers are short).
+#define SPI_BUS_LOCK_SPIN_COUNT 4000
+
+//
+// Class used to share one SPI controller between the devices on an SPI bus.
+//
+// Each device is added with its own chip select pin and SPI settings.  A device acquires
+// the bus for each sequence of transfers, which locks out other users of the bus and
+// reprograms only the controller settings that differ from those of the last device
+// that used the bus.
+//
+class SpiBusClass
+{
+public:
+    SpiBusClass(ULONG busNumber) :
+        m_busNumber(busNumber),
+        m_controller(nullptr),
+        m_deviceCount(0),
+        m_activeDevice(SPI_BUS_NO_DEVICE)
+    {
+        ZeroMemory(m_devices, sizeof(m_devices));
+        ZeroMemory(&m_programmed, sizeof(m_programmed));
+        InitializeCriticalSectionAndSpinCount(&m_lock, SPI_BUS_LOCK_SPIN_COUNT);
+    }
+
+    virtual ~SpiBusClass()
+    {
+        DeleteCriticalSection(&m_lock);
+    }
+
+    /// Add a device to this SPI bus.
+    LIGHTNING_DLL_API HRESULT addDevice(ULONG csPin, ULONG mode, ULONG clockKhz, ULONG dataBits, BOOL lsbFirst, ULONG & device);
+
+    /// Change the SPI settings used to talk to a device on this bus.
+    LIGHTNING_DLL_API HRESULT changeDevice(ULONG device, ULONG mode, ULONG clockKhz, ULONG dataBits, BOOL lsbFirst);
+
+    /// Remove a device from this SPI bus.
+    LIGHTNING_DLL_API void removeDevice(ULONG device);
+
+    /// Get exclusive use of the SPI bus, set up for a device.
+    LIGHTNING_DLL_API HRESULT acquire(ULONG device, SpiControllerClass* & controller);
+
+    /// Set the acquired SPI bus up for another device, without releasing the bus.
+    LIGHTNING_DLL_API HRESULT switchDevice(ULONG device);
+
+    /// Release the SPI bus after a successful call to acquire().
+    void release()
+    {
+        LeaveCriticalSection(&m_lock);
+    }
+
+private:
+
+    /// The settings used to talk to a device on the bus.
+    typedef struct _SPI_DEVICE_PROFILE {
+        BOOL inUse;             ///< TRUE if this entry describes a device
+        ULONG csPin;            ///< Chip select pin of the device
+        ULONG mode;             ///< SPI mode (0-3)
+        ULONG clockKhz;         ///< SPI clock rate
+        ULONG dataBits;         ///< Number of bits in a transfer
+        BOOL lsbFirst;          ///< TRUE to shift data LSB first
+    } SPI_DEVICE_PROFILE, *PSPI_DEVICE_PROFILE;
+
+    /// The bus number of the SPI controller used by this object.
+    ULONG m_busNumber;
+
+    /// The object we use to talk to the SPI controller, nullptr if no devices are on the bus.
+    SpiControllerClass* m_controller;
+
+    /// The devices on the bus.
+    SPI_DEVICE_PROFILE m_devices[SPI_BUS_MAX_DEVICES];
+
+    /// Count of devices on the bus.
+    ULONG m_deviceCount;
+
+    /// The device the controller is set up for, SPI_BUS_NO_DEVICE if none.
+    ULONG m_activeDevice;
+
+    /// The settings programmed into the controller (inUse is FALSE if they are not known).
+    SPI_DEVICE_PROFILE m_programmed;
+
+    /// Lock used to serialize use of the bus.
+    RTL_CRITICAL_SECTION m_lock;
+
+    // Method to create and initialize the SPI controller object.
+    HRESULT _openController(ULONG mode, ULONG clockKhz, ULONG dataBits);
+
+    // Method to release the pins of the SPI controller and delete the controller object.
+    void _closeController();
+
+    // Method to set up the controller for a device.
+    HRESULT _applyProfile(ULONG device);
+};
+
+/// The global object for the main SPI bus.
+LIGHTNING_DLL_API extern SpiBusClass g_spi;
+
+/// The global object for the secondary SPI bus.
+LIGHTNING_DLL_API extern SpiBusClass g_spi2nd;
+
+#endif  // _SPI_BUS_H_
@@ -6,6 +6,7 @@
 
 #include "SpiController.h"
 #include "BoardPins.h"
+#include "HiResTimer.h"
 
 /**
 \return HRESULT success or error code.
@@ -24,6 +25,15 @@ HRESULT SpiControllerClass::revertPinsToGpio()
     tmpHr = g_pins.verifyPinFunction(m_misoPin, FUNC_DIO, BoardPinsClass::UNLOCK_FUNCTION);
     if (SUCCEEDED(hr)) { hr = tmpHr; }
 
+    if (m_csPin != NO_CHIP_SELECT_PIN)
+    {
+        tmpHr = g_pins.verifyPinFunction(m_csPin, FUNC_DIO, BoardPinsClass::UNLOCK_FUNCTION);
+        if (SUCCEEDED(hr)) { hr = tmpHr; }
+
+        m_csPin = NO_CHIP_SELECT_PIN;
+        m_hardwareChipSelect = FALSE;
+    }
+
     return hr;
 }
 
@@ -235,3 +245,263 @@ void SpiControllerClass::setLsbFirstBitOrder()
 {
     m_flipBitOrder = TRUE;
 }
+
+/**
+If the controller has a chip select line that can drive the pin, the pin is given to the
+controller and the chip select is driven by register writes.  Otherwise the pin is used
+as a GPIO output.  Either way the chip select is left deasserted (high).  Any chip select
+pin set earlier is released.
+\param[in] csPin The number of the pin to use as the chip select.
+\return HRESULT success or error code.
+\note This method must be called after begin(), since which pins the controller can drive
+depends on the SPI bus in use.
+*/
+HRESULT SpiControllerClass::setChipSelectPin(ULONG csPin)
+{
+    HRESULT hr = S_OK;
+
+    // Release any chip select pin set earlier.
+    if ((m_csPin != NO_CHIP_SELECT_PIN) && (m_csPin != csPin))
+    {
+        hr = g_pins.verifyPinFunction(m_csPin, FUNC_DIO, BoardPinsClass::UNLOCK_FUNCTION);
+        m_csPin = NO_CHIP_SELECT_PIN;
+        m_hardwareChipSelect = FALSE;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = configureChipSelectPin(csPin);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = useChipSelectPin(csPin);
+    }
+
+    return hr;
+}
+
+/**
+This method is used when several devices, each with its own chip select pin, share the
+controller.  Each pin is prepared once, and remains locked to its function until it is
+released with revertPinsToGpio() (if it is the pin in use) or BoardPinsClass::verifyPinFunction().
+\param[in] csPin The number of the pin to use as a chip select.
+\return HRESULT success or error code.
+*/
+HRESULT SpiControllerClass::configureChipSelectPin(ULONG csPin)
+{
+    HRESULT hr = S_OK;
+    ULONG csLine = 0;
+
+    if (_hardwareChipSelectLine(csPin, csLine))
+    {
+        // The controller keeps the chip select lines it is not using deasserted.
+        hr = g_pins.verifyPinFunction(csPin, FUNC_SPI, BoardPinsClass::LOCK_FUNCTION);
+    }
+    else
+    {
+        hr = g_pins.setPinMode(csPin, DIRECTION_OUT, FALSE);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = g_pins.setPinState(csPin, HIGH);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = g_pins.verifyPinFunction(csPin, FUNC_DIO, BoardPinsClass::LOCK_FUNCTION);
+        }
+    }
+
+    return hr;
+}
+
+/**
+No pin configuration is done by this method, so switching between devices is cheap.
+\param[in] csPin The number of a pin prepared with configureChipSelectPin().
+\return HRESULT success or error code.
+*/
+HRESULT SpiControllerClass::useChipSelectPin(ULONG csPin)
+{
+    HRESULT hr = S_OK;
+    ULONG csLine = 0;
+
+    m_hardwareChipSelect = _hardwareChipSelectLine(csPin, csLine);
+    m_csLine = csLine;
+    m_csPin = csPin;
+
+    hr = _driveHardwareChipSelect(FALSE);
+
+    return hr;
+}
+
+/**
+\return HRESULT success or error code.
+\note If no chip select pin has been set, this method does nothing.
+*/
+HRESULT SpiControllerClass::selectChip()
+{
+    HRESULT hr = S_OK;
+
+    if (m_hardwareChipSelect)
+    {
+        hr = _driveHardwareChipSelect(TRUE);
+    }
+    else if (m_csPin != NO_CHIP_SELECT_PIN)
+    {
+        hr = g_pins.setPinState(m_csPin, LOW);
+    }
+
+    return hr;
+}
+
+/**
+\return HRESULT success or error code.
+\note If no chip select pin has been set, this method does nothing.
+*/
+HRESULT SpiControllerClass::deselectChip()
+{
+    HRESULT hr = S_OK;
+
+    if (m_hardwareChipSelect)
+    {
+        hr = _driveHardwareChipSelect(FALSE);
+    }
+    else if (m_csPin != NO_CHIP_SELECT_PIN)
+    {
+        hr = g_pins.setPinState(m_csPin, HIGH);
+    }
+
+    return hr;
+}
+
+/**
+The chip select is asserted before the first segment and deasserted after the last one,
+so a command and its data (for example) can be sent to a device without the chip select
+changing between them.  A segment with a dataBits value other than 0 sets the data width
+of the controller for that segment, and the data width in use before this method was
+called is restored at the end.
+\param[in] segments The segments to transfer, in the order they are sent on the bus.
+\param[in] segmentCount The number of segments.
+\return HRESULT success or error code.
+\note In segments with a dataBits value of 0 or 8 each byte of the buffers is one transfer.
+Otherwise each word takes up (dataBits + 7) / 8 bytes of the buffers, most significant byte
+first, and byteCount must be a multiple of this size.  As for transferBuffer(), the data is
+sent and received MSbit first.
+*/
+HRESULT SpiControllerClass::transferSegments(const SPI_SEGMENT* segments, ULONG segmentCount)
+{
+    HRESULT hr = S_OK;
+    HRESULT tmpHr;
+    ULONG savedDataBits = m_dataBits;
+    ULONG wordBytes;
+    const SPI_SEGMENT* segment;
+    HiResTimerClass timer;
+
+    if ((segments == nullptr) && (segmentCount > 0))
+    {
+        hr = E_POINTER;
+    }
+
+    // Check all the segment lengths before anything is sent.
+    for (ULONG i = 0; SUCCEEDED(hr) && (i < segmentCount); i++)
+    {
+        wordBytes = (segments[i].dataBits + 7) / 8;
+        if ((wordBytes > 1) && ((segments[i].byteCount % wordBytes) != 0))
+        {
+            hr = DMAP_E_SPI_SEGMENT_LENGTH_INVALID;
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = selectChip();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        for (ULONG i = 0; SUCCEEDED(hr) && (i < segmentCount); i++)
+        {
+            segment = &segments[i];
+
+            // Set the data width for this segment, if it is not already set.
+            if ((segment->dataBits != 0) && (segment->dataBits != m_dataBits))
+            {
+                hr = setDataWidth(segment->dataBits);
+            }
+
+            if (SUCCEEDED(hr) && (segment->byteCount > 0))
+            {
+                if ((segment->dataBits == 0) || (segment->dataBits == 8))
+                {
+                    hr = transferBuffer(segment->dataOut, segment->dataIn, segment->byteCount);
+                }
+                else
+                {
+                    hr = _transferWords(segment->dataOut, segment->dataIn, segment->byteCount, segment->dataBits);
+                }
+            }
+
+            if (SUCCEEDED(hr) && (segment->delayUs > 0))
+            {
+                timer.StartTimeout(segment->delayUs);
+                while (!timer.TimeIsUp());
+            }
+        }
+
+        // Regardless of the transfer result, deselect the device.
+        tmpHr = deselectChip();
+        if (SUCCEEDED(hr)) { hr = tmpHr; }
+    }
+
+    // Put back the data width that was set when this method was called.
+    if (m_dataBits != savedDataBits)
+    {
+        tmpHr = setDataWidth(savedDataBits);
+        if (SUCCEEDED(hr)) { hr = tmpHr; }
+    }
+
+    return hr;
+}
+
+/**
+\param[in] dataOut The words to send, most significant byte first.  If the parameter is
+NULL, 0's will be sent.
+\param[out] dataIn The buffer for the words received.  If this parameter is NULL, data in
+will be ignored.
+\param[in] byteCount The number of bytes in each buffer, a multiple of the word size.
+\param[in] bits The number of bits in each word (the data width set on the controller).
+\return HRESULT success or error code.
+*/
+HRESULT SpiControllerClass::_transferWords(PBYTE dataOut, PBYTE dataIn, ULONG byteCount, ULONG bits)
+{
+    HRESULT hr = S_OK;
+    ULONG wordBytes = (bits + 7) / 8;
+    ULONG txData;
+    ULONG rxData;
+
+    for (ULONG offset = 0; SUCCEEDED(hr) && (offset < byteCount); offset = offset + wordBytes)
+    {
+        txData = 0;
+        if (dataOut != nullptr)
+        {
+            for (ULONG i = 0; i < wordBytes; i++)
+            {
+                txData = (txData << 8) | dataOut[offset + i];
+            }
+        }
+
+        hr = _transfer(txData, rxData, bits);
+
+        if (SUCCEEDED(hr) && (dataIn != nullptr))
+        {
+            for (ULONG i = wordBytes; i > 0; i--)
+            {
+                dataIn[offset + i - 1] = (BYTE)(rxData & 0xFF);
+                rxData = rxData >> 8;
+            }
+        }
+    }
+
+    return hr;
+}
@@ -17,6 +17,17 @@
 #define DEFAULT_SPI_MODE 0
 #define DEFAULT_SPI_BITS 8
 
+#define NO_CHIP_SELECT_PIN 0xFFFFFFFF
+
+/// One segment of an SPI transaction performed with transferSegments().
+typedef struct _SPI_SEGMENT {
+    PBYTE dataOut;          ///< Data to send, nullptr to send zeros
+    PBYTE dataIn;           ///< Buffer for the data received, nullptr to ignore it
+    ULONG byteCount;        ///< Number of bytes in each buffer
+    ULONG dataBits;         ///< Bits in each word of the segment, 0 for bytes sent with transferBuffer()
+    ULONG delayUs;          ///< Microseconds to wait after the segment, with the chip select still asserted
+} SPI_SEGMENT, *PSPI_SEGMENT;
+
 class SpiControllerClass
 {
 public:
@@ -26,7 +37,10 @@ public:
         m_dataBits(DEFAULT_SPI_BITS),
         m_sckPin(0xFFFFFFFF),
         m_mosiPin(0xFFFFFFFF),
-        m_misoPin(0xFFFFFFFF)
+        m_misoPin(0xFFFFFFFF),
+        m_csPin(NO_CHIP_SELECT_PIN),
+        m_csLine(0),
+        m_hardwareChipSelect(FALSE)
     {
     }
 
@@ -54,6 +68,27 @@ public:
     /// Finish using the SPI controller associated with this object.
     virtual void end() = 0;
 
+    /// Set the pin used as the chip select of the device accessed with this controller.
+    LIGHTNING_DLL_API HRESULT setChipSelectPin(ULONG csPin);
+
+    /// Prepare a pin for use as a chip select, leaving it deasserted.
+    LIGHTNING_DLL_API HRESULT configureChipSelectPin(ULONG csPin);
+
+    /// Make a pin prepared with configureChipSelectPin() the one selectChip() drives.
+    LIGHTNING_DLL_API HRESULT useChipSelectPin(ULONG csPin);
+
+    /// Select the device by asserting (driving low) its chip select.
+    LIGHTNING_DLL_API HRESULT selectChip();
+
+    /// Deselect the device by deasserting (driving high) its chip select.
+    LIGHTNING_DLL_API HRESULT deselectChip();
+
+    /// Determine whether the chip select is driven by the controller hardware.
+    BOOL chipSelectIsHardware()
+    {
+        return m_hardwareChipSelect;
+    }
+
     /// Method to set the default bit order: MSB First.
     LIGHTNING_DLL_API void setMsbFirstBitOrder();
 
@@ -117,12 +152,16 @@ public:
     \param[in] bufferBytes The number of bytes to transfer.  Each bufffer 
     must be at least this long.
     \return HRESULT success or error code.
+    \note The chip select is not changed by this method, see selectChip().
     \note The data is sent and received MSbit first.  If LSbit first transfer, or 
     any other special ordering of the bytes in the buffer, is needed, the data must
     be organized appropriately in the buffer before it is handed to this method.
     */
     virtual inline HRESULT transferBuffer(PBYTE dataOut, PBYTE dataIn, size_t bufferBytes) = 0;
 
+    /// Perform a sequence of transfers with the device selected for the whole sequence.
+    LIGHTNING_DLL_API HRESULT transferSegments(const SPI_SEGMENT* segments, ULONG segmentCount);
+
 protected:
     /// SPI Clock pin number.
     ULONG m_sckPin;
@@ -136,6 +175,32 @@ protected:
     /// The number of bits in an SPI transfer.
     ULONG m_dataBits;
 
+    /// SPI Chip Select pin number, NO_CHIP_SELECT_PIN if none has been set.
+    ULONG m_csPin;
+
+    /// The controller chip select line driven on the chip select pin.
+    ULONG m_csLine;
+
+    /// TRUE if the chip select is driven by the controller, FALSE if it is driven as a GPIO.
+    BOOL m_hardwareChipSelect;
+
+    /// Method to determine whether a pin can be driven as a chip select by the controller.
+    /**
+    \param[in] csPin The number of the pin to be used as a chip select.
+    \param[out] csLine The controller chip select line that drives the pin.
+    \return TRUE if the controller can drive the pin, FALSE otherwise.
+    */
+    virtual BOOL _hardwareChipSelectLine(ULONG csPin, ULONG & csLine) = 0;
+
+    /// Method to drive the controller chip select line to the selected or deselected state.
+    /**
+    If the chip select in use is a GPIO pin, this method leaves all the controller chip
+    select lines deasserted, with the controller ready to transfer data.
+    \param[in] selected TRUE to assert the chip select, FALSE to deassert it.
+    \return HRESULT success or error code.
+    */
+    virtual HRESULT _driveHardwareChipSelect(BOOL selected) = 0;
+
 private:
 
     /// If TRUE invert the data before/after transfer (Controller only supports MSB first).
@@ -152,6 +217,9 @@ private:
     \return HRESULT success or error code.
     */
     virtual inline HRESULT _transfer(ULONG dataOut, ULONG & dataIn, ULONG bits) = 0;
+
+    /// Method to transfer a buffer of words that are not single bytes.
+    HRESULT _transferWords(PBYTE dataOut, PBYTE dataIn, ULONG byteCount, ULONG bits);
 };
 
 #endif  // _SPI_CONTROLLER_H_
\ No newline at end of file
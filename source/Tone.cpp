@@ -0,0 +1,375 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#include "pch.h"
+
+#include "Tone.h"
+#include "BoardPins.h"
+#include "BcmPwmController.h"
+#include "ErrorCodes.h"
+#include "HiResTimer.h"
+
+//
+// Global extern exports
+//
+ToneClass g_tone;
+
+// Constructor.
+ToneClass::ToneClass() :
+    m_threadRunning(FALSE),
+    m_stopRequested(FALSE)
+{
+    ZeroMemory(m_tones, sizeof(m_tones));
+    InitializeSRWLock(&m_lock);
+    QueryPerformanceFrequency(&m_frequency);
+}
+
+/**
+The tone starts straight away and this method returns without waiting for it to finish.
+\param[in] pin The number of the pin to play the tone on.  On boards that use an external
+PWM chip, this can also be a PWM pseudo pin (PWM0-PWMn).
+\param[in] frequencyHz The frequency of the tone.
+\param[in] durationMs The time the tone plays for in milliseconds, or 0 to play it until
+stop() is called.
+\return HRESULT success or error code.
+\note A PWM chip drives all its channels at one frequency, so a tone on a PWM chip pin
+changes the frequency of the other PWM signals from that chip.
+*/
+HRESULT ToneClass::start(ULONG pin, ULONG frequencyHz, ULONG durationMs)
+{
+    HRESULT hr = S_OK;
+    ULONG index = TONE_MAX_TONES;
+    TONE_OUTPUT output = TONE_SOFTWARE;
+    LARGE_INTEGER nowTicks;
+
+    if (frequencyHz < TONE_MIN_FREQUENCY_HZ)
+    {
+        hr = DMAP_E_PWM_FREQUENCY_INVALID;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        AcquireSRWLockExclusive(&m_lock);
+
+        // Stop any tone already playing on the pin.
+        if (SUCCEEDED(_findTone(pin, index)))
+        {
+            hr = _stopTone(index);
+        }
+
+        // Find a free entry for the tone.
+        if (SUCCEEDED(hr))
+        {
+            index = TONE_MAX_TONES;
+            for (ULONG i = 0; (i < TONE_MAX_TONES) && (index == TONE_MAX_TONES); i++)
+            {
+                if (!m_tones[i].inUse)
+                {
+                    index = i;
+                }
+            }
+
+            if (index == TONE_MAX_TONES)
+            {
+                hr = DMAP_E_TOO_MANY_TONES;
+            }
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = _startOutput(pin, frequencyHz, output);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            QueryPerformanceCounter(&nowTicks);
+
+            TONE & tone = m_tones[index];
+            tone.inUse = TRUE;
+            tone.pin = pin;
+            tone.frequencyHz = frequencyHz;
+            tone.output = output;
+            tone.state = LOW;
+            tone.halfPeriodTicks = m_frequency.QuadPart / (2LL * frequencyHz);
+            if (tone.halfPeriodTicks == 0)
+            {
+                tone.halfPeriodTicks = 1;
+            }
+            tone.nextToggleTicks = nowTicks.QuadPart + tone.halfPeriodTicks;
+            tone.timed = (durationMs != 0);
+            tone.endTicks = nowTicks.QuadPart + (((LONGLONG)durationMs * m_frequency.QuadPart) / 1000LL);
+
+            // Start the tone thread if this tone needs it and it is not running.
+            if (_needsThread(tone) && !m_threadRunning)
+            {
+                if (m_thread.joinable())
+                {
+                    m_thread.join();
+                }
+                m_stopRequested = FALSE;
+                m_threadRunning = TRUE;
+                m_thread = std::thread(&ToneClass::_toneLoop, this);
+            }
+        }
+
+        ReleaseSRWLockExclusive(&m_lock);
+    }
+
+    return hr;
+}
+
+/**
+\param[in] pin The number of the pin to stop the tone on.  If no tone is playing on the
+pin, nothing is done.
+\return HRESULT success or error code.
+*/
+HRESULT ToneClass::stop(ULONG pin)
+{
+    HRESULT hr = S_OK;
+    ULONG index;
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    if (SUCCEEDED(_findTone(pin, index)))
+    {
+        hr = _stopTone(index);
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return hr;
+}
+
+/**
+Waits for the tone thread to finish, then stops any tones still playing.
+*/
+void ToneClass::end()
+{
+    if (m_thread.joinable())
+    {
+        m_stopRequested = TRUE;
+        m_thread.join();
+    }
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    m_threadRunning = FALSE;
+    for (ULONG i = 0; i < TONE_MAX_TONES; i++)
+    {
+        if (m_tones[i].inUse)
+        {
+            _stopTone(i);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&m_lock);
+}
+
+/**
+This method must be called with the lock held.
+\param[in] pin The board pin number.
+\param[out] index The index of the entry for the tone on the pin.
+\return HRESULT success or error code.
+*/
+HRESULT ToneClass::_findTone(ULONG pin, ULONG & index)
+{
+    HRESULT hr = DMAP_E_PWM_PIN_NOT_ADDED;
+
+    for (ULONG i = 0; (i < TONE_MAX_TONES) && FAILED(hr); i++)
+    {
+        if (m_tones[i].inUse && (m_tones[i].pin == pin))
+        {
+            index = i;
+            hr = S_OK;
+        }
+    }
+
+    return hr;
+}
+
+/**
+This method must be called with the lock held.  The PWM hardware is used if it can drive
+the pin.  Both channels of the PWM controller in the SOC run at the same frequency, so
+if the other channel is playing a tone of a different frequency the pin is toggled by the
+tone thread instead.
+\param[in] pin The board pin number.
+\param[in] frequencyHz The frequency of the tone.
+\param[out] output How the tone is made.
+\return HRESULT success or error code.
+*/
+HRESULT ToneClass::_startOutput(ULONG pin, ULONG frequencyHz, TONE_OUTPUT & output)
+{
+    HRESULT hr = S_OK;
+    BoardPinsClass::BOARD_TYPE board;
+    ULONG channel;
+    BOOL socFree = TRUE;
+
+    hr = g_pins.getBoardType(board);
+
+    if (SUCCEEDED(hr))
+    {
+        for (ULONG i = 0; i < TONE_MAX_TONES; i++)
+        {
+            if (m_tones[i].inUse && (m_tones[i].output == TONE_SOC_PWM) && (m_tones[i].frequencyHz != frequencyHz))
+            {
+                socFree = FALSE;
+            }
+        }
+
+        if ((board != BoardPinsClass::BOARD_TYPE::MBM_IKA_LURE) && (pin >= PWM0))
+        {
+            // A pseudo pin for a channel of the external PWM chip.
+            output = TONE_PWM_CHIP;
+        }
+        else if (SUCCEEDED(g_pins.getSocPwmChannel(pin, channel)) && socFree &&
+            (frequencyHz <= BCM_PWM_MAX_FREQUENCY_HZ))
+        {
+            hr = g_pins.verifyPinFunction(pin, FUNC_PWM, BoardPinsClass::NO_LOCK_CHANGE);
+            output = TONE_SOC_PWM;
+        }
+        else if ((board == BoardPinsClass::BOARD_TYPE::MBM_IKA_LURE) &&
+            SUCCEEDED(g_pins.verifyPinFunction(pin, FUNC_PWM, BoardPinsClass::NO_LOCK_CHANGE)))
+        {
+            output = TONE_PWM_CHIP;
+        }
+        else if (frequencyHz > TONE_MAX_SOFTWARE_FREQUENCY_HZ)
+        {
+            hr = DMAP_E_PWM_FREQUENCY_INVALID;
+        }
+        else
+        {
+            output = TONE_SOFTWARE;
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (output == TONE_SOFTWARE)
+        {
+            hr = g_pins.verifyPinFunction(pin, FUNC_DIO, BoardPinsClass::NO_LOCK_CHANGE);
+
+            if (SUCCEEDED(hr))
+            {
+                hr = g_pins.setPinMode(pin, DIRECTION_OUT, FALSE);
+            }
+
+            if (SUCCEEDED(hr))
+            {
+                hr = g_pins.setPinState(pin, LOW);
+            }
+        }
+        else
+        {
+            hr = g_pins.setPwmFrequency(pin, frequencyHz);
+
+            if (SUCCEEDED(hr))
+            {
+                hr = g_pins.setPwmDutyCycle(pin, 0x80000000);
+            }
+        }
+    }
+
+    return hr;
+}
+
+/**
+This method must be called with the lock held.
+\param[in] index The index of the entry for the tone.
+\return HRESULT success or error code.
+*/
+HRESULT ToneClass::_stopTone(ULONG index)
+{
+    HRESULT hr = S_OK;
+
+    if (m_tones[index].output == TONE_SOFTWARE)
+    {
+        hr = g_pins.setPinState(m_tones[index].pin, LOW);
+    }
+    else
+    {
+        hr = g_pins.setPwmDutyCycle(m_tones[index].pin, 0);
+    }
+
+    m_tones[index].inUse = FALSE;
+
+    return hr;
+}
+
+/**
+Each pass toggles the pins of the software tones that are due and stops the timed tones
+that have ended, then waits for the next toggle or end time.  The thread stops itself
+when no tone needs it any more.
+*/
+void ToneClass::_toneLoop()
+{
+    LARGE_INTEGER nowTicks;
+    LONGLONG waitTicks;
+    BOOL keepRunning = TRUE;
+
+    // Keep Sleep() at 1 ms resolution while the thread runs.
+    TimerResolutionClass timerResolution;
+
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+    while (keepRunning && !m_stopRequested)
+    {
+        AcquireSRWLockExclusive(&m_lock);
+
+        QueryPerformanceCounter(&nowTicks);
+        waitTicks = nowTicks.QuadPart + ((TONE_POLL_MS * m_frequency.QuadPart) / 1000LL);
+        keepRunning = FALSE;
+
+        for (ULONG i = 0; i < TONE_MAX_TONES; i++)
+        {
+            TONE & tone = m_tones[i];
+
+            if (tone.inUse && tone.timed && (nowTicks.QuadPart >= tone.endTicks))
+            {
+                _stopTone(i);
+            }
+
+            if (tone.inUse && (tone.output == TONE_SOFTWARE))
+            {
+                if (nowTicks.QuadPart >= tone.nextToggleTicks)
+                {
+                    tone.state = (tone.state == LOW) ? HIGH : LOW;
+                    g_pins.setPinState(tone.pin, tone.state);
+
+                    tone.nextToggleTicks = tone.nextToggleTicks + tone.halfPeriodTicks;
+                    if (tone.nextToggleTicks <= nowTicks.QuadPart)
+                    {
+                        // The thread fell behind, start timing from now.
+                        tone.nextToggleTicks = nowTicks.QuadPart + tone.halfPeriodTicks;
+                    }
+                }
+                if (tone.nextToggleTicks < waitTicks)
+                {
+                    waitTicks = tone.nextToggleTicks;
+                }
+            }
+
+            if (tone.inUse && tone.timed && (tone.endTicks < waitTicks))
+            {
+                waitTicks = tone.endTicks;
+            }
+
+            if (_needsThread(tone))
+            {
+                keepRunning = TRUE;
+            }
+        }
+
+        if (!keepRunning)
+        {
+            m_threadRunning = FALSE;
+        }
+
+        ReleaseSRWLockExclusive(&m_lock);
+
+        if (keepRunning)
+        {
+            HiResTimerClass::WaitUntil(waitTicks, m_stopRequested);
+        }
+    }
+}
@@ -0,0 +1,121 @@
+// Copyright (c) Microsoft Open Technologies, Inc.  All rights reserved.  
+// Licensed under the BSD 2-Clause License.  
+// See License.txt in the project root for license information.
+
+#ifndef _TONE_H_
+#define _TONE_H_
+
+#include <Windows.h>
+#include <thread>
+
+// The most tones that can be played at the same time.
+#define TONE_MAX_TONES 8
+
+// The lowest tone frequency, and the highest that can be made by toggling a GPIO pin.
+#define TONE_MIN_FREQUENCY_HZ 1
+#define TONE_MAX_SOFTWARE_FREQUENCY_HZ 5000
+
+// The longest the tone thread goes without checking for new tones, in milliseconds.
+#define TONE_POLL_MS 10
+
+//
+// Class used to play square wave tones on pins without blocking the caller.
+//
+// A tone on a pin that can be driven by a PWM controller (the PWM controller in the
+// SOC, or a PCA9685 PWM chip) is made by the PWM hardware as a 50% duty cycle signal.
+// Tones on other pins are made by one background thread that toggles the pins of all
+// those tones.  The same thread stops tones that were started with a duration.
+//
+class ToneClass
+{
+public:
+    LIGHTNING_DLL_API ToneClass();
+
+    /// Destructor.
+    /**
+    g_tone is destroyed during static destruction, with the loader lock held, so the
+    destructor must not join the tone thread or drive the pins.  Stop the tones first, with
+    end() or by calling stop() for each pin.  A tone thread that is still running is told
+    to stop and detached.
+    */
+    virtual ~ToneClass()
+    {
+        if (m_thread.joinable())
+        {
+            m_stopRequested = TRUE;
+            m_thread.detach();
+        }
+    }
+
+    /// Start a tone on a pin, replacing any tone already playing on the pin.
+    LIGHTNING_DLL_API HRESULT start(ULONG pin, ULONG frequencyHz, ULONG durationMs);
+
+    /// Stop the tone on a pin, leaving the pin LOW.
+    LIGHTNING_DLL_API HRESULT stop(ULONG pin);
+
+    /// Stop all tones and the tone thread.  Call before the object is destroyed.
+    LIGHTNING_DLL_API void end();
+
+private:
+
+    /// The ways a tone can be made.
+    typedef enum {
+        TONE_SOC_PWM,       ///< By the PWM controller in the SOC
+        TONE_PWM_CHIP,      ///< By a PWM chip
+        TONE_SOFTWARE       ///< By the tone thread toggling a GPIO pin
+    } TONE_OUTPUT;
+
+    /// The settings for one tone.
+    typedef struct _TONE {
+        BOOL inUse;                 ///< TRUE if this entry is used for a tone
+        ULONG pin;                  ///< The board pin number
+        ULONG frequencyHz;          ///< The frequency of the tone
+        TONE_OUTPUT output;         ///< How the tone is made
+        ULONG state;                ///< The current pin state, for a software tone
+        LONGLONG halfPeriodTicks;   ///< Time between pin toggles, for a software tone
+        LONGLONG nextToggleTicks;   ///< Timer reading when the pin is next toggled, for a software tone
+        BOOL timed;                 ///< TRUE if the tone stops by itself
+        LONGLONG endTicks;          ///< Timer reading when the tone stops, if timed is TRUE
+    } TONE;
+
+    /// The tones.
+    TONE m_tones[TONE_MAX_TONES];
+
+    /// The high resolution timer frequency on this system.
+    LARGE_INTEGER m_frequency;
+
+    /// Lock protecting the tones.
+    SRWLOCK m_lock;
+
+    /// TRUE while the tone thread is running.
+    BOOL m_threadRunning;
+
+    /// Set to TRUE to tell the tone thread to stop.
+    volatile BOOL m_stopRequested;
+
+    /// The tone thread.
+    std::thread m_thread;
+
+    // Method to find the entry used for the tone on a pin.
+    HRESULT _findTone(ULONG pin, ULONG & index);
+
+    // Method to choose how a tone is made and set the pin up for it.
+    HRESULT _startOutput(ULONG pin, ULONG frequencyHz, TONE_OUTPUT & output);
+
+    // Method to stop a tone and free its entry, called with the lock held.
+    HRESULT _stopTone(ULONG index);
+
+    // Method to determine whether a tone needs the tone thread.
+    inline BOOL _needsThread(const TONE & tone)
+    {
+        return tone.inUse && (tone.timed || (tone.output == TONE_SOFTWARE));
+    }
+
+    // Method run by the tone thread.
+    void _toneLoop();
+};
+
+/// The global object used to play tones.
+LIGHTNING_DLL_API extern ToneClass g_tone;
+
+#endif  // _TONE_H_
@@ -1,6 +1,7 @@
 #include "pch.h"
 
 #include "arduino.h"
+#include "Tone.h"
 
 // 
 // Global extern exports
@@ -19,20 +20,29 @@ char* dtostrf(double value, char width, uint8_t precision, char* buffer)
 
 void tone(int pin, unsigned int frequency)
 {
-    UNREFERENCED_PARAMETER(pin);
-    UNREFERENCED_PARAMETER(frequency);
+    tone(pin, frequency, 0);
 }
 
 void tone(int pin, unsigned int frequency, unsigned long duration)
 {
-    UNREFERENCED_PARAMETER(pin);
-    UNREFERENCED_PARAMETER(frequency);
-    UNREFERENCED_PARAMETER(duration);
+    HRESULT hr;
+
+    hr = g_tone.start(pin, frequency, duration);
+    if (FAILED(hr))
+    {
+        ThrowError(hr, "Error occurred starting a tone of: %d Hz on pin: %d, Error: %08x", frequency, pin, hr);
+    }
 }
 
 void noTone(int pin)
 {
-    UNREFERENCED_PARAMETER(pin);
+    HRESULT hr;
+
+    hr = g_tone.stop(pin);
+    if (FAILED(hr))
+    {
+        ThrowError(hr, "Error occurred stopping the tone on pin: %d, Error: %08x", pin, hr);
+    }
 }
 
 //
@@ -251,7 +261,9 @@ void analogReference(int type)
 /**
 \param[in] pin The number of the pin for the PWM output.  On boards with built-in PWM support
 this is a GPIO pin, on boards that use an external PWM chip, this is a pseudo pin number named
-PWM0-PWMn, where "n" is one less than the number of PWM pins.
+PWM0-PWMn, where "n" is one less than the number of PWM pins.  On the Raspberry Pi 2,
+pins 12, 32, 33 and 35 are driven by the PWM controller in the SOC; other numbers below
+PWM0 are taken as channel numbers of the external PWM chips.
 \param[in] dutyCycle The high pulse time, range 0 to pwm_resolution_count - 1, (defaults
 to a count of 255, for 8-bit PWM resolution.)
 \Note: This call throws an error if the pin number is outside the range supported
@@ -261,6 +273,7 @@ void analogWrite(unsigned int pin, unsigned int dutyCycle)
 {
     HRESULT hr;
     ULONG ioPin = pin;
+    ULONG channel;
     BoardPinsClass::BOARD_TYPE board;
     ULONGLONG scaledDutyCycle;
 
@@ -283,8 +296,25 @@ void analogWrite(unsigned int pin, unsigned int dutyCycle)
         }
         break;
 
-    case BoardPinsClass::BOARD_TYPE::MBM_BARE:
     case BoardPinsClass::BOARD_TYPE::PI2_BARE:
+        // A GPIO pin that can be driven by the PWM controller in the SOC is used as is.
+        if (SUCCEEDED(g_pins.getSocPwmChannel(pin, channel)))
+        {
+            hr = g_pins.verifyPinFunction(ioPin, FUNC_PWM, BoardPinsClass::NO_LOCK_CHANGE);
+
+            if (FAILED(hr))
+            {
+                ThrowError(hr, "Error occurred verifying pin: %d function: PWM, Error: %08x", ioPin, hr);
+            }
+        }
+        // Translate other PWM channel numbers to fake pin numbers.
+        else if (pin < PWM0)
+        {
+            ioPin = PWM0 + pin;
+        }
+        break;
+
+    case BoardPinsClass::BOARD_TYPE::MBM_BARE:
         // Translate the PWM channel numbers to fake pin numbers.
         if (pin < PWM0)
         {
@@ -225,7 +225,9 @@ LIGHTNING_DLL_API extern ULONG g_pwmResolutionBits;
 /**
 \param[in] pin The number of the pin for the PWM output.  On boards with built-in PWM support
 this is a GPIO pin, on boards that use an external PWM chip, this is a pseudo pin number named 
-PWM0-PWMn, where "n" is one less than the number of PWM pins.
+PWM0-PWMn, where "n" is one less than the number of PWM pins.  On the Raspberry Pi 2,
+pins 12, 32, 33 and 35 are driven by the PWM controller in the SOC; other numbers below
+PWM0 are taken as channel numbers of the external PWM chips.
 \param[in] dutyCycle The high pulse time, range 0 to pwm_resolution_count - 1, (defaults 
 to a count of 255, for 8-bit PWM resolution.)
 \Note: This call throws an error if the pin number is outside the range supported
@@ -252,21 +254,25 @@ LIGHTNING_DLL_API void shiftOut(uint8_t data_pin_, uint8_t clock_pin_, uint8_t b
 
 ///
 /// \brief Performs a tone operation.
-/// \details This will start a PWM wave on the designated pin of the
-/// inputted frequency with 50% duty cycle
-/// \param [in] pin - The Arduino GPIO pin on which to generate the pulse train.
-///        This can be pin 3, 5, 6, 7, 8, 9, 10, or 11.
+/// \details This will start a square wave of the inputted frequency with 50% duty
+/// cycle on the designated pin, and return without waiting.  The tone plays until
+/// noTone() is called for the pin, which must be done before the program exits.
+/// \param [in] pin - The GPIO pin on which to generate the pulse train.  Pins that
+///        can be driven by a PWM controller are driven by the PWM hardware, other
+///        pins are toggled by a background thread.
 /// \param [in] frequency - in Hertz
 ///
 LIGHTNING_DLL_API void tone(int pin, unsigned int frequency);
 
 ///
 /// \brief Performs a tone operation.
-/// \details This will start a PWM wave on the designated pin of the
-/// inputted frequency with 50% duty cycle and set up a timer to trigger
-/// a callback after the inputted duration
-/// \param [in] pin - The Arduino GPIO pin on which to generate the pulse train.
-///        This can be pin 3, 5, 6, 7, 8, 9, 10, or 11.
+/// \details This will start a square wave of the inputted frequency with 50% duty
+/// cycle on the designated pin, and return without waiting.  The tone stops by
+/// itself after the inputted duration.  If the program can exit before then, call
+/// noTone() for the pin first.
+/// \param [in] pin - The GPIO pin on which to generate the pulse train.  Pins that
+///        can be driven by a PWM controller are driven by the PWM hardware, other
+///        pins are toggled by a background thread.
 /// \param [in] frequency - in Hertz
 /// \param [in] duration - in milliseconds
 ///
@@ -274,10 +280,9 @@ LIGHTNING_DLL_API void tone(int pin, unsigned int frequency, unsigned long durat
 
 ///
 /// \brief Performs a noTone operation.
-/// \details This will stop a PWM wave on the designated pin if there is
-/// a tone running on it
-/// \param [in] pin - The Arduino GPIO pin on which to generate the pulse train.
-///        This can be pin 3, 5, 6, 7, 8, 9, 10, or 11.
+/// \details This will stop the tone on the designated pin if there is
+/// a tone running on it, leaving the pin LOW
+/// \param [in] pin - The GPIO pin on which the tone was started.
 ///
 LIGHTNING_DLL_API void noTone(int pin);
 
@@ -5,27 +5,74 @@
 #include "pch.h"
 
 #include "EEPROM.h"
-#include "wire.h"
+#include "I2c.h"
+#include "ErrorCodes.h"
 
-// I2C transaction code(s):
-namespace {
-    const uint8_t EEPROM_ADDR7 = 0x50;
+EEPROMClass::EEPROMClass (
+    void
+) :
+    m_i2cAddress(EEPROM_DEFAULT_I2C_ADDRESS),
+    m_sizeBytes(EEPROM_DEFAULT_SIZE_BYTES),
+    m_pageBytes(EEPROM_DEFAULT_PAGE_BYTES),
+    m_addressBytes(2),
+    m_blockSelectMask(0),
+    m_writeInProgress(false),
+    m_writeBuffer(EEPROM_DEFAULT_PAGE_BYTES + 2),
+    m_cacheEnabled(false)
+{
+}
+
+HRESULT
+EEPROMClass::setDevice (
+    const uint8_t i2cAddress,
+    const size_t sizeBytes,
+    const size_t pageBytes
+) {
+    HRESULT hr = S_OK;
+
+    if (i2cAddress > 0x7F)
+    {
+        hr = DMAP_E_I2C_ADDRESS_OUT_OF_RANGE;
+    }
+    else if ((sizeBytes == 0) || (sizeBytes > 0x10000) || (pageBytes == 0) || (pageBytes > sizeBytes))
+    {
+        hr = E_INVALIDARG;
+    }
+    else if ((sizeBytes > 256) && (sizeBytes <= 2048) && ((i2cAddress & ((sizeBytes - 1) >> 8)) != 0))
+    {
+        // The I2C address bits that select a block of a 24C04 to 24C16 must be zero.
+        hr = E_INVALIDARG;
+    }
+
+    // Finish with the EEPROM currently in use before switching to the new one.
+    if (SUCCEEDED(hr))
+    {
+        hr = flush();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_i2cAddress = i2cAddress;
+        m_sizeBytes = static_cast<ULONG>(sizeBytes);
+        m_pageBytes = static_cast<ULONG>(pageBytes);
+        m_addressBytes = (m_sizeBytes > 2048) ? 2 : 1;
+        m_blockSelectMask = (m_addressBytes == 1) ? ((m_sizeBytes - 1) >> 8) : 0;
+        m_writeBuffer.resize(m_pageBytes + m_addressBytes);
+        _resetCache();
+    }
+
+    return hr;
 }
 
 uint8_t
 EEPROMClass::read (
     const int address
 ) const {
-    // Request data from EEPROM
-    Wire.begin();
-    Wire.beginTransmission(EEPROM_ADDR7);
-    Wire.write(static_cast<uint8_t>(address >> 8));  // high-byte
-    Wire.write(static_cast<uint8_t>(address));  // low-byte
-    if ( TwoWire::ADDR_NACK_RECV == Wire.endTransmission(false) ) { return 0; }
+    uint8_t value = 0;
+
+    if (FAILED(readBlock(address, &value, 1))) { value = 0; }
 
-    // Return response
-    Wire.requestFrom(EEPROM_ADDR7, 1);
-    return static_cast<uint8_t>(Wire.read());
+    return value;
 }
 
 void
@@ -33,13 +80,467 @@ EEPROMClass::write (
     const int address,
     const uint8_t value
 ) const {
-    // Write data to EEPROM
-    Wire.begin();
-    Wire.beginTransmission(EEPROM_ADDR7);
-    Wire.write(static_cast<uint8_t>(address >> 8));  // high-byte
-    Wire.write(static_cast<uint8_t>(address));  // low-byte
-    Wire.write(value);
-    Wire.endTransmission(true);
+    writeBlock(address, &value, 1);
+}
+
+void
+EEPROMClass::update (
+    const int address,
+    const uint8_t value
+) const {
+    updateBlock(address, &value, 1);
+}
+
+HRESULT
+EEPROMClass::readBlock (
+    const int address,
+    uint8_t * buffer,
+    const size_t length
+) const {
+    HRESULT hr = S_OK;
+
+    hr = _checkRange(address, buffer, length);
+
+    if (SUCCEEDED(hr) && (length > 0))
+    {
+        if (m_cacheEnabled)
+        {
+            hr = _cachePages(address, static_cast<ULONG>(length), false);
+            if (SUCCEEDED(hr))
+            {
+                memcpy(buffer, &m_cache[address], length);
+            }
+        }
+        else
+        {
+            hr = _readDevice(address, buffer, static_cast<ULONG>(length));
+        }
+    }
+
+    return hr;
+}
+
+HRESULT
+EEPROMClass::writeBlock (
+    const int address,
+    const uint8_t * buffer,
+    const size_t length
+) const {
+    HRESULT hr = S_OK;
+    ULONG offset = 0;
+    ULONG chunk = 0;
+
+    hr = _checkRange(address, buffer, length);
+
+    if (SUCCEEDED(hr) && m_cacheEnabled && (length > 0))
+    {
+        // Pages the block covers completely do not need to be read first.
+        hr = _cachePages(address, static_cast<ULONG>(length), true);
+        for (offset = 0; SUCCEEDED(hr) && (offset < length); offset++)
+        {
+            _cacheWrite(address + offset, buffer[offset], false);
+        }
+    }
+    else
+    {
+        // Write the part of the block that falls in each page.
+        while (SUCCEEDED(hr) && (offset < length))
+        {
+            chunk = m_pageBytes - ((address + offset) % m_pageBytes);
+            if (chunk > (length - offset))
+            {
+                chunk = static_cast<ULONG>(length - offset);
+            }
+            hr = _writePage(address + offset, &buffer[offset], chunk);
+            offset = offset + chunk;
+        }
+    }
+
+    return hr;
+}
+
+HRESULT
+EEPROMClass::updateBlock (
+    const int address,
+    const uint8_t * buffer,
+    const size_t length
+) const {
+    HRESULT hr = S_OK;
+    std::vector<uint8_t> current;
+    ULONG offset = 0;
+    ULONG chunk = 0;
+    ULONG first = 0;
+    ULONG last = 0;
+
+    hr = _checkRange(address, buffer, length);
+
+    if (SUCCEEDED(hr) && m_cacheEnabled && (length > 0))
+    {
+        hr = _cachePages(address, static_cast<ULONG>(length), false);
+        for (offset = 0; SUCCEEDED(hr) && (offset < length); offset++)
+        {
+            _cacheWrite(address + offset, buffer[offset], true);
+        }
+    }
+    else if (SUCCEEDED(hr) && (length > 0))
+    {
+        // Read the current contents with one sequential read.
+        current.resize(length);
+        hr = _readDevice(address, current.data(), static_cast<ULONG>(length));
+
+        // In each page, write only the span of bytes that changed.
+        while (SUCCEEDED(hr) && (offset < length))
+        {
+            chunk = m_pageBytes - ((address + offset) % m_pageBytes);
+            if (chunk > (length - offset))
+            {
+                chunk = static_cast<ULONG>(length - offset);
+            }
+
+            first = offset;
+            while ((first < (offset + chunk)) && (current[first] == buffer[first]))
+            {
+                first++;
+            }
+            last = offset + chunk;
+            while ((last > first) && (current[last - 1] == buffer[last - 1]))
+            {
+                last--;
+            }
+
+            if (last > first)
+            {
+                hr = _writePage(address + first, &buffer[first], last - first);
+            }
+            offset = offset + chunk;
+        }
+    }
+
+    return hr;
+}
+
+HRESULT
+EEPROMClass::setWriteBackCache (
+    const bool enable
+) {
+    HRESULT hr = S_OK;
+
+    if (m_cacheEnabled && !enable)
+    {
+        hr = flush();
+    }
+
+    if (SUCCEEDED(hr) && (m_cacheEnabled != enable))
+    {
+        m_cacheEnabled = enable;
+        _resetCache();
+    }
+
+    return hr;
+}
+
+HRESULT
+EEPROMClass::flush (
+    void
+) {
+    HRESULT hr = S_OK;
+    ULONG pageAddress = 0;
+
+    // Write the changed span of each dirty page.
+    for (ULONG page = 0; SUCCEEDED(hr) && (page < m_dirtyStart.size()); page++)
+    {
+        if (m_dirtyStart[page] < m_dirtyEnd[page])
+        {
+            pageAddress = page * m_pageBytes;
+            hr = _writePage(
+                pageAddress + m_dirtyStart[page],
+                &m_cache[pageAddress + m_dirtyStart[page]],
+                m_dirtyEnd[page] - m_dirtyStart[page]);
+            if (SUCCEEDED(hr))
+            {
+                m_dirtyStart[page] = m_pageBytes;
+                m_dirtyEnd[page] = 0;
+            }
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = _waitForWriteCycle();
+    }
+
+    return hr;
+}
+
+HRESULT
+EEPROMClass::_checkRange (
+    const int address,
+    const void * buffer,
+    const size_t length
+) const {
+    HRESULT hr = S_OK;
+
+    if ((buffer == nullptr) && (length > 0))
+    {
+        hr = E_POINTER;
+    }
+    else if ((address < 0) || (length > m_sizeBytes) || (static_cast<ULONG>(address) > (m_sizeBytes - length)))
+    {
+        hr = DMAP_E_EEPROM_ADDRESS_OUT_OF_RANGE;
+    }
+
+    return hr;
+}
+
+/**
+EEPROMs of 512 to 2048 bytes take one memory address byte, and the bits of the memory
+address above it select a 256 byte block through the low bits of the I2C address.
+*/
+uint8_t
+EEPROMClass::_deviceAddress (
+    const ULONG address
+) const {
+    return static_cast<uint8_t>(m_i2cAddress | ((address >> 8) & m_blockSelectMask));
+}
+
+HRESULT
+EEPROMClass::_readDevice (
+    const ULONG address,
+    uint8_t * buffer,
+    const ULONG length
+) const {
+    HRESULT hr = S_OK;
+    UCHAR addressBuffer[2];
+    ULONG offset = 0;
+    ULONG chunk = 0;
+
+    hr = _waitForWriteCycle();
+
+    // The EEPROM sends sequential bytes for as long as they are read, so each
+    // chunk needs only one memory address.
+    while (SUCCEEDED(hr) && (offset < length))
+    {
+        chunk = length - offset;
+        if (chunk > EEPROM_READ_CHUNK_BYTES)
+        {
+            chunk = EEPROM_READ_CHUNK_BYTES;
+        }
+
+        // A read of a block-select EEPROM can't continue into the next block, which
+        // has a different I2C address.
+        if ((m_blockSelectMask != 0) && (chunk > (256 - ((address + offset) % 256))))
+        {
+            chunk = 256 - ((address + offset) % 256);
+        }
+
+        addressBuffer[0] = static_cast<UCHAR>((address + offset) >> 8);
+        addressBuffer[1] = static_cast<UCHAR>(address + offset);
+
+        m_transaction.reset();
+        hr = m_transaction.setAddress(_deviceAddress(address + offset));
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_transaction.queueWrite(&addressBuffer[2 - m_addressBytes], m_addressBytes);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_transaction.queueRead(&buffer[offset], chunk, TRUE);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_transaction.execute(g_i2c.getController());
+        }
+
+        offset = offset + chunk;
+    }
+
+    return hr;
+}
+
+HRESULT
+EEPROMClass::_writePage (
+    const ULONG address,
+    const uint8_t * buffer,
+    const ULONG length
+) const {
+    HRESULT hr = S_OK;
+
+    // The EEPROM can't accept a page until the previous page has been written.
+    hr = _waitForWriteCycle();
+
+    if (SUCCEEDED(hr))
+    {
+        if (m_addressBytes == 2)
+        {
+            m_writeBuffer[0] = static_cast<UCHAR>(address >> 8);
+        }
+        m_writeBuffer[m_addressBytes - 1] = static_cast<UCHAR>(address);
+        memcpy(&m_writeBuffer[m_addressBytes], buffer, length);
+
+        m_transaction.reset();
+        hr = m_transaction.setAddress(_deviceAddress(address));
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_transaction.queueWrite(m_writeBuffer.data(), m_addressBytes + length);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_transaction.execute(g_i2c.getController());
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_writeInProgress = true;
+    }
+
+    return hr;
+}
+
+/**
+While the EEPROM is writing a page it does not acknowledge its I2C address, so the
+write is complete as soon as a transfer to the EEPROM succeeds.  The polling transfer
+sends only the memory address, which does not start another write.
+*/
+HRESULT
+EEPROMClass::_waitForWriteCycle (
+    void
+) const {
+    HRESULT hr = S_OK;
+    UCHAR addressBuffer[2] = { 0, 0 };
+    ULONGLONG startTime = GetTickCount64();
+    bool busy = m_writeInProgress;
+
+    while (SUCCEEDED(hr) && busy)
+    {
+        m_transaction.reset();
+        hr = m_transaction.setAddress(m_i2cAddress);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_transaction.queueWrite(addressBuffer, m_addressBytes);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_transaction.execute(g_i2c.getController());
+            if (SUCCEEDED(hr))
+            {
+                busy = false;
+            }
+            else if (m_transaction.getError() == I2cTransactionClass::ADR_NACK)
+            {
+                if ((GetTickCount64() - startTime) < EEPROM_WRITE_CYCLE_TIMEOUT_MS)
+                {
+                    hr = S_OK;
+                }
+                else
+                {
+                    hr = DMAP_E_EEPROM_WRITE_CYCLE_TIMEOUT;
+                }
+            }
+        }
+    }
+
+    m_writeInProgress = false;
+
+    return hr;
+}
+
+HRESULT
+EEPROMClass::_cachePages (
+    const ULONG address,
+    const ULONG length,
+    const bool fullPagesWritten
+) const {
+    HRESULT hr = S_OK;
+    ULONG page = address / m_pageBytes;
+    ULONG lastPage = (address + length - 1) / m_pageBytes;
+    ULONG runStart = 0;
+    ULONG runEnd = 0;
+
+    while (SUCCEEDED(hr) && (page <= lastPage))
+    {
+        // Find a run of pages that must be read into the cache.  A page that will be
+        // completely overwritten does not need to be read.
+        runStart = page;
+        while ((page <= lastPage) && !m_pageCached[page] &&
+            !(fullPagesWritten && ((page * m_pageBytes) >= address) && (((page + 1) * m_pageBytes) <= (address + length))))
+        {
+            page++;
+        }
+
+        if (page > runStart)
+        {
+            runEnd = page * m_pageBytes;
+            if (runEnd > m_sizeBytes)
+            {
+                runEnd = m_sizeBytes;
+            }
+            hr = _readDevice(runStart * m_pageBytes, &m_cache[runStart * m_pageBytes], runEnd - (runStart * m_pageBytes));
+            for (ULONG i = runStart; SUCCEEDED(hr) && (i < page); i++)
+            {
+                m_pageCached[i] = true;
+            }
+        }
+        else
+        {
+            page++;
+        }
+    }
+
+    return hr;
+}
+
+void
+EEPROMClass::_cacheWrite (
+    const ULONG address,
+    const uint8_t value,
+    const bool onlyIfChanged
+) const {
+    ULONG page = address / m_pageBytes;
+    ULONG offset = address % m_pageBytes;
+
+    if (!onlyIfChanged || (m_cache[address] != value))
+    {
+        m_cache[address] = value;
+        if (offset < m_dirtyStart[page])
+        {
+            m_dirtyStart[page] = offset;
+        }
+        if (offset >= m_dirtyEnd[page])
+        {
+            m_dirtyEnd[page] = offset + 1;
+        }
+    }
+    m_pageCached[page] = true;
+}
+
+void
+EEPROMClass::_resetCache (
+    void
+) {
+    ULONG pages = (m_sizeBytes + m_pageBytes - 1) / m_pageBytes;
+
+    if (m_cacheEnabled)
+    {
+        m_cache.assign(m_sizeBytes, 0xFF);
+        m_pageCached.assign(pages, false);
+        m_dirtyStart.assign(pages, m_pageBytes);
+        m_dirtyEnd.assign(pages, 0);
+    }
+    else
+    {
+        m_cache.clear();
+        m_pageCached.clear();
+        m_dirtyStart.clear();
+        m_dirtyEnd.clear();
+    }
 }
 
 EEPROMClass EEPROM;
@@ -6,7 +6,15 @@
 #define EEPROM_H
 
 #include <inttypes.h> 
+#include <vector>
 #include "Lightning.h"
+#include "I2cTransaction.h"
+
+#define EEPROM_DEFAULT_I2C_ADDRESS 0x50     ///< 7-bit I2C address of the EEPROM
+#define EEPROM_DEFAULT_SIZE_BYTES 32768     ///< Size of a 24C256 EEPROM
+#define EEPROM_DEFAULT_PAGE_BYTES 64        ///< Write page size of a 24C256 EEPROM
+#define EEPROM_READ_CHUNK_BYTES 4096        ///< Most bytes read in one I2C transaction
+#define EEPROM_WRITE_CYCLE_TIMEOUT_MS 50    ///< Longest time to wait for a write cycle
 
 /// \brief A pseudo static class to support EEPROM usage
 /// \details EEPROM is a type of non-volatile memory used in computers
@@ -14,9 +22,43 @@
 /// must be saved when power is removed (e.g. calibration tables or
 /// device configuration). This class allows you to read and write from
 /// this memory.
+///
+/// Block reads use sequential reads, and block writes are split into one
+/// page write per EEPROM page. Completion of a page write is detected by
+/// polling for the EEPROM to acknowledge its address, just before the next
+/// access, so a write returns as soon as it has been sent. An optional
+/// write-back cache holds written data until flush() is called.
 class EEPROMClass
 {
   public:
+    LIGHTNING_DLL_API EEPROMClass();
+
+    /// \brief Describes the EEPROM the other methods access.
+    /// \param [in] i2cAddress The 7-bit I2C address of the EEPROM
+    /// \param [in] sizeBytes The size of the EEPROM in bytes
+    /// \param [in] pageBytes The size of an EEPROM write page in bytes
+    /// \returns HRESULT success or error code.
+    /// \note The default is a 24C256 at address 0x50. EEPROMs larger than
+    /// 2048 bytes are sent a two byte memory address. EEPROMs of 512 to 2048
+    /// bytes (24C04 through 24C16) are sent one address byte, and take the
+    /// upper memory address bits in the low bits of the I2C address, so those
+    /// bits of i2cAddress must be zero.
+    LIGHTNING_DLL_API HRESULT
+    setDevice (
+        const uint8_t i2cAddress,
+        const size_t sizeBytes,
+        const size_t pageBytes
+    );
+
+    /// \brief Gets the size of the EEPROM.
+    /// \returns the number of bytes in the EEPROM (int)
+    int
+    length (
+        void
+    ) const {
+        return static_cast<int>(m_sizeBytes);
+    }
+
     /// \brief Reads a byte from the EEPROM.
     /// \param [in] address The location to read from, starting from 0 (int)
     /// \returns the value stored in that location (byte)
@@ -37,6 +79,161 @@ class EEPROMClass
         const int address,
         const uint8_t value
     ) const;
+
+    /// \brief Write a byte to the EEPROM only if it differs from the byte
+    /// already stored.
+    /// \param [in] address The location to write to, starting from 0 (int)
+    /// \param [in] value The value to write, from 0 to 255 (byte)
+    LIGHTNING_DLL_API void
+    update (
+        const int address,
+        const uint8_t value
+    ) const;
+
+    /// \brief Reads a block of bytes from the EEPROM.
+    /// \param [in] address The location to start reading from
+    /// \param [out] buffer The buffer to read into
+    /// \param [in] length The number of bytes to read
+    /// \returns HRESULT success or error code.
+    LIGHTNING_DLL_API HRESULT
+    readBlock (
+        const int address,
+        uint8_t * buffer,
+        const size_t length
+    ) const;
+
+    /// \brief Writes a block of bytes to the EEPROM.
+    /// \param [in] address The location to start writing to
+    /// \param [in] buffer The bytes to write
+    /// \param [in] length The number of bytes to write
+    /// \returns HRESULT success or error code.
+    /// \note One page write is done for each EEPROM page the block touches.
+    LIGHTNING_DLL_API HRESULT
+    writeBlock (
+        const int address,
+        const uint8_t * buffer,
+        const size_t length
+    ) const;
+
+    /// \brief Writes the bytes of a block that differ from the bytes already
+    /// stored in the EEPROM.
+    /// \param [in] address The location to start writing to
+    /// \param [in] buffer The bytes to write
+    /// \param [in] length The number of bytes to write
+    /// \returns HRESULT success or error code.
+    /// \note Pages that already hold the data are not written, which saves
+    /// both time and EEPROM write cycles.
+    LIGHTNING_DLL_API HRESULT
+    updateBlock (
+        const int address,
+        const uint8_t * buffer,
+        const size_t length
+    ) const;
+
+    /// \brief Turns the write-back cache on or off.
+    /// \param [in] enable true to hold writes in memory until flush() is
+    /// called, false to write them to the EEPROM immediately (the default)
+    /// \returns HRESULT success or error code.
+    /// \note Turning the cache off flushes it. Data held in the cache is lost
+    /// if the program ends without calling flush().
+    LIGHTNING_DLL_API HRESULT
+    setWriteBackCache (
+        const bool enable
+    );
+
+    /// \brief Writes any data held in the write-back cache to the EEPROM,
+    /// and waits for the EEPROM to finish writing.
+    /// \returns HRESULT success or error code.
+    LIGHTNING_DLL_API HRESULT
+    flush (
+        void
+    );
+
+  private:
+    /// The 7-bit I2C address of the EEPROM.
+    ULONG m_i2cAddress;
+
+    /// The size of the EEPROM in bytes.
+    ULONG m_sizeBytes;
+
+    /// The size of an EEPROM write page in bytes.
+    ULONG m_pageBytes;
+
+    /// The number of memory address bytes sent to the EEPROM.
+    ULONG m_addressBytes;
+
+    /// The bits of the I2C address that select a 256 byte block of memory.
+    ULONG m_blockSelectMask;
+
+    /// true if the EEPROM may still be busy with a page write.
+    mutable bool m_writeInProgress;
+
+    /// The transaction used to access the EEPROM.
+    mutable I2cTransactionClass m_transaction;
+
+    /// Buffer used to build the memory address and data of a page write.
+    mutable std::vector<UCHAR> m_writeBuffer;
+
+    /// true if the write-back cache is in use.
+    bool m_cacheEnabled;
+
+    /// The write-back cache contents, and which pages of it hold EEPROM data.
+    mutable std::vector<uint8_t> m_cache;
+    mutable std::vector<bool> m_pageCached;
+
+    /// For each page, the range of page offsets [start, end) that must be written.
+    mutable std::vector<ULONG> m_dirtyStart;
+    mutable std::vector<ULONG> m_dirtyEnd;
+
+    HRESULT
+    _checkRange (
+        const int address,
+        const void * buffer,
+        const size_t length
+    ) const;
+
+    uint8_t
+    _deviceAddress (
+        const ULONG address
+    ) const;
+
+    HRESULT
+    _readDevice (
+        const ULONG address,
+        uint8_t * buffer,
+        const ULONG length
+    ) const;
+
+    HRESULT
+    _writePage (
+        const ULONG address,
+        const uint8_t * buffer,
+        const ULONG length
+    ) const;
+
+    HRESULT
+    _waitForWriteCycle (
+        void
+    ) const;
+
+    HRESULT
+    _cachePages (
+        const ULONG address,
+        const ULONG length,
+        const bool fullPagesWritten
+    ) const;
+
+    void
+    _cacheWrite (
+        const ULONG address,
+        const uint8_t value,
+        const bool onlyIfChanged
+    ) const;
+
+    void
+    _resetCache (
+        void
+    );
 };
 
 LIGHTNING_DLL_API  extern EEPROMClass EEPROM;  ///< This variable will provide global access to
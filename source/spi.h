@@ -10,8 +10,7 @@
 #include "ArduinoCommon.h"
 #include "ArduinoError.h"
 #include "SpiController.h"
-#include "BtSpiController.h"
-#include "BcmSpiController.h"
+#include "SpiBus.h"
 #include "BoardPins.h"
 
 // SPI clock values in KHz.
@@ -43,7 +42,8 @@ public:
     /// Constructor.
     SPIClass()
     {
-        m_controller = nullptr;
+        m_bus = nullptr;
+        m_device = SPI_BUS_NO_DEVICE;
         m_bitOrder = MSBFIRST;             // Default bit order is MSB First
         m_clockKHz = 4000;                 // Default clock rate is 4 MHz
         m_mode = SPI_MODE0;                // Default to Mode 0
@@ -53,7 +53,8 @@ public:
     /// Destructor.
     virtual ~SPIClass()
     {
-        this->end();
+        // The device is not removed from the SPI bus here.  The global SPI bus objects
+        // may already have been destroyed when the global SPI object is destroyed.
     }
 
     /// Initialize the externally accessible SPI bus for use.
@@ -69,11 +70,15 @@ public:
     /**
     \param[in] spiController The SPI controller to use. (SPI_CONTROLLER0 or SPI_CONTROLLER1 on Raspberry Pi, or SPI_CONTROLLER0 on Minnowboard Max)
     \return None.
+    \note The SPI bus is shared with the other users of the same SPI controller (such as
+    MCP3008 ADCs).  The sketch drives the chip select of its device itself, for example
+    with digitalWrite().
     */
     void begin(ULONG spiController)
     {
         HRESULT hr;
         BoardPinsClass::BOARD_TYPE board;
+        SpiBusClass* bus = nullptr;
 
         hr = g_pins.getBoardType(board);
 
@@ -82,101 +87,59 @@ public:
             ThrowError(hr, "An error occurred determining board type: %08x", hr);
         }
 
-        // Create and initialize the SPI Controller object if we don't already have one.
-        if (m_controller == nullptr)
+        if ((board != BoardPinsClass::BOARD_TYPE::MBM_BARE) &&
+            (board != BoardPinsClass::BOARD_TYPE::PI2_BARE) &&
+            (board != BoardPinsClass::BOARD_TYPE::MBM_IKA_LURE))
         {
-            if (board == BoardPinsClass::BOARD_TYPE::MBM_BARE)
-            {
-                m_controller = new BtSpiControllerClass;
-                if (spiController == SPI_CONTROLLER0)
-                {
-                    hr = m_controller->configurePins(MBM_PIN_MISO, MBM_PIN_MOSI, MBM_PIN_SCK);
-                }
-                else
-                {
-                    ThrowError(DMAP_E_SPI_CONTROLLER_NOT_SUPPORTED, "The specified SPI controller is not supported: %d", spiController);
-                }
-            }
-            else if (board == BoardPinsClass::BOARD_TYPE::PI2_BARE)
-            {
-                m_controller = new BcmSpiControllerClass;
-                if (spiController == SPI_CONTROLLER0)
-                {
-                    hr = m_controller->configurePins(PI2_PIN_SPI0_MISO, PI2_PIN_SPI0_MOSI, PI2_PIN_SPI0_SCK);
-                }
-                else if (spiController == SPI_CONTROLLER1)
-                {
-                    hr = m_controller->configurePins(PI2_PIN_SPI1_MISO, PI2_PIN_SPI1_MOSI, PI2_PIN_SPI1_SCK);
-                }
-                else
-                {
-                    ThrowError(DMAP_E_SPI_CONTROLLER_NOT_SUPPORTED, "The specified SPI controller is not supported: %d", spiController);
-                }
-            }
-            else if (board == BoardPinsClass::BOARD_TYPE::MBM_IKA_LURE)
-            {
-                m_controller = new BtSpiControllerClass;
-                if (spiController == SPI_CONTROLLER0)
-                {
-                    hr = m_controller->configurePins(ARDUINO_PIN_MISO, ARDUINO_PIN_MOSI, ARDUINO_PIN_SCK);
-                }
-                else
-                {
-                    ThrowError(DMAP_E_SPI_CONTROLLER_NOT_SUPPORTED, "The specified SPI controller is not supported: %d", spiController);
-                }
-            }
-            else
-            {
-                ThrowError(DMAP_E_BOARD_TYPE_NOT_RECOGNIZED, "Board type unrecognized for SPI use: %d", board);
-            }
-
-            if (FAILED(hr))
-            {
-                ThrowError(hr, "An error occurred configuring pins for SPI use: %08x", hr);
-            }
+            ThrowError(DMAP_E_BOARD_TYPE_NOT_RECOGNIZED, "Board type unrecognized for SPI use: %d", board);
         }
 
-        // Set the desired SPI bit shifting order.
-        if (m_bitOrder == MSBFIRST)
+        if (spiController == SPI_CONTROLLER0)
         {
-            m_controller->setMsbFirstBitOrder();
+            bus = &g_spi;
+        }
+        else if ((spiController == SPI_CONTROLLER1) && (board == BoardPinsClass::BOARD_TYPE::PI2_BARE))
+        {
+            bus = &g_spi2nd;
         }
         else
         {
-            m_controller->setLsbFirstBitOrder();
+            ThrowError(DMAP_E_SPI_CONTROLLER_NOT_SUPPORTED, "The specified SPI controller is not supported: %d", spiController);
         }
 
-        // Map the SPI1 controller registers into memory.
-        hr = m_controller->begin(EXTERNAL_SPI_BUS, m_mode, m_clockKHz, m_dataWidth);
+        // If begin() was already called, leave the SPI bus that was in use.
+        if ((m_bus != nullptr) && (m_bus != bus))
+        {
+            end();
+        }
 
-        if (FAILED(hr))
+        if (m_bus == nullptr)
         {
-            ThrowError(hr, "An error occurred initializing the SPI controller: %08x", hr);
+            // Add this object to the SPI bus as a device with no chip select pin.
+            hr = bus->addDevice(NO_CHIP_SELECT_PIN, m_mode, m_clockKHz, m_dataWidth, (m_bitOrder == LSBFIRST), m_device);
+
+            if (FAILED(hr))
+            {
+                ThrowError(hr, "An error occurred initializing the SPI controller: %08x", hr);
+            }
+
+            m_bus = bus;
         }
     }
 
-    /// Free up the external SPI bus so its pins can be used for other functions.
+    /// Stop using the external SPI bus.
     /**
     \return None.
+    \note When no other device is using the SPI bus its pins are freed up, so they can be used
+    for other functions.
     */
     void end()
     {
-        HRESULT hr;
-
-        if (m_controller != nullptr)
+        if (m_bus != nullptr)
         {
-            // Set all SPI pins as digital I/O.
-            hr = m_controller->revertPinsToGpio();
-
-            if (FAILED(hr))
-            {
-                ThrowError(hr, "An error occurred reverting SPI pins to GPIO: %08x", hr);
-            }
-
-            // Get rid of the underlying SPI Controller object.  This closes the handle
-            // we have open to the SPI controller.
-            delete m_controller;
-            m_controller = nullptr;
+            m_bus->removeDevice(m_device);
+            m_bus = nullptr;
+            m_device = SPI_BUS_NO_DEVICE;
         }
     }
 
@@ -188,22 +151,19 @@ public:
     */
     void setBitOrder(int bitOrder)
     {
+        HRESULT hr;
+
         if ((bitOrder != MSBFIRST) && (bitOrder != LSBFIRST))
         {
             ThrowError(E_INVALIDARG, "SPI bit order must be MSBFIRST or LSBFIRST.");
         }
         m_bitOrder = bitOrder;
 
-        if (m_controller != nullptr)
+        hr = _changeDevice();
+
+        if (FAILED(hr))
         {
-            if (bitOrder == MSBFIRST)
-            {
-                m_controller->setMsbFirstBitOrder();
-            }
-            else
-            {
-                m_controller->setLsbFirstBitOrder();
-            }
+            ThrowError(hr, "An error occurred setting the SPI bit order: %d", hr);
         }
     }
 
@@ -235,14 +195,11 @@ public:
 
         m_clockKHz = clockKHz;
 
-        if (m_controller != nullptr)
-        {
-            hr = m_controller->setClock(clockKHz);
+        hr = _changeDevice();
 
-            if (FAILED(hr))
-            {
-                ThrowError(hr, "An error occurred setting the SPI clock rate: %d", hr);
-            }
+        if (FAILED(hr))
+        {
+            ThrowError(hr, "An error occurred setting the SPI clock rate: %d", hr);
         }
     }
 
@@ -262,26 +219,31 @@ public:
         }
         m_mode = mode;
 
-        if (m_controller != nullptr)
-        {
-            hr = m_controller->setMode(mode);
+        hr = _changeDevice();
 
-            if (FAILED(hr))
-            {
-                ThrowError(hr, "An error occurred setting the SPI mode: %d", hr);
-            }
+        if (FAILED(hr))
+        {
+            ThrowError(hr, "An error occurred setting the SPI mode: %d", hr);
         }
     }
 
     /// Set the SPI data width.
     /**
     \param[in] bits The width of each transfer in bits (4-32).
-    \note The data width must be set before begin() is called.  If an SPI controller is in use the following
-    sequence can be used to change the data width: end(), setDataWidth(newWidth), begin().
+    \note The data width can be set before or after begin() is called.
     */
     void setDataWidth(UINT bits)
     {
+        HRESULT hr;
+
         m_dataWidth = bits;
+
+        hr = _changeDevice();
+
+        if (FAILED(hr))
+        {
+            ThrowError(hr, "An error occurred setting the SPI data width: %d", hr);
+        }
     }
 
     /// Transfer one byte in each direction on the SPI bus.
@@ -293,15 +255,12 @@ public:
     inline ULONG transfer(ULONG val)
     {
         HRESULT hr;
+        SpiControllerClass* controller = _acquireBus();
         ULONG dataReturn = 0;
 
-        if (m_controller == nullptr)
-        {
-            ThrowError(HRESULT_FROM_WIN32(ERROR_INVALID_STATE), "Can't transfer on SPI bus until an SPI.begin() has been done.");
-        }
-
         // Transfer the data.
-        hr = m_controller->transfer8(val, dataReturn);
+        hr = controller->transfer8(val, dataReturn);
+        m_bus->release();
 
         if (FAILED(hr))
         {
@@ -319,15 +278,12 @@ public:
     inline ULONG transfer16(ULONG val)
     {
         HRESULT hr;
+        SpiControllerClass* controller = _acquireBus();
         ULONG dataReturn = 0;
 
-        if (m_controller == nullptr)
-        {
-            ThrowError(HRESULT_FROM_WIN32(ERROR_INVALID_STATE), "Can't transfer on SPI bus until an SPI.begin() has been done.");
-        }
-
         // Transfer the data.
-        hr = m_controller->transfer16(val, dataReturn);
+        hr = controller->transfer16(val, dataReturn);
+        m_bus->release();
 
         if (FAILED(hr))
         {
@@ -345,15 +301,12 @@ public:
     inline ULONG transfer24(ULONG val)
     {
         HRESULT hr;
+        SpiControllerClass* controller = _acquireBus();
         ULONG dataReturn = 0;
 
-        if (m_controller == nullptr)
-        {
-            ThrowError(HRESULT_FROM_WIN32(ERROR_INVALID_STATE), "Can't transfer on SPI bus until an SPI.begin() has been done.");
-        }
-
         // Transfer the data.
-        hr = m_controller->transfer24(val, dataReturn);
+        hr = controller->transfer24(val, dataReturn);
+        m_bus->release();
 
         if (FAILED(hr))
         {
@@ -371,15 +324,12 @@ public:
     inline ULONG transfer32(ULONG val)
     {
         HRESULT hr;
+        SpiControllerClass* controller = _acquireBus();
         ULONG dataReturn = 0;
 
-        if (m_controller == nullptr)
-        {
-            ThrowError(HRESULT_FROM_WIN32(ERROR_INVALID_STATE), "Can't transfer on SPI bus until an SPI.begin() has been done.");
-        }
-
         // Transfer the data.
-        hr = m_controller->transfer32(val, dataReturn);
+        hr = controller->transfer32(val, dataReturn);
+        m_bus->release();
 
         if (FAILED(hr))
         {
@@ -391,8 +341,11 @@ public:
 
 private:
 
-    /// Underlying SPI Controller object that really does the work.
-    SpiControllerClass *m_controller;
+    /// The shared SPI bus this object uses, nullptr if begin() has not been done.
+    SpiBusClass *m_bus;
+
+    /// The handle of this object's device on the SPI bus.
+    ULONG m_device;
 
     /// Bit order (LSBFIRST or MSBFIRST)
     ULONG m_bitOrder;
@@ -405,6 +358,46 @@ private:
 
     /// SPI mode to use.
     ULONG m_mode;
+
+    /// Get exclusive use of the SPI bus, set up with the settings of this object.
+    /**
+    \return The SPI controller to transfer with.  The bus must be released with m_bus->release().
+    */
+    SpiControllerClass* _acquireBus()
+    {
+        HRESULT hr;
+        SpiControllerClass* controller = nullptr;
+
+        if (m_bus == nullptr)
+        {
+            ThrowError(HRESULT_FROM_WIN32(ERROR_INVALID_STATE), "Can't transfer on SPI bus until an SPI.begin() has been done.");
+        }
+
+        hr = m_bus->acquire(m_device, controller);
+
+        if (FAILED(hr))
+        {
+            ThrowError(hr, "An error occurred acquiring the SPI bus: %d", hr);
+        }
+
+        return controller;
+    }
+
+    /// Apply the current settings of this object to its device on the SPI bus, if it has one.
+    /**
+    \return HRESULT success or error code.
+    */
+    HRESULT _changeDevice()
+    {
+        HRESULT hr = S_OK;
+
+        if (m_bus != nullptr)
+        {
+            hr = m_bus->changeDevice(m_device, m_mode, m_clockKHz, m_dataWidth, (m_bitOrder == LSBFIRST));
+        }
+
+        return hr;
+    }
 };
 
 /// The global SPI bus object.